@@ -10,12 +10,11 @@ echo tmpdir $tmpdir
 for i in test/regression/*.vcf.gz;
 do
     echo Testing $i
-    echo $i > test.txt
-    bin/gvcfgenotyper -f ${i%vcf.gz}fa -l test.txt | grep -A1000 CHROM > ${tmpdir}/$(basename $i).observed 
+    echo $i > ${tmpdir}/test.txt
+    bin/gvcfgenotyper -f ${i%vcf.gz}fa -l ${tmpdir}/test.txt -L ${tmpdir}/$(basename $i).log | grep -A1000 CHROM > ${tmpdir}/$(basename $i).observed 
     diff ${tmpdir}/$(basename $i).observed ${i}.expected
 done
 
-rm test.txt
 rm -rf $tmpdir
 
 echo "Regression tests passed"
@@ -0,0 +1,60 @@
+#!/bin/bash
+
+##merges synthetic cohorts of increasing size and reports sites/sec and peak RSS for each
+##usage: src/bash/run_scaling_benchmark.sh [sample counts, default "10 100 1000 10000"]
+##extra gvcfgenotyper options can be passed in GG_OPTS, e.g. GG_OPTS="-@ 8" src/bash/run_scaling_benchmark.sh 100
+
+set -e
+
+gg=${GG:-bin/gvcfgenotyper}
+sizes=${@:-10 100 1000 10000}
+length=${LENGTH:-1000000}
+
+tmpdir=`mktemp -d`
+tmpdir=$(cd $tmpdir && pwd)
+
+##the largest cohort is simulated once, smaller cohorts are its first N samples
+largest=0
+for n in $sizes;
+do
+    if [ $n -gt $largest ]; then largest=$n; fi
+done
+
+##every GVCF is open at once
+ulimit -n $(( largest + 256 )) 2>/dev/null || ulimit -n $(ulimit -Hn)
+
+echo simulating $largest samples of ${length}bp in $tmpdir 1>&2
+$gg simulate -o $tmpdir/cohort -n $largest --length $length -@ ${SIM_THREADS:-4} -L $tmpdir/simulate.log
+
+##peak RSS of a command in kB, polled from /proc when GNU time is not installed
+run_with_peak_rss() {
+    if [ -x /usr/bin/time ]; then
+        /usr/bin/time -f "%M" -o $tmpdir/rss "$@"
+        peak=$(tail -1 $tmpdir/rss)
+    else
+        "$@" &
+        pid=$!
+        peak=0
+        while kill -0 $pid 2>/dev/null;
+        do
+            hwm=$(awk '/VmHWM/ {print $2}' /proc/$pid/status 2>/dev/null || true)
+            if [ -n "$hwm" ] && [ $hwm -gt $peak ]; then peak=$hwm; fi
+            sleep 0.02
+        done
+        wait $pid
+    fi
+}
+
+printf "samples\tsites\tseconds\tsites_per_sec\tpeak_rss_kb\n"
+for n in $sizes;
+do
+    head -n $n $tmpdir/cohort/gvcfs.txt > $tmpdir/gvcfs.$n.txt
+    start=$(date +%s.%N)
+    run_with_peak_rss $gg -l $tmpdir/gvcfs.$n.txt -f $tmpdir/cohort/ref.fa -O u -o /dev/null -L $tmpdir/merge.$n.log $GG_OPTS
+    end=$(date +%s.%N)
+    sites=$(sed -n 's/.*Wrote \([0-9]*\) variants.*/\1/p' $tmpdir/merge.$n.log)
+    awk -v n=$n -v sites=$sites -v start=$start -v end=$end -v peak=$peak \
+        'BEGIN {s = end - start; printf "%d\t%d\t%.2f\t%.0f\t%d\n", n, sites, s, sites / s, peak}'
+done
+
+rm -rf $tmpdir
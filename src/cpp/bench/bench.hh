@@ -0,0 +1,66 @@
+//
+// Minimal benchmark harness for bin/bench_gvcfgenotyper.
+//
+
+#ifndef GVCFGENOTYPER_BENCH_HH
+#define GVCFGENOTYPER_BENCH_HH
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "DepthBlock.hh"
+#include "multiAllele.hh"
+
+namespace bench
+{
+    //a benchmark body performs some work and returns the number of operations (eg. records) it processed.
+    typedef std::function<size_t()> body_t;
+
+    struct Benchmark
+    {
+        std::string name;
+        body_t body;
+    };
+
+    std::vector<Benchmark> &registry();
+    int add(const std::string &name, body_t body);
+
+    //resolves a path relative to the repository's test/ directory.
+    std::string test_path(const std::string &relative);
+
+    //every GVCF in test/test2, the bundled platinum genome subset.
+    std::vector<std::string> test2_gvcfs();
+
+    //a site of the merge of the test2 GVCFs
+    struct site_t
+    {
+        multiAllele *alleles;
+        bcf1_t *record;//alleles collapsed into a record
+        std::vector<std::deque<bcf1_t *> > variants;//what GetAllVariantsUpTo gives CollapseRecords, for each sample
+        std::vector<bcf1_t *> collapsed;//CollapseRecords of variants, nullptr where a sample has none
+        std::vector<int> dp;//FORMAT/DP of each sample, from its variant or reference block
+        std::vector<int> adf, adr;//INFO/ADF and ADR
+        std::vector<std::vector<int> > pls;//a PL over the site's alleles for each ALT, as CollapseRecords collapses them
+    };
+
+    //the normalised variants and reference blocks of each test2 GVCF, as GVCFReader buffers them, and the sites
+    //GVCFMerger makes of them. Built the first time it is asked for and kept until the end of the run, benchmarks
+    //must not change it.
+    struct corpus_t
+    {
+        std::vector<bcf_hdr_t *> headers;
+        std::vector<std::vector<bcf1_t *> > variants;
+        std::vector<std::vector<DepthBlock> > blocks;
+        std::vector<site_t> sites;
+    };
+    corpus_t &test2_corpus();
+}
+
+#define BENCHMARK(name) \
+    static size_t bench_##name(); \
+    static int bench_registered_##name = bench::add(#name, bench_##name); \
+    static size_t bench_##name()
+
+#endif //GVCFGENOTYPER_BENCH_HH
@@ -0,0 +1,78 @@
+//GVCF lines per second buffered as DepthBlocks decoded by tag name against DepthBuffer::push_back(header, record),
+//which looks the tags up once per header and reads their values in place.
+
+#include "bench.hh"
+#include "DepthBuffer.hh"
+#include "VcfReader.hh"
+
+//flushes periodically so the buffer stays about as small as it would be during a merge
+static const size_t flush_every = 64;
+
+//One buffer is carried through every GVCF, as a GVCFReader carries one through the whole of a (much longer) GVCF.
+//The test2 GVCFs are short, most of the time and allocations per line are opening them and parsing, see
+//VcfReader_stream.
+static size_t buffer_lines(bool by_name)
+{
+    size_t n = 0;
+    DepthBuffer buffer;
+    bcf1_t *record = bcf_init1();
+    for (auto &fname : bench::test2_gvcfs())
+    {
+        VcfReader reader(fname);
+        while (reader.Next(record))
+        {
+            if (!by_name)
+            {
+                buffer.push_back(reader.GetHeader(), record);
+            }
+            else if (bcf_get_fmt(reader.GetHeader(), record, "DP") != nullptr)
+            {
+                buffer.push_back(DepthBlock(reader.GetHeader(), record));
+            }
+            if (++n % flush_every == 0)
+            {
+                buffer.FlushBuffer(record->rid, record->pos - 1);
+            }
+        }
+        buffer.FlushBuffer();
+    }
+    bcf_destroy(record);
+    return (n);
+}
+
+BENCHMARK(DepthBuffer_by_name)
+{
+    return (buffer_lines(true));
+}
+
+BENCHMARK(DepthBuffer_push_back)
+{
+    return (buffer_lines(false));
+}
+
+//the reference blocks of each sample are buffered up to a site and flushed behind it, as GVCFReader does, so
+//Interpolate sees a buffer of the usual size.
+BENCHMARK(DepthBuffer_Interpolate)
+{
+    bench::corpus_t &corpus = bench::test2_corpus();
+    size_t n = 0;
+    DepthBlock db;
+    for (size_t i = 0; i < corpus.blocks.size(); i++)
+    {
+        DepthBuffer buffer;
+        auto block = corpus.blocks[i].begin();
+        for (auto site = corpus.sites.begin(); site != corpus.sites.end(); site++)
+        {
+            bcf1_t *record = site->record;
+            buffer.FlushBuffer(record->rid, record->pos - 1);
+            while (block != corpus.blocks[i].end() && (block->rid() < record->rid ||
+                                                       (block->rid() == record->rid && block->start() <= record->pos + record->rlen)))
+            {
+                buffer.push_back(*block++);
+            }
+            buffer.Interpolate(record->rid, record->pos, ggutils::get_end_of_variant(record), db);
+            n++;
+        }
+    }
+    return (n);
+}
@@ -0,0 +1,50 @@
+//Sites per second of the whole merge of the test2 GVCFs: next() (CollapseRecords, Genotype and
+//UpdateFormatAndInfo for every site), and write_vcf one site at a time and in batches, written as VCF to /dev/null.
+//All of them include opening the GVCFs and the reference.
+
+#include "bench.hh"
+#include "GVCFMerger.hh"
+
+static size_t count_sites()
+{
+    static size_t num_sites = 0;
+    if (num_sites == 0)
+    {
+        GVCFMerger g(bench::test2_gvcfs(), "/dev/null", "v", bench::test_path("test2/test2.ref.fa"), 5000);
+        while (g.next() != nullptr)
+        {
+            num_sites++;
+        }
+    }
+    return (num_sites);
+}
+
+BENCHMARK(GVCFMerger_next)
+{
+    GVCFMerger g(bench::test2_gvcfs(), "/dev/null", "v", bench::test_path("test2/test2.ref.fa"), 5000);
+    size_t n = 0;
+    while (g.next() != nullptr)
+    {
+        n++;
+    }
+    return (n);
+}
+
+static size_t write_vcf(int batch_sites)
+{
+    size_t n = count_sites();
+    GVCFMerger g(bench::test2_gvcfs(), "/dev/null", "v", bench::test_path("test2/test2.ref.fa"), 5000);
+    g.SetBatchSites(batch_sites);
+    g.write_vcf();
+    return (n);
+}
+
+BENCHMARK(GVCFMerger_write)
+{
+    return (write_vcf(0));
+}
+
+BENCHMARK(GVCFMerger_write_batched)
+{
+    return (write_vcf(256));
+}
@@ -0,0 +1,59 @@
+//Building a sample's genotype at a site: CollapseRecords over its variants there, then Genotype mapped onto the
+//site's alleles (as genotype_sample does, see SiteColumns), and Genotype straight from a single record.
+
+#include "bench.hh"
+#include "Genotype.hh"
+#include "Normaliser.hh"
+
+BENCHMARK(CollapseRecords)
+{
+    bench::corpus_t &corpus = bench::test2_corpus();
+    size_t n = 0;
+    for (auto site = corpus.sites.begin(); site != corpus.sites.end(); site++)
+    {
+        for (size_t i = 0; i < site->variants.size(); i++)
+        {
+            auto range = std::make_pair(site->variants[i].begin(), site->variants[i].end());
+            bcf1_t *record = CollapseRecords(corpus.headers[i], range);
+            if (record != nullptr)
+            {
+                bcf_destroy(record);
+                n++;
+            }
+        }
+    }
+    return (n);
+}
+
+BENCHMARK(Genotype_map)
+{
+    bench::corpus_t &corpus = bench::test2_corpus();
+    size_t n = 0;
+    for (auto site = corpus.sites.begin(); site != corpus.sites.end(); site++)
+    {
+        for (size_t i = 0; i < site->collapsed.size(); i++)
+        {
+            if (site->collapsed[i] != nullptr)
+            {
+                Genotype g(corpus.headers[i], site->collapsed[i], *site->alleles);
+                n++;
+            }
+        }
+    }
+    return (n);
+}
+
+BENCHMARK(Genotype_record)
+{
+    bench::corpus_t &corpus = bench::test2_corpus();
+    size_t n = 0;
+    for (size_t i = 0; i < corpus.variants.size(); i++)
+    {
+        for (auto it = corpus.variants[i].begin(); it != corpus.variants[i].end(); it++)
+        {
+            Genotype g(corpus.headers[i], *it);
+            n++;
+        }
+    }
+    return (n);
+}
@@ -0,0 +1,27 @@
+//Normalised variants per second through VariantBuffer::PushBack (duplicate check and insertion sort).
+//Each push includes the bcf_dup of the record, GVCFReader hands over a freshly read record instead.
+
+#include "bench.hh"
+#include "VariantBuffer.hh"
+
+//flushes periodically so the buffer stays about as small as it would be during a merge
+static const size_t flush_every = 64;
+
+BENCHMARK(VariantBuffer_PushBack)
+{
+    bench::corpus_t &corpus = bench::test2_corpus();
+    size_t n = 0;
+    for (size_t i = 0; i < corpus.variants.size(); i++)
+    {
+        VariantBuffer buffer;
+        for (auto it = corpus.variants[i].begin(); it != corpus.variants[i].end(); it++)
+        {
+            buffer.PushBack(corpus.headers[i], bcf_dup(*it));
+            if (++n % flush_every == 0)
+            {
+                buffer.FlushBuffer((*it)->rid, (*it)->pos - 1);
+            }
+        }
+    }
+    return (n);
+}
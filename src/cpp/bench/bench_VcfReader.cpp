@@ -0,0 +1,95 @@
+//Records per second of the lean VcfReader against the htslib synced reader it replaced in GVCFReader.
+
+#include "bench.hh"
+#include "VcfReader.hh"
+
+static const char *bench_regions = "chr1:1-20000,chr1:40000-60000,chr1:90000-100000";
+
+static size_t read_all(VcfReader &reader)
+{
+    size_t n = 0;
+    bcf1_t *record = bcf_init1();
+    while (reader.Next(record))
+    {
+        n++;
+    }
+    bcf_destroy(record);
+    return (n);
+}
+
+static size_t read_all(bcf_srs_t *sr)
+{
+    size_t n = 0;
+    while (bcf_sr_next_line(sr))
+    {
+        n++;
+    }
+    return (n);
+}
+
+BENCHMARK(VcfReader_stream)
+{
+    size_t n = 0;
+    for (auto &fname : bench::test2_gvcfs())
+    {
+        VcfReader reader(fname);
+        n += read_all(reader);
+    }
+    return (n);
+}
+
+BENCHMARK(SyncedReader_stream)
+{
+    size_t n = 0;
+    for (auto &fname : bench::test2_gvcfs())
+    {
+        bcf_srs_t *sr = bcf_sr_init();
+        bcf_sr_add_reader(sr, fname.c_str());
+        n += read_all(sr);
+        bcf_sr_destroy(sr);
+    }
+    return (n);
+}
+
+BENCHMARK(VcfReader_regions)
+{
+    size_t n = 0;
+    for (auto &fname : bench::test2_gvcfs())
+    {
+        VcfReader reader(fname);
+        reader.SetRegions(bench_regions);
+        n += read_all(reader);
+    }
+    return (n);
+}
+
+BENCHMARK(SyncedReader_regions)
+{
+    size_t n = 0;
+    for (auto &fname : bench::test2_gvcfs())
+    {
+        bcf_srs_t *sr = bcf_sr_init();
+        bcf_sr_set_regions(sr, bench_regions, 0);
+        bcf_sr_add_reader(sr, fname.c_str());
+        n += read_all(sr);
+        bcf_sr_destroy(sr);
+    }
+    return (n);
+}
+
+//the first pass of --two-pass, which only wants the variant lines
+BENCHMARK(VcfReader_variants)
+{
+    size_t n = 0;
+    for (auto &fname : bench::test2_gvcfs())
+    {
+        VcfReader reader(fname);
+        bcf1_t *record = bcf_init1();
+        while (reader.NextVariant(record))
+        {
+        }
+        n += reader.GetNumRecordsRead() + reader.GetNumRecordsSkipped();
+        bcf_destroy(record);
+    }
+    return (n);
+}
@@ -0,0 +1,155 @@
+//The test2 GVCFs read, normalised and merged once, so that benchmarks of the merge's building blocks can be fed
+//the records those building blocks see during a real run.
+
+#include "bench.hh"
+#include "GVCFReader.hh"
+#include "Genotype.hh"
+
+static void add_sample_values(bench::corpus_t &corpus, bench::site_t &site, size_t sample, size_t &block)
+{
+    bcf1_t *record = site.record;
+    if (site.collapsed[sample] == nullptr)
+    {
+        const std::vector<DepthBlock> &blocks = corpus.blocks[sample];
+        while (block < blocks.size() && (blocks[block].rid() < record->rid ||
+                                         (blocks[block].rid() == record->rid && blocks[block].end() < record->pos)))
+        {
+            block++;
+        }
+        site.dp[sample] = block < blocks.size() && blocks[block].IntersectSize(record->rid, record->pos, record->pos) > 0
+                          ? blocks[block].dp() : 0;
+        return;
+    }
+
+    Genotype g(corpus.headers[sample], site.collapsed[sample], *site.alleles);
+    site.dp[sample] = g.dp();
+    for (int j = 0; j < record->n_allele; j++)
+    {
+        if (g.HasAdf() && g.HasAdr() && g.adf(j) != bcf_int32_missing)
+        {
+            site.adf[j] += g.adf(j);
+            site.adr[j] += g.adr(j);
+        }
+    }
+    if (!g.HasPl() || g.ploidy() != 2)
+    {
+        return;
+    }
+    int num_gl = ggutils::get_number_of_likelihoods(2, record->n_allele);
+    for (int a = 1; a < record->n_allele; a++)
+    {
+        //the first sample with the ALT supplies its set, like one row of a collision in CollapseRecords
+        if (site.pls[a - 1].empty() && ggutils::find_allele(site.collapsed[sample], record, a) != -1)
+        {
+            site.pls[a - 1].assign(num_gl, bcf_int32_missing);
+            site.pls[a - 1][ggutils::get_gl_index(0, 0)] = g.pl(0, 0);
+            site.pls[a - 1][ggutils::get_gl_index(0, a)] = g.pl(0, a);
+            site.pls[a - 1][ggutils::get_gl_index(a, a)] = g.pl(a, a);
+        }
+    }
+}
+
+//replays GVCFMerger::GetNextVariant and FlushBuffer over the buffered variants, as SiteColumns::Plan does
+static void plan_sites(bench::corpus_t &corpus)
+{
+    size_t num_samples = corpus.variants.size();
+    std::vector<size_t> cursor(num_samples, 0), block(num_samples, 0);
+    while (true)
+    {
+        bcf1_t *min_rec = nullptr;
+        for (size_t i = 0; i < num_samples; i++)
+        {
+            if (cursor[i] < corpus.variants[i].size() &&
+                (min_rec == nullptr || ggutils::bcf1_less_than(corpus.variants[i][cursor[i]], min_rec)))
+            {
+                min_rec = corpus.variants[i][cursor[i]];
+            }
+        }
+        if (min_rec == nullptr)
+        {
+            break;
+        }
+
+        corpus.sites.emplace_back();
+        bench::site_t &site = corpus.sites.back();
+        site.alleles = new multiAllele;
+        site.alleles->Init(corpus.headers[0], false);
+        site.alleles->SetPosition(min_rec->rid, min_rec->pos);
+        for (size_t i = 0; i < num_samples; i++)
+        {
+            for (size_t j = cursor[i]; j < corpus.variants[i].size(); j++)
+            {
+                bcf1_t *rec = corpus.variants[i][j];
+                if (rec->rid != min_rec->rid || rec->pos > min_rec->pos)
+                {
+                    break;
+                }
+                if (ggutils::get_variant_rank(rec) == ggutils::get_variant_rank(min_rec))
+                {
+                    site.alleles->Allele(rec);
+                }
+            }
+        }
+        site.record = bcf_init1();
+        site.alleles->Collapse(site.record);
+
+        bcf1_t *max_rec = site.alleles->GetMax();
+        site.variants.resize(num_samples);
+        site.collapsed.resize(num_samples, nullptr);
+        site.dp.resize(num_samples);
+        site.adf.assign(site.record->n_allele, 0);
+        site.adr.assign(site.record->n_allele, 0);
+        site.pls.resize(site.record->n_allele - 1);
+        for (size_t i = 0; i < num_samples; i++)
+        {
+            while (cursor[i] < corpus.variants[i].size() && ggutils::bcf1_leq(corpus.variants[i][cursor[i]], max_rec))
+            {
+                site.variants[i].push_back(corpus.variants[i][cursor[i]++]);
+            }
+            auto range = std::make_pair(site.variants[i].begin(), site.variants[i].end());
+            site.collapsed[i] = CollapseRecords(corpus.headers[i], range);
+            add_sample_values(corpus, site, i, block[i]);
+        }
+        //sites where not every ALT has a set are not collisions collapse_gls would see
+        for (auto it = site.pls.begin(); it != site.pls.end(); it++)
+        {
+            if (it->empty())
+            {
+                site.pls.clear();
+                break;
+            }
+        }
+    }
+}
+
+namespace bench
+{
+    corpus_t &test2_corpus()
+    {
+        static corpus_t *corpus = nullptr;
+        if (corpus != nullptr)
+        {
+            return (*corpus);
+        }
+        corpus = new corpus_t;
+        Normaliser normaliser(test_path("test2/test2.ref.fa"));
+        for (auto &fname : test2_gvcfs())
+        {
+            GVCFReader reader(fname, &normaliser, 1000);
+            reader.ReadAll();
+            corpus->headers.push_back(bcf_hdr_dup(reader.GetHeader()));
+            corpus->variants.emplace_back();
+            for (size_t i = 0; i < reader.GetNumVariants(); i++)
+            {
+                corpus->variants.back().push_back(bcf_dup(reader.GetVariant(i)));
+            }
+            corpus->blocks.emplace_back();
+            for (size_t i = 0; i < reader.GetNumDepthBlocks(); i++)
+            {
+                corpus->blocks.back().push_back(reader.GetDepthBlock(i));
+            }
+        }
+        plan_sites(*corpus);
+        return (*corpus);
+    }
+}
@@ -0,0 +1,181 @@
+#include "bench.hh"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <libgen.h>
+
+#include "spdlog.h"
+#include "StringUtil.hh"
+
+static std::string g_base_path;
+
+//Every malloc/calloc/realloc (and so every operator new) of the process is counted, htslib's included.
+//glibc exports its allocator under these names, elsewhere allocations are not counted.
+static std::atomic<size_t> g_num_allocs(0), g_alloc_bytes(0);
+#ifdef __GLIBC__
+#define BENCH_COUNT_ALLOCS 1
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t num, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    g_num_allocs.fetch_add(1, std::memory_order_relaxed);
+    g_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    return (__libc_malloc(size));
+}
+
+void *calloc(size_t num, size_t size)
+{
+    g_num_allocs.fetch_add(1, std::memory_order_relaxed);
+    g_alloc_bytes.fetch_add(num * size, std::memory_order_relaxed);
+    return (__libc_calloc(num, size));
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    g_num_allocs.fetch_add(1, std::memory_order_relaxed);
+    g_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    return (__libc_realloc(ptr, size));
+}
+}
+#else
+#define BENCH_COUNT_ALLOCS 0
+#endif
+
+namespace bench
+{
+    std::vector<Benchmark> &registry()
+    {
+        static std::vector<Benchmark> benchmarks;
+        return (benchmarks);
+    }
+
+    int add(const std::string &name, body_t body)
+    {
+        registry().push_back({name, body});
+        return ((int) registry().size());
+    }
+
+    std::string test_path(const std::string &relative)
+    {
+        return (g_base_path + "/../test/" + relative);
+    }
+
+    std::vector<std::string> test2_gvcfs()
+    {
+        std::vector<std::string> files;
+        std::string dirname = test_path("test2/");
+        DIR *dir = opendir(dirname.c_str());
+        if (dir == nullptr)
+        {
+            std::cerr << "ERROR: could not open " << dirname << std::endl;
+            exit(1);
+        }
+        struct dirent *ent;
+        while ((ent = readdir(dir)) != nullptr)
+        {
+            const std::string fname = ent->d_name;
+            if (stringutil::endsWith(fname, ".vcf.gz"))
+            {
+                files.push_back(dirname + fname);
+            }
+        }
+        closedir(dir);
+        std::sort(files.begin(), files.end());
+        return (files);
+    }
+}
+
+static void usage()
+{
+    std::cerr << "Usage: bench_gvcfgenotyper [-n repeats] [-j] [filter]" << std::endl;
+    std::cerr << "Runs every benchmark whose name contains filter." << std::endl;
+    std::cerr << "Prints a tab-separated table, or one JSON object per benchmark with -j. allocs/op counts malloc," << std::endl;
+    std::cerr << "calloc and realloc calls and bytes/op the bytes they asked for (-1 when they cannot be counted)." << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    int repeats = 5;
+    bool json = false;
+    std::string filter = "";
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            repeats = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "-j") == 0)
+        {
+            json = true;
+        }
+        else if (argv[i][0] == '-')
+        {
+            usage();
+            return (1);
+        }
+        else
+        {
+            filter = argv[i];
+        }
+    }
+
+    char actualpath[PATH_MAX + 1];
+    realpath(dirname(argv[0]), actualpath);
+    g_base_path = actualpath;
+
+    //library code expects the gvcfgenotyper logger to exist
+    spdlog::basic_logger_mt("gg_logger", "/dev/null");
+
+    if (!json)
+    {
+        std::cout << "benchmark\trepeats\tops\tns/op\tallocs/op\tbytes/op\tops/s" << std::endl;
+    }
+    for (auto &b : bench::registry())
+    {
+        if (b.name.find(filter) == std::string::npos)
+        {
+            continue;
+        }
+        b.body();//warm up the page cache and allocator, and build the corpus
+        size_t ops = 0;
+        size_t num_allocs = g_num_allocs.load(), alloc_bytes = g_alloc_bytes.load();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repeats; i++)
+        {
+            ops += b.body();
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        num_allocs = g_num_allocs.load() - num_allocs;
+        alloc_bytes = g_alloc_bytes.load() - alloc_bytes;
+
+        double ns_per_op = ops ? ns / ops : 0., ops_per_s = ns > 0 ? 1e9 * ops / ns : 0.;
+        double allocs_per_op = -1, bytes_per_op = -1;
+        if (BENCH_COUNT_ALLOCS)
+        {
+            allocs_per_op = ops ? (double) num_allocs / ops : 0.;
+            bytes_per_op = ops ? (double) alloc_bytes / ops : 0.;
+        }
+        if (json)
+        {
+            std::cout << "{\"benchmark\":\"" << b.name << "\",\"repeats\":" << repeats << ",\"ops\":" << ops
+                      << ",\"ns_per_op\":" << ns_per_op << ",\"allocs_per_op\":" << allocs_per_op
+                      << ",\"bytes_per_op\":" << bytes_per_op << ",\"ops_per_s\":" << ops_per_s << "}" << std::endl;
+        }
+        else
+        {
+            std::cout << b.name << "\t" << repeats << "\t" << ops << "\t" << ns_per_op << "\t" << allocs_per_op << "\t"
+                      << bytes_per_op << "\t" << ops_per_s << std::endl;
+        }
+    }
+    spdlog::drop_all();
+    return (0);
+}
@@ -0,0 +1,51 @@
+//multiAllele::Allele (gathering every sample's alleles at a site) and AlleleIndex (mapping a sample's alleles
+//back onto the site's), over the sites of the test2 merge.
+
+#include "bench.hh"
+
+BENCHMARK(multiAllele_Allele)
+{
+    bench::corpus_t &corpus = bench::test2_corpus();
+    size_t n = 0;
+    multiAllele alleles;
+    alleles.Init(corpus.headers[0], false);
+    bcf1_t *record = bcf_init1();
+    for (auto site = corpus.sites.begin(); site != corpus.sites.end(); site++)
+    {
+        alleles.SetPosition(site->record->rid, site->record->pos);
+        //the rank of the site's records, the collapsed record can rank differently
+        int rank = ggutils::get_variant_rank(site->alleles->GetMax());
+        for (auto sample = site->variants.begin(); sample != site->variants.end(); sample++)
+        {
+            for (auto it = sample->begin(); it != sample->end(); it++)
+            {
+                if ((*it)->pos == site->record->pos && ggutils::get_variant_rank(*it) == rank)
+                {
+                    alleles.Allele(*it);
+                    n++;
+                }
+            }
+        }
+        alleles.Collapse(record);
+    }
+    bcf_destroy(record);
+    return (n);
+}
+
+BENCHMARK(multiAllele_AlleleIndex)
+{
+    bench::corpus_t &corpus = bench::test2_corpus();
+    size_t n = 0;
+    for (auto site = corpus.sites.begin(); site != corpus.sites.end(); site++)
+    {
+        for (auto it = site->collapsed.begin(); it != site->collapsed.end(); it++)
+        {
+            for (int i = 1; *it != nullptr && i < (*it)->n_allele; i++)
+            {
+                site->alleles->AlleleIndex(*it, i);
+                n++;
+            }
+        }
+    }
+    return (n);
+}
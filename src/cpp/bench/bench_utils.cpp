@@ -0,0 +1,48 @@
+//The ggutils arithmetic behind INFO: the medians of SetMedianInfoValues, the strand bias test of INFO/FS and the
+//likelihood collapse CollapseRecords does when a sample has several records at a site.
+
+#include "bench.hh"
+
+BENCHMARK(inplace_median)
+{
+    bench::corpus_t &corpus = bench::test2_corpus();
+    size_t n = 0;
+    std::vector<int> work;
+    for (auto site = corpus.sites.begin(); site != corpus.sites.end(); site++)
+    {
+        work.assign(site->dp.begin(), site->dp.end());
+        ggutils::inplace_median(work);
+        n++;
+    }
+    return (n);
+}
+
+BENCHMARK(fisher_sb_test)
+{
+    bench::corpus_t &corpus = bench::test2_corpus();
+    size_t n = 0;
+    std::vector<float> pvalues;
+    for (auto site = corpus.sites.begin(); site != corpus.sites.end(); site++)
+    {
+        ggutils::fisher_sb_test(site->adr.data(), site->adf.data(), site->record->n_allele, pvalues);
+        n++;
+    }
+    return (n);
+}
+
+BENCHMARK(collapse_gls)
+{
+    bench::corpus_t &corpus = bench::test2_corpus();
+    size_t n = 0;
+    std::vector<int> output;
+    for (auto site = corpus.sites.begin(); site != corpus.sites.end(); site++)
+    {
+        //only sites with two or more ALTs collapse anything
+        if (site->pls.size() > 1)
+        {
+            ggutils::collapse_gls(2, site->record->n_allele, site->pls, output);
+            n++;
+        }
+    }
+    return (n);
+}
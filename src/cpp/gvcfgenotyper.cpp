@@ -1,5 +1,11 @@
 #include "GVCFMerger.hh"
+#include "ShardConcatenator.hh"
+#include "ChunkPlanner.hh"
+#include "GVCFSimulator.hh"
+#include "Trace.hh"
 #include <getopt.h>
+#include <sys/stat.h>
+#include <sstream>
 
 #include "spdlog.h"
 
@@ -8,6 +14,9 @@ static void usage()
     std::cerr << "\nAbout:   GVCF merging and genotyping for Illumina GVCFs" << std::endl;
     std::cerr << "Version: " << GG_VERSION << std::endl;
     std::cerr << "Usage:   gvcfgenotyper -f ref.fa -l gvcf_list.txt" << std::endl;
+    std::cerr << "         gvcfgenotyper plan -l gvcf_list.txt -n 100 > chunks.txt  (see gvcfgenotyper plan)" << std::endl;
+    std::cerr << "         gvcfgenotyper concat -o merged.bcf shard1.bcf shard2.bcf ...  (see gvcfgenotyper concat)" << std::endl;
+    std::cerr << "         gvcfgenotyper simulate -o cohort/ -n 100  (see gvcfgenotyper simulate)" << std::endl;
     std::cerr << "" << std::endl;
     std::cerr << "Options:" << std::endl;
     std::cerr << "    -l, --list          <file>          plain text list of gvcfs to merge" << std::endl;
@@ -19,18 +28,409 @@ static void usage()
             << std::endl;
     std::cerr << "    -r, --region        <region>        region to genotype eg. chr1 or chr20:5000000-6000000"
               << std::endl;
+    std::cerr << "    -R, --regions-file  <file>          regions to genotype, tab-delimited CHROM BEG END (1-based) or a .bed file." << std::endl;
+    std::cerr << "                                        The GVCFs are opened once and seeked from one region to the next" << std::endl;
+    std::cerr << "    -W, --write-index                   write a CSI index of each output file as it is written (-O b or z)" << std::endl;
     std::cerr << "    -M, --max-alleles   INT             maximum number of alleles [50]" << std::endl;
-//    std::cerr << "    -@, --thread      INT             number of threads [0]" << std::endl; //TODO: implement multi-threading!
+    std::cerr << "        --two-pass[=always]             scan the GVCFs for variant sites first, then seek to them if" << std::endl;
+    std::cerr << "                                        sites are sparse enough (or always). GVCFs must be indexed" << std::endl;
+    std::cerr << "    -@, --thread        INT             number of threads, samples are genotyped in parallel one chunk" << std::endl;
+    std::cerr << "                                        at a time. GVCFs must be indexed [1]" << std::endl;
+    std::cerr << "        --chunk-size    INT             bp genotyped per chunk with -@ [1000000]" << std::endl;
+    std::cerr << "        --chunk-workers INT             chunks genotyped at once, sharing the -@ threads. Each worker opens" << std::endl;
+    std::cerr << "                                        every GVCF, idle workers take (and split) chunks queued for busy ones [1]" << std::endl;
+    std::cerr << "        --read-threads  INT             without -@, read and decompress the GVCFs on INT threads of their own" << std::endl;
+    std::cerr << "                                        while the main thread merges, and log how often each stage waited [0]" << std::endl;
+    std::cerr << "        --batch-sites   INT             without -@, merge INT sites at a time, one sample at a time (0: one site" << std::endl;
+    std::cerr << "                                        at a time). Not used with --output-mode gvcf [" << BATCH_SITES << "]" << std::endl;
+    std::cerr << "        --stats-interval INT            log sites/s, records/s, thread time by stage and the slowest GVCFs every" << std::endl;
+    std::cerr << "                                        INT seconds, 0: only at the end [" << STATS_INTERVAL << "]" << std::endl;
+    std::cerr << "        --stats-json    <file>          also write the counters, CPU time, peak RSS and I/O bytes to file as JSON" << std::endl;
+    std::cerr << "                                        with every report (replacing the previous one)" << std::endl;
+    std::cerr << "        --memory-budget INT             warn when the memory accounted to buffers, headers, indexes and records" << std::endl;
+    std::cerr << "                                        (logged with the stats) reaches 90% of INT MB, 0: no budget [--max-memory]" << std::endl;
+    std::cerr << "        --max-memory    INT             without -@, size each GVCF's look-ahead so the read buffers stay within" << std::endl;
+    std::cerr << "                                        half of INT MB, 0: a fixed 5000 bp. Not with -@ or --chunk-workers [0]" << std::endl;
+    std::cerr << "        --progress-interval INT         log the position reached, the % of the genome (or -r/-R regions) done," << std::endl;
+    std::cerr << "                                        sites/s and the time left every INT seconds, 0: never [" << PROGRESS_INTERVAL << "]" << std::endl;
+    std::cerr << "        --progress                      also print the progress reports to stderr" << std::endl;
+    std::cerr << "        --trace         <file>          write a timeline of every thread's stages to file in the Chrome trace" << std::endl;
+    std::cerr << "                                        format (chrome://tracing, ui.perfetto.dev). Only in make trace builds" << std::endl;
+    std::cerr << "        --local-alleles                 write LAA/LAD/LPL (only the alleles each sample has) instead of AD/PL" << std::endl;
+    std::cerr << "        --output-mode   <vcf|gvcf>      gvcf: also write cohort reference blocks between sites [vcf]" << std::endl;
+    std::cerr << "        --band-dp       INT             gvcf: start a new reference block when any sample's DP changes by more than this ["
+              << DEFAULT_DP_BAND << "]" << std::endl;
+    std::cerr << "        --band-gq       INT             gvcf: as --band-dp for GQ [" << DEFAULT_GQ_BAND << "]" << std::endl;
+    std::cerr << "        --sites-only                    only write INFO, without the sample columns" << std::endl;
+    std::cerr << "        --extra-output  <file[:type[:what]]>  also write file in the same pass, type as for -O with an optional" << std::endl;
+    std::cerr << "                                        compression level (eg. z1) [z]. what is sites for a sites-only file or a" << std::endl;
+    std::cerr << "                                        file with the names of the samples to keep [all samples]. Can be repeated" << std::endl;
     std::cerr << std::endl;
 }
 
+//adds an --extra-output file:type:what to g
+static void add_extra_output(GVCFMerger &g, const string &spec)
+{
+    std::vector<std::string> fields;
+    std::stringstream ss(spec);
+    std::string field;
+    while (std::getline(ss, field, ':'))
+    {
+        fields.push_back(field);
+    }
+    if (fields.empty() || fields.size() > 3 || fields[0].empty())
+    {
+        ggutils::die("invalid --extra-output: " + spec);
+    }
+    std::string type = fields.size() > 1 ? fields[1] : "z";
+    std::vector<std::string> samples;
+    bool sites = fields.size() > 2 && fields[2] == "sites";
+    if (fields.size() > 2 && !sites)
+    {
+        ggutils::read_text_file(fields[2], samples);
+        if (samples.empty())
+        {
+            ggutils::die("no samples in " + fields[2]);
+        }
+    }
+    g.AddOutput(fields[0], type, sites, samples);
+}
+
+static void concat_usage()
+{
+    std::cerr << "\nAbout:   Concatenates gvcfgenotyper outputs for consecutive regions (eg. one per -r) without" << std::endl;
+    std::cerr << "         recompressing them. Records a shard shares with the previous one are dropped." << std::endl;
+    std::cerr << "Usage:   gvcfgenotyper concat -o merged.bcf shard1.bcf shard2.bcf ..." << std::endl;
+    std::cerr << "" << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "    -o, --output-file   <file>          output file name, also indexed as <file>.csi" << std::endl;
+    std::cerr << "    -l, --list          <file>          plain text list of shards, in order" << std::endl;
+    std::cerr << "    -L, --log-file      <file>          logging information" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "Shards have to be bgzf compressed (-O b or z) and have identical headers." << std::endl;
+    std::cerr << std::endl;
+}
+
+static int concat_main(int argc, char **argv)
+{
+    if (argc < 2)
+    { concat_usage(); }
+    int c;
+    string output_file = "";
+    string shard_list = "";
+    string log_file = "gvcfgenotyper."+ggutils::string_time()+"."+to_string(getpid())+".log";
+    static struct option loptions[] = {
+            {"output-file", 1, 0, 'o'},
+            {"list",        1, 0, 'l'},
+            {"log-file",    1, 0, 'L'},
+            {0,             0, 0, 0}
+    };
+    while ((c = getopt_long(argc, argv, "o:l:L:", loptions, NULL)) >= 0)
+    {
+        switch (c)
+        {
+            case 'o':
+                output_file = optarg;
+                break;
+            case 'l':
+                shard_list = optarg;
+                break;
+            case 'L':
+                log_file = optarg;
+                break;
+            default:
+                ggutils::die("unrecognised argument");
+        }
+    }
+    std::vector<std::string> shards;
+    if (!shard_list.empty())
+    {
+        ggutils::read_text_file(shard_list, shards);
+    }
+    shards.insert(shards.end(), argv + optind, argv + argc);
+    if (output_file.empty())
+    {
+        ggutils::die("--output-file is required");
+    }
+    if (shards.empty())
+    {
+        ggutils::die("no shards given");
+    }
+    std::cerr << "Logging output to " <<log_file<<std::endl;
+    std::shared_ptr<spdlog::logger> lg = spdlog::basic_logger_mt("gg_logger", log_file);
+    spdlog::set_pattern(" [%c] [%l] %v");
+    lg->info("Concatenating {} shards", shards.size());
+
+    ShardConcatenator concatenator(shards, output_file);
+    concatenator.Concat();
+    lg->info("Wrote {} records, dropped {} duplicates, {} bytes were copied without recompressing them",
+             concatenator.GetNumRecords(), concatenator.GetNumDuplicates(), concatenator.GetNumBytesCopied());
+    lg->info("Done");
+    spdlog::drop_all();
+    return (0);
+}
+
+static void plan_usage()
+{
+    std::cerr << "\nAbout:   Splits the genome into chunks with similar amounts of GVCF data, estimated from the" << std::endl;
+    std::cerr << "         indices of the GVCFs. Prints one chunk per line, in the format taken by -r." << std::endl;
+    std::cerr << "Usage:   gvcfgenotyper plan -l gvcf_list.txt -n 100 > chunks.txt" << std::endl;
+    std::cerr << "" << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "    -l, --list          <file>          plain text list of gvcfs to merge (bgzipped and indexed)" << std::endl;
+    std::cerr << "    -n, --chunks        <int>           number of chunks" << std::endl;
+    std::cerr << "    -o, --output-file   <file>          output file name [stdout]" << std::endl;
+    std::cerr << "        --bin-size      <int>           resolution of the estimate and of the cuts in bp [" << DEFAULT_PLAN_BIN_SIZE << "]" << std::endl;
+    std::cerr << "    -L, --log-file      <file>          logging information" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "Chunks are only cut where no variant of any GVCF spans the cut." << std::endl;
+    std::cerr << std::endl;
+}
+
+static int plan_main(int argc, char **argv)
+{
+    if (argc < 2)
+    { plan_usage(); }
+    int c;
+    string output_file = "";
+    string gvcf_list = "";
+    int num_chunks = 0;
+    int bin_size = DEFAULT_PLAN_BIN_SIZE;
+    string log_file = "gvcfgenotyper."+ggutils::string_time()+"."+to_string(getpid())+".log";
+    static struct option loptions[] = {
+            {"list",        1, 0, 'l'},
+            {"chunks",      1, 0, 'n'},
+            {"output-file", 1, 0, 'o'},
+            {"log-file",    1, 0, 'L'},
+            {"bin-size",    1, 0, 1},
+            {0,             0, 0, 0}
+    };
+    while ((c = getopt_long(argc, argv, "l:n:o:L:", loptions, NULL)) >= 0)
+    {
+        switch (c)
+        {
+            case 'l':
+                gvcf_list = optarg;
+                break;
+            case 'n':
+                num_chunks = stoi(optarg);
+                break;
+            case 'o':
+                output_file = optarg;
+                break;
+            case 'L':
+                log_file = optarg;
+                break;
+            case 1:
+                bin_size = stoi(optarg);
+                break;
+            default:
+                ggutils::die("unrecognised argument");
+        }
+    }
+    if (gvcf_list.empty())
+    {
+        ggutils::die("--list is required");
+    }
+    if (num_chunks < 1)
+    {
+        ggutils::die("--chunks must be at least 1");
+    }
+    std::cerr << "Logging output to " <<log_file<<std::endl;
+    std::shared_ptr<spdlog::logger> lg = spdlog::basic_logger_mt("gg_logger", log_file);
+    spdlog::set_pattern(" [%c] [%l] %v");
+
+    std::vector<std::string> input_files;
+    ggutils::read_text_file(gvcf_list, input_files);
+    ChunkPlanner planner(input_files, bin_size);
+    auto chunks = planner.Plan(num_chunks);
+
+    std::ofstream ofile;
+    if (!output_file.empty())
+    {
+        ofile.open(output_file);
+        if (!ofile)
+        {
+            ggutils::die("problem opening output file: " + output_file);
+        }
+    }
+    std::ostream &out = output_file.empty() ? std::cout : ofile;
+    double max_bytes = 0;
+    for (size_t k = 0; k < chunks.size(); k++)
+    {
+        for (size_t i = 0; i < chunks[k].size(); i++)
+        {
+            out << (i > 0 ? "," : "") << ggutils::region2string(chunks[k][i]);
+        }
+        out << std::endl;
+        max_bytes = max(max_bytes, planner.GetChunkBytes()[k]);
+    }
+    lg->info("Planned {} chunks over {} bins, {:.0f} bytes in total, the largest chunk is {:.2f}x the mean",
+             chunks.size(), planner.GetNumBins(), planner.GetTotalBytes(),
+             planner.GetTotalBytes() > 0 ? max_bytes * chunks.size() / planner.GetTotalBytes() : 1.0);
+    if ((int) chunks.size() < num_chunks)
+    {
+        lg->warn("Only {} of {} chunks, use a smaller --bin-size for more", chunks.size(), num_chunks);
+    }
+    lg->info("Done");
+    spdlog::drop_all();
+    return (0);
+}
+
+static void simulate_usage()
+{
+    simulation_t defaults;
+    std::cerr << "\nAbout:   Writes a synthetic cohort of Strelka style GVCFs and their reference, for benchmarks." << std::endl;
+    std::cerr << "Usage:   gvcfgenotyper simulate -o cohort/ -n 100" << std::endl;
+    std::cerr << "" << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "    -o, --output-dir    <dir>           directory for ref.fa, the GVCFs and gvcfs.txt (created if needed)" << std::endl;
+    std::cerr << "    -n, --samples       <int>           number of samples [" << defaults.num_samples << "]" << std::endl;
+    std::cerr << "        --contigs       <int>           number of contigs [" << defaults.num_contigs << "]" << std::endl;
+    std::cerr << "        --length        <int>           bp per contig [" << defaults.contig_length << "]" << std::endl;
+    std::cerr << "        --snp-rate      <float>         SNP sites of the cohort per bp [" << defaults.snp_rate << "]" << std::endl;
+    std::cerr << "        --indel-rate    <float>         indel sites per bp [" << defaults.indel_rate << "]" << std::endl;
+    std::cerr << "        --mnp-rate      <float>         MNP sites per bp [" << defaults.mnp_rate << "]" << std::endl;
+    std::cerr << "        --multiallelic-rate <float>     fraction of sites with a second ALT [" << defaults.multiallelic_rate << "]" << std::endl;
+    std::cerr << "        --mean-block    <int>           mean reference block length, geometric [" << defaults.mean_block_length << "]" << std::endl;
+    std::cerr << "        --haploid-fraction <float>      samples that are haploid on the last contig [" << defaults.haploid_fraction << "]" << std::endl;
+    std::cerr << "        --missing-rate  <float>         records with a missing value or a sample filter [" << defaults.missing_rate << "]" << std::endl;
+    std::cerr << "        --seed          <int>           random seed [" << defaults.seed << "]" << std::endl;
+    std::cerr << "    -@, --thread        <int>           GVCFs written at once [1]" << std::endl;
+    std::cerr << "    -L, --log-file      <file>          logging information" << std::endl;
+    std::cerr << std::endl;
+}
+
+static int simulate_main(int argc, char **argv)
+{
+    if (argc < 2)
+    { simulate_usage(); }
+    int c;
+    string output_dir = "";
+    simulation_t params;
+    int num_threads = 1;
+    string log_file = "gvcfgenotyper."+ggutils::string_time()+"."+to_string(getpid())+".log";
+    static struct option loptions[] = {
+            {"output-dir",  1, 0, 'o'},
+            {"samples",     1, 0, 'n'},
+            {"thread",      1, 0, '@'},
+            {"log-file",    1, 0, 'L'},
+            {"contigs",     1, 0, 1},
+            {"length",      1, 0, 2},
+            {"snp-rate",    1, 0, 3},
+            {"indel-rate",  1, 0, 4},
+            {"mnp-rate",    1, 0, 5},
+            {"multiallelic-rate", 1, 0, 6},
+            {"mean-block",  1, 0, 7},
+            {"haploid-fraction", 1, 0, 8},
+            {"missing-rate", 1, 0, 9},
+            {"seed",        1, 0, 10},
+            {0,             0, 0, 0}
+    };
+    while ((c = getopt_long(argc, argv, "o:n:@:L:", loptions, NULL)) >= 0)
+    {
+        switch (c)
+        {
+            case 'o':
+                output_dir = optarg;
+                break;
+            case 'n':
+                params.num_samples = stoi(optarg);
+                break;
+            case '@':
+                num_threads = stoi(optarg);
+                break;
+            case 'L':
+                log_file = optarg;
+                break;
+            case 1:
+                params.num_contigs = stoi(optarg);
+                break;
+            case 2:
+                params.contig_length = stoi(optarg);
+                break;
+            case 3:
+                params.snp_rate = stod(optarg);
+                break;
+            case 4:
+                params.indel_rate = stod(optarg);
+                break;
+            case 5:
+                params.mnp_rate = stod(optarg);
+                break;
+            case 6:
+                params.multiallelic_rate = stod(optarg);
+                break;
+            case 7:
+                params.mean_block_length = stoi(optarg);
+                break;
+            case 8:
+                params.haploid_fraction = stod(optarg);
+                break;
+            case 9:
+                params.missing_rate = stod(optarg);
+                break;
+            case 10:
+                params.seed = (unsigned int) stoul(optarg);
+                break;
+            default:
+                ggutils::die("unrecognised argument");
+        }
+    }
+    if (output_dir.empty())
+    {
+        ggutils::die("--output-dir is required");
+    }
+    if (num_threads < 1)
+    {
+        ggutils::die("-@ must be at least 1");
+    }
+    if (mkdir(output_dir.c_str(), 0777) != 0 && errno != EEXIST)
+    {
+        ggutils::die("problem creating " + output_dir);
+    }
+    std::cerr << "Logging output to " <<log_file<<std::endl;
+    std::shared_ptr<spdlog::logger> lg = spdlog::basic_logger_mt("gg_logger", log_file);
+    spdlog::set_pattern(" [%c] [%l] %v");
+
+    GVCFSimulator simulator(params);
+    simulator.Write(output_dir, num_threads);
+    lg->info("Done");
+    spdlog::drop_all();
+    return (0);
+}
+
 int main(int argc, char **argv)
 {
+    if (argc > 1 && (string) argv[1] == "plan")
+    {
+        return (plan_main(argc - 1, argv + 1));
+    }
+    if (argc > 1 && (string) argv[1] == "concat")
+    {
+        return (concat_main(argc - 1, argv + 1));
+    }
+    if (argc > 1 && (string) argv[1] == "simulate")
+    {
+        return (simulate_main(argc - 1, argv + 1));
+    }
     if (argc < 2)
     { usage(); }
     int c;
     string region = "";
-    int n_threads = 0;
+    string regions_file = "";
+    int n_threads = 1;
+    int chunk_size = 1000000;
+    int chunk_workers = 1;
+    int read_threads = 0;
+    int batch_sites = BATCH_SITES;
+    int stats_interval = STATS_INTERVAL;
+    string stats_json = "";
+    int progress_interval = PROGRESS_INTERVAL;
+    bool progress_stderr = false;
+    string trace_file = "";
+    int memory_budget = -1;
+    int max_memory = 0;
     string output_file = "";
     string log_file = "gvcfgenotyper."+ggutils::string_time()+"."+to_string(getpid())+".log";
     string output_type = "v";
@@ -42,6 +442,14 @@ int main(int argc, char **argv)
     bool ignore_non_matching_ref=false;
     // Another hidden flag to force processing of gvcf files with duplicate sample names
     bool force_samples=false;
+    int two_pass = TWO_PASS_OFF;
+    bool local_alleles = false;
+    bool sites_only = false;
+    bool write_index = false;
+    std::vector<std::string> extra_outputs;
+    string output_mode = "vcf";
+    int band_dp = DEFAULT_DP_BAND;
+    int band_gq = DEFAULT_GQ_BAND;
 
     static struct option loptions[] = {
             {"list",        1, 0, 'l'},
@@ -50,14 +458,34 @@ int main(int argc, char **argv)
             {"output-type", 1, 0, 'O'},
             {"log-file",    1, 0, 'L'},
             {"region",      1, 0, 'r'},
+            {"regions-file", 1, 0, 'R'},
             {"thread",      1, 0, '@'},
+            {"write-index", 0, 0, 'W'},
             {"max-alleles", 1, 0, 'M'},
 	        {"ignore-non-matching-ref",0,0,1},
 	        {"force-samples",0,0,'s'},
+            {"two-pass",    2, 0, 2},
+            {"chunk-size",  1, 0, 3},
+            {"local-alleles", 0, 0, 4},
+            {"output-mode", 1, 0, 5},
+            {"band-dp",     1, 0, 6},
+            {"band-gq",     1, 0, 7},
+            {"sites-only",  0, 0, 8},
+            {"extra-output", 1, 0, 9},
+            {"chunk-workers", 1, 0, 10},
+            {"read-threads", 1, 0, 11},
+            {"batch-sites", 1, 0, 12},
+            {"stats-interval", 1, 0, 13},
+            {"stats-json",  1, 0, 14},
+            {"progress-interval", 1, 0, 15},
+            {"progress",    0, 0, 16},
+            {"trace",       1, 0, 17},
+            {"memory-budget", 1, 0, 18},
+            {"max-memory",  1, 0, 19},
             {0,             0, 0, 0}
     };
 
-    while ((c = getopt_long(argc, argv, "L:l:f:o:O:r:@:", loptions, NULL)) >= 0)
+    while ((c = getopt_long(argc, argv, "L:l:f:o:O:r:R:@:W", loptions, NULL)) >= 0)
     {
         switch (c)
         {
@@ -82,14 +510,79 @@ int main(int argc, char **argv)
             case 'r':
                 region = optarg;
                 break;
+            case 'R':
+                regions_file = optarg;
+                break;
             case '@':
                 n_threads = stoi(optarg);
                 break;
+            case 'W':
+                write_index = true;
+                break;
             case 1:
 	            ignore_non_matching_ref=true;break;
             case 's':
 	            force_samples=true;
                 break;
+            case 2:
+                if (optarg == NULL)
+                    two_pass = TWO_PASS_AUTO;
+                else if ((string) optarg == "always")
+                    two_pass = TWO_PASS_ALWAYS;
+                else
+                    ggutils::die("invalid --two-pass argument: " + (string) optarg);
+                break;
+            case 3:
+                chunk_size = stoi(optarg);
+                break;
+            case 4:
+                local_alleles = true;
+                break;
+            case 5:
+                output_mode = optarg;
+                break;
+            case 6:
+                band_dp = stoi(optarg);
+                break;
+            case 7:
+                band_gq = stoi(optarg);
+                break;
+            case 8:
+                sites_only = true;
+                break;
+            case 9:
+                extra_outputs.push_back(optarg);
+                break;
+            case 10:
+                chunk_workers = stoi(optarg);
+                break;
+            case 11:
+                read_threads = stoi(optarg);
+                break;
+            case 12:
+                batch_sites = stoi(optarg);
+                break;
+            case 13:
+                stats_interval = stoi(optarg);
+                break;
+            case 14:
+                stats_json = optarg;
+                break;
+            case 15:
+                progress_interval = stoi(optarg);
+                break;
+            case 16:
+                progress_stderr = true;
+                break;
+            case 17:
+                trace_file = optarg;
+                break;
+            case 18:
+                memory_budget = stoi(optarg);
+                break;
+            case 19:
+                max_memory = stoi(optarg);
+                break;
 	        default:
 	            if (optarg != NULL)
 		            ggutils::die("Unknown argument:" + (string) optarg + "\n");
@@ -107,13 +600,79 @@ int main(int argc, char **argv)
     {
         ggutils::die("--fasta-ref is required");
     }
-    if (output_type != "b" && output_type != "z" && output_type != "v" && output_type != "u")
+    if (!region.empty() && !regions_file.empty())
+    {
+        ggutils::die("-r and -R cannot be used together");
+    }
+    if (!is_output_mode(output_type))
     {
         ggutils::die("invalid output type: " + output_type);
     }
-    if (n_threads != 0)
+    if (n_threads < 1)
+    {
+        ggutils::die("-@ must be at least 1");
+    }
+    if (chunk_size < 1)
+    {
+        ggutils::die("--chunk-size must be positive");
+    }
+    if (chunk_workers < 1)
+    {
+        ggutils::die("--chunk-workers must be at least 1");
+    }
+    if (read_threads < 0)
+    {
+        ggutils::die("--read-threads cannot be negative");
+    }
+    if (read_threads > 0 && (n_threads > 1 || chunk_workers > 1))
+    {
+        ggutils::die("--read-threads is for the streaming merge, -@ and --chunk-workers read on their own threads");
+    }
+    if (batch_sites < 0)
+    {
+        ggutils::die("--batch-sites cannot be negative");
+    }
+    if (stats_interval < 0)
+    {
+        ggutils::die("--stats-interval cannot be negative");
+    }
+    if (progress_interval < 0)
+    {
+        ggutils::die("--progress-interval cannot be negative");
+    }
+    if (max_memory < 0)
     {
-        ggutils::die("-@ is not implemented");
+        ggutils::die("--max-memory cannot be negative");
+    }
+    if (max_memory > 0 && (n_threads > 1 || chunk_workers > 1))
+    {
+        ggutils::die("--max-memory is for the streaming merge, -@ and --chunk-workers buffer each chunk on its own");
+    }
+    if (memory_budget < -1)
+    {
+        ggutils::die("--memory-budget cannot be negative");
+    }
+    if (memory_budget == -1)
+    {
+        memory_budget = max_memory;
+    }
+#ifndef GG_TRACE
+    if (!trace_file.empty())
+    {
+        ggutils::die("--trace needs a build with tracing, see make trace");
+    }
+#endif
+    if (output_mode != "vcf" && output_mode != "gvcf")
+    {
+        ggutils::die("invalid output mode: " + output_mode);
+    }
+    if (output_mode == "gvcf" && (n_threads > 1 || chunk_workers > 1 || two_pass != TWO_PASS_OFF))
+    {
+        ggutils::die("--output-mode gvcf reads every reference block so it does not work with -@, --chunk-workers or --two-pass");
+    }
+    if (output_mode == "gvcf" && sites_only)
+    {
+        ggutils::die("--sites-only has no sample columns to put reference blocks in, use --output-mode vcf");
     }
     std::cerr << "Logging output to " <<log_file<<std::endl;
 
@@ -130,9 +689,52 @@ int main(int argc, char **argv)
     std::vector<std::string> input_files;
     ggutils::read_text_file(gvcf_list, input_files);
     int is_file = 0;
-    GVCFMerger g(input_files, output_file, output_type, reference_genome, buffer_size, region, is_file, ignore_non_matching_ref, force_samples);
-    g.SetMaxAlleles(max_alleles);
-    g.write_vcf();
+    if (!regions_file.empty())
+    {
+        region = regions_file;
+        is_file = 1;
+    }
+    if (!trace_file.empty())
+    {
+        Tracer::Open(trace_file);
+    }
+    //the merger (and its read threads) has to be gone before the trace is closed
+    {
+        GVCFMerger g(input_files, output_file, output_type, reference_genome, buffer_size, region, is_file, ignore_non_matching_ref, force_samples, two_pass,
+                     local_alleles, output_mode == "gvcf", sites_only);
+        g.SetMaxAlleles(max_alleles);
+        if (n_threads > 1 || chunk_workers > 1)
+        {
+            g.SetThreads(n_threads, chunk_size, chunk_workers);
+        }
+        if (read_threads > 0)
+        {
+            g.SetReadThreads(read_threads);
+        }
+        g.SetBatchSites(batch_sites);
+        g.SetStatsInterval(stats_interval);
+        if (!stats_json.empty())
+        {
+            g.SetStatsJson(stats_json);
+        }
+        g.SetProgress(progress_interval, progress_stderr);
+        g.SetMemoryBudget((size_t) memory_budget << 20);
+        g.SetMaxMemory((size_t) max_memory << 20);
+        if (output_mode == "gvcf")
+        {
+            g.SetReferenceBands(band_dp, band_gq);
+        }
+        for (auto it = extra_outputs.begin(); it != extra_outputs.end(); it++)
+        {
+            add_extra_output(g, *it);
+        }
+        if (write_index)
+        {
+            g.SetWriteIndex();
+        }
+        g.write_vcf();
+    }
+    Tracer::Close();
 
     lg->info("Done");
     spdlog::drop_all();
@@ -0,0 +1,274 @@
+#include "ChunkGenotyper.hh"
+
+#include <atomic>
+#include <set>
+#include <thread>
+
+#include "Trace.hh"
+
+ChunkGenotyper::chunk_result_t::~chunk_result_t()
+{
+    for (auto it = sites.begin(); it != sites.end(); it++)
+    {
+        bcf_destroy(it->record);
+    }
+}
+
+ChunkGenotyper::ChunkGenotyper(const chunk_inputs_t &inputs, std::vector<GVCFReader> &readers,
+                               Normaliser *normaliser, const SiteColumns &columns, RunStats *stats,
+                               int num_threads, int num_workers)
+    : _readers(readers), _columns(columns)
+{
+    if (num_threads < 1 || num_workers < 1)
+    {
+        ggutils::die("ChunkGenotyper needs at least one thread and worker");
+    }
+    _site_regions = inputs.site_regions;
+    _normaliser = normaliser;
+    _stats = stats;
+    _num_samples = readers.size();
+    _lg = spdlog::get("gg_logger");
+
+    _workers.resize(num_workers);
+    int worker_threads = max(1, num_threads / num_workers);
+    for (int w = 0; w < num_workers; w++)
+    {
+        chunk_worker_t &worker = _workers[w];
+        worker.index = w;
+        for (int t = 0; t < worker_threads; t++)
+        {
+            worker.normalisers.push_back(w == 0 && t == 0 ? _normaliser :
+                                         new Normaliser(inputs.reference_genome, inputs.ignore_non_matching_ref));
+            worker.scratch.push_back(_columns.NewScratch());
+            worker.clocks.push_back(_stats->NewClock());
+        }
+        if (w == 0)
+        {
+            worker.readers = &_readers;
+            continue;
+        }
+        worker.readers = new vector<GVCFReader>();
+        worker.readers->reserve(_num_samples);
+        for (size_t i = 0; i < _num_samples; i++)
+        {
+            worker.readers->emplace_back(inputs.files[i], worker.normalisers[0], inputs.buffer_size, inputs.region,
+                                         inputs.is_file, inputs.site_regions, inputs.output_header);
+            worker.readers->back().SetStats(_stats->GetReader(i));
+            worker.readers->back().SetMemoryStats(_stats->GetMemory());
+        }
+    }
+}
+
+ChunkGenotyper::~ChunkGenotyper()
+{
+    for (auto worker = _workers.begin(); worker != _workers.end(); worker++)
+    {
+        for (size_t t = 0; t < worker->normalisers.size(); t++)
+        {
+            if (worker->normalisers[t] != _normaliser)
+            {
+                delete worker->normalisers[t];
+            }
+            delete worker->scratch[t];
+        }
+        if (worker->readers != &_readers)
+        {
+            for (auto it = worker->readers->begin(); it != worker->readers->end(); it++)
+            {
+                it->SetMemoryStats(nullptr);
+            }
+            delete worker->readers;
+        }
+    }
+}
+
+void ChunkGenotyper::Run(const std::vector<ggutils::region_t> &bounds, int chunk_size, const chunk_writer_t &write)
+{
+    int num_workers = (int) _workers.size();
+    ChunkScheduler scheduler(bounds, chunk_size, num_workers);
+    vector<std::thread> threads;
+    for (int w = 0; w < num_workers; w++)
+    {
+        threads.emplace_back([&, w]()
+                             {
+                                 chunk_task_t task;
+                                 StageClock::Attach(_workers[w].clocks[0]);
+                                 GG_TRACE_THREAD(fmt::format("chunk worker {}", w));
+                                 while (scheduler.Take(w, task))
+                                 {
+                                     const ggutils::region_t &bound = scheduler.GetBounds()[task.bound];
+                                     scheduler.Finish(task, Genotype(_workers[w], bound, task.start, task.end));
+                                     StageClock::Enter(STAGE_NONE);
+                                 }
+                                 StageClock::Attach(nullptr);
+                             });
+    }
+
+    //chunks are written in genome order as they come out of the scheduler's reorder buffer
+    chunk_task_t task;
+    chunk_output_t *output;
+    StageClock::Enter(STAGE_NONE);
+    while ((output = scheduler.NextOutput(task)) != nullptr)
+    {
+        chunk_result_t *result = static_cast<chunk_result_t *>(output);
+        write(result->sites, result->columns);
+        _lg->info("Genotyped {}:{}-{}", scheduler.GetBounds()[task.bound].chrom, task.start + 1, task.end + 1);
+        _stats->GetMemory()->Add(MEM_COLUMNS, -(int64_t) result->bytes);
+        delete result;
+        StageClock::Enter(STAGE_NONE);
+    }
+    for (auto it = threads.begin(); it != threads.end(); it++)
+    {
+        it->join();
+    }
+    if (num_workers > 1)
+    {
+        _lg->info("{} chunks, {} stolen by idle workers and {} split, at most {} chunks waiting to be written",
+                  scheduler.GetNumChunks(), scheduler.GetNumSteals(), scheduler.GetNumSplits(), scheduler.GetMaxPending());
+    }
+}
+
+//runs f(sample_index, thread_index) for every sample, spread over the worker's threads
+void ChunkGenotyper::ForEachSample(chunk_worker_t &worker,
+                                   const std::function<void(size_t sample_index, size_t thread_index)> &f)
+{
+    size_t num_threads = worker.normalisers.size();
+    if (num_threads == 1)
+    {
+        for (size_t i = 0; i < _num_samples; i++)
+        {
+            f(i, 0);
+        }
+        return;
+    }
+    //the calling thread only waits, each thread counts its time on the worker's clock for its index
+    run_stage_t previous = StageClock::Enter(STAGE_NONE);
+    std::atomic<size_t> next_sample(0);
+    vector<std::thread> threads;
+    for (size_t t = 0; t < num_threads; t++)
+    {
+        threads.emplace_back([&, t]()
+                             {
+                                 StageClock::Attach(worker.clocks[t]);
+                                 GG_TRACE_THREAD(fmt::format("chunk worker {} thread {}", worker.index, t));
+                                 size_t i;
+                                 while ((i = next_sample++) < _num_samples)
+                                 {
+                                     f(i, t);
+                                 }
+                                 StageClock::Attach(nullptr);
+                             });
+    }
+    for (auto it = threads.begin(); it != threads.end(); it++)
+    {
+        it->join();
+    }
+    StageClock::Enter(previous);
+}
+
+std::vector<ggutils::region_t> ChunkGenotyper::GetBounds(const std::string &region, int is_file,
+                                                         std::vector<GVCFReader> &readers, const bcf_hdr_t *header)
+{
+    vector<ggutils::region_t> regions;
+    if (!region.empty())
+    {
+        is_file ? ggutils::read_regions_file(region, regions) : ggutils::parse_regions(region, regions);
+    }
+    else
+    {
+        std::set<std::string> contigs;
+        for (size_t i = 0; i < readers.size(); i++)
+        {
+            auto names = readers[i].GetIndexedContigs();
+            contigs.insert(names.begin(), names.end());
+        }
+        for (auto it = contigs.begin(); it != contigs.end(); it++)
+        {
+            int rid = bcf_hdr_name2id(header, it->c_str());
+            int length = rid < 0 ? 0 : (int) header->id[BCF_DT_CTG][rid].val->info[0];
+            regions.push_back({*it, 0, length > 0 ? length - 1 : std::numeric_limits<int>::max() - 1});
+        }
+    }
+
+    vector<std::pair<int, ggutils::region_t> > sorted;
+    for (auto it = regions.begin(); it != regions.end(); it++)
+    {
+        int rid = bcf_hdr_name2id(header, it->chrom.c_str());
+        if (rid >= 0)
+        {
+            sorted.emplace_back(rid, *it);
+        }
+    }
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const std::pair<int, ggutils::region_t> &a, const std::pair<int, ggutils::region_t> &b)
+                     {
+                         return (a.first < b.first || (a.first == b.first && a.second.start < b.second.start));
+                     });
+    vector<ggutils::region_t> ret;
+    for (size_t i = 0; i < sorted.size(); i++)
+    {
+        if (i > 0 && sorted[i].first == sorted[i - 1].first && sorted[i].second.start <= ret.back().end)
+        {
+            ret.back().end = max(ret.back().end, sorted[i].second.end);
+        }
+        else
+        {
+            ret.push_back(sorted[i].second);
+        }
+    }
+    return (ret);
+}
+
+//Genotypes the sites starting in start-end (reading CHUNK_PADDING more on each side, within bound) in three steps:
+//1. every sample's GVCF is read for the window, one thread per sample at a time
+//2. the sites and their alleles are fixed by SiteColumns::Plan over the buffered variants
+//3. each sample is genotyped at every site on its own thread, into a sample-major column
+//The columns are transposed into site-major rows and written by Run once the chunks before are.
+ChunkGenotyper::chunk_result_t *ChunkGenotyper::Genotype(chunk_worker_t &worker, const ggutils::region_t &bound,
+                                                         int start, int end)
+{
+    GG_TRACE_SCOPE("chunk", fmt::format("{}:{}-{}", bound.chrom, start + 1, end + 1));
+    chunk_result_t *result = new chunk_result_t;
+    ggutils::region_t window = {bound.chrom,
+                                (int) std::max((long long) bound.start, (long long) start - CHUNK_PADDING),
+                                (int) std::min((long long) bound.end, (long long) end + CHUNK_PADDING)};
+    vector<ggutils::region_t> regions;
+    if (_site_regions != nullptr)
+    {
+        for (auto it = _site_regions->begin(); it != _site_regions->end(); it++)
+        {
+            if (it->chrom == window.chrom && it->start <= window.end && window.start <= it->end)
+            {
+                regions.push_back({it->chrom, max(it->start, window.start), min(it->end, window.end)});
+            }
+        }
+        if (regions.empty())
+        {
+            return (result);
+        }
+    }
+    else
+    {
+        regions.push_back(window);
+    }
+
+    vector<GVCFReader> &readers = *worker.readers;
+    ForEachSample(worker, [&](size_t i, size_t t)
+                  {
+                      StageClock::Enter(STAGE_READ);
+                      readers[i].SetNormaliser(worker.normalisers[t]);
+                      readers[i].SetRegions(regions);
+                      readers[i].ReadAll();
+                  });
+
+    _columns.Plan(readers, start, end, result->sites);
+
+    result->columns.resize(_num_samples);
+    ForEachSample(worker, [&](size_t i, size_t t)
+                  {
+                      SiteColumns::GenotypeColumn(readers[i], result->sites, result->columns[i], worker.scratch[t]);
+                  });
+    result->bytes = SiteColumns::GetBytes(result->sites, result->columns);
+    _stats->GetMemory()->Add(MEM_COLUMNS, result->bytes);
+    return (result);
+}
@@ -0,0 +1,99 @@
+//
+// The sample-parallel engine (--threads with --chunk-size), genotypes chunks of the genome on several workers.
+//
+
+#ifndef GVCFGENOTYPER_CHUNKGENOTYPER_HH
+#define GVCFGENOTYPER_CHUNKGENOTYPER_HH
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <htslib/vcf.h>
+}
+
+#include "ggutils.hh"
+#include "ChunkScheduler.hh"
+#include "GVCFReader.hh"
+#include "Normaliser.hh"
+#include "RunStats.hh"
+#include "SiteColumns.hh"
+
+//chunks are read this much further on each side than the sites they output, so that a site near the edge
+//of a chunk sees the same variants (normalisation can move them left) and depth blocks as when streaming
+#define CHUNK_PADDING 5000
+
+//how the workers after the first open every GVCF again, as the first worker's readers were opened
+struct chunk_inputs_t
+{
+    std::vector<std::string> files;
+    std::string reference_genome;
+    bool ignore_non_matching_ref;
+    int buffer_size;
+    std::string region;
+    int is_file;
+    const std::vector<ggutils::region_t> *site_regions;//from --two-pass, nullptr if the readers do not seek
+    const bcf_hdr_t *output_header;
+};
+
+//Each worker genotypes a chunk at a time (see Genotype), on threads of its own, with its own readers. The
+//ChunkScheduler hands out the chunks and gives them back in genome order to Run, which writes them on the
+//calling thread.
+class ChunkGenotyper
+{
+public:
+    //called with the sites and sample columns of each chunk
+    typedef std::function<void(std::deque<planned_site_t> &sites, std::vector<sample_column_t> &columns)> chunk_writer_t;
+
+    //the first worker uses readers and normaliser, the others open inputs. The num_threads threads are shared
+    //out between num_workers workers.
+    ChunkGenotyper(const chunk_inputs_t &inputs, std::vector<GVCFReader> &readers, Normaliser *normaliser,
+                   const SiteColumns &columns, RunStats *stats, int num_threads, int num_workers);
+    ~ChunkGenotyper();
+
+    //genotypes bounds in chunks of chunk_size bp and calls write(sites, columns) for every chunk in genome order
+    void Run(const std::vector<ggutils::region_t> &bounds, int chunk_size, const chunk_writer_t &write);
+
+    //the regions (-r/-R, otherwise every contig indexed by any of readers) that are cut into chunks, in the order of
+    //header with overlapping regions merged
+    static std::vector<ggutils::region_t> GetBounds(const std::string &region, int is_file,
+                                                    std::vector<GVCFReader> &readers, const bcf_hdr_t *header);
+
+private:
+    //the sites and genotypes of a chunk, waiting in the ChunkScheduler to be written
+    struct chunk_result_t : public chunk_output_t
+    {
+        std::deque<planned_site_t> sites;
+        std::vector<sample_column_t> columns;
+        size_t bytes = 0;//accounted to MEM_COLUMNS until the chunk is written
+        ~chunk_result_t();
+    };
+
+    //a worker genotypes one chunk at a time
+    struct chunk_worker_t
+    {
+        std::vector<GVCFReader> *readers;//the readers given to the constructor for the first worker
+        std::vector<Normaliser *> normalisers;//one for each of the worker's threads
+        std::vector<ggutils::vcf_data_t *> scratch;
+        std::vector<StageClock *> clocks;
+        int index;//in _workers
+    };
+
+    chunk_result_t *Genotype(chunk_worker_t &worker, const ggutils::region_t &bound, int start, int end);
+    void ForEachSample(chunk_worker_t &worker,
+                       const std::function<void(size_t sample_index, size_t thread_index)> &f);
+
+    const std::vector<ggutils::region_t> *_site_regions;
+    std::vector<GVCFReader> &_readers;
+    Normaliser *_normaliser;
+    const SiteColumns &_columns;
+    RunStats *_stats;
+    size_t _num_samples;
+    std::vector<chunk_worker_t> _workers;
+    std::shared_ptr<spdlog::logger> _lg;
+};
+
+#endif //GVCFGENOTYPER_CHUNKGENOTYPER_HH
@@ -0,0 +1,248 @@
+#include "ChunkPlanner.hh"
+
+extern "C" {
+#include <htslib/bgzf.h>
+}
+
+ChunkPlanner::ChunkPlanner(const std::vector<std::string> &input_files, int bin_size)
+{
+    _bin_size = bin_size;
+    _total_bytes = 0;
+    _record = bcf_init1();
+    _lg = spdlog::get("gg_logger");
+    if (input_files.empty())
+    {
+        ggutils::die("no GVCFs to plan chunks for");
+    }
+    if (_bin_size < 1)
+    {
+        ggutils::die("--bin-size must be positive");
+    }
+    for (size_t i = 0; i < input_files.size(); i++)
+    {
+        _readers.push_back(new VcfReader(input_files[i]));
+        if (!_readers.back()->HasIndex())
+        {
+            ggutils::die(input_files[i] + " has no CSI/TBI index, plan needs indexed GVCFs");
+        }
+    }
+    _header = _readers[0]->GetHeader();
+
+    //bins for every contig (in the order of the first GVCF's header) that some GVCF has records for
+    std::set<std::string> indexed;
+    for (size_t i = 0; i < _readers.size(); i++)
+    {
+        auto names = _readers[i]->GetIndexedContigs();
+        indexed.insert(names.begin(), names.end());
+    }
+    const int max_end = std::numeric_limits<int>::max() - 1;
+    for (int rid = 0; rid < _header->n[BCF_DT_CTG]; rid++)
+    {
+        if (indexed.count(bcf_hdr_id2name(_header, rid)) == 0)
+        {
+            continue;
+        }
+        //contigs without a length in the header are one bin
+        long long length = (long long) _header->id[BCF_DT_CTG][rid].val->info[0];
+        long long start = 0;
+        do
+        {
+            bool last = length <= 0 || start + _bin_size >= length;
+            _bins.push_back({rid, (int) start, last ? max_end : (int) (start + _bin_size - 1), 0});
+            start += _bin_size;
+        } while (_bins.back().end != max_end);
+    }
+
+    for (size_t i = 0; i < _readers.size(); i++)
+    {
+        AddFile(*_readers[i]);
+        if (_lg != nullptr)
+        {
+            _lg->info("Read the index of {} ({}/{})", _readers[i]->GetFileName(), i + 1, _readers.size());
+        }
+    }
+}
+
+ChunkPlanner::~ChunkPlanner()
+{
+    for (auto it = _readers.begin(); it != _readers.end(); it++)
+    {
+        delete *it;
+    }
+    bcf_destroy(_record);
+}
+
+//adds one GVCF's bytes to each bin: the compressed bytes an indexed read of the bin goes through
+void ChunkPlanner::AddFile(VcfReader &reader)
+{
+    const std::string &fname = reader.GetFileName();
+    hts_idx_t *idx = reader.GetIndex();
+    vector<vector<hts_pair64_t> > chunks(_bins.size());
+    int rid = -1, tid = -1;
+    for (size_t b = 0; b < _bins.size(); b++)
+    {
+        if (_bins[b].rid != rid)
+        {
+            rid = _bins[b].rid;
+            tid = reader.GetIndexTid(bcf_hdr_id2name(_header, rid));
+        }
+        hts_itr_t *itr = tid < 0 ? nullptr : hts_itr_query(idx, tid, _bins[b].start, _bins[b].end + 1, nullptr);
+        if (itr != nullptr)
+        {
+            chunks[b].assign(itr->off, itr->off + itr->n_off);
+            hts_itr_destroy(itr);
+        }
+    }
+
+    //offsets within a block are uncompressed, they are scaled by the compression ratio of the first block with records
+    double ratio = 0;
+    for (size_t b = 0; b < _bins.size() && ratio == 0; b++)
+    {
+        if (!chunks[b].empty())
+        {
+            BGZF *fp = bgzf_open(fname.c_str(), "r");
+            if (fp == nullptr)
+            {
+                ggutils::die("problem opening " + fname);
+            }
+            if (bgzf_seek(fp, (int64_t) (chunks[b][0].u >> 16) << 16, SEEK_SET) == 0 && bgzf_read_block(fp) == 0 &&
+                fp->block_length > 0)
+            {
+                ratio = (double) fp->block_clength / fp->block_length;
+            }
+            bgzf_close(fp);
+            break;
+        }
+    }
+    auto compressed = [ratio](uint64_t offset)
+    {
+        return ((double) (offset >> 16) + (double) (offset & 0xFFFF) * ratio);
+    };
+    for (size_t b = 0; b < _bins.size(); b++)
+    {
+        for (auto it = chunks[b].begin(); it != chunks[b].end(); it++)
+        {
+            double bytes = std::max(0.0, compressed(it->v) - compressed(it->u));
+            _bins[b].bytes += bytes;
+            _total_bytes += bytes;
+        }
+    }
+}
+
+//moves pos (the first base of a chunk) right until no variant of any GVCF starts before it and ends at or after it
+int ChunkPlanner::SafeCut(int rid, int pos)
+{
+    std::vector<ggutils::region_t> region(1);
+    region[0].chrom = bcf_hdr_id2name(_header, rid);
+    bool moved = true;
+    while (moved)
+    {
+        moved = false;
+        region[0].start = region[0].end = pos - 1;
+        for (auto it = _readers.begin(); it != _readers.end(); it++)
+        {
+            if ((*it)->GetIndexTid(region[0].chrom) < 0 || (*it)->SetRegions(region) == 0)
+            {
+                continue;
+            }
+            while ((*it)->NextVariant(_record))
+            {
+                int end = _record->pos + _record->rlen - 1;
+                if (_record->pos < pos && end >= pos)
+                {
+                    pos = end + 1;
+                    moved = true;
+                }
+            }
+        }
+    }
+    return (pos);
+}
+
+std::vector<std::vector<ggutils::region_t> > ChunkPlanner::Plan(int num_chunks)
+{
+    if (num_chunks < 1)
+    {
+        ggutils::die("the number of chunks must be positive");
+    }
+    //cumulative[b] is the number of bytes before bin b
+    std::vector<double> cumulative(_bins.size() + 1, 0);
+    for (size_t b = 0; b < _bins.size(); b++)
+    {
+        cumulative[b + 1] = cumulative[b] + _bins[b].bytes;
+    }
+
+    //a cut is the bin a chunk starts in and its first base, the first chunk starts at bin 0
+    std::vector<std::pair<size_t, int> > cuts;
+    cuts.emplace_back(0, 0);
+    for (int k = 1; k < num_chunks; k++)
+    {
+        double target = _total_bytes * k / num_chunks;
+        size_t b = std::lower_bound(cumulative.begin(), cumulative.end(), target) - cumulative.begin();
+        if (b > 0 && target - cumulative[b - 1] < cumulative[b] - target)
+        {
+            b--;
+        }
+        //no cuts that would leave a chunk without data
+        if (b == 0 || b >= _bins.size() || cumulative[b] <= cumulative[cuts.back().first] ||
+            cumulative[b] >= _total_bytes)
+        {
+            continue;
+        }
+        int pos = _bins[b].start;
+        if (pos > 0)
+        {
+            pos = SafeCut(_bins[b].rid, pos);
+            //the cut may have moved into a later bin
+            while (b + 1 < _bins.size() && _bins[b + 1].rid == _bins[b].rid && _bins[b].end < pos)
+            {
+                b++;
+            }
+            if (_bins[b].end < pos)
+            {
+                //past the end of the contig, the chunk ends with it
+                if (++b >= _bins.size())
+                {
+                    continue;
+                }
+                pos = 0;
+            }
+        }
+        if (b > cuts.back().first || (b == cuts.back().first && pos > cuts.back().second))
+        {
+            cuts.emplace_back(b, pos);
+        }
+    }
+
+    std::vector<std::vector<ggutils::region_t> > chunks;
+    _chunk_bytes.clear();
+    for (size_t k = 0; k < cuts.size(); k++)
+    {
+        size_t first = cuts[k].first;
+        size_t last = k + 1 < cuts.size() ? cuts[k + 1].first : _bins.size() - 1;
+        int last_rid = _bins[last].rid;
+        std::vector<ggutils::region_t> regions;
+        for (size_t b = first; b <= last; b++)
+        {
+            if (b > first && _bins[b].rid == _bins[b - 1].rid)
+            {
+                continue;
+            }
+            ggutils::region_t r = {bcf_hdr_id2name(_header, _bins[b].rid), b == first ? cuts[k].second : 0,
+                                   std::numeric_limits<int>::max() - 1};
+            if (k + 1 < cuts.size() && _bins[b].rid == last_rid)
+            {
+                //ends just before the next chunk
+                if (cuts[k + 1].second == 0)
+                {
+                    continue;
+                }
+                r.end = cuts[k + 1].second - 1;
+            }
+            regions.push_back(r);
+        }
+        chunks.push_back(regions);
+        _chunk_bytes.push_back(cumulative[k + 1 < cuts.size() ? cuts[k + 1].first : _bins.size()] - cumulative[first]);
+    }
+    return (chunks);
+}
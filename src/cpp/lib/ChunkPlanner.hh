@@ -0,0 +1,59 @@
+//
+// gvcfgenotyper plan: splits the genome into chunks of similar work using the GVCF indices.
+//
+
+#ifndef GVCFGENOTYPER_CHUNKPLANNER_HH
+#define GVCFGENOTYPER_CHUNKPLANNER_HH
+
+#include <string>
+#include <vector>
+
+#include "VcfReader.hh"
+#include "ggutils.hh"
+#include "spdlog.h"
+
+//default width of the bins the cohort's compressed bytes are estimated for
+#define DEFAULT_PLAN_BIN_SIZE 1000000
+
+//Estimates how many compressed bytes the cohort has in each bin_size bin of the genome from the CSI/TBI index of
+//every GVCF (the chunks of the file the index would read for the bin), without reading any records. Chunks are
+//then cut at bin boundaries so each gets close to the same share of the bytes. A cut is moved right until no
+//variant of any GVCF spans it, so that merging each chunk with -r gives the same records as one run over all of them.
+//A chunk can contain several contigs, eg. the tail of one chromosome and a run of small alt contigs.
+class ChunkPlanner
+{
+public:
+    ChunkPlanner(const std::vector<std::string> &input_files, int bin_size = DEFAULT_PLAN_BIN_SIZE);
+    ~ChunkPlanner();
+
+    //up to num_chunks chunks in genome order, each a list of regions for -r. Fewer are returned when there
+    //are not enough bins with data.
+    std::vector<std::vector<ggutils::region_t> > Plan(int num_chunks);
+
+    double GetTotalBytes() const { return _total_bytes; }
+    //estimated compressed bytes of each chunk returned by the last Plan()
+    const std::vector<double> &GetChunkBytes() const { return _chunk_bytes; }
+    size_t GetNumBins() const { return _bins.size(); }
+
+private:
+    struct bin_t
+    {
+        int rid;
+        int start, end;
+        double bytes;
+    };
+
+    void AddFile(VcfReader &reader);
+    int SafeCut(int rid, int pos);
+
+    int _bin_size;
+    std::vector<VcfReader *> _readers;
+    bcf_hdr_t *_header;
+    std::vector<bin_t> _bins;
+    double _total_bytes;
+    std::vector<double> _chunk_bytes;
+    bcf1_t *_record;
+    std::shared_ptr<spdlog::logger> _lg;
+};
+
+#endif //GVCFGENOTYPER_CHUNKPLANNER_HH
@@ -0,0 +1,151 @@
+#include "ChunkScheduler.hh"
+
+#include <limits>
+
+ChunkScheduler::ChunkScheduler(const std::vector<ggutils::region_t> &bounds, int chunk_size, int num_workers,
+                               int min_split_size)
+{
+    if (chunk_size < 1 || num_workers < 1)
+    {
+        ggutils::die("ChunkScheduler needs a positive chunk size and at least one worker");
+    }
+    _bounds = bounds;
+    _queues.resize(num_workers);
+    _num_queued = 0;
+    _num_running = 0;
+    _capacity = (size_t) CHUNK_REORDER_BUFFER * num_workers;
+    _min_split_size = min_split_size;
+    _num_chunks = 0;
+    _num_steals = 0;
+    _num_splits = 0;
+    _max_pending = 0;
+
+    const int max_end = std::numeric_limits<int>::max() - 1;
+    for (size_t b = 0; b < _bounds.size(); b++)
+    {
+        //contigs without a length in the header are done in one go
+        long long size = _bounds[b].end == max_end ? (long long) max_end + 1 : chunk_size;
+        for (long long start = _bounds[b].start; start <= _bounds[b].end; start += size)
+        {
+            chunk_task_t task = {b, (int) start, (int) std::min((long long) _bounds[b].end, start + size - 1)};
+            _queues[_num_chunks++ % _queues.size()].push_back(task);
+        }
+    }
+    _num_queued = _num_chunks;
+    _next = chunk_key_t(0, _bounds.empty() ? 0 : _bounds[0].start);
+    Advance();
+}
+
+ChunkScheduler::~ChunkScheduler()
+{
+    for (auto it = _finished.begin(); it != _finished.end(); it++)
+    {
+        delete it->second.second;
+    }
+}
+
+bool ChunkScheduler::IsNext(const chunk_task_t &task) const
+{
+    return (task.bound == _next.first && task.start == _next.second);
+}
+
+bool ChunkScheduler::Splittable(const chunk_task_t &task) const
+{
+    return (_bounds[task.bound].end != std::numeric_limits<int>::max() - 1 &&
+            (long long) task.end - task.start + 1 >= 2LL * _min_split_size);
+}
+
+//moves _next past the ends of bounds
+void ChunkScheduler::Advance()
+{
+    while (_next.first < _bounds.size() && _next.second > _bounds[_next.first].end)
+    {
+        _next.first++;
+        _next.second = _next.first < _bounds.size() ? _bounds[_next.first].start : 0;
+    }
+}
+
+bool ChunkScheduler::Take(int worker, chunk_task_t &task)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (_num_queued > 0)
+    {
+        std::deque<chunk_task_t> *own = &_queues[worker], *earliest = nullptr;
+        for (auto it = _queues.begin(); it != _queues.end(); it++)
+        {
+            if (!it->empty() && (earliest == nullptr || it->front().bound < earliest->front().bound ||
+                                 (it->front().bound == earliest->front().bound &&
+                                  it->front().start < earliest->front().start)))
+            {
+                earliest = &(*it);
+            }
+        }
+        bool room = _finished.size() + _num_running < _capacity;
+        std::deque<chunk_task_t> *from = nullptr;
+        if (room && !own->empty())
+        {
+            from = own;
+        }
+        else if (room || IsNext(earliest->front()))
+        {
+            from = earliest;
+        }
+        if (from == nullptr)
+        {
+            _changed.wait(lock);
+            continue;
+        }
+
+        task = from->front();
+        from->pop_front();
+        _num_queued--;
+        if (from != own)
+        {
+            _num_steals++;
+            //the other workers are about to run out too, leave them the second half
+            if (_num_queued + 1 < _queues.size() && Splittable(task))
+            {
+                int mid = task.start + (int) (((long long) task.end - task.start + 1) / 2);
+                from->push_front({task.bound, mid, task.end});
+                task.end = mid - 1;
+                _num_queued++;
+                _num_chunks++;
+                _num_splits++;
+            }
+        }
+        _num_running++;
+        _max_pending = std::max(_max_pending, _finished.size() + _num_running);
+        return (true);
+    }
+    return (false);
+}
+
+void ChunkScheduler::Finish(const chunk_task_t &task, chunk_output_t *output)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _num_running--;
+    _finished[chunk_key_t(task.bound, task.start)] = std::make_pair(task, output);
+    _changed.notify_all();
+}
+
+chunk_output_t *ChunkScheduler::NextOutput(chunk_task_t &task)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (_next.first < _bounds.size())
+    {
+        auto it = _finished.find(_next);
+        if (it == _finished.end())
+        {
+            _changed.wait(lock);
+            continue;
+        }
+        task = it->second.first;
+        chunk_output_t *output = it->second.second;
+        _finished.erase(it);
+        _next.second = task.end + 1;
+        Advance();
+        _changed.notify_all();
+        return (output);
+    }
+    return (nullptr);
+}
@@ -0,0 +1,82 @@
+//
+// Hands the chunks of the sample-parallel engine to several workers and gives them back in genome order.
+//
+
+#ifndef GVCFGENOTYPER_CHUNKSCHEDULER_HH
+#define GVCFGENOTYPER_CHUNKSCHEDULER_HH
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "ggutils.hh"
+
+//chunks smaller than this are not split any further
+#define MIN_SPLIT_CHUNK_SIZE 20000
+//finished chunks (and chunks being worked on) that may wait to be written, per worker
+#define CHUNK_REORDER_BUFFER 2
+
+//start-end (inclusive) of bounds[bound]
+struct chunk_task_t
+{
+    size_t bound;
+    int start, end;
+};
+
+//whatever a worker made of a chunk, owned by the scheduler until NextOutput() returns it
+struct chunk_output_t
+{
+    virtual ~chunk_output_t() {}
+};
+
+//Each worker has a deque of chunks, dealt round robin in genome order so that every worker starts near the
+//front of the genome. A worker takes chunks from the front of its own deque. When that is empty it steals the
+//earliest chunk queued by another worker, and if fewer chunks are left than there are workers, the stolen chunk is
+//split in half so that the workers going idle at the end share the last (possibly dense) chunks.
+//Finished chunks go into a reorder buffer that NextOutput() empties in genome order. Workers wait before
+//starting a chunk while the buffer is full, except for the chunk that is written next, so at most
+//CHUNK_REORDER_BUFFER chunks per worker are held in memory however uneven the chunks are.
+//Chunks of bounds without a known end (INT_MAX-1, contigs without a length) are never split.
+class ChunkScheduler
+{
+public:
+    ChunkScheduler(const std::vector<ggutils::region_t> &bounds, int chunk_size, int num_workers,
+                   int min_split_size = MIN_SPLIT_CHUNK_SIZE);
+    ~ChunkScheduler();
+
+    //blocks until worker can start a chunk, returns false once there is none left
+    bool Take(int worker, chunk_task_t &task);
+    //hands a finished chunk to the reorder buffer, the scheduler deletes output if it is never returned
+    void Finish(const chunk_task_t &task, chunk_output_t *output);
+    //blocks until the next chunk in genome order is finished, returns nullptr after the last one
+    chunk_output_t *NextOutput(chunk_task_t &task);
+
+    const std::vector<ggutils::region_t> &GetBounds() const { return _bounds; }
+    size_t GetNumChunks() const { return _num_chunks; }
+    size_t GetNumSteals() const { return _num_steals; }
+    size_t GetNumSplits() const { return _num_splits; }
+    //the most chunks that were finished or being worked on but not yet written
+    size_t GetMaxPending() const { return _max_pending; }
+
+private:
+    typedef std::pair<size_t, int> chunk_key_t;//bound and start, the genome order of chunks
+
+    bool IsNext(const chunk_task_t &task) const;
+    bool Splittable(const chunk_task_t &task) const;
+    void Advance();
+
+    std::vector<ggutils::region_t> _bounds;
+    std::vector<std::deque<chunk_task_t> > _queues;
+    std::map<chunk_key_t, std::pair<chunk_task_t, chunk_output_t *> > _finished;
+    chunk_key_t _next;//chunk that NextOutput returns next
+    size_t _num_queued, _num_running;
+    size_t _capacity;
+    int _min_split_size;
+    size_t _num_chunks, _num_steals, _num_splits, _max_pending;
+    std::mutex _mutex;
+    std::condition_variable _changed;
+};
+
+#endif //GVCFGENOTYPER_CHUNKSCHEDULER_HH
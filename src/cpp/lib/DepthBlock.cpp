@@ -15,6 +15,30 @@ DepthBlock::DepthBlock(int rid, int start, int end, int dp, int dpf, int gq, int
     assert(end >= start);
 }
 
+DepthBlock::DepthBlock(bcf_hdr_t *header, bcf1_t *record)
+: _rid(record->rid), _start(record->pos)
+{
+    _end = ggutils::get_end_of_gvcf_block(header, record);
+    _ploidy = ggutils::get_ploidy(header, record);
+    ggutils::bcf1_get_one_format_int(header, record, "DP", _dp);
+    //If the record has FORMAT/GQ, use that, otherwise take FORMAT/GQX (illumina gvcf quirk).
+    int status = ggutils::bcf1_get_one_format_int(header, record, "GQ", _gq);
+    if (status != 1)
+    {
+        float tmp;
+        status = ggutils::bcf1_get_one_format_float(header, record, "GQ", tmp);
+        if (status == 1)
+            _gq = bcf_float_is_missing(tmp) ? 0 : (int32_t) tmp; //replace missing values with 0
+        if (status != 1)
+            status = ggutils::bcf1_get_one_format_int(header, record, "GQX", _gq);
+        if (status != 1)
+            ggutils::die("no FORMAT/GQ found");
+    }
+    _gq = _gq == bcf_int32_missing ? 0 : _gq; //replace missing values with 0
+    ggutils::bcf1_get_one_format_int(header, record, "DPF", _dpf);
+    assert(_end >= _start);
+}
+
 void DepthBlock::SetToMissing()
 {
     _dp = _gq = _dpf = bcf_int32_missing;
@@ -103,4 +127,4 @@ DepthBlock DepthBlock::Intersect(int rid, int start, int end)
     return {_rid, max(_start, start), min(end, _end), _dp, _dpf, _gq, _ploidy};
 }
 
-int DepthBlock::ploidy() {return _ploidy;}
+int DepthBlock::ploidy() const {return _ploidy;}
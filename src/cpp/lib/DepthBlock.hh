@@ -19,6 +19,9 @@ public:
 
     DepthBlock(int rid, int start, int end, int dp, int dpf, int gq,int ploidy);
 
+    //decodes DP/DPF/GQ (or GQX) and ploidy from a single sample GVCF line
+    DepthBlock(bcf_hdr_t *header, bcf1_t *record);
+
     inline bool operator == (const DepthBlock& db) const {
         return (_rid==db._rid &&
                 _start==db._start &&
@@ -45,7 +48,7 @@ public:
     int dp() const { return _dp; }
     int gq() const { return _gq; }
     int dpf() const { return _dpf; }
-    int ploidy();
+    int ploidy() const;
     int size() const;
 
 private:
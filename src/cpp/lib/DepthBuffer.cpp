@@ -1,85 +1,353 @@
 #include "GVCFReader.hh"
 
+DepthBuffer::DepthBuffer()
+: _num_popped(0), _capacity(0), _head(0), _size(0), _header(nullptr), _dp_id(-1), _dpf_id(-1), _gq_id(-1),
+  _gqx_id(-1), _gt_id(-1), _end_id(-1), _gq_is_float(false), _allow_gap(false)
+{
+    Grow();
+}
+
+DepthBuffer::~DepthBuffer()
+{
+}
+
+static uint16_t pack_value(int value)
+{
+    if (value == bcf_int32_missing || value < 0)
+    {
+        return (DEPTH_MISSING);
+    }
+    return ((uint16_t) std::min(value, DEPTH_MAX_VALUE));
+}
+
+static int unpack_value(uint16_t value)
+{
+    return (value == DEPTH_MISSING ? bcf_int32_missing : value);
+}
+
+void DepthBuffer::Store(size_t slot, const DepthBlock &db)
+{
+    _start[slot] = (uint32_t) db.start();
+    _length[slot] = (uint32_t) (db.end() - db.start());
+    _dp[slot] = pack_value(db.dp());
+    _dpf[slot] = pack_value(db.dpf());
+    _gq[slot] = pack_value(db.gq());
+    int ploidy = db.ploidy() + DEPTH_PLOIDY_OFFSET;
+    _ploidy[slot] = (uint8_t) std::max(0, std::min(ploidy, 15));
+}
+
+DepthBlock DepthBuffer::At(size_t index) const
+{
+    size_t slot = Slot(index);
+    return {GetRid(index), (int) _start[slot], (int) (_start[slot] + _length[slot]), unpack_value(_dp[slot]),
+            unpack_value(_dpf[slot]), unpack_value(_gq[slot]), _ploidy[slot] - DEPTH_PLOIDY_OFFSET};
+}
+
+int DepthBuffer::GetRid(size_t index) const
+{
+    uint64_t seq = _num_popped + index;
+    size_t run = 0;
+    while (run + 1 < _contigs.size() && _contigs[run + 1].seq <= seq)
+    {
+        run++;
+    }
+    return (_contigs[run].rid);
+}
+
+int DepthBuffer::IntersectSize(size_t index, int rid, int start, int end) const
+{
+    int block_start = GetStart(index), block_end = GetEnd(index);
+    if (GetRid(index) != rid || block_end < start || block_start > end)
+    {
+        return (0);
+    }
+    return (min(end, block_end) - max(block_start, start) + 1);
+}
+
+//the first block that is not before rid:start. Blocks on a contig do not overlap and are in order, so each run of
+//blocks on a contig is binary searched for the first block ending at or after start.
+size_t DepthBuffer::Find(int rid, int start) const
+{
+    for (size_t run = 0; run < _contigs.size(); run++)
+    {
+        size_t first = run == 0 ? 0 : _contigs[run].seq - _num_popped;
+        size_t end = run + 1 < _contigs.size() ? _contigs[run + 1].seq - _num_popped : _size;
+        if (_contigs[run].rid < rid)
+        {
+            continue;
+        }
+        size_t last = end;
+        while (first < last)
+        {
+            size_t middle = first + (last - first) / 2;
+            if (GetEnd(middle) < start)
+            {
+                first = middle + 1;
+            }
+            else
+            {
+                last = middle;
+            }
+        }
+        if (first < end)
+        {
+            return (first);
+        }
+    }
+    return (_size);
+}
+
 //interpolates depth for a given interval a<=x<b
 //returns 0 on success and -1 if the buffer didnt contain the interval
+//The blocks are combined one after the other with DepthBlock::Add, whose length weighted averages are rounded at
+//every step, so that the values are the same as they have always been.
 int DepthBuffer::Interpolate(const int rid, const int start, const int stop, DepthBlock &db)
 {
     db.SetToMissing();
-    auto dp_ptr = _buffer.begin();
-    while (dp_ptr != _buffer.end() && (dp_ptr->end() < start || dp_ptr->rid() < rid))
-    {
-        dp_ptr++;
-    }
-
-    if (dp_ptr == _buffer.end())
+    size_t index = Find(rid, start);
+    if (index == _size)
     {
         return (-1);
     }
 
-    db = dp_ptr->Intersect(rid, start, stop);
-    dp_ptr++;
-    while (dp_ptr != _buffer.end() && dp_ptr->IntersectSize(rid, start, stop) > 0)
+    db = At(index).Intersect(rid, start, stop);
+    index++;
+    while (index < _size && IntersectSize(index, rid, start, stop) > 0)
     {
-        db.Add(dp_ptr->Intersect(rid, start, stop));
-        dp_ptr++;
+        db.Add(At(index).Intersect(rid, start, stop));
+        index++;
     }
     return (0);
 }
 
-void DepthBuffer::push_back(const DepthBlock& db)
+bool DepthBuffer::Append(const DepthBlock& db)
 {
     //sanity check on value being pushed
-    if (!(_buffer.empty() || db.rid() != _buffer.back().rid() || db.start() == (1 + _buffer.back().end()) ||
-          db.start() == _buffer.back().end()))
+    bool allow_gap = _allow_gap;
+    _allow_gap = false;
+    int back_rid = _size > 0 ? _contigs.back().rid : 0, back_end = _size > 0 ? GetEnd(_size - 1) : 0;
+    if (!(_size == 0 || (allow_gap && db.start() > back_end) || db.rid() != back_rid || db.start() == (1 + back_end) ||
+          db.start() == back_end))
     {
-        if (!_buffer.empty())
+        if (_size > 0)
         {
-            std::cerr << _buffer.back().rid() << ":" << _buffer.back().start() + 1 << "-" << _buffer.back().end() + 1 << "   ->   ";
+            std::cerr << back_rid << ":" << GetStart(_size - 1) + 1 << "-" << back_end + 1 << "   ->   ";
             std::cerr << db.rid() << ":" << db.start() + 1 << "-" << db.end() + 1 << std::endl;
             
         }
         ggutils::die("non-contiguous homozygous reference blocks. Is this an Illumina GVCF?");
     }
 
-    if (_buffer.empty() || db.rid() > _buffer.back().rid() || db.start() > _buffer.back().end())
+    if (_size == 0 || db.rid() > back_rid || db.start() > back_end)
+    {
+        if (_size == _capacity)
+        {
+            Grow();
+        }
+        if (_contigs.empty() || db.rid() != back_rid)
+        {
+            _contigs.push_back({_num_popped + _size, db.rid()});
+        }
+        Store(Slot(_size++), db);
+        return (true);
+    }
+    return (false);
+}
+
+//the arrays are laid out again from slot 0 with twice the room
+template<typename T>
+static void grow_ring(std::vector<T> &ring, size_t head, size_t size, size_t capacity)
+{
+    std::vector<T> grown(capacity);
+    for (size_t index = 0; index < size; index++)
     {
-        _buffer.push_back(std::move(db));
+        grown[index] = ring[(head + index) & (ring.size() - 1)];
     }
+    ring.swap(grown);
 }
 
-int DepthBuffer::FlushBuffer(const int rid, const int pos)
+void DepthBuffer::Grow()
 {
-    int num_flushed = 0;
-    while (!_buffer.empty() && _buffer.front().rid() < rid)
+    size_t capacity = std::max((size_t) DEPTH_BUFFER_MIN_CAPACITY, 2 * _capacity);
+    if (_capacity == 0)
     {
-        _buffer.pop_front();
-        num_flushed++;
+        _start.resize(capacity);
+        _length.resize(capacity);
+        _dp.resize(capacity);
+        _dpf.resize(capacity);
+        _gq.resize(capacity);
+        _ploidy.resize(capacity);
     }
-    while (!_buffer.empty() && _buffer.front().end() < pos && _buffer.front().rid() == rid)
+    else
     {
-        _buffer.pop_front();
-        num_flushed++;
+        grow_ring(_start, _head, _size, capacity);
+        grow_ring(_length, _head, _size, capacity);
+        grow_ring(_dp, _head, _size, capacity);
+        grow_ring(_dpf, _head, _size, capacity);
+        grow_ring(_gq, _head, _size, capacity);
+        grow_ring(_ploidy, _head, _size, capacity);
     }
-    return (num_flushed);
+    _capacity = capacity;
+    _head = 0;
 }
 
-int DepthBuffer::FlushBuffer()
+void DepthBuffer::push_back(const DepthBlock& db)
 {
-    int num_flushed=_buffer.size();
-    _buffer.clear();
-    return num_flushed;
+    Append(db);
+}
+
+//id of a FORMAT/INFO tag declared in header, -1 if it is not
+static int tag_id(bcf_hdr_t *header, int type, const char *tag)
+{
+    int id = bcf_hdr_id2int(header, BCF_DT_ID, tag);
+    return (bcf_hdr_idinfo_exists(header, type, id) ? id : -1);
+}
+
+void DepthBuffer::SetHeader(bcf_hdr_t *header)
+{
+    _header = header;
+    _dp_id = tag_id(header, BCF_HL_FMT, "DP");
+    _dpf_id = tag_id(header, BCF_HL_FMT, "DPF");
+    _gq_id = tag_id(header, BCF_HL_FMT, "GQ");
+    _gqx_id = tag_id(header, BCF_HL_FMT, "GQX");
+    _gt_id = tag_id(header, BCF_HL_FMT, "GT");
+    _end_id = tag_id(header, BCF_HL_INFO, "END");
+    _gq_is_float = _gq_id >= 0 && bcf_hdr_id2type(header, BCF_HL_FMT, _gq_id) == BCF_HT_REAL;
+    //tags of another type are treated as absent, as bcf_get_format_int32 does
+    if (_gq_id >= 0 && !_gq_is_float && bcf_hdr_id2type(header, BCF_HL_FMT, _gq_id) != BCF_HT_INT) _gq_id = -1;
+    if (_dp_id >= 0 && bcf_hdr_id2type(header, BCF_HL_FMT, _dp_id) != BCF_HT_INT) _dp_id = -1;
+    if (_dpf_id >= 0 && bcf_hdr_id2type(header, BCF_HL_FMT, _dpf_id) != BCF_HT_INT) _dpf_id = -1;
+    if (_gqx_id >= 0 && bcf_hdr_id2type(header, BCF_HL_FMT, _gqx_id) != BCF_HT_INT) _gqx_id = -1;
+}
+
+//the FORMAT value of the record's one sample for tag id, false if the record does not have it. Integers are
+//widened as bcf_get_format_int32 does and floats are read as bcf_get_format_float does.
+static bool format_int(bcf1_t *record, int id, int32_t &value)
+{
+    bcf_fmt_t *fmt = id >= 0 ? bcf_get_fmt_id(record, id) : nullptr;
+    if (fmt == nullptr || fmt->p == nullptr)
+    {
+        return (false);
+    }
+    if (fmt->n > 1)
+    {
+        ggutils::die("more than one value of a FORMAT field of a reference block");
+    }
+    switch (fmt->type)
+    {
+        case BCF_BT_INT8:
+        {
+            int8_t v = *(int8_t *) fmt->p;
+            value = v == bcf_int8_missing ? bcf_int32_missing : (v == bcf_int8_vector_end ? bcf_int32_vector_end : v);
+            break;
+        }
+        case BCF_BT_INT16:
+        {
+            int16_t v = *(int16_t *) fmt->p;
+            value = v == bcf_int16_missing ? bcf_int32_missing : (v == bcf_int16_vector_end ? bcf_int32_vector_end : v);
+            break;
+        }
+        case BCF_BT_INT32:
+            value = *(int32_t *) fmt->p;
+            break;
+        default:
+            ggutils::die("unexpected type of a FORMAT field of a reference block");
+    }
+    return (true);
+}
+
+static bool format_float(bcf1_t *record, int id, float &value)
+{
+    bcf_fmt_t *fmt = id >= 0 ? bcf_get_fmt_id(record, id) : nullptr;
+    if (fmt == nullptr || fmt->p == nullptr)
+    {
+        return (false);
+    }
+    if (fmt->n > 1 || fmt->type != BCF_BT_FLOAT)
+    {
+        ggutils::die("unexpected FORMAT/GQ of a reference block");
+    }
+    memcpy(&value, fmt->p, sizeof(float));
+    return (true);
+}
+
+void DepthBuffer::push_back(bcf_hdr_t *header, bcf1_t *record)
+{
+    //the tags are looked up once per header rather than once per line
+    if (header != _header)
+    {
+        SetHeader(header);
+    }
+    int32_t dp, dpf, gq;
+    //lines without FORMAT/DP (eg. strelka indel records, which have FORMAT/DPI) do not describe depth
+    if (!format_int(record, _dp_id, dp))
+    {
+        return;
+    }
+    if (!format_int(record, _dpf_id, dpf))
+    {
+        dpf = bcf_int32_missing;
+    }
+    //If the record has FORMAT/GQ, use that, otherwise take FORMAT/GQX (illumina gvcf quirk).
+    float float_gq;
+    if (_gq_is_float && format_float(record, _gq_id, float_gq))
+    {
+        gq = bcf_float_is_missing(float_gq) ? 0 : (int32_t) float_gq; //replace missing values with 0
+    }
+    else if (!(!_gq_is_float && format_int(record, _gq_id, gq)) && !format_int(record, _gqx_id, gq))
+    {
+        ggutils::die("no FORMAT/GQ found");
+    }
+    gq = gq == bcf_int32_missing ? 0 : gq; //replace missing values with 0
+    //the number of GT values, or bcf_get_genotypes' error code
+    int ploidy = -1;
+    if (_gt_id >= 0)
+    {
+        bcf_fmt_t *gt = bcf_get_fmt_id(record, _gt_id);
+        ploidy = bcf_hdr_id2type(header, BCF_HL_FMT, _gt_id) != BCF_HT_STR ? -2 :
+                 (gt == nullptr || gt->p == nullptr ? -3 : gt->n);
+    }
+    Append(DepthBlock(record->rid, record->pos, ggutils::get_end_of_gvcf_block(record, _end_id), dp, dpf, gq,
+                      ploidy));
+}
+
+void DepthBuffer::PopFront()
+{
+    _head = Slot(1);
+    _size--;
+    _num_popped++;
+    while (_contigs.size() > 1 && _contigs[1].seq <= _num_popped)
+    {
+        _contigs.pop_front();
+    }
+    if (_size == 0)
+    {
+        _contigs.clear();
+    }
 }
 
-DepthBlock *DepthBuffer::Back()
+int DepthBuffer::FlushBuffer(const int rid, const int pos)
 {
-    if (_buffer.empty())
+    int num_flushed = 0;
+    while (_size > 0 && _contigs.front().rid < rid)
     {
-        return (nullptr);
+        PopFront();
+        num_flushed++;
     }
-    return (&_buffer.back());
+    while (_size > 0 && GetEnd(0) < pos && _contigs.front().rid == rid)
+    {
+        PopFront();
+        num_flushed++;
+    }
+    return (num_flushed);
 }
 
-size_t DepthBuffer::size()
+int DepthBuffer::FlushBuffer()
 {
-    return (_buffer.size());
+    int num_flushed = _size;
+    while (_size > 0)
+    {
+        PopFront();
+    }
+    return num_flushed;
 }
@@ -11,32 +11,86 @@ extern "C" {
 
 #include "DepthBlock.hh"
 
+//blocks the ring has room for before it first grows
+#define DEPTH_BUFFER_MIN_CAPACITY 16
+//DP, DPF and GQ are stored as uint16, larger values are stored as DEPTH_MAX_VALUE and missing ones as DEPTH_MISSING
+#define DEPTH_MAX_VALUE 0xfffe
+#define DEPTH_MISSING 0xffff
+//ploidy is stored in a nibble offset by this much, which keeps bcf_get_genotypes' error codes (-1 to -3)
+#define DEPTH_PLOIDY_OFFSET 3
+
+//The homref blocks of one GVCF, in order. Blocks are packed into a ring of parallel arrays (start, length, DP,
+//DPF, GQ and ploidy), the contig is stored once for each run of blocks on it. Blocks are handed out as DepthBlock values, which are no longer valid references into the buffer.
 class DepthBuffer
 {
 public:
-    DepthBuffer()
-    {};
+    DepthBuffer();
 
-    ~DepthBuffer()
-    {};
+    ~DepthBuffer();
 
-    // performs additional check on db, if passed moves db into internal buffer
-    // which invalidates db
+    // performs additional check on db, if passed copies db into the buffer
     void push_back(const DepthBlock& db);
 
-    DepthBlock *Pop();
-    DepthBlock *Back();
-    DepthBlock *Front();
-    DepthBlock Intersect(const DepthBlock &db);
+    // buffers the block of a GVCF line with FORMAT/DP, the same block as DepthBlock(header, record) but with the
+    // tags looked up once per header and their values read in place
+    void push_back(bcf_hdr_t *header, bcf1_t *record);
+
+    //the next block pushed may start after a gap, used when the reader jumps to a new region
+    void AllowGap() { _allow_gap = true; }
+
+    //position of the index'th buffered block
+    int GetRid(size_t index) const;
+    int GetStart(size_t index) const { return ((int) _start[Slot(index)]); }
+    int GetEnd(size_t index) const
+    {
+        size_t slot = Slot(index);
+        return ((int) (_start[slot] + _length[slot]));
+    }
+    //index'th buffered block
+    DepthBlock At(size_t index) const;
     int FlushBuffer();
     int FlushBuffer(const int rid, const int pos);
     int Interpolate(const int rid, const int start, const int end, DepthBlock &db);//interpolates depth for an interval a<=x<
 
     //accessors/mutators
-    size_t size();
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    //bytes of the ring
+    size_t GetBytes() const
+    {
+        return (_capacity * (2 * sizeof(uint32_t) + 3 * sizeof(uint16_t) + sizeof(uint8_t)) +
+                _contigs.size() * sizeof(contig_run_t));
+    }
 
 private:
-    deque<DepthBlock> _buffer;
+    //the blocks from the seq'th block ever pushed up to the next run are on contig rid
+    struct contig_run_t
+    {
+        uint64_t seq;
+        int rid;
+    };
+
+    size_t Slot(size_t index) const { return (_head + index) & (_capacity - 1); }
+    bool Append(const DepthBlock &db);
+    void Store(size_t slot, const DepthBlock &db);
+    void SetHeader(bcf_hdr_t *header);
+    //index of the first block Interpolate uses for rid:start, size() if there is none
+    size_t Find(int rid, int start) const;
+    int IntersectSize(size_t index, int rid, int start, int end) const;
+    void Grow();
+    void PopFront();
+
+    std::deque<contig_run_t> _contigs;
+    uint64_t _num_popped;//seq of the front block
+    size_t _capacity, _head, _size;//the index'th block is in slot (_head + index) % _capacity
+    std::vector<uint32_t> _start, _length;//length is end - start
+    std::vector<uint16_t> _dp, _dpf, _gq;
+    std::vector<uint8_t> _ploidy;
+    bcf_hdr_t *_header;
+    //FORMAT/DP, DPF, GQ, GQX and GT and INFO/END in _header, -1 if it does not have them
+    int _dp_id, _dpf_id, _gq_id, _gqx_id, _gt_id, _end_id;
+    bool _gq_is_float;//FORMAT/GQ is declared as a Float (illumina gvcf quirk)
+    bool _allow_gap;
 };
 
 #endif //GVCFGENOTYPER_DEPTHBUFFER_HH
@@ -1,8 +1,10 @@
 #include "GVCFMerger.hh"
 #include "ggutils.hh"
+#include "Trace.hh"
 #include <htslib/hts.h>
 #include <htslib/vcf.h>
 
+#include <set>
 #include <unordered_map>
 
 extern "C" {
@@ -11,10 +13,22 @@ extern "C" {
 
 //#define DEBUG
 
+//site intervals closer than this are read in one go by the second pass of --two-pass
+#define SITE_MERGE_DISTANCE 1000
+
 GVCFMerger::~GVCFMerger()
 {
+    //the read threads have to stop before the readers are deleted
+    delete _read_ahead;
     delete _normaliser;
-    hts_close(_output_file);
+    delete _blocks;
+    delete _columns;
+    delete _stats;
+    delete _progress_meter;
+    for (auto it = _sinks.begin(); it != _sinks.end(); it++)
+    {
+        delete *it;
+    }
     bcf_hdr_destroy(_output_header);
     delete _format;
     free(_info_adf);
@@ -31,51 +45,249 @@ GVCFMerger::GVCFMerger(const vector<string> &input_files,
                        const string &region /*= ""*/,
                        const int is_file /*= 0*/,
                        bool ignore_non_matching_ref,
-                       bool force_samples)
+                       bool force_samples,
+                       int two_pass,
+                       bool local_alleles,
+                       bool gvcf_output,
+                       bool sites_only)
 {    
     _force_samples = force_samples;
     _has_pl = true;
     _has_strand_ad=true;
     _num_variants=0;
     _normaliser = new Normaliser(reference_genome,ignore_non_matching_ref);
+    _reference_genome = reference_genome;
+    _ignore_non_matching_ref = ignore_non_matching_ref;
+    _region = region;
+    _is_file = is_file;
+    _num_threads = 1;
+    _chunk_size = 0;
+    _chunk_workers = 1;
+    _input_files = input_files;
+    _buffer_size = buffer_size;
+    _read_threads = 0;
+    _batch_sites = 0;
+    _read_ahead = nullptr;
+    _stats = nullptr;
+    _stats_interval = STATS_INTERVAL;
+    _progress_meter = nullptr;
+    _progress_interval = PROGRESS_INTERVAL;
+    _progress_stderr = false;
+    _memory_budget = 0;
+    _max_memory = 0;
+    _num_adapt_sites = 0;
+    _logged_buffer_size = 0;
+    _records_published = 0;
+    _local_alleles = local_alleles;
+    _sites_only = sites_only;
+    _write_index = false;
+    _blocks = nullptr;
     _num_gvcfs = input_files.size();
     _readers.reserve(_num_gvcfs);
 
     // retrieve logger from factory
     _lg = spdlog::get("gg_logger");
     assert(_lg!=nullptr);
+    _seek = two_pass != TWO_PASS_OFF && PlanSites(input_files, region, is_file, two_pass, _site_regions);
+
+    //the output header (samples and contigs) comes from the GVCFs' headers, the readers then number their records'
+    //contigs as the output does
+    vector<VcfReader *> files;
+    for (size_t i = 0; i < _num_gvcfs; i++)
+    {
+        files.push_back(new VcfReader(input_files[i]));
+    }
+    BuildHeader(files, gvcf_output);
     _lg->info("Input GVCFs:");
     for (size_t i = 0; i < _num_gvcfs; i++)
     {
         _lg->info("Opened {} {}/{}",input_files[i],(i+1),_num_gvcfs);
-        _readers.emplace_back(input_files[i], _normaliser, buffer_size, region, is_file);
+        _readers.emplace_back(files[i], _normaliser, buffer_size, region, is_file,
+                              _seek ? &_site_regions : nullptr, _output_header);
         _has_pl &= _readers.back().HasPl();
         _has_strand_ad &= _readers.back().HasStrandAd();
     }
     assert(_readers.size() == _num_gvcfs);
-
-    _output_file = hts_open(!output_filename.empty() ? output_filename.c_str() : "-", ("w" + output_mode).c_str());
-
-    if (!_output_file)
+    //each reader warns about contigs it does not have, but with none at all the output would silently be empty
+    if (!region.empty())
     {
-        ggutils::die("problem opening output file: " + output_filename);
+        vector<ggutils::region_t> regions;
+        is_file ? ggutils::read_regions_file(region, regions) : ggutils::parse_regions(region, regions);
+        bool found = false;
+        for (auto it = regions.begin(); it != regions.end() && !found; it++)
+        {
+            found = bcf_hdr_name2id(_output_header, it->chrom.c_str()) >= 0;
+        }
+        if (!found)
+        {
+            ggutils::die("none of the contigs in " + region + " are in the header of any input GVCF");
+        }
     }
 
     size_t n_allele = 2;
-    _format = new ggutils::vcf_data_t(2,2,_num_gvcfs);
+    _format = new ggutils::vcf_data_t(2,2,_num_gvcfs,_local_alleles);
 
     _info_adf = (int32_t *) malloc(n_allele * sizeof(int32_t));
     _info_adr = (int32_t *) malloc(n_allele * sizeof(int32_t));
     _info_ac = (int32_t *) malloc(n_allele * sizeof(int32_t));
 
-    BuildHeader();
-    _record_collapser.Init(_output_header);
+    _sinks.push_back(new OutputSink(output_filename, output_mode, _output_header, sites_only));
+    _record_collapser.Init(_output_header, false);
     _output_record = bcf_init1();
 
     _num_ps_written = 0;
     _mean_weighted_mq = 0;
     _sum_mq_weights = 0;
     _max_alleles = INT32_MAX;
+
+    _columns = new SiteColumns(_output_header, _num_gvcfs, _local_alleles);
+    if (gvcf_output)
+    {
+        _blocks = new ReferenceBlockWriter(reference_genome, _output_header, _num_gvcfs, region, is_file);
+    }
+}
+
+void GVCFMerger::AddOutput(const string &output_filename, const string &output_mode, bool sites_only,
+                           const vector<string> &samples)
+{
+    _sinks.push_back(new OutputSink(output_filename, output_mode, _output_header, sites_only, samples));
+    _sites_only &= sites_only;
+    if (_write_index)
+    {
+        _sinks.back()->BuildIndex();
+    }
+}
+
+void GVCFMerger::SetWriteIndex()
+{
+    _write_index = true;
+    for (auto it = _sinks.begin(); it != _sinks.end(); it++)
+    {
+        (*it)->BuildIndex();
+    }
+}
+
+void GVCFMerger::SetStatsInterval(int interval)
+{
+    if (interval < 0)
+    {
+        ggutils::die("GVCFMerger::SetStatsInterval needs a non-negative number of seconds");
+    }
+    _stats_interval = interval;
+}
+
+void GVCFMerger::SetStatsJson(const string &fname)
+{
+    _stats_json = fname;
+}
+
+void GVCFMerger::SetProgress(int interval, bool to_stderr)
+{
+    if (interval < 0)
+    {
+        ggutils::die("GVCFMerger::SetProgress needs a non-negative number of seconds");
+    }
+    _progress_interval = interval;
+    _progress_stderr = to_stderr;
+}
+
+void GVCFMerger::SetMemoryBudget(size_t bytes)
+{
+    _memory_budget = bytes;
+}
+
+void GVCFMerger::SetMaxMemory(size_t bytes)
+{
+    _max_memory = bytes;
+    if (_max_memory > 0)
+    {
+        //windows start small and grow once the readers have shown how much they buffer per bp
+        _buffer_size = MIN_ADAPTIVE_BUFFER_SIZE;
+        for (size_t i = 0; i < _num_gvcfs; i++)
+        {
+            _readers[i].SetBufferSize(_buffer_size);
+        }
+    }
+}
+
+int GVCFMerger::GetAdaptiveBufferSize(double budget, size_t num_readers, double bytes_per_record,
+                                      double records_per_bp)
+{
+    double bytes_per_bp = bytes_per_record * records_per_bp;
+    if (budget <= 0 || num_readers == 0 || bytes_per_bp <= 0)
+    {
+        return (budget > 0 ? MAX_ADAPTIVE_BUFFER_SIZE : MIN_ADAPTIVE_BUFFER_SIZE);
+    }
+    double window = budget / num_readers / bytes_per_bp;
+    return ((int) std::max((double) MIN_ADAPTIVE_BUFFER_SIZE, std::min((double) MAX_ADAPTIVE_BUFFER_SIZE, window)));
+}
+
+void GVCFMerger::AdaptBufferSize(size_t num_sites)
+{
+    _num_adapt_sites += num_sites;
+    if (_max_memory == 0 || _num_adapt_sites < ADAPTIVE_BUFFER_SITES)
+    {
+        return;
+    }
+    _num_adapt_sites = 0;
+    //only readers in the middle of a contig say how much a bp of window costs
+    double bytes = 0, records = 0, span = 0;
+    for (size_t i = 0; i < _num_gvcfs; i++)
+    {
+        int reader_span = _readers[i].GetBufferedSpan();
+        if (reader_span > 0)
+        {
+            bytes += _readers[i].GetBufferedBytes();
+            records += _readers[i].GetNumBufferedRecords();
+            span += reader_span;
+        }
+    }
+    if (records == 0)
+    {
+        return;
+    }
+    //headers and indexes stay for the whole run
+    MemoryStats *memory = _stats->GetMemory();
+    double budget = _max_memory * ADAPTIVE_BUFFER_FRACTION - memory->GetBytes(MEM_HEADERS) -
+                    memory->GetBytes(MEM_INDEXES);
+    _buffer_size = GetAdaptiveBufferSize(budget, _num_gvcfs, bytes / records, records / span);
+    for (size_t i = 0; i < _num_gvcfs; i++)
+    {
+        _readers[i].SetBufferSize(_buffer_size);
+    }
+    if (_buffer_size > 2 * _logged_buffer_size || 2 * _buffer_size < _logged_buffer_size)
+    {
+        _lg->info("Reader windows are {} bp ({:.0f} bytes per buffered record, {:.3f} records per bp of each GVCF)",
+                  _buffer_size, bytes / records, records / span);
+        _logged_buffer_size = _buffer_size;
+    }
+}
+
+void GVCFMerger::SetReferenceBands(int dp_band, int gq_band)
+{
+    if (_blocks == nullptr)
+    {
+        ggutils::die("reference bands are only used with gvcf output");
+    }
+    _blocks->SetBands(dp_band, gq_band);
+}
+
+//first pass of --two-pass, fills site_regions and returns true if the readers should seek to them
+bool GVCFMerger::PlanSites(const vector<string> &input_files, const string &region, const int is_file, int two_pass,
+                           vector<ggutils::region_t> &site_regions)
+{
+    _lg->info("Scanning GVCFs for variant sites");
+    SiteUnion sites(_normaliser, region, is_file);
+    for (size_t i = 0; i < input_files.size(); i++)
+    {
+        sites.Add(input_files[i]);
+    }
+    site_regions = sites.GetRegions(SITE_MERGE_DISTANCE);
+    bool seek = two_pass == TWO_PASS_ALWAYS || sites.ShouldSeek(site_regions.size());
+    _lg->info("Found {} site intervals in {} lines, {} regions to seek. {}", sites.GetNumSites(),
+              sites.GetNumLinesScanned(), site_regions.size(),
+              seek ? "Seeking to sites." : "Streaming GVCFs.");
+    return (seek);
 }
 
 int GVCFMerger::GetNextVariant()
@@ -130,7 +342,11 @@ void GVCFMerger::SetOutputBuffersToMissing(int num_alleles)
 {
     _format->resize(num_alleles);
     _format->set_missing();
+    ResetInfoBuffers(num_alleles);
+}
 
+void GVCFMerger::ResetInfoBuffers(int num_alleles)
+{
     _info_adf = (int32_t *) realloc(_info_adf, num_alleles * sizeof(int32_t));
     _info_adr = (int32_t *) realloc(_info_adr, num_alleles * sizeof(int32_t));
     _info_ac = (int32_t *) realloc(_info_ac, num_alleles * sizeof(int32_t));
@@ -141,78 +357,17 @@ void GVCFMerger::SetOutputBuffersToMissing(int num_alleles)
 
 }
 
-void GVCFMerger::GenotypeHomrefVariant(int sample_index, DepthBlock &homref_block)
-{
-    int num_pl_per_sample = ggutils::get_number_of_likelihoods(2,_output_record->n_allele);
-    int num_pl_in_this_sample = ggutils::get_number_of_likelihoods(homref_block.ploidy(),_output_record->n_allele);
-
-    int *pl_ptr = _format->pl + sample_index*num_pl_per_sample;
-    _format->dp[sample_index] = homref_block.dp();
-    _format->dpf[sample_index] = homref_block.dpf();
-    _format->gq[sample_index] = homref_block.gq();
-    _format->ad[sample_index * _output_record->n_allele] = homref_block.dp();
-    if(_format->ft[sample_index]) _format->ft[sample_index]=(char *)realloc(_format->ft[sample_index],2);
-    else _format->ft[sample_index]=(char *)malloc(2);
-    _format->ft[sample_index][0] = '.';
-    _format->ft[sample_index][1] = '\0';
-    
-    for(int i=1;i<_output_record->n_allele;i++)
-        _format->ad[sample_index * _output_record->n_allele+i] = 0;
-    if (homref_block.dp() > 0)
-    {
-        if(homref_block.ploidy()==2)
-        {
-            _format->gt[2 * sample_index] = _format->gt[2 * sample_index + 1] = bcf_gt_unphased(0);
-        }
-        else
-        {
-            _format->gt[2 * sample_index] = bcf_gt_unphased(0);
-            _format->gt[2 * sample_index + 1] = bcf_int32_vector_end;
-        }
-    }
-    //FIXME: dummy PL value for homref sites
-    std::fill(pl_ptr,pl_ptr+num_pl_per_sample,bcf_int32_vector_end);
-    std::fill(pl_ptr,pl_ptr+num_pl_in_this_sample,255);
-    pl_ptr[0] = 0;
-}
-
-void GVCFMerger::GenotypeAltVariant(int sample_index,bcf1_t *sample_variants)
-{
-    int default_ploidy=2;
-    Genotype g(_readers[sample_index].GetHeader(), sample_variants,_record_collapser);
-    g.PropagateFormatFields(sample_index, default_ploidy, _format);
-    if(g.mq() != bcf_int32_missing)
-    {
-        _mean_weighted_mq += (g.dp() * g.mq());
-        _sum_mq_weights += g.dp();
-    }
-    if(!bcf_float_is_missing(g.qual()))
-        _output_record->qual += g.qual();
-}
-
-void GVCFMerger::GenotypeSample(int sample_index)
+void GVCFMerger::AddSampleStats(const sample_stats_t &stats)
 {
-    DepthBlock homref_block;//working structure to store homref info.
-    auto hdr = _readers[sample_index].GetHeader();
-    auto records = _readers[sample_index].GetAllVariantsUpTo(_record_collapser.GetMax());
-
-    bcf1_t *sample_record = CollapseRecords(hdr,records);
-    //this sample has variants at this position, we need to populate its FORMAT field
-    if (sample_record!=nullptr)
-    {
-        GenotypeAltVariant(sample_index, sample_record);
-        bcf_destroy(sample_record);
-    }
-    else    //this sample does not have the variant, reconstruct the format fields from homref blocks
-    {
-        _readers[sample_index].GetDepth(_output_record->rid, _output_record->pos,
-                                        ggutils::get_end_of_variant(_output_record), homref_block);
-        GenotypeHomrefVariant(sample_index, homref_block);
-    }
+    _mean_weighted_mq += stats.mq_weighted;
+    _sum_mq_weights += stats.mq_weight;
+    if(!bcf_float_is_missing(stats.qual))
+        _output_record->qual += stats.qual;
 }
 
 bcf1_t *GVCFMerger::next()
 {
+    StageClock::Enter(STAGE_SITES);
     if (AreAllReadersEmpty()) return (nullptr);
 
     bcf_clear(_output_record);
@@ -226,6 +381,11 @@ bcf1_t *GVCFMerger::next()
 
     if(_output_record->n_allele <= _max_alleles)
     {
+        if(_blocks != nullptr)
+        {
+            _blocks->AddSite(_readers, _output_record);
+        }
+
         //fill in the format information for every sample.
         SetOutputBuffersToMissing(_output_record->n_allele);
 
@@ -236,33 +396,36 @@ bcf1_t *GVCFMerger::next()
 
         for (size_t i = 0; i < _num_gvcfs; i++)
         {
-            GenotypeSample(i);
+            sample_stats_t stats;
+            genotype_sample(_readers[i], _record_collapser, _output_record, _format, i, stats);
+            AddSampleStats(stats);
             _readers[i].FlushBuffer(_record_collapser.GetMax());
         }
         _num_variants++;
-        UpdateFormatAndInfo();
+        UpdateFormatAndInfo(_format);
         return(_output_record);
     }
     else
     {
         _lg->warn("Too many alleles at {}:{} dropping this position.",
                   bcf_hdr_id2name(_output_header,_output_record->rid),_output_record->pos+1);
+        if (_stats != nullptr) _stats->AddDroppedSite();
         for (size_t i = 0; i < _num_gvcfs; i++)
             _readers[i].FlushBuffer(_record_collapser.GetMax());
         return(next());
     }
 }
 
-std::vector<int> GVCFMerger::FindAltGenotypes(const int allele) 
+std::vector<int> GVCFMerger::FindAltGenotypes(const ggutils::vcf_data_t *format, const int allele)
 {
     std::vector<int> indices_of_alt_genotypes;
     for(size_t i=0;i<_num_gvcfs;++i)
     {
         bool is_alt(false);
-        if(_format->ploidy==1)
-            is_alt = !bcf_gt_is_missing(_format->gt[i]) && bcf_gt_allele(_format->gt[i])==allele;
+        if(format->ploidy==1)
+            is_alt = !bcf_gt_is_missing(format->gt[i]) && bcf_gt_allele(format->gt[i])==allele;
         else
-            is_alt = !bcf_gt_is_missing(_format->gt[2*i+1]) && !bcf_gt_is_missing(_format->gt[2*i]) && (bcf_gt_allele(_format->gt[2*i])==allele||bcf_gt_allele(_format->gt[2*i+1])==allele);
+            is_alt = !bcf_gt_is_missing(format->gt[2*i+1]) && !bcf_gt_is_missing(format->gt[2*i]) && (bcf_gt_allele(format->gt[2*i])==allele||bcf_gt_allele(format->gt[2*i+1])==allele);
         if(is_alt) {
             indices_of_alt_genotypes.push_back(i);
         }
@@ -270,19 +433,19 @@ std::vector<int> GVCFMerger::FindAltGenotypes(const int allele)
     return indices_of_alt_genotypes;
 }
 
-void GVCFMerger::SetMedianInfoValues()
+void GVCFMerger::SetMedianInfoValues(const ggutils::vcf_data_t *format)
 {
     std::vector<float> median_gq(_output_record->n_allele);
     std::vector<float> median_gqx(_output_record->n_allele);
     std::vector<float> median_dp(_output_record->n_allele);
     for(int allele=0;allele<_output_record->n_allele;allele++)
     {
-        std::vector<int> indices_of_alt_genotypes = FindAltGenotypes(allele);
+        std::vector<int> indices_of_alt_genotypes = FindAltGenotypes(format, allele);
         // INFO/GQX_MEDIAN
         std::vector<int> values_at_alt_genotypes;
         for(const auto alt_gt : indices_of_alt_genotypes) {
-            if(_format->gq[alt_gt]!=bcf_int32_missing)
-                values_at_alt_genotypes.push_back(_format->gq[alt_gt]);
+            if(format->gq[alt_gt]!=bcf_int32_missing)
+                values_at_alt_genotypes.push_back(format->gq[alt_gt]);
         }
         bcf_float_set_missing(median_gq[allele]);
         if(!values_at_alt_genotypes.empty())
@@ -291,8 +454,8 @@ void GVCFMerger::SetMedianInfoValues()
         // INFO/GQ_MEDIAN
         values_at_alt_genotypes.clear();
         for(const auto alt_gt : indices_of_alt_genotypes) {
-            if(_format->gqx[alt_gt]!=bcf_int32_missing)
-                values_at_alt_genotypes.push_back(_format->gqx[alt_gt]);
+            if(format->gqx[alt_gt]!=bcf_int32_missing)
+                values_at_alt_genotypes.push_back(format->gqx[alt_gt]);
         }
         bcf_float_set_missing(median_gqx[allele]);
         if(!values_at_alt_genotypes.empty())
@@ -301,8 +464,8 @@ void GVCFMerger::SetMedianInfoValues()
         // INFO/DP_MEDIAN
         values_at_alt_genotypes.clear();
         for(const auto alt_gt : indices_of_alt_genotypes) {
-            if(_format->dp[alt_gt]!=bcf_int32_missing)
-                values_at_alt_genotypes.push_back(_format->dp[alt_gt]);
+            if(format->dp[alt_gt]!=bcf_int32_missing)
+                values_at_alt_genotypes.push_back(format->dp[alt_gt]);
         }
         bcf_float_set_missing(median_dp[allele]);
         if(!values_at_alt_genotypes.empty())
@@ -313,7 +476,7 @@ void GVCFMerger::SetMedianInfoValues()
     assert(bcf_update_info_float(_output_header,_output_record,"DP_MEDIAN",median_dp.data()+1,_output_record->n_allele-1)==0);
 }
 
-void GVCFMerger::SetHistogramInfoValues() 
+void GVCFMerger::SetHistogramInfoValues(const ggutils::vcf_data_t *format)
 {
     //histogram bins
     const int maxval = 100;
@@ -327,9 +490,9 @@ void GVCFMerger::SetHistogramInfoValues()
     std::string hist_dp_alt;
     for(int allele=0;allele<_output_record->n_allele;++allele)
     {
-        for(const auto alt_gt_idx : FindAltGenotypes(allele)) {
-            if(_format->dp[alt_gt_idx]!=bcf_int32_missing) {
-                size_t bin_idx = _format->dp[alt_gt_idx] > maxval ? (nbins-1) : ((size_t)(_format->dp[alt_gt_idx] / bin_width));
+        for(const auto alt_gt_idx : FindAltGenotypes(format, allele)) {
+            if(format->dp[alt_gt_idx]!=bcf_int32_missing) {
+                size_t bin_idx = format->dp[alt_gt_idx] > maxval ? (nbins-1) : ((size_t)(format->dp[alt_gt_idx] / bin_width));
                 ++allele_hist[allele][bin_idx];
             }
         }
@@ -339,21 +502,54 @@ void GVCFMerger::SetHistogramInfoValues()
     assert(bcf_update_info_string(_output_header,_output_record,"DP_HIST_ALT",hist_dp_alt.c_str())==0);
 }
 
-void GVCFMerger::UpdateFormatAndInfo()
+//counts the called alleles of format->gt, the same as bcf_calc_ac does for FORMAT/GT but without
+//needing the genotypes in the output record
+void GVCFMerger::CountAlleles(const ggutils::vcf_data_t *format, int32_t *ac)
 {
-    assert(bcf_update_genotypes(_output_header, _output_record,_format->gt, _num_gvcfs * 2)==0);
-    assert(bcf_update_format_string(_output_header, _output_record, "FT",(const char **)_format->ft, _num_gvcfs)==0);    
-    assert(bcf_update_format_int32(_output_header, _output_record, "GQ",_format->gq, _num_gvcfs)==0);
-    assert(bcf_update_format_int32(_output_header, _output_record, "GQX",_format->gqx, _num_gvcfs)==0);
-    assert(bcf_update_format_int32(_output_header, _output_record, "DP",_format->dp, _num_gvcfs)==0);
-    assert(bcf_update_format_int32(_output_header, _output_record, "DPF",_format->dpf, _num_gvcfs)==0);
-    assert(bcf_update_format_int32(_output_header, _output_record, "AD",_format->ad, _num_gvcfs * _output_record->n_allele)==0);
-    if(_has_strand_ad)
+    std::fill(ac, ac + _output_record->n_allele, 0);
+    for (size_t i = 0; i < 2 * _num_gvcfs; i += 2)
     {
-        assert(bcf_update_format_int32(_output_header, _output_record, "ADF",_format->adf, _num_gvcfs * _output_record->n_allele)==0);
-        assert(bcf_update_format_int32(_output_header, _output_record, "ADR",_format->adr, _num_gvcfs * _output_record->n_allele)==0);
+        for (size_t j = i; j < i + 2 && format->gt[j] != bcf_int32_vector_end; j++)
+        {
+            if (!bcf_gt_is_missing(format->gt[j]))
+            {
+                assert(bcf_gt_allele(format->gt[j]) < _output_record->n_allele);
+                ac[bcf_gt_allele(format->gt[j])]++;
+            }
+        }
     }
-    if(_has_pl) assert(bcf_update_format_int32(_output_header, _output_record, "PL",_format->pl, _format->num_pl)==0);
+}
+
+//sets the output record's INFO from the genotypes in format, and its FORMAT fields unless _sites_only
+void GVCFMerger::UpdateFormatAndInfo(const ggutils::vcf_data_t *format)
+{
+    if(!_sites_only)
+    {
+        StageClock::Enter(STAGE_ENCODE);
+        assert(bcf_update_genotypes(_output_header, _output_record,format->gt, _num_gvcfs * 2)==0);
+        assert(bcf_update_format_string(_output_header, _output_record, "FT",(const char **)format->ft, _num_gvcfs)==0);    
+        assert(bcf_update_format_int32(_output_header, _output_record, "GQ",format->gq, _num_gvcfs)==0);
+        assert(bcf_update_format_int32(_output_header, _output_record, "GQX",format->gqx, _num_gvcfs)==0);
+        assert(bcf_update_format_int32(_output_header, _output_record, "DP",format->dp, _num_gvcfs)==0);
+        assert(bcf_update_format_int32(_output_header, _output_record, "DPF",format->dpf, _num_gvcfs)==0);
+        if(_local_alleles)
+        {
+            assert(bcf_update_format_int32(_output_header, _output_record, "LAA",format->laa, _num_gvcfs * format->laa_per_sample())==0);
+            assert(bcf_update_format_int32(_output_header, _output_record, "LAD",format->lad, _num_gvcfs * format->num_local)==0);
+        }
+        else
+        {
+            assert(bcf_update_format_int32(_output_header, _output_record, "AD",format->ad, _num_gvcfs * _output_record->n_allele)==0);
+        }
+        if(_has_strand_ad)
+        {
+            assert(bcf_update_format_int32(_output_header, _output_record, "ADF",format->adf, _num_gvcfs * _output_record->n_allele)==0);
+            assert(bcf_update_format_int32(_output_header, _output_record, "ADR",format->adr, _num_gvcfs * _output_record->n_allele)==0);
+        }
+        if(_has_pl && _local_alleles) assert(bcf_update_format_int32(_output_header, _output_record, "LPL",format->lpl, _num_gvcfs * format->lpl_per_sample())==0);
+        else if(_has_pl) assert(bcf_update_format_int32(_output_header, _output_record, "PL",format->pl, format->num_pl)==0);
+    }
+    StageClock::Enter(STAGE_INFO);
 
     // Write INFO/MQ
     if (_sum_mq_weights>0)
@@ -362,18 +558,15 @@ void GVCFMerger::UpdateFormatAndInfo()
         assert(bcf_update_info_int32(_output_header,_output_record,"MQ",&_mean_weighted_mq,1)==0);
     }
 
-    // Calculate AC/AN using htslib standard functions
-    int ret = bcf_calc_ac(_output_header,_output_record,_info_ac,BCF_UN_FMT);
-    if (ret)
-    {
-        // sum over all allele counts to get AN
-        int an = 0;
-        for (int i=0; i<_output_record->n_allele; i++)
-            an += _info_ac[i];
+    // Calculate AC/AN
+    CountAlleles(format, _info_ac);
+    // sum over all allele counts to get AN
+    int an = 0;
+    for (int i=0; i<_output_record->n_allele; i++)
+        an += _info_ac[i];
 
-        bcf_update_info_int32(_output_header, _output_record, "AN", &an, 1);
-        bcf_update_info_int32(_output_header, _output_record, "AC", _info_ac+1, _output_record->n_allele-1);
-    }
+    bcf_update_info_int32(_output_header, _output_record, "AN", &an, 1);
+    bcf_update_info_int32(_output_header, _output_record, "AC", _info_ac+1, _output_record->n_allele-1);
 
     // Calculate INFO/ADF + INFO/ADR
     if(_has_strand_ad)
@@ -382,11 +575,11 @@ void GVCFMerger::UpdateFormatAndInfo()
         {
             for (size_t j=0;j<_output_record->n_allele;++j)
             {
-                assert( (_format->adr[i+j]==bcf_int32_missing) == (_format->adf[i+j]==bcf_int32_missing) );
-                if(_format->adf[i+j]!=bcf_int32_missing)
+                assert( (format->adr[i+j]==bcf_int32_missing) == (format->adf[i+j]==bcf_int32_missing) );
+                if(format->adf[i+j]!=bcf_int32_missing)
                 {
-                    _info_adf[j] += _format->adf[i+j];
-                    _info_adr[j] += _format->adr[i+j];
+                    _info_adf[j] += format->adf[i+j];
+                    _info_adr[j] += format->adr[i+j];
                 }
             }
         }
@@ -397,13 +590,13 @@ void GVCFMerger::UpdateFormatAndInfo()
     }
 
     // Calculate INFO/HOM (probably better called INFO/HOM_ALT?)
-    if (_format->ploidy>1) 
+    if (format->ploidy>1) 
     {
         size_t n_hom_alt=0;
         for(size_t i=0;i<_num_gvcfs;++i)
         {
-            if (!bcf_gt_is_missing(_format->gt[2*i]) && !bcf_gt_is_missing(_format->gt[2*i+1])) {
-                if (bcf_gt_allele(_format->gt[2*i])==bcf_gt_allele(_format->gt[2*i+1])) {
+            if (!bcf_gt_is_missing(format->gt[2*i]) && !bcf_gt_is_missing(format->gt[2*i+1])) {
+                if (bcf_gt_allele(format->gt[2*i])==bcf_gt_allele(format->gt[2*i+1])) {
                     ++n_hom_alt;
                 }
             }
@@ -412,17 +605,17 @@ void GVCFMerger::UpdateFormatAndInfo()
     }
 
     // Calculate INFO/GC
-    if (_format->ploidy>1) 
+    if (format->ploidy>1) 
     {
         size_t GC[]={0,0,0};
         for(size_t i=0;i<_num_gvcfs;++i)
         {
-            if (!bcf_gt_is_missing(_format->gt[2*i]) && !bcf_gt_is_missing(_format->gt[2*i+1])) {
-                if (bcf_gt_allele(_format->gt[2*i])==0 && bcf_gt_allele(_format->gt[2*i+1])==0) {
+            if (!bcf_gt_is_missing(format->gt[2*i]) && !bcf_gt_is_missing(format->gt[2*i+1])) {
+                if (bcf_gt_allele(format->gt[2*i])==0 && bcf_gt_allele(format->gt[2*i+1])==0) {
                     ++GC[0];
-                } else if (bcf_gt_allele(_format->gt[2*i])!=bcf_gt_allele(_format->gt[2*i+1])) {
+                } else if (bcf_gt_allele(format->gt[2*i])!=bcf_gt_allele(format->gt[2*i+1])) {
                     ++GC[1];
-                } else if (bcf_gt_allele(_format->gt[2*i])==1 && bcf_gt_allele(_format->gt[2*i+1])==1) {
+                } else if (bcf_gt_allele(format->gt[2*i])==1 && bcf_gt_allele(format->gt[2*i+1])==1) {
                     ++GC[2];
                 }
             }
@@ -430,45 +623,251 @@ void GVCFMerger::UpdateFormatAndInfo()
         bcf_update_info_int32(_output_header,_output_record,"GC",&GC,3);
     }
 
-    SetMedianInfoValues();
-    SetHistogramInfoValues();
+    SetMedianInfoValues(format);
+    SetHistogramInfoValues(format);
 }
 
-void GVCFMerger::write_vcf()
+void GVCFMerger::WriteOutputRecord()
 {
-    int last_rid = -1;
-    int last_pos = 0;
-    int num_written = 0;
-    while (next() != nullptr)
+    WriteRecord(_output_record);
+    _num_written++;
+    //the clock is only looked at every so many sites
+    if (_stats != nullptr && (_num_written & 255) == 0)
+    {
+        _stats->MaybeReport(_num_written);
+    }
+    if (_progress_meter != nullptr)
     {
-        if (!(_output_record->pos >= last_pos || _output_record->rid > last_rid))
+        _progress_meter->Update(_output_record->rid, _output_record->pos, _num_written);
+    }
+    //every site, as a site with many alleles is what makes the FORMAT arrays peak
+    if (_stats != nullptr)
+    {
+        _stats->GetMemory()->Update(MEM_RECORDS, _records_published, GetRecordBytes());
+    }
+}
+
+size_t GVCFMerger::GetRecordBytes()
+{
+    return (_format->bytes() + ggutils::bcf1_bytes(_output_record) + _columns->GetRowBytes());
+}
+
+//writes record to every sink, reference blocks are not written to sites-only sinks
+void GVCFMerger::WriteRecord(bcf1_t *record, bool reference_block)
+{
+    if (!(record->pos >= _last_pos || record->rid > _last_rid))
+    {
+        std::cerr << bcf_hdr_int2id(_output_header, BCF_DT_CTG, record->rid) << ":"
+                  << record->pos + 1 << std::endl;
+        std::cerr << bcf_hdr_int2id(_output_header, BCF_DT_CTG, _last_rid) << ":" << _last_pos + 1 << std::endl;
+        ggutils::print_variant(_output_header, record);
+        throw std::runtime_error("GVCFMerger::write_vcf variants out of order");
+    }
+
+    _last_pos = record->pos;
+    _last_rid = record->rid;
+    if (!reference_block && !_progress_regions.empty())
+    {
+        LogRegionProgress(record->rid, record->pos);
+    }
+    StageClock::Enter(STAGE_ENCODE);
+    for (auto it = _sinks.begin(); it != _sinks.end(); it++)
+    {
+        if (!(reference_block && (*it)->IsSitesOnly()))
         {
-            std::cerr << bcf_hdr_int2id(_output_header, BCF_DT_CTG, _output_record->rid) << ":"
-                      << _output_record->pos + 1 << std::endl;
-            std::cerr << bcf_hdr_int2id(_output_header, BCF_DT_CTG, last_rid) << ":" << last_pos + 1 << std::endl;
-            ggutils::print_variant(_output_header, _output_record);
-            throw std::runtime_error("GVCFMerger::write_vcf variants out of order");
+            (*it)->Write(record);
         }
+    }
+}
 
-        last_pos = _output_record->pos;
-        last_rid = _output_record->rid;
-        bcf_write1(_output_file, _output_header, _output_record);
-        num_written++;
+//logs each region that the output has moved past
+void GVCFMerger::LogRegionProgress(int rid, int pos)
+{
+    while (_progress_index < _progress_regions.size() &&
+           (_progress_rids[_progress_index] < rid ||
+            (_progress_rids[_progress_index] == rid && _progress_regions[_progress_index].end < pos)))
+    {
+        _lg->info("Finished region {} ({}/{}), {} variants",
+                  ggutils::region2string(_progress_regions[_progress_index]), _progress_index + 1,
+                  _progress_regions.size(), _num_written - _progress_written);
+        _progress_written = _num_written;
+        _progress_index++;
+    }
+}
+
+void GVCFMerger::WriteReferenceBlocks()
+{
+    bcf1_t *block;
+    while ((block = _blocks->NextRecord()) != nullptr)
+    {
+        WriteRecord(block, true);
     }
-    assert(AreAllReadersEmpty());
-    _lg->info("Wrote {} variants",num_written);
 }
 
-void GVCFMerger::BuildHeader()
+//transposes the columns of sites into rows, then fills in and writes the output record of each emitted site
+void GVCFMerger::WriteColumns(std::deque<planned_site_t> &sites, vector<sample_column_t> &columns)
+{
+    _columns->Transpose(sites, columns, [&](planned_site_t &site, const ggutils::vcf_data_t *row, size_t index)
+    {
+        bcf_clear(_output_record);
+        bcf_update_id(_output_header, _output_record, ".");
+        site.alleles.Collapse(_output_record);
+        _output_record->qual = 0;
+        ResetInfoBuffers(_output_record->n_allele);
+        _num_ps_written = 0;
+        _mean_weighted_mq = 0;
+        _sum_mq_weights = 0;
+        StageClock::Enter(STAGE_INFO);
+        for (size_t i = 0; i < _num_gvcfs; i++)
+        {
+            AddSampleStats(columns[i].stats[index]);
+        }
+        _num_variants++;
+        UpdateFormatAndInfo(row);
+        WriteOutputRecord();
+    });
+}
+
+void GVCFMerger::write_vcf()
+{
+    _last_rid = -1;
+    _last_pos = 0;
+    _num_written = 0;
+    if (_blocks != nullptr)
+    {
+        _blocks->Reset();
+    }
+    _progress_index = 0;
+    _progress_written = 0;
+    if (!_region.empty())
+    {
+        _progress_regions = ChunkGenotyper::GetBounds(_region, _is_file, _readers, _output_header);
+        _progress_rids.clear();
+        for (auto it = _progress_regions.begin(); it != _progress_regions.end(); it++)
+        {
+            _progress_rids.push_back(bcf_hdr_name2id(_output_header, it->chrom.c_str()));
+        }
+        if (_progress_regions.size() < 2)
+        {
+            _progress_regions.clear();
+        }
+    }
+    for (size_t i = 0; i < _num_gvcfs; i++)
+    {
+        _readers[i].SetMemoryStats(nullptr);
+    }
+    delete _stats;
+    _stats = new RunStats(_input_files, _stats_interval);
+    if (!_stats_json.empty())
+    {
+        _stats->SetJsonFile(_stats_json);
+    }
+    _stats->GetMemory()->SetBudget(_memory_budget);
+    _records_published = 0;
+    _columns->SetMaxAlleles(_max_alleles);
+    _columns->SetStats(_stats);
+    for (size_t i = 0; i < _num_gvcfs; i++)
+    {
+        _readers[i].SetStats(_stats->GetReader(i));
+        _readers[i].SetMemoryStats(_stats->GetMemory());
+    }
+    for (auto it = _sinks.begin(); it != _sinks.end(); it++)
+    {
+        _stats->AddClock(&(*it)->GetClock());
+    }
+    delete _progress_meter;
+    _progress_meter = nullptr;
+    if (_progress_interval > 0)
+    {
+        //without -r/-R the whole of every contig in the header, which unlike ChunkGenotyper::GetBounds needs no index
+        vector<ggutils::region_t> bounds;
+        if (!_region.empty())
+        {
+            bounds = ChunkGenotyper::GetBounds(_region, _is_file, _readers, _output_header);
+        }
+        for (int rid = 0; _region.empty() && rid < _output_header->n[BCF_DT_CTG]; rid++)
+        {
+            bounds.push_back({bcf_hdr_id2name(_output_header, rid), 0, std::numeric_limits<int>::max() - 1});
+        }
+        _progress_meter = new ProgressMeter(_output_header, bounds, _progress_interval, _progress_stderr);
+    }
+    StageClock::Attach(_stats->NewClock());
+    GG_TRACE_THREAD("merge");
+    if (_chunk_size > 0)
+    {
+        WriteChunks();
+    }
+    else
+    {
+        if (_read_threads > 0)
+        {
+            _read_ahead = new ReadAhead(_read_threads);
+            for (auto it = _readers.begin(); it != _readers.end(); it++)
+            {
+                it->SetReadAhead(_read_ahead);
+            }
+            _read_ahead->Start();
+        }
+        if (_batch_sites > 0 && _blocks == nullptr)
+        {
+            WriteBatches();
+        }
+        while (next() != nullptr)
+        {
+            if (_blocks != nullptr)
+            {
+                WriteReferenceBlocks();
+            }
+            WriteOutputRecord();
+            AdaptBufferSize(1);
+        }
+        assert(AreAllReadersEmpty());
+        if (_blocks != nullptr)
+        {
+            //blocks after the last site
+            _blocks->Band(_readers, INT_MAX, INT_MAX);
+            _blocks->Close();
+            WriteReferenceBlocks();
+        }
+    }
+    if (!_progress_regions.empty())
+    {
+        LogRegionProgress(INT_MAX, INT_MAX);
+    }
+    _lg->info("Wrote {} variants",_num_written);
+    for (auto it = _sinks.begin(); it != _sinks.end(); it++)
+    {
+        (*it)->Close();
+        _lg->info("Wrote {} records to {}", (*it)->GetNumWritten(), (*it)->GetFileName().empty() ? "stdout" : (*it)->GetFileName());
+    }
+    StageClock::Attach(nullptr);
+    _stats->Report(_num_written, true);
+    if (_read_ahead != nullptr)
+    {
+        //merge -> format and compress is the queue of each output file
+        LogStageStats("read -> merge", _read_ahead->GetStats(), READ_AHEAD_QUEUE);
+        for (auto it = _sinks.begin(); it != _sinks.end(); it++)
+        {
+            LogStageStats("merge -> " + ((*it)->GetFileName().empty() ? "stdout" : (*it)->GetFileName()),
+                          (*it)->GetStats(), SINK_QUEUE_SIZE);
+        }
+    }
+    if (_blocks != nullptr)
+    {
+        _lg->info("Wrote {} reference blocks",_blocks->GetNumWritten());
+    }
+}
+
+void GVCFMerger::BuildHeader(const vector<VcfReader *> &files, bool gvcf_output)
 {
     _output_header = bcf_hdr_init("w");
     std::unordered_map<std::string,long long> repeat_count;
     for (size_t i = 0; i < _num_gvcfs; i++)
     {
-        const bcf_hdr_t *hr = _readers[i].GetHeader();
-        for (int j = 0; j < bcf_hdr_nsamples(hr); j++)
+        //the reader's header may be shared with other GVCFs, see HeaderCache
+        for (size_t j = 0; j < files[i]->GetSampleNames().size(); j++)
         {
-            string sample_name = hr->samples[j];
+            string sample_name = files[i]->GetSampleNames()[j];
             if (bcf_hdr_id2int(_output_header, BCF_DT_SAMPLE, sample_name.c_str()) != -1)
             {
                 if (_force_samples)
@@ -517,21 +916,111 @@ void GVCFMerger::BuildHeader()
                    "##FORMAT=<ID=DP,Number=1,Type=Integer,Description=\"Filtered basecall depth used for site genotyping\">");
     bcf_hdr_append(_output_header,
                    "##FORMAT=<ID=DPF,Number=1,Type=Integer,Description=\"Basecalls filtered from input prior to site genotyping\">");
-    bcf_hdr_append(_output_header,
-                   "##FORMAT=<ID=AD,Number=R,Type=Integer,Description=\"Allelic depths for the ref and alt alleles in the order listed.\">");
+    if(!_local_alleles)
+        bcf_hdr_append(_output_header,
+                       "##FORMAT=<ID=AD,Number=R,Type=Integer,Description=\"Allelic depths for the ref and alt alleles in the order listed.\">");
     bcf_hdr_append(_output_header, "##FORMAT=<ID=ADF,Number=R,Type=Integer,Description=\"Allelic depths on the forward strand\"");
     bcf_hdr_append(_output_header, "##FORMAT=<ID=ADR,Number=R,Type=Integer,Description=\"Allelic depths on the reverse strand\"");
     bcf_hdr_append(_output_header, "##FORMAT=<ID=GQ,Number=1,Type=Integer,Description=\"Genotype Quality\">");
     bcf_hdr_append(_output_header, "##FORMAT=<ID=FT,Number=1,Type=String,Description=\"Sample filter, 'PASS' indicates that all single sample filters passed for this sample\">");
 
-    bcf_hdr_append(_output_header,
-                   "##FORMAT=<ID=PL,Number=G,Type=Integer,Description=\"Normalized, Phred-scaled likelihoods for genotypes as defined in "
-                           "the VCF specification.\">");
+    if(_local_alleles)
+    {
+        bcf_hdr_append(_output_header, "##FORMAT=<ID=LAA,Number=.,Type=Integer,Description=\"1-based indices into ALT, indicating which alleles are relevant (local) for the current sample\">");
+        bcf_hdr_append(_output_header, "##FORMAT=<ID=LAD,Number=.,Type=Integer,Description=\"Local-allele representation of AD, for REF followed by the LAA alleles\">");
+        bcf_hdr_append(_output_header, "##FORMAT=<ID=LPL,Number=.,Type=Integer,Description=\"Local-allele representation of PL, for the genotypes of REF and the LAA alleles\">");
+    }
+    else
+    {
+        bcf_hdr_append(_output_header,
+                       "##FORMAT=<ID=PL,Number=G,Type=Integer,Description=\"Normalized, Phred-scaled likelihoods for genotypes as defined in "
+                               "the VCF specification.\">");
+    }
     bcf_hdr_append(_output_header, "##FORMAT=<ID=PS,Number=1,Type=Integer,Description=\"Phase set identifier\">");
     bcf_hdr_append(_output_header, "##FORMAT=<ID=GQX,Number=1,Type=Integer,Description=\"Empirically calibrated genotype quality score for "
             "variant sites, otherwise minimum of {Genotype quality assuming variant position,Genotype quality assuming non-variant position}\">");
+    if(gvcf_output)
+        bcf_hdr_append(_output_header, "##INFO=<ID=END,Number=1,Type=Integer,Description=\"End position of a reference block, where DP/GQ are the smallest over the block\">");
     bcf_hdr_append(_output_header, ("##gvcfgenotyper_version="+(string)GG_VERSION).c_str());
-    ggutils::copy_contigs(_readers[0].GetHeader(), _output_header);
-    
-    bcf_hdr_write(_output_file, _output_header);
+    //the first GVCF's contigs, then those only other GVCFs have in the order they come in. Readers share headers
+    //(see HeaderCache), each distinct one is only looked at once. GVCFReader gives records these contig ids.
+    ggutils::copy_contigs(files[0]->GetHeader(), _output_header);
+    std::set<const bcf_hdr_t *> added;
+    for (size_t i = 1; i < _num_gvcfs; i++)
+    {
+        const bcf_hdr_t *hr = files[i]->GetHeader();
+        if (!added.insert(hr).second)
+        {
+            continue;
+        }
+        for (int rid = 0; rid < hr->n[BCF_DT_CTG]; rid++)
+        {
+            if (bcf_hdr_name2id(_output_header, bcf_hdr_id2name(hr, rid)) < 0)
+            {
+                bcf_hdr_add_hrec(_output_header, bcf_hrec_dup(hr->id[BCF_DT_CTG][rid].val->hrec[0]));
+            }
+        }
+    }
+    bcf_hdr_sync(_output_header);
+}
+
+void GVCFMerger::SetBatchSites(int batch_sites)
+{
+    if (batch_sites < 0)
+    {
+        ggutils::die("GVCFMerger::SetBatchSites needs a non-negative number of sites");
+    }
+    _batch_sites = batch_sites;
+}
+
+//Merges up to _batch_sites sites at a time, see SiteBatcher
+void GVCFMerger::WriteBatches()
+{
+    SiteBatcher batcher(_readers, *_columns, _batch_sites, _stats->GetMemory());
+    while (batcher.Next(_buffer_size))
+    {
+        WriteColumns(batcher.GetSites(), batcher.GetColumns());
+        AdaptBufferSize(batcher.GetSites().size());
+    }
+}
+
+void GVCFMerger::SetReadThreads(int num_threads)
+{
+    if (num_threads < 0)
+    {
+        ggutils::die("GVCFMerger::SetReadThreads needs a non-negative number of threads");
+    }
+    _read_threads = num_threads;
+}
+
+//producer stalls mean the stage after the queue is the slower one, consumer stalls the stage before it
+void GVCFMerger::LogStageStats(const string &name, const ggutils::stage_stats_t &stats, size_t capacity)
+{
+    _lg->info("Queue {}: {:.1f} of {} queued on average, the producer waited {} times and the consumer {} times",
+              name, stats.num_popped > 0 ? (double) stats.queued / stats.num_popped : 0.0, capacity,
+              stats.producer_stalls, stats.consumer_stalls);
+}
+
+void GVCFMerger::SetThreads(int num_threads, int chunk_size, int chunk_workers)
+{
+    if (num_threads < 1 || chunk_size < 1 || chunk_workers < 1)
+    {
+        ggutils::die("GVCFMerger::SetThreads needs at least one thread and worker and a positive chunk size");
+    }
+    _num_threads = num_threads;
+    _chunk_size = chunk_size;
+    _chunk_workers = chunk_workers;
+}
+
+//the first chunk worker uses _readers and _normaliser, the others open every GVCF again
+void GVCFMerger::WriteChunks()
+{
+    chunk_inputs_t inputs = {_input_files, _reference_genome, _ignore_non_matching_ref, _buffer_size, _region,
+                             _is_file, _seek ? &_site_regions : nullptr, _output_header};
+    ChunkGenotyper genotyper(inputs, _readers, _normaliser, *_columns, _stats, _num_threads, _chunk_workers);
+    genotyper.Run(ChunkGenotyper::GetBounds(_region, _is_file, _readers, _output_header), _chunk_size,
+                  [&](std::deque<planned_site_t> &sites, vector<sample_column_t> &columns)
+                  {
+                      WriteColumns(sites, columns);
+                  });
 }
@@ -2,6 +2,7 @@
 #ifndef GVCFMERGER_H
 #define GVCFMERGER_H
 
+#include <deque>
 #include <list>
 #include <stdexcept>
 
@@ -16,8 +17,33 @@ extern "C" {
 
 #include "ggutils.hh"
 #include "GVCFReader.hh"
+#include "SiteUnion.hh"
+#include "ReferenceBlockWriter.hh"
+#include "OutputSink.hh"
+#include "SiteColumns.hh"
+#include "SiteBatcher.hh"
+#include "ChunkGenotyper.hh"
 #include "multiAllele.hh"
 #include "Genotype.hh"
+#include "RunStats.hh"
+#include "ProgressMeter.hh"
+
+//values for the two_pass argument of GVCFMerger
+#define TWO_PASS_OFF 0 //stream every GVCF
+#define TWO_PASS_AUTO 1 //scan for sites first and seek to them if that looks cheaper than streaming
+#define TWO_PASS_ALWAYS 2 //scan for sites first and always seek to them
+
+//default --batch-sites, sites the streaming merge plans and genotypes at a time (0: one site at a time,
+//batching was measured to be no faster on 5 to 100 sample cohorts)
+#define BATCH_SITES 0
+
+//bounds of the look-ahead window --max-memory gives each reader, in bp
+#define MIN_ADAPTIVE_BUFFER_SIZE 1000
+#define MAX_ADAPTIVE_BUFFER_SIZE 200000
+//fraction of --max-memory the readers' buffers may take, the rest is left to the sites, columns and output
+#define ADAPTIVE_BUFFER_FRACTION 0.5
+//sites between two adjustments of the window
+#define ADAPTIVE_BUFFER_SITES 1024
 
 class GVCFMerger
 {
@@ -30,30 +56,88 @@ public:
 	           const string &region = "",
                const int is_file = 0,
                bool ignore_non_matching_ref=false,
-               bool force_samples=false);
+               bool force_samples=false,
+               int two_pass=TWO_PASS_OFF,
+               bool local_alleles=false,
+               bool gvcf_output=false,
+               bool sites_only=false);
     ~GVCFMerger();
     void write_vcf();
     bcf1_t *next();
     int GetNextVariant();
     void SetMaxAlleles(size_t max_alleles) {_max_alleles=max_alleles;};
+    //switches write_vcf to the sample-parallel engine, which works through the genome in chunks of chunk_size bp
+    //and genotypes every sample of a chunk on its own thread (see ChunkGenotyper). chunk_workers chunks are
+    //genotyped at once (see ChunkScheduler), each worker with its own readers and num_threads/chunk_workers threads.
+    void SetThreads(int num_threads, int chunk_size, int chunk_workers = 1);
+    //without SetThreads (and reference blocks), sites are merged batch_sites at a time rather than one by one,
+    //see SiteBatcher. 0 merges them one at a time with next().
+    void SetBatchSites(int batch_sites);
+    //without SetThreads, the GVCFs are read and decompressed on num_threads threads of their own (see ReadAhead)
+    //while this thread merges, and the occupancy and stalls of the queues between the stages are logged
+    void SetReadThreads(int num_threads);
+    //with gvcf_output, a new reference block starts when any sample's DP/GQ moves more than this from the block's start
+    void SetReferenceBands(int dp_band, int gq_band);
+    //writes another output file in the same pass, see OutputSink. Must be called before write_vcf.
+    void AddOutput(const string &output_filename, const string &output_mode, bool sites_only,
+                   const vector<string> &samples = {});
+    //index every output file (including ones added later) as it is written, see OutputSink::BuildIndex
+    void SetWriteIndex();
+    //write_vcf logs its timing and throughput counters (see RunStats) every interval seconds, 0 only at the end
+    void SetStatsInterval(int interval);
+    //every report of the counters also replaces fname with them as JSON (see RunStats::SetJsonFile)
+    void SetStatsJson(const string &fname);
+    //write_vcf logs how far through the genome it is, with sites/sec and the time left, every interval seconds
+    //(0 for never), also to stderr if to_stderr. See ProgressMeter.
+    void SetProgress(int interval, bool to_stderr);
+    //write_vcf warns when the memory it accounts for (see MemoryStats) comes close to bytes, 0 for no budget
+    void SetMemoryBudget(size_t bytes);
+    //the streaming merge sizes the readers' look-ahead windows so their buffers stay within a share of bytes,
+    //from the number of GVCFs and the bytes and records buffered per bp so far, instead of the fixed buffer_size.
+    //0 keeps buffer_size.
+    void SetMaxMemory(size_t bytes);
+    //window in bp that keeps num_readers buffers holding records_per_bp records of bytes_per_record each within
+    //budget bytes, between MIN_ADAPTIVE_BUFFER_SIZE and MAX_ADAPTIVE_BUFFER_SIZE
+    static int GetAdaptiveBufferSize(double budget, size_t num_readers, double bytes_per_record,
+                                     double records_per_bp);
 
 private:
-    void GenotypeHomrefVariant(int sample_index, DepthBlock &depth);
-    void GenotypeAltVariant(int sample_index,bcf1_t *sample_variants);
-    void GenotypeSample(int sample_index);
-    void UpdateFormatAndInfo();
-    void BuildHeader();
+    void AddSampleStats(const sample_stats_t &stats);
+    void UpdateFormatAndInfo(const ggutils::vcf_data_t *format);
+    void CountAlleles(const ggutils::vcf_data_t *format, int32_t *ac);
+    void WriteOutputRecord();
+    //bytes of the output record, its FORMAT arrays and the rows of SiteColumns::Transpose, for MEM_RECORDS
+    size_t GetRecordBytes();
+    //counts num_sites written and resizes the readers' windows every ADAPTIVE_BUFFER_SITES sites with
+    //--max-memory, see SetMaxMemory
+    void AdaptBufferSize(size_t num_sites);
+    void WriteRecord(bcf1_t *record, bool reference_block = false);
+    void LogRegionProgress(int rid, int pos);
+    void LogStageStats(const string &name, const ggutils::stage_stats_t &stats, size_t capacity);
+    void WriteReferenceBlocks();
+    void WriteColumns(std::deque<planned_site_t> &sites, vector<sample_column_t> &columns);
+    void BuildHeader(const vector<VcfReader *> &files, bool gvcf_output);
+    bool PlanSites(const vector<string> &input_files, const string &region, const int is_file, int two_pass,
+                   vector<ggutils::region_t> &site_regions);
     void SetOutputBuffersToMissing(int num_alleles);
+    void ResetInfoBuffers(int num_alleles);
     bool AreAllReadersEmpty();
-    void SetMedianInfoValues();
-    vector<int> FindAltGenotypes(const int allele);
-    void SetHistogramInfoValues();
+    void SetMedianInfoValues(const ggutils::vcf_data_t *format);
+    vector<int> FindAltGenotypes(const ggutils::vcf_data_t *format, const int allele);
+    void SetHistogramInfoValues(const ggutils::vcf_data_t *format);
+
+    //batched streaming merge
+    void WriteBatches();
+
+    //sample-parallel engine
+    void WriteChunks();
 
     multiAllele _record_collapser;
     vector<GVCFReader> _readers;
     size_t _num_gvcfs;
     bcf1_t *_output_record;
-    htsFile *_output_file;
+    vector<OutputSink *> _sinks;//the first one is output_filename
+    bool _write_index;
     bcf_hdr_t *_output_header;
     ggutils::vcf_data_t *_format;//stores all our format fields.
     int32_t *_info_adf, *_info_adr, *_info_ac;
@@ -65,6 +149,39 @@ private:
     bool _force_samples;
 	size_t _max_alleles;
     std::vector<float> _sb_pvalue;
+    int _last_rid, _last_pos;
+    size_t _num_written;
+
+    string _reference_genome, _region;
+    int _is_file;
+    bool _ignore_non_matching_ref;
+    vector<ggutils::region_t> _site_regions;//from --two-pass, only used if _seek
+    vector<ggutils::region_t> _progress_regions;//sorted and merged -r/-R regions when there are several
+    vector<int> _progress_rids;
+    size_t _progress_index, _progress_written;
+    bool _seek;
+    bool _local_alleles;//write LAA/LAD/LPL instead of AD/PL
+    bool _sites_only;//no sink has sample columns, so FORMAT is not set
+
+    ReferenceBlockWriter *_blocks;//--output-mode gvcf, nullptr otherwise
+    SiteColumns *_columns;//genotypes the sites of a batch or chunk
+    int _num_threads, _chunk_size, _chunk_workers;
+    vector<string> _input_files;
+    int _buffer_size;
+    int _read_threads;
+    size_t _batch_sites;
+    ReadAhead *_read_ahead;//the read stage of the streaming merge, nullptr if it is not run on its own threads
+    RunStats *_stats;//of the current write_vcf
+    int _stats_interval;
+    string _stats_json;
+    ProgressMeter *_progress_meter;//of the current write_vcf, nullptr without progress reports
+    int _progress_interval;
+    bool _progress_stderr;
+    size_t _memory_budget;
+    int64_t _records_published;//bytes of GetRecordBytes in _stats' MemoryStats
+    size_t _max_memory;
+    size_t _num_adapt_sites;//sites since the windows were last resized
+    int _logged_buffer_size;//window size last logged
 };
 
 #endif
@@ -1,6 +1,5 @@
 #include <htslib/vcf.h>
 #include "GVCFReader.hh"
-#include "StringUtil.hh"
 //#define DEBUG
 
 int GVCFReader::FlushBuffer(bcf1_t *record)
@@ -9,6 +8,7 @@ int GVCFReader::FlushBuffer(bcf1_t *record)
     _depth_buffer.FlushBuffer(record->rid, record->pos - 1);
     int num_flushed = _variant_buffer.FlushBuffer(record);
     FillBuffer();
+    UpdateMemory();
     return (num_flushed);
 }
 
@@ -17,71 +17,138 @@ int GVCFReader::FlushBuffer(int chrom, int pos)
     _depth_buffer.FlushBuffer(chrom, pos);
     int num_flushed = _variant_buffer.FlushBuffer(chrom, pos);
     FillBuffer();
+    UpdateMemory();
     return (num_flushed);
 }
 
 int GVCFReader::FlushBuffer()
 {
     _depth_buffer.FlushBuffer();
-    return (_variant_buffer.FlushBuffer());
+    int num_flushed = _variant_buffer.FlushBuffer();
+    UpdateMemory(true);
+    return (num_flushed);
+}
+
+void GVCFReader::SetMemoryStats(MemoryStats *memory)
+{
+    if (_memory != nullptr)
+    {
+        for (int c = 0; c < MEM_TOTAL; c++)
+        {
+            _memory->Update((memory_component_t) c, _memory_published[c], 0);
+        }
+    }
+    _memory = memory;
+    UpdateMemory(true);
+}
+
+void GVCFReader::UpdateMemory(bool force)
+{
+    if (_memory == nullptr)
+    {
+        return;
+    }
+    int64_t bytes[] = {(int64_t) _variant_buffer.GetBytes(), (int64_t) _depth_buffer.GetBytes()};
+    memory_component_t components[] = {MEM_VARIANTS, MEM_BLOCKS};
+    for (int k = 0; k < 2; k++)
+    {
+        if (force || std::abs(bytes[k] - _memory_published[components[k]]) >= MEMORY_UPDATE_BYTES)
+        {
+            _memory->Update(components[k], _memory_published[components[k]], bytes[k]);
+        }
+    }
+    if (force)
+    {
+        //the headers do not change, the index is loaded when it is first needed. A shared header is split between
+        //the readers holding it when this reader came up.
+        int64_t header_bytes = ggutils::bcf_hdr_bytes(_reader->GetHeader()) / _reader->GetSharedHeader().use_count();
+        if (_bcf_header != _reader->GetHeader())
+        {
+            header_bytes += ggutils::bcf_hdr_bytes(_bcf_header) / _contigs.use_count();
+        }
+        _memory->Update(MEM_HEADERS, _memory_published[MEM_HEADERS], header_bytes);
+        _memory->Update(MEM_INDEXES, _memory_published[MEM_INDEXES], _reader->GetIndexBytes());
+    }
 }
 
 GVCFReader::GVCFReader(const std::string &input_gvcf, Normaliser * normaliser, const int buffer_size,
-                       const string &region /*=""*/, const int is_file /*=0*/)
+                       const string &region /*=""*/, const int is_file /*=0*/,
+                       const std::vector<ggutils::region_t> *regions /*=nullptr*/,
+                       const bcf_hdr_t *output_header /*=nullptr*/)
+    : GVCFReader(new VcfReader(input_gvcf), normaliser, buffer_size, region, is_file, regions, output_header)
 {
-    _input_gvcf=input_gvcf;
+}
+
+GVCFReader::GVCFReader(VcfReader *reader, Normaliser * normaliser, const int buffer_size,
+                       const string &region /*=""*/, const int is_file /*=0*/,
+                       const std::vector<ggutils::region_t> *regions /*=nullptr*/,
+                       const bcf_hdr_t *output_header /*=nullptr*/)
+{
+    _input_gvcf=reader->GetFileName();
     _lg = spdlog::get("gg_logger");
     assert(_lg!=nullptr);
-    _bcf_record = nullptr;
-    _bcf_reader = bcf_sr_init();
-    if (!region.empty())
+    _reader = reader;
+    _read_ahead = nullptr;
+    _stream = 0;
+    _eof = false;
+    _region_index = -1;
+    _stats = nullptr;
+    _memory = nullptr;
+    std::fill(_memory_published, _memory_published + MEM_TOTAL, 0);
+
+    //header setup, the shared header may carry another GVCF's sample names
+    if (output_header != nullptr)
     {
-        if (bcf_sr_set_regions(_bcf_reader, region.c_str(), is_file) == -1)
-        {
-            ggutils::die("Cannot navigate to region " + region);
-        }
+        _contigs = HeaderCache::MapContigs(_reader->GetSharedHeader(), output_header);
+        _reader->SetContigMap(_contigs);
+        _shared_header = _contigs->header;
     }
-    if (!(bcf_sr_add_reader(_bcf_reader, input_gvcf.c_str())))
+    else
     {
-      ggutils::die("problem opening "+input_gvcf+"\n"+bcf_sr_strerror(_bcf_reader->errnum));
+        _shared_header = _reader->GetSharedHeader();
+    }
+    _bcf_header = _shared_header.get();
+    _sample_names = _reader->GetSampleNames();
+
+    if (regions != nullptr)
+    {
+        _reader->SetRegions(*regions);
+    }
+    else if (!region.empty())
+    {
+        if ((is_file ? _reader->SetRegionsFile(region) : _reader->SetRegions(region)) == 0)
+        {
+            _lg->warn("WARNING: none of the contigs in {} are in the header of {}", region, _input_gvcf);
+        }
     }
     if (buffer_size < 2)
     {
         ggutils::die("GVCFReader needs buffer size of at least 2");
     }
     _buffer_size = buffer_size;
-    _bcf_record = nullptr;
+    _longest_variant = 0;
+    _bcf_record = bcf_init1();
 
-    //header setup
-    _bcf_header = bcf_hdr_dup(_bcf_reader->readers[0].header);
-    bcf_hdr_append(_bcf_header, "##FORMAT=<ID=FT,Number=1,Type=String,Description=\"Sample filter, 'PASS' indicates that all single sample filters passed for this sample\">");
-    bcf_hdr_sync(_bcf_header);
     _normaliser = normaliser;
-    FillBuffer();
-
-    // flush variant buffer to get rid of variants overlapping 
-    // the interval start
-    if(region.find(":")!=std::string::npos)
+    //-r/-R as they are, with the contig ids records come with. The regions read are different ones when seeking from
+    //site to site, reading a chunk or reading contigs out of the file's order.
+    if (!region.empty())
     {
-        string chr;
-        int64_t start=0, end = 0;
-        stringutil::parsePos(region, chr, start, end);
-        if (!region.empty())
-        {
-            int rid = bcf_hdr_name2id(_bcf_header, chr.c_str());
-            FlushBuffer(rid, start);
-        }
+        std::vector<ggutils::region_t> parsed;
+        is_file ? ggutils::read_regions_file(region, parsed) : ggutils::parse_regions(region, parsed);
+        VcfReader::SortRegions(_bcf_header, parsed, _regions, _region_rids);
     }
+    FillBuffer();
 
     //Checking and warning if a few tags are not present. This is how we support legacy GVCFs without crashing.
     if(bcf_hdr_id2int(_bcf_header, BCF_DT_ID, "ADF")==-1)
-        _lg->warn("WARNING: {} has no FORMAT/ADF tag",input_gvcf);
+        _lg->warn("WARNING: {} has no FORMAT/ADF tag",_input_gvcf);
     if(bcf_hdr_id2int(_bcf_header, BCF_DT_ID, "ADR")==-1)
-        _lg->warn("WARNING: {} has no FORMAT/ADR tag",input_gvcf);
+        _lg->warn("WARNING: {} has no FORMAT/ADR tag",_input_gvcf);
     if(bcf_hdr_id2int(_bcf_header, BCF_DT_ID, "PL")==-1) 
-        _lg->warn("WARNING: {} has no FORMAT/PL tag",input_gvcf);
+        _lg->warn("WARNING: {} has no FORMAT/PL tag",_input_gvcf);
     if(bcf_hdr_id2int(_bcf_header, BCF_DT_ID, "MQ")==-1)
-        _lg->warn("WARNING: {} has no MQ tag",input_gvcf);
+        _lg->warn("WARNING: {} has no MQ tag",_input_gvcf);
 }
 
 bool GVCFReader::HasPl()
@@ -96,12 +163,8 @@ bool GVCFReader::HasStrandAd()
 
 GVCFReader::~GVCFReader()
 {
-    if (_bcf_reader->errnum)
-    {
-        error("Error: %s\n", bcf_sr_strerror(_bcf_reader->errnum));
-    }
-    bcf_sr_destroy(_bcf_reader);
-    bcf_hdr_destroy(_bcf_header);
+    delete _reader;
+    bcf_destroy(_bcf_record);
 }
 
 size_t GVCFReader::FillBuffer()
@@ -112,7 +175,7 @@ size_t GVCFReader::FillBuffer()
         ReadLines(2);
     }
     while (_variant_buffer.Size() > 1 && _variant_buffer.Back()->rid == _variant_buffer.Front()->rid &&
-           (_variant_buffer.Back()->pos - _variant_buffer.Front()->pos) < _buffer_size)
+           (_variant_buffer.Back()->pos - _variant_buffer.Front()->pos) < GetLookAhead())
     {
         int num_read = ReadLines(1);
         if (num_read == 0)
@@ -124,18 +187,36 @@ size_t GVCFReader::FillBuffer()
     return (_variant_buffer.Size());
 }
 
+void GVCFReader::SetBufferSize(int buffer_size)
+{
+    if (buffer_size < 2)
+    {
+        ggutils::die("GVCFReader needs buffer size of at least 2");
+    }
+    _buffer_size = buffer_size;
+}
+
+int GVCFReader::GetBufferedSpan()
+{
+    if (_variant_buffer.Size() < 2 || _variant_buffer.Back()->rid != _variant_buffer.Front()->rid)
+    {
+        return (0);
+    }
+    return (_variant_buffer.Back()->pos - _variant_buffer.Front()->pos);
+}
+
 int GVCFReader::ReadUntil(int rid, int pos)
 {
     int num_read = 0;
 //    bcf1_t *rec=_variant_buffer.back();
-    DepthBlock *db = _depth_buffer.Back();
-    while (db == nullptr)
+    while (_depth_buffer.empty())
     {
         ReadLines(1);
-        db = _depth_buffer.Back();
     }
 
-    while (db != nullptr && bcf_sr_has_line(_bcf_reader, 0) && (db->rid() < rid || (db->rid() == rid && db->end() < pos)))
+    size_t back = _depth_buffer.size() - 1;
+    while (!IsEof() && (_depth_buffer.GetRid(back) < rid ||
+                        (_depth_buffer.GetRid(back) == rid && _depth_buffer.GetEnd(back) < pos)))
     {
         if (ReadLines(1) < 1)
         {
@@ -145,12 +226,28 @@ int GVCFReader::ReadUntil(int rid, int pos)
         {
             num_read++;
         }
-        db = _depth_buffer.Back();
+        back = _depth_buffer.size() - 1;
     }
 
     return (num_read);
 }
 
+int GVCFReader::ReadVariantsUntil(int rid, int pos)
+{
+    int num_read = 0;
+    bcf1_t *back = _variant_buffer.IsEmpty() ? nullptr : _variant_buffer.Back();
+    while (back == nullptr || back->rid < rid || (back->rid == rid && back->pos <= pos))
+    {
+        if (ReadLines(1) == 0)
+        {
+            break;
+        }
+        num_read++;
+        back = _variant_buffer.Back();
+    }
+    return (num_read);
+}
+
 int GVCFReader::ReadLines(const unsigned num_lines)
 {
     if (num_lines == 0)
@@ -159,13 +256,29 @@ int GVCFReader::ReadLines(const unsigned num_lines)
     }
 
     unsigned num_read = 0;
+    int region_index;
+    //with stats, reading is timed on the thread's clock, normalisation is taken out of it
+    StageClock *clock = _stats != nullptr ? StageClock::Current() : nullptr;
+    run_stage_t previous = STAGE_NONE;
+    uint64_t start = 0, normalise = 0, num_records = 0, num_invalid = 0;
+    size_t num_duplicates = _variant_buffer.GetNumDuplicatedRecords();
+    if (clock != nullptr)
+    {
+        previous = clock->Switch(STAGE_READ);
+        start = clock->GetLast();
+    }
 
-    while (num_read < num_lines && bcf_sr_next_line(_bcf_reader))
+    while (num_read < num_lines && NextRecord(region_index))
     {
-        _bcf_record = bcf_sr_get_line(_bcf_reader, 0);
+        num_records++;
 #ifdef DEBUG
         ggutils::print_variant(_bcf_header,_bcf_record);
 #endif
+        if (region_index != _region_index)
+        {
+            _region_index = region_index;
+            _depth_buffer.AllowGap();
+        }
 
         if(_bcf_record->n_allele>1)
         {
@@ -185,45 +298,126 @@ int GVCFReader::ReadLines(const unsigned num_lines)
 		free(filter.s);
 		
 		vector<bcf1_t *> atomised_variants;
-		_normaliser->Unarise(_bcf_record, atomised_variants,_bcf_header);
+		if (clock != nullptr)
+		{
+		    clock->Switch(STAGE_NORMALISE);
+		    uint64_t normalise_start = clock->GetLast();
+		    _normaliser->Unarise(_bcf_record, atomised_variants,_bcf_header,_sample_names[0].c_str());
+		    clock->Switch(STAGE_READ);
+		    normalise += clock->GetLast() - normalise_start;
+		}
+		else
+		{
+		    _normaliser->Unarise(_bcf_record, atomised_variants,_bcf_header,_sample_names[0].c_str());
+		}
 		for (auto v = atomised_variants.begin();v!=atomised_variants.end();v++)
 		{
+		    _longest_variant = std::max(_longest_variant, (int) (*v)->rlen);
+		    if (StartsOutsideRegions(*v))
+		    {
+		        bcf_destroy(*v);
+		        continue;
+		    }
 		    _variant_buffer.PushBack(_bcf_header, *v);
 		}
 		num_read++;
 	    }
 	    else
 	    {
+		num_invalid++;
 		_lg->warn("WARNING: {} from {} is not a valid GVCFGenotyper variant, this record will be ignored.",ggutils::record2string(_bcf_header,_bcf_record),_input_gvcf);
 	    }
         }
-        int32_t dp;
-        //buffer a depth block. FIXME: this should really all be in the DepthBlock constructor.
-        if(ggutils::bcf1_get_one_format_int(_bcf_header, _bcf_record, "DP",dp)==1)
+        //reference blocks and variant lines with FORMAT/DP both give the depth of the sample at their positions
+        _depth_buffer.push_back(_bcf_header, _bcf_record);
+    }
+    if (clock != nullptr)
+    {
+        clock->Switch(previous);
+        _stats->Add(num_records, num_read, clock->GetLast() - start - normalise, normalise);
+    }
+    else if (_stats != nullptr)
+    {
+        _stats->Add(num_records, num_read, 0, 0);
+    }
+    if (_stats != nullptr && num_records > 0)
+    {
+        _stats->AddSkipped(num_invalid, _variant_buffer.GetNumDuplicatedRecords() - num_duplicates);
+        _stats->UpdatePeaks(_variant_buffer.Size(), _depth_buffer.size());
+    }
+    UpdateMemory();
+    return (num_read);
+}
+
+//reads the next line into _bcf_record, from _read_ahead if there is one
+//Variants are kept when they start in a -r/-R region, or after the last region of their contig (a record overlapping
+//the region that normalises to more than one variant). One that starts before a region (and after the end of the one
+//before) only overlaps it, which is the same for the first region as for any other and for -r as for -R.
+bool GVCFReader::StartsOutsideRegions(bcf1_t *variant)
+{
+    //first region on the variant's contig that ends at or after it
+    auto first = std::lower_bound(_region_rids.begin(), _region_rids.end(), variant->rid);
+    auto last = std::upper_bound(first, _region_rids.end(), variant->rid);
+    size_t begin = first - _region_rids.begin(), end = last - _region_rids.begin();
+    while (begin < end)
+    {
+        size_t middle = (begin + end) / 2;
+        if (_regions[middle].end < variant->pos)
+        {
+            begin = middle + 1;
+        }
+        else
         {
-            int ploidy = ggutils::get_ploidy(_bcf_header,_bcf_record);
-            int start = _bcf_record->pos;
-            int32_t dpf, gq, end;
-            end = ggutils::get_end_of_gvcf_block(_bcf_header, _bcf_record);
-            //If the record has FORMAT/GQ, use that, otherwise take FORMAT/GQX (illumina gvcf quirk).
-            int status = ggutils::bcf1_get_one_format_int(_bcf_header,_bcf_record,"GQ",gq);
-            if(status!=1)
-            {
-                float tmp;
-                status = ggutils::bcf1_get_one_format_float(_bcf_header, _bcf_record, "GQ", tmp);
-                if (status == 1)
-                    gq = bcf_float_is_missing(tmp) ? 0 : (int32_t) tmp; //replace missing values with 0
-                if (status != 1)
-                    status = ggutils::bcf1_get_one_format_int(_bcf_header, _bcf_record, "GQX", gq);
-                if (status != 1)
-                    ggutils::die("no FORMAT/GQ found");
-            }
-            gq = gq==bcf_int32_missing ? 0 : gq; //replace missing values with 0
-            ggutils::bcf1_get_one_format_int(_bcf_header,_bcf_record,"DPF",dpf);
-            _depth_buffer.push_back(DepthBlock(_bcf_record->rid, start, end, dp, dpf, gq, ploidy));
+            end = middle;
         }
     }
-    return (num_read);
+    return (begin < _regions.size() && _region_rids[begin] == variant->rid && variant->pos < _regions[begin].start);
+}
+
+int GVCFReader::NextRecord(int &region_index)
+{
+    if (_read_ahead != nullptr)
+    {
+        int ret = _read_ahead->Next(_stream, _bcf_record, region_index);
+        _eof = ret == 0;
+        return (ret);
+    }
+    int ret = _reader->Next(_bcf_record);
+    region_index = _reader->GetRegionIndex();
+    return (ret);
+}
+
+bool GVCFReader::IsEof()
+{
+    return (_read_ahead != nullptr ? _eof : _reader->IsEof());
+}
+
+void GVCFReader::SetReadAhead(ReadAhead *read_ahead)
+{
+    _read_ahead = read_ahead;
+    _stream = _read_ahead->Add(_reader);
+}
+
+int GVCFReader::ReadAll()
+{
+    return (ReadLines(std::numeric_limits<unsigned>::max()));
+}
+
+void GVCFReader::SetRegions(const std::vector<ggutils::region_t> &regions)
+{
+    if (_read_ahead != nullptr)
+    {
+        ggutils::die("GVCFReader::SetRegions cannot be used once records are read ahead");
+    }
+    FlushBuffer();
+    _reader->SetRegions(regions);
+    _region_index = -1;
+    UpdateMemory(true);
+}
+
+bcf1_t *GVCFReader::GetVariant(size_t index)
+{
+    return (_variant_buffer.At(index));
 }
 
 bcf1_t *GVCFReader::Front()
@@ -261,6 +455,11 @@ bcf_hdr_t *GVCFReader::GetHeader()
     return (_bcf_header);
 }
 
+const std::string &GVCFReader::GetSampleName(int index) const
+{
+    return (_sample_names.at(index));
+}
+
 //gets dp/dpf/gq (possibly interpolated) for a give interval a<=x<b
 void GVCFReader::GetDepth(int rid, int start, int stop, DepthBlock &db)
 {
@@ -18,15 +18,31 @@ extern "C" {
 #include "Normaliser.hh"
 #include "VariantBuffer.hh"
 #include "DepthBuffer.hh"
+#include "VcfReader.hh"
+#include "ReadAhead.hh"
+#include "RunStats.hh"
+#include "HeaderCache.hh"
 
 #include "spdlog.h"
 
+//a reader only updates MemoryStats once its buffers have changed by this many bytes, so that threads reading
+//different GVCFs do not all write the same counters at every site
+#define MEMORY_UPDATE_BYTES 16384
+
 
 class GVCFReader
 {
 public:
+    //if regions is given only records overlapping those regions are read (see SiteUnion), region is then
+    //only used to drop variants that start outside it. If output_header is given records come with its contig ids
+    //(see HeaderCache::MapContigs), and so does GetHeader.
     GVCFReader(const std::string &input_gvcf,Normaliser *normaliser, const int buffer_size,
-               const string &region = "", const int is_file = 0);
+               const string &region = "", const int is_file = 0,
+               const std::vector<ggutils::region_t> *regions = nullptr, const bcf_hdr_t *output_header = nullptr);
+    //as above for a GVCF that is already open, the GVCFReader takes ownership of reader
+    GVCFReader(VcfReader *reader,Normaliser *normaliser, const int buffer_size,
+               const string &region = "", const int is_file = 0,
+               const std::vector<ggutils::region_t> *regions = nullptr, const bcf_hdr_t *output_header = nullptr);
 
     ~GVCFReader();
 
@@ -41,25 +57,84 @@ public:
     bcf1_t *Front(); //return pointer to current vcf record
     bcf1_t *Pop(); //return pointer to current vcf record and remove it from buffer
     int ReadLines(const unsigned num_lines); //read at most num_lines
+    int ReadAll(); //read everything left in the file (or regions)
+    //discards everything buffered and restricts further reading to regions
+    void SetRegions(const std::vector<ggutils::region_t> &regions);
+    //records are read on read_ahead's threads from now on, SetRegions can no longer be used
+    void SetReadAhead(ReadAhead *read_ahead);
+    //the normaliser is not thread-safe, so each thread reading GVCFs needs its own
+    void SetNormaliser(Normaliser *normaliser) { _normaliser = normaliser; }
+    //records read from now on, and the time spent reading and normalising them, are added to stats
+    void SetStats(reader_stats_t *stats) { _stats = stats; }
+    //the reader's buffers, headers and index are accounted to memory from now on, and taken out of the
+    //previous MemoryStats. nullptr stops the accounting.
+    void SetMemoryStats(MemoryStats *memory);
+    //contigs that have records according to the GVCF's index
+    std::vector<std::string> GetIndexedContigs() { return _reader->GetIndexedContigs(); }
+    //index'th buffered variant, lets the sites of a chunk be planned without flushing the buffer
+    bcf1_t *GetVariant(size_t index);
+    //reads until the buffered variants span GetLookAhead() bp (or a contig or the file ends)
     size_t FillBuffer();
+    //the bp FillBuffer keeps buffered ahead of the first variant, lets the merge adapt it to its memory (see
+    //GVCFMerger::SetMaxMemory)
+    void SetBufferSize(int buffer_size);
+    int GetBufferSize() const { return _buffer_size; }
+    //the buffer size, or more when a variant read so far is longer, so that every variant overlapping a buffered
+    //deletion is buffered with it
+    int GetLookAhead() const { return std::max(_buffer_size, _longest_variant); }
+    //bp between the first and last buffered variant, 0 if they are on different contigs
+    int GetBufferedSpan();
+    //variants and reference blocks buffered, and their bytes
+    size_t GetNumBufferedRecords() { return _variant_buffer.Size() + _depth_buffer.size(); }
+    size_t GetBufferedBytes() const { return _variant_buffer.GetBytes() + _depth_buffer.GetBytes(); }
 
     //gets dp/dpf/gq (possibly interpolated) for a give interval
     void GetDepth(int rid, int start, int end, DepthBlock &db);
     bool IsEmpty();
     size_t GetNumVariants();
     size_t GetNumDepthBlocks();
+    //index'th buffered homref block, these are flushed along with the variants
+    DepthBlock GetDepthBlock(size_t index) { return _depth_buffer.At(index); }
+    //position of the index'th homref block, without decoding it
+    int GetDepthBlockRid(size_t index) const { return _depth_buffer.GetRid(index); }
+    int GetDepthBlockStart(size_t index) const { return _depth_buffer.GetStart(index); }
+    int GetDepthBlockEnd(size_t index) const { return _depth_buffer.GetEnd(index); }
+    //the header records are read with, possibly shared with other readers (see HeaderCache), so its sample names
+    //are not necessarily this GVCF's
     bcf_hdr_t *GetHeader();
+    int GetNumSamples() const { return ((int) _sample_names.size()); }
+    const std::string &GetSampleName(int index = 0) const;
     int ReadUntil(int rid, int pos);
+    //reads until a variant after rid:pos is buffered (or the end of the file), returns the number of variants read
+    int ReadVariantsUntil(int rid, int pos);
     bool HasStrandAd();
     bool HasPl();
 private:
+    int NextRecord(int &region_index);
+    bool StartsOutsideRegions(bcf1_t *variant);
+    bool IsEof();
+    void UpdateMemory(bool force = false);
+
     int _buffer_size;//ensure buffer has at least _buffer_size/2 variants avaiable (except at end of file)
-    bcf_srs_t *_bcf_reader;//htslib synced reader.
+    int _longest_variant;//rlen of the longest variant read
+    VcfReader *_reader;
+    ReadAhead *_read_ahead;//nullptr when records are read on the calling thread
+    size_t _stream;//of _reader in _read_ahead
+    bool _eof;//_read_ahead had no more records
+    int _region_index;//region of the last record read, a change means the depth blocks may have a gap
+    std::vector<ggutils::region_t> _regions;//-r/-R sorted and merged, empty for the whole file
+    std::vector<int> _region_rids;
     bcf1_t *_bcf_record;
-    bcf_hdr_t *_bcf_header;
+    std::shared_ptr<const contig_map_t> _contigs;//nullptr unless records are given the output header's contig ids
+    std::shared_ptr<bcf_hdr_t> _shared_header;//declared ahead of the buffers so it outlives them
+    bcf_hdr_t *_bcf_header;//_shared_header.get()
+    std::vector<std::string> _sample_names;
     VariantBuffer _variant_buffer;
     DepthBuffer _depth_buffer;
     Normaliser *_normaliser;
+    reader_stats_t *_stats;//nullptr if nothing is counted
+    MemoryStats *_memory;//nullptr if memory is not accounted
+    int64_t _memory_published[MEM_TOTAL];//bytes of each component added to _memory
     std::shared_ptr<spdlog::logger> _lg;
     std::string _input_gvcf;
 };
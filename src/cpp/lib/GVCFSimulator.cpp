@@ -0,0 +1,450 @@
+#include "GVCFSimulator.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+extern "C" {
+#include <htslib/bgzf.h>
+#include <htslib/faidx.h>
+#include <htslib/tbx.h>
+}
+
+//GVCF text is compressed this many bytes at a time
+#define SIM_WRITE_BUFFER 65536
+
+static const char *bases = "ACGT";
+
+GVCFSimulator::GVCFSimulator(const simulation_t &params)
+{
+    _params = params;
+    _lg = spdlog::get("gg_logger");
+    if (_params.num_samples < 1 || _params.num_contigs < 1 || _params.contig_length < 100)
+    {
+        ggutils::die("gvcfgenotyper simulate needs at least one sample, one contig and contigs of at least 100bp");
+    }
+    if (_params.mean_block_length < 1)
+    {
+        ggutils::die("the mean reference block length has to be at least 1");
+    }
+    for (int c = 0; c < _params.num_contigs; c++)
+    {
+        _contigs.push_back("chr" + std::to_string(c + 1));
+    }
+    SimulateReference();
+    SimulateSites();
+    _lg->info("Simulated {} sites on {} contigs of {} bp", _sites.size(), _params.num_contigs, _params.contig_length);
+}
+
+std::string GVCFSimulator::RandomBases(std::mt19937 &rng, int length)
+{
+    std::string seq(length, 'A');
+    for (int i = 0; i < length; i++)
+    {
+        seq[i] = bases[rng() % 4];
+    }
+    return (seq);
+}
+
+void GVCFSimulator::SimulateReference()
+{
+    std::mt19937 rng(_params.seed);
+    std::uniform_real_distribution<double> u(0, 1);
+    for (int c = 0; c < _params.num_contigs; c++)
+    {
+        std::string seq = RandomBases(rng, _params.contig_length);
+        for (int i = 1; i < _params.contig_length; i++)
+        {
+            //homopolymer runs, so that some indels are not left aligned as called
+            if (u(rng) < 0.15)
+            {
+                seq[i] = seq[i - 1];
+            }
+        }
+        _sequences.push_back(seq);
+    }
+}
+
+void GVCFSimulator::SimulateSites()
+{
+    std::mt19937 rng(_params.seed + 1);
+    std::uniform_real_distribution<double> u(0, 1);
+    double rate = _params.snp_rate + _params.indel_rate + _params.mnp_rate;
+    if (rate <= 0)
+    {
+        return;
+    }
+    std::geometric_distribution<int> gap(std::min(rate, 1.0));
+    for (int rid = 0; rid < _params.num_contigs; rid++)
+    {
+        const std::string &seq = _sequences[rid];
+        int pos = 0;
+        while (true)
+        {
+            pos += 1 + gap(rng);
+            if (pos >= _params.contig_length - 20)
+            {
+                break;
+            }
+            sim_site_t site;
+            site.rid = rid;
+            site.pos = pos;
+            double type = u(rng) * rate;
+            bool multiallelic = u(rng) < _params.multiallelic_rate;
+            if (type < _params.snp_rate)
+            {
+                site.indel = false;
+                site.ref = seq.substr(pos, 1);
+                std::string alts;
+                for (int b = 0; b < 4; b++)
+                {
+                    if (bases[b] != seq[pos])
+                    {
+                        alts += bases[b];
+                    }
+                }
+                std::shuffle(alts.begin(), alts.end(), rng);
+                site.alts.push_back(alts.substr(0, 1));
+                if (multiallelic)
+                {
+                    site.alts.push_back(alts.substr(1, 1));
+                }
+            }
+            else if (type < _params.snp_rate + _params.indel_rate)
+            {
+                site.indel = true;
+                int length = 1 + rng() % 10;
+                if (u(rng) < 0.5)
+                {
+                    site.ref = seq.substr(pos, 1);
+                    site.alts.push_back(site.ref + RandomBases(rng, length));
+                    if (multiallelic)
+                    {
+                        site.alts.push_back(site.ref + RandomBases(rng, length + 1));
+                    }
+                }
+                else
+                {
+                    site.ref = seq.substr(pos, length + 1);
+                    site.alts.push_back(seq.substr(pos, 1));
+                    if (multiallelic)
+                    {
+                        //an insertion after the deleted bases, which normalises to another position
+                        site.alts.push_back(site.ref + RandomBases(rng, 1));
+                    }
+                }
+            }
+            else
+            {
+                site.indel = false;
+                int length = 2 + rng() % 2;
+                site.ref = seq.substr(pos, length);
+                for (int k = 0; k < (multiallelic ? 2 : 1); k++)
+                {
+                    std::string alt = site.ref;
+                    for (int i = 0; i < length; i++)
+                    {
+                        alt[i] = bases[(strchr(bases, alt[i]) - bases + 1 + k + rng() % 2) % 4];
+                    }
+                    site.alts.push_back(alt);
+                }
+                if (multiallelic && site.alts[0] == site.alts[1])
+                {
+                    site.alts.pop_back();
+                }
+            }
+            //mostly rare variants, but every site is carried by about one sample or more
+            double freq = std::max(0.5 * pow(u(rng), 3), 0.5 / _params.num_samples);
+            site.freq.push_back(freq);
+            if (site.alts.size() > 1)
+            {
+                site.freq.push_back(freq * u(rng));
+            }
+            _sites.push_back(site);
+            pos += site.ref.size();
+        }
+    }
+}
+
+void GVCFSimulator::WriteHeader(std::string &out, const std::string &sample)
+{
+    out += "##fileformat=VCFv4.1\n";
+    out += "##FILTER=<ID=PASS,Description=\"All filters passed\">\n";
+    out += "##source=gvcfgenotyper simulate\n";
+    out += "##INFO=<ID=END,Number=1,Type=Integer,Description=\"End position of the region described in this record\">\n";
+    out += "##INFO=<ID=BLOCKAVG_min30p3a,Number=0,Type=Flag,Description=\"Non-variant multi-site block\">\n";
+    out += "##INFO=<ID=SNVHPOL,Number=1,Type=Integer,Description=\"SNV contextual homopolymer length\">\n";
+    out += "##INFO=<ID=MQ,Number=1,Type=Integer,Description=\"RMS of mapping quality\">\n";
+    out += "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">\n";
+    out += "##FORMAT=<ID=GQ,Number=1,Type=Float,Description=\"Genotype Quality\">\n";
+    out += "##FORMAT=<ID=GQX,Number=1,Type=Integer,Description=\"Empirically calibrated genotype quality score\">\n";
+    out += "##FORMAT=<ID=DP,Number=1,Type=Integer,Description=\"Filtered basecall depth used for site genotyping\">\n";
+    out += "##FORMAT=<ID=DPF,Number=1,Type=Integer,Description=\"Basecalls filtered from input prior to site genotyping\">\n";
+    out += "##FORMAT=<ID=MIN_DP,Number=1,Type=Integer,Description=\"Minimum filtered basecall depth used for site genotyping within a non-variant multi-site block\">\n";
+    out += "##FORMAT=<ID=AD,Number=.,Type=Integer,Description=\"Allelic depths for the ref and alt alleles in the order listed\">\n";
+    out += "##FORMAT=<ID=ADF,Number=.,Type=Integer,Description=\"Allelic depths on the forward strand\">\n";
+    out += "##FORMAT=<ID=ADR,Number=.,Type=Integer,Description=\"Allelic depths on the reverse strand\">\n";
+    out += "##FORMAT=<ID=FT,Number=1,Type=String,Description=\"Sample filter, 'PASS' indicates that all filters have passed for this sample\">\n";
+    out += "##FORMAT=<ID=DPI,Number=1,Type=Integer,Description=\"Read depth associated with indel, taken from the site preceding the indel\">\n";
+    out += "##FORMAT=<ID=PL,Number=G,Type=Integer,Description=\"Normalized, Phred-scaled likelihoods for genotypes as defined in the VCF specification\">\n";
+    out += "##FORMAT=<ID=SB,Number=1,Type=Float,Description=\"Sample site strand bias\">\n";
+    out += "##FILTER=<ID=LowGQX,Description=\"Locus GQX is below threshold or not present\">\n";
+    for (int c = 0; c < _params.num_contigs; c++)
+    {
+        out += "##contig=<ID=" + _contigs[c] + ",length=" + std::to_string(_params.contig_length) + ">\n";
+    }
+    out += "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\t" + sample + "\n";
+}
+
+//compresses out to fp once it is large enough (or always with force)
+static void flush_text(BGZF *fp, std::string &out, bool force)
+{
+    if (out.size() >= SIM_WRITE_BUFFER || (force && !out.empty()))
+    {
+        if (bgzf_write(fp, out.data(), out.size()) < 0)
+        {
+            ggutils::die("problem writing simulated GVCF");
+        }
+        out.clear();
+    }
+}
+
+void GVCFSimulator::WriteSample(int index, const std::string &fname)
+{
+    std::seed_seq seed = {_params.seed, (unsigned int) index};
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> u(0, 1);
+    std::geometric_distribution<int> block_length(1.0 / _params.mean_block_length);
+    int mean_depth = 20 + rng() % 21;
+    bool haploid_sample = u(rng) < _params.haploid_fraction;
+
+    BGZF *fp = bgzf_open(fname.c_str(), "w");
+    if (fp == nullptr)
+    {
+        ggutils::die("problem opening " + fname);
+    }
+    char sample[32];
+    snprintf(sample, sizeof(sample), "SIM%05d", index + 1);
+    std::string out;
+    WriteHeader(out, sample);
+
+    auto site = _sites.begin();
+    for (int rid = 0; rid < _params.num_contigs; rid++)
+    {
+        const std::string &chrom = _contigs[rid];
+        const std::string &seq = _sequences[rid];
+        bool haploid = haploid_sample && rid == _params.num_contigs - 1;
+        int ploidy = haploid ? 1 : 2;
+        int covered = 0;//bases before this have a record
+        auto write_blocks = [&](int start, int end)
+        {
+            while (start <= end)
+            {
+                int stop = std::min(end, start + block_length(rng));
+                int dp = (int) (mean_depth * (0.6 + 0.8 * u(rng)));
+                int min_dp = (int) (dp * (0.7 + 0.3 * u(rng)));
+                int dpf = rng() % 3;
+                int gqx = std::min(3 * dp, 300);
+                bool missing = u(rng) < _params.missing_rate;
+                out += chrom + "\t" + std::to_string(start + 1) + "\t.\t" + seq[start] + "\t.\t.\tPASS\t";
+                out += stop > start ? "END=" + std::to_string(stop + 1) + ";BLOCKAVG_min30p3a" : ".";
+                out += "\tGT:GQX:DP:DPF:MIN_DP\t";
+                out += haploid ? "0" : "0/0";
+                out += ":" + (missing && u(rng) < 0.5 ? "." : std::to_string(gqx));
+                out += ":" + std::to_string(dp) + ":" + (missing ? "." : std::to_string(dpf)) + ":" + std::to_string(min_dp) + "\n";
+                flush_text(fp, out, false);
+                start = stop + 1;
+            }
+        };
+
+        for (; site != _sites.end() && site->rid == rid; site++)
+        {
+            //alleles of the sample, 0 is REF
+            int gt[2] = {0, 0};
+            for (int k = 0; k < ploidy; k++)
+            {
+                double r = u(rng);
+                for (size_t a = 0; a < site->freq.size(); a++)
+                {
+                    if (r < site->freq[a])
+                    {
+                        gt[k] = (int) a + 1;
+                        break;
+                    }
+                    r -= site->freq[a];
+                }
+            }
+            if (gt[0] == 0 && gt[1] == 0)
+            {
+                continue;
+            }
+            //indels have no DP, a reference block covers the base before them (as in Strelka's GVCFs)
+            write_blocks(covered, site->indel ? site->pos : site->pos - 1);
+            covered = site->indel ? site->pos + 1 : site->pos + (int) site->ref.size();
+
+            //the sample's record only has the ALTs it carries
+            std::vector<int> alts;
+            for (int k = 0; k < ploidy; k++)
+            {
+                if (gt[k] > 0 && std::find(alts.begin(), alts.end(), gt[k]) == alts.end())
+                {
+                    alts.push_back(gt[k]);
+                }
+            }
+            std::sort(alts.begin(), alts.end());
+            int num_allele = (int) alts.size() + 1;
+            int call[2];
+            for (int k = 0; k < ploidy; k++)
+            {
+                call[k] = gt[k] == 0 ? 0 : (int) (std::find(alts.begin(), alts.end(), gt[k]) - alts.begin()) + 1;
+            }
+            if (ploidy == 2 && call[0] > call[1])
+            {
+                std::swap(call[0], call[1]);
+            }
+
+            int dp = (int) (mean_depth * (0.6 + 0.8 * u(rng)));
+            std::vector<int> ad(num_allele, 0);
+            for (int r = 0; r < dp; r++)
+            {
+                ad[call[ploidy == 2 ? rng() % 2 : 0]]++;
+            }
+            std::vector<int> pl;
+            int gq = 999;
+            for (int j = 0; j < num_allele; j++)
+            {
+                for (int i = 0; i <= (ploidy == 2 ? j : 0); i++)
+                {
+                    int g0 = ploidy == 2 ? i : j, g1 = j;
+                    int mismatches = ploidy == 2 ? (g0 != call[0]) + (g1 != call[1]) : (g1 != call[0]);
+                    pl.push_back(std::min(999, mismatches * (3 * dp + (int) (rng() % 10))));
+                    if (pl.back() > 0)
+                    {
+                        gq = std::min(gq, pl.back());
+                    }
+                }
+            }
+            int gqx = std::min(gq, 3 * dp);
+            int missing = u(rng) < _params.missing_rate ? 1 + rng() % 4 : 0;
+            std::string filter = missing == 4 ? "LowGQX" : "PASS";
+
+            out += chrom + "\t" + std::to_string(site->pos + 1) + "\t.\t" + site->ref + "\t";
+            for (size_t a = 0; a < alts.size(); a++)
+            {
+                out += (a > 0 ? "," : "") + site->alts[alts[a] - 1];
+            }
+            out += "\t" + std::to_string(gq) + "\t" + filter + "\t";
+            out += site->indel ? "MQ=60" : "SNVHPOL=" + std::to_string(1 + rng() % 5) + ";MQ=60";
+            out += site->indel ? "\tGT:GQ:GQX:DPI:AD" : "\tGT:GQ:GQX:DP:DPF:AD";
+            out += missing == 3 ? "" : ":ADF:ADR";
+            out += site->indel ? ":FT" : ":SB:FT";
+            out += missing == 2 ? "" : ":PL";
+            out += "\t" + std::to_string(call[0]) + (ploidy == 2 ? "/" + std::to_string(call[1]) : "");
+            out += ":" + std::to_string(gq) + ":" + (missing == 1 ? "." : std::to_string(gqx)) + ":" + std::to_string(dp);
+            if (!site->indel)
+            {
+                out += ":" + std::to_string(rng() % 3);
+            }
+            std::string adf, adr, ads;
+            for (int a = 0; a < num_allele; a++)
+            {
+                int forward = ad[a] / 2 + (ad[a] % 2 == 1 ? (int) (rng() % 2) : 0);
+                ads += (a > 0 ? "," : "") + std::to_string(ad[a]);
+                adf += (a > 0 ? "," : "") + std::to_string(forward);
+                adr += (a > 0 ? "," : "") + std::to_string(ad[a] - forward);
+            }
+            out += ":" + ads;
+            if (missing != 3)
+            {
+                out += ":" + adf + ":" + adr;
+            }
+            if (!site->indel)
+            {
+                out += ":" + std::to_string(-(int) (rng() % 100)) + ".0";
+            }
+            out += ":" + filter;
+            if (missing != 2)
+            {
+                for (size_t g = 0; g < pl.size(); g++)
+                {
+                    out += (g > 0 ? "," : ":") + std::to_string(pl[g]);
+                }
+            }
+            out += "\n";
+            flush_text(fp, out, false);
+        }
+        write_blocks(covered, _params.contig_length - 1);
+    }
+    flush_text(fp, out, true);
+    if (bgzf_close(fp) < 0)
+    {
+        ggutils::die("problem closing " + fname);
+    }
+    if (tbx_index_build(fname.c_str(), 0, &tbx_conf_vcf) < 0)
+    {
+        ggutils::die("problem indexing " + fname);
+    }
+}
+
+void GVCFSimulator::Write(const std::string &output_dir, int num_threads)
+{
+    std::string ref_fname = output_dir + "/ref.fa";
+    std::ofstream ref(ref_fname);
+    if (!ref)
+    {
+        ggutils::die("problem opening " + ref_fname);
+    }
+    for (int c = 0; c < _params.num_contigs; c++)
+    {
+        ref << ">" << _contigs[c] << "\n";
+        for (int i = 0; i < _params.contig_length; i += 60)
+        {
+            ref << _sequences[c].substr(i, 60) << "\n";
+        }
+    }
+    ref.close();
+    if (fai_build(ref_fname.c_str()) < 0)
+    {
+        ggutils::die("problem indexing " + ref_fname);
+    }
+
+    _files.clear();
+    for (int i = 0; i < _params.num_samples; i++)
+    {
+        char fname[32];
+        snprintf(fname, sizeof(fname), "/SIM%05d.genome.vcf.gz", i + 1);
+        _files.push_back(output_dir + fname);
+    }
+    std::atomic<int> next(0);
+    auto worker = [&]()
+    {
+        for (int i = next++; i < _params.num_samples; i = next++)
+        {
+            WriteSample(i, _files[i]);
+            if ((i + 1) % 1000 == 0)
+            {
+                _lg->info("Wrote {} of {} GVCFs", i + 1, _params.num_samples);
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int t = 1; t < num_threads; t++)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto it = threads.begin(); it != threads.end(); it++)
+    {
+        it->join();
+    }
+
+    std::ofstream list(output_dir + "/gvcfs.txt");
+    for (auto it = _files.begin(); it != _files.end(); it++)
+    {
+        list << *it << "\n";
+    }
+    _lg->info("Wrote {} GVCFs, {} and {}/gvcfs.txt", _files.size(), ref_fname, output_dir);
+}
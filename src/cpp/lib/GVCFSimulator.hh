@@ -0,0 +1,79 @@
+//
+// gvcfgenotyper simulate: writes a synthetic cohort of Illumina (Strelka) style GVCFs and their reference.
+//
+
+#ifndef GVCFGENOTYPER_GVCFSIMULATOR_HH
+#define GVCFGENOTYPER_GVCFSIMULATOR_HH
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ggutils.hh"
+#include "spdlog.h"
+
+//the cohort gvcfgenotyper simulate writes, the defaults are its defaults
+struct simulation_t
+{
+    int num_samples = 10;
+    int num_contigs = 1;
+    int contig_length = 1000000;
+    //variant sites of the cohort per bp, each sample carries a site with its own allele frequency
+    double snp_rate = 1e-3;
+    double indel_rate = 2e-4;
+    double mnp_rate = 2e-5;
+    //sites with a second ALT, samples may carry either ALT or both (a 1/2 record)
+    double multiallelic_rate = 0.05;
+    //reference block lengths are geometric with this mean, blocks of one base are written without END
+    int mean_block_length = 100;
+    //samples that are haploid on the last contig, as Strelka writes chrX of males
+    double haploid_fraction = 0.5;
+    //records with a missing value (GQX, PL, DPF or ADF/ADR) or a sample filter
+    double missing_rate = 0.01;
+    unsigned int seed = 1;
+};
+
+//Simulates the sites of a cohort on a random reference with short homopolymers (so that indels need normalising),
+//then each sample's genotypes at them. Sites do not overlap each other. Each sample's GVCF covers every base of
+//every contig with reference blocks and variant records like Strelka's: indels carry DPI rather than DP and a
+//reference block covers their first base, single base blocks have no END and haploid calls are written as such.
+//Samples are simulated from their own seed, so the GVCFs are the same whatever the number of threads.
+class GVCFSimulator
+{
+public:
+    explicit GVCFSimulator(const simulation_t &params);
+
+    //writes ref.fa (and .fai), a bgzipped and tabix indexed GVCF per sample and gvcfs.txt listing the GVCFs
+    //to output_dir, which has to exist. Samples are written on num_threads threads.
+    void Write(const std::string &output_dir, int num_threads = 1);
+
+    size_t GetNumSites() const { return _sites.size(); }
+    const std::vector<std::string> &GetFiles() const { return _files; }
+    const std::vector<std::string> &GetContigs() const { return _contigs; }
+
+private:
+    //a variant site of the cohort, alts[k] has frequency freq[k] in every sample
+    struct sim_site_t
+    {
+        int rid, pos;//0-based
+        std::string ref;
+        std::vector<std::string> alts;
+        std::vector<double> freq;
+        bool indel;
+    };
+
+    void SimulateReference();
+    void SimulateSites();
+    std::string RandomBases(std::mt19937 &rng, int length);
+    void WriteHeader(std::string &out, const std::string &sample);
+    void WriteSample(int index, const std::string &fname);
+
+    simulation_t _params;
+    std::vector<std::string> _contigs;
+    std::vector<std::string> _sequences;
+    std::vector<sim_site_t> _sites;
+    std::vector<std::string> _files;
+    std::shared_ptr<spdlog::logger> _lg;
+};
+
+#endif //GVCFGENOTYPER_GVCFSIMULATOR_HH
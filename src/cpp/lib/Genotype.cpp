@@ -432,7 +432,7 @@ void Genotype::SetPlFromGl()
     }
 }
 
-int Genotype::PropagateFormatFields(size_t sample_index, size_t ploidy, ggutils::vcf_data_t *format)
+void Genotype::PropagateScalarFields(size_t sample_index, ggutils::vcf_data_t *format)
 {
     assert(sample_index<format->num_sample);
     
@@ -448,6 +448,11 @@ int Genotype::PropagateFormatFields(size_t sample_index, size_t ploidy, ggutils:
 
     format->dp[sample_index] = dp();
     format->dpf[sample_index] = dpf();
+}
+
+int Genotype::PropagateFormatFields(size_t sample_index, size_t ploidy, ggutils::vcf_data_t *format)
+{
+    PropagateScalarFields(sample_index,format);
 
     //update Number=R (eg FORMAT/AD)
     for(int i=0;i<_num_allele;i++)
@@ -471,6 +476,35 @@ int Genotype::PropagateFormatFields(size_t sample_index, size_t ploidy, ggutils:
     return(1);
 }
 
+int Genotype::PropagateLocalFormatFields(size_t sample_index, size_t ploidy, const vector<int> &local_alleles, ggutils::vcf_data_t *format)
+{
+    assert(format->local && local_alleles.size()==(size_t)_num_allele);
+    PropagateScalarFields(sample_index,format);
+
+    //ADF/ADR stay Number=R, alleles this sample does not have get zero depth as in PropagateFormatFields
+    int32_t *adf_dst = format->adf + sample_index*format->num_allele;
+    int32_t *adr_dst = format->adr + sample_index*format->num_allele;
+    std::fill(adf_dst,adf_dst+format->num_allele,0);
+    std::fill(adr_dst,adr_dst+format->num_allele,0);
+    for(int i=0;i<_num_allele;i++)
+    {
+        adf_dst[local_alleles[i]] = adf(i);
+        adr_dst[local_alleles[i]] = adr(i);
+    }
+
+    //GT uses the site's allele indices
+    for(size_t i=0;i<ploidy;i++)
+    {
+        int32_t *dst = format->gt + sample_index*ploidy + i;
+        if(i>=(size_t)_ploidy) *dst = bcf_int32_vector_end;
+        else if(bcf_gt_is_missing(gt(i))) *dst = gt(i);
+        else *dst = bcf_gt_unphased(local_alleles[bcf_gt_allele(gt(i))]);
+    }
+
+    format->set_local_fields(sample_index,local_alleles,_ad,_pl,ggutils::get_number_of_likelihoods(_ploidy,_num_allele));
+    return(1);
+}
+
 void Genotype::SetGtToHomRef()
 {
     _gt[0] = bcf_gt_unphased(0);
@@ -496,7 +530,30 @@ void Genotype::MakeDiploid()
 Genotype::Genotype(bcf_hdr_t *sample_header,bcf1_t* sample_variants,multiAllele & alleles_to_map)
 {
     Genotype src(sample_header,sample_variants);
-    allocate(src.ploidy(),alleles_to_map.GetNumAlleles()+1);
+    vector<int> dst_index(sample_variants->n_allele);
+    for(int src_index=0;src_index<sample_variants->n_allele;src_index++)
+        dst_index[src_index]=alleles_to_map.AlleleIndex(sample_variants,src_index);
+    MapAlleles(src,dst_index,alleles_to_map.GetNumAlleles()+1);
+}
+
+Genotype::Genotype(bcf_hdr_t *sample_header,bcf1_t* sample_variants,multiAllele & alleles_to_map,vector<int> & local_alleles)
+{
+    Genotype src(sample_header,sample_variants);
+    vector<int> dst_index(sample_variants->n_allele);
+    for(int src_index=0;src_index<sample_variants->n_allele;src_index++)
+        dst_index[src_index]=alleles_to_map.AlleleIndex(sample_variants,src_index);
+    local_alleles.assign(dst_index.begin(),dst_index.end());
+    local_alleles.push_back(0);
+    std::sort(local_alleles.begin(),local_alleles.end());
+    local_alleles.erase(std::unique(local_alleles.begin(),local_alleles.end()),local_alleles.end());
+    for(size_t i=0;i<dst_index.size();i++)
+        dst_index[i] = std::lower_bound(local_alleles.begin(),local_alleles.end(),dst_index[i]) - local_alleles.begin();
+    MapAlleles(src,dst_index,local_alleles.size());
+}
+
+void Genotype::MapAlleles(Genotype &src, const vector<int> &dst_index, int num_allele)
+{
+    allocate(src.ploidy(),num_allele);
     SetDepthToZero();
     std::fill(_pl,_pl+ggutils::get_number_of_likelihoods(_ploidy,_num_allele),MAXPL);
     _qual = src.qual();
@@ -508,30 +565,30 @@ Genotype::Genotype(bcf_hdr_t *sample_header,bcf1_t* sample_variants,multiAllele
     
     if(!src.IsGtMissing())
     {
-        _gt[0] = bcf_gt_unphased(alleles_to_map.AlleleIndex(sample_variants,bcf_gt_allele(src.gt(0))));
-        if(src.ploidy()==2) _gt[1] = bcf_gt_unphased(alleles_to_map.AlleleIndex(sample_variants,bcf_gt_allele(src.gt(1))));
+        _gt[0] = bcf_gt_unphased(dst_index[bcf_gt_allele(src.gt(0))]);
+        if(src.ploidy()==2) _gt[1] = bcf_gt_unphased(dst_index[bcf_gt_allele(src.gt(1))]);
     }
-    for(int src_index=0;src_index<sample_variants->n_allele;src_index++)
+    int num_src_allele = dst_index.size();
+    for(int src_index=0;src_index<num_src_allele;src_index++)
     {
-        int dst_index=alleles_to_map.AlleleIndex(sample_variants,src_index);
-        SetAd(src.ad(src_index),dst_index);
+        int dst=dst_index[src_index];
+        SetAd(src.ad(src_index),dst);
         if(src.HasAdf() && src.HasAdr())
         {
-            _adf[dst_index] = src.adf(src_index);
-            _adr[dst_index] = src.adr(src_index);
+            _adf[dst] = src.adf(src_index);
+            _adr[dst] = src.adr(src_index);
         }
         if(src.HasPl())
         {
             if (_ploidy == 1)
             {
-                _pl[dst_index] = src.pl(src_index);
+                _pl[dst] = src.pl(src_index);
             }
             else
             {
-                for (int src_index2=src_index;src_index2<sample_variants->n_allele;src_index2++)
+                for (int src_index2=src_index;src_index2<num_src_allele;src_index2++)
                 {
-                    int dst_index2 = alleles_to_map.AlleleIndex(sample_variants,src_index2);
-                    _pl[ggutils::get_gl_index(dst_index, dst_index2)] = src.pl(src_index,src_index2);
+                    _pl[ggutils::get_gl_index(dst, dst_index[src_index2])] = src.pl(src_index,src_index2);
                 }
             }
         }
@@ -34,6 +34,10 @@ public:
     //Handle "conflicts" where allele and genotype combinations conflict with one another in a rudimentary but sane way.
     Genotype(bcf_hdr_t *sample_header,bcf1_t *sample_variants,multiAllele & alleles_to_map);
 
+    //As above but only with the alleles of alleles_to_map that sample_variants has (REF is always included).
+    //Their indices in alleles_to_map are stored in local_alleles, so memory does not grow with the number of alleles at the site.
+    Genotype(bcf_hdr_t *sample_header,bcf1_t *sample_variants,multiAllele & alleles_to_map,vector<int> & local_alleles);
+
     Genotype(bcf_hdr_t *sample_header,pair<std::deque<bcf1_t *>::iterator,std::deque<bcf1_t *>::iterator> & sample_variants);
 
     ~Genotype();
@@ -43,6 +47,8 @@ public:
 
     //Copies FORMAT fields from this object into a vcf_data_t object, ploidy is the ploidy of the vcf_data_t format.
     int PropagateFormatFields(size_t sample_index, size_t ploidy, ggutils::vcf_data_t *format);
+    //As above for a Genotype made with local_alleles, into a local allele mode vcf_data_t (LAA/LAD/LPL).
+    int PropagateLocalFormatFields(size_t sample_index, size_t ploidy, const vector<int> &local_alleles, ggutils::vcf_data_t *format);
 
     //Copies FORMAT/INFO fields from this object into record.
     int UpdateBcfRecord(bcf_hdr_t *header, bcf1_t *record);
@@ -106,6 +112,10 @@ public:
 private:
     //Assigns memory according to ploidy/num_allele.
     void allocate(int ploidy, int num_allele);
+    //fills this Genotype from src, whose allele i is allele dst_index[i] of the num_allele alleles of this Genotype
+    void MapAlleles(Genotype &src, const vector<int> &dst_index, int num_allele);
+    //copies FT/GQ/GQX/DP/DPF
+    void PropagateScalarFields(size_t sample_index, ggutils::vcf_data_t *format);
     void init_logger();
     float _qual;
     int32_t _mq;
@@ -0,0 +1,203 @@
+#include "HeaderCache.hh"
+
+#include <cstring>
+
+#include "ggutils.hh"
+
+std::mutex HeaderCache::_mutex;
+std::unordered_map<std::string, std::weak_ptr<bcf_hdr_t>> HeaderCache::_headers;
+std::map<std::pair<const bcf_hdr_t *, const bcf_hdr_t *>, std::weak_ptr<const contig_map_t>> HeaderCache::_contig_maps;
+
+//the calling thread's copies of shared headers, freed when the thread exits
+struct parse_headers_t
+{
+    std::unordered_map<const bcf_hdr_t *, std::pair<std::weak_ptr<bcf_hdr_t>, bcf_hdr_t *>> copies;
+
+    ~parse_headers_t()
+    {
+        for (auto it = copies.begin(); it != copies.end(); it++)
+        {
+            bcf_hdr_destroy(it->second.second);
+        }
+    }
+};
+
+static thread_local parse_headers_t t_parse_headers;
+
+std::string HeaderCache::GetKey(const bcf_hdr_t *header)
+{
+    //generic lines (##fileDate, ##cmdline, ...) often differ between GVCFs but do not go into the dictionaries,
+    //the sample names are left out as they are all that differs between the #CHROM lines
+    kstring_t text = {0, 0, nullptr};
+    for (int i = 0; i < header->nhrec; i++)
+    {
+        if (header->hrec[i]->type != BCF_HL_GEN)
+        {
+            bcf_hrec_format(header->hrec[i], &text);
+        }
+    }
+    std::string key = text.s != nullptr ? std::string(text.s, text.l) : "";
+    free(text.s);
+    return (key + std::to_string(bcf_hdr_nsamples(header)));
+}
+
+std::shared_ptr<bcf_hdr_t> HeaderCache::Share(const bcf_hdr_t *header)
+{
+    std::string key = GetKey(header);
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto found = _headers.find(key);
+    if (found != _headers.end())
+    {
+        std::shared_ptr<bcf_hdr_t> shared = found->second.lock();
+        if (shared != nullptr)
+        {
+            return (shared);
+        }
+    }
+    //headers of readers that have all gone are dropped as new ones come in
+    for (auto it = _headers.begin(); it != _headers.end();)
+    {
+        it = it->second.expired() ? _headers.erase(it) : std::next(it);
+    }
+    bcf_hdr_t *copy = bcf_hdr_dup(header);
+    bcf_hdr_append(copy, "##FORMAT=<ID=FT,Number=1,Type=String,Description=\"Sample filter, 'PASS' indicates that all single sample filters passed for this sample\">");
+    bcf_hdr_sync(copy);
+    std::shared_ptr<bcf_hdr_t> shared(copy, bcf_hdr_destroy);
+    _headers[key] = shared;
+    return (shared);
+}
+
+size_t HeaderCache::GetNumHeaders()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    size_t num_headers = 0;
+    for (auto it = _headers.begin(); it != _headers.end(); it++)
+    {
+        num_headers += !it->second.expired();
+    }
+    return (num_headers);
+}
+
+//header with its contig lines replaced by those of output, in output's order. The other lines keep their IDX, so
+//tags have the same ids as in header.
+static bcf_hdr_t *replace_contigs(const bcf_hdr_t *header, const bcf_hdr_t *output)
+{
+    kstring_t text = {0, 0, nullptr}, contigs = {0, 0, nullptr};
+    bcf_hdr_format(header, 1, &text);
+    for (int rid = 0; rid < output->n[BCF_DT_CTG]; rid++)
+    {
+        bcf_hrec_format(output->id[BCF_DT_CTG][rid].val->hrec[0], &contigs);
+    }
+    //the contigs go after ##fileformat, which has to be the first line
+    std::string lines(text.s, text.l), replaced;
+    size_t start = 0;
+    while (start < lines.size())
+    {
+        size_t end = lines.find('\n', start);
+        end = end == std::string::npos ? lines.size() : end + 1;
+        if (lines.compare(start, 9, "##contig=") != 0)
+        {
+            replaced.append(lines, start, end - start);
+        }
+        if (start == 0)
+        {
+            replaced.append(contigs.s != nullptr ? contigs.s : "", contigs.l);
+        }
+        start = end;
+    }
+    free(text.s);
+    free(contigs.s);
+    bcf_hdr_t *ret = bcf_hdr_init("r");
+    if (bcf_hdr_parse(ret, (char *) replaced.c_str()) < 0)
+    {
+        ggutils::die("problem numbering the contigs of a GVCF header as the output does");
+    }
+    bcf_hdr_sync(ret);
+    for (int id = 0; id < header->n[BCF_DT_ID]; id++)
+    {
+        const char *key = header->id[BCF_DT_ID][id].key, *translated = id < ret->n[BCF_DT_ID] ? ret->id[BCF_DT_ID][id].key : nullptr;
+        if ((key == nullptr) != (translated == nullptr) || (key != nullptr && strcmp(key, translated) != 0))
+        {
+            ggutils::die("problem numbering the contigs of a GVCF header as the output does");
+        }
+    }
+    return (ret);
+}
+
+std::shared_ptr<const contig_map_t> HeaderCache::MapContigs(const std::shared_ptr<bcf_hdr_t> &header,
+                                                            const bcf_hdr_t *output)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto key = std::make_pair((const bcf_hdr_t *) header.get(), output);
+    auto found = _contig_maps.find(key);
+    if (found != _contig_maps.end())
+    {
+        std::shared_ptr<const contig_map_t> map = found->second.lock();
+        if (map != nullptr)
+        {
+            return (map);
+        }
+    }
+    for (auto it = _contig_maps.begin(); it != _contig_maps.end();)
+    {
+        it = it->second.expired() ? _contig_maps.erase(it) : std::next(it);
+    }
+    std::shared_ptr<contig_map_t> map = std::make_shared<contig_map_t>();
+    map->in_order = true;
+    bool same = true;
+    int previous = -1;
+    for (int rid = 0; rid < header->n[BCF_DT_CTG]; rid++)
+    {
+        int output_rid = bcf_hdr_name2id(output, bcf_hdr_id2name(header.get(), rid));
+        map->rids.push_back(output_rid);
+        same &= output_rid == rid;
+        if (output_rid >= 0)
+        {
+            map->in_order &= output_rid > previous;
+            previous = output_rid;
+        }
+    }
+    //contigs the output has and this header does not are never read, so they do not need the same ids
+    if (same)
+    {
+        map->rids.clear();
+        map->header = header;
+    }
+    else
+    {
+        map->header = std::shared_ptr<bcf_hdr_t>(replace_contigs(header.get(), output), bcf_hdr_destroy);
+    }
+    _contig_maps[key] = map;
+    return (map);
+}
+
+bcf_hdr_t *HeaderCache::GetParseHeader(const std::shared_ptr<bcf_hdr_t> &header)
+{
+    auto &copies = t_parse_headers.copies;
+    auto found = copies.find(header.get());
+    if (found != copies.end())
+    {
+        if (found->second.first.lock() == header)
+        {
+            return (found->second.second);
+        }
+        //a header that has been freed since, at the same address
+        bcf_hdr_destroy(found->second.second);
+        copies.erase(found);
+    }
+    for (auto it = copies.begin(); it != copies.end();)
+    {
+        if (it->second.first.expired())
+        {
+            bcf_hdr_destroy(it->second.second);
+            it = copies.erase(it);
+        }
+        else
+        {
+            it++;
+        }
+    }
+    bcf_hdr_t *copy = bcf_hdr_dup(header.get());
+    copies[header.get()] = std::make_pair(std::weak_ptr<bcf_hdr_t>(header), copy);
+    return (copy);
+}
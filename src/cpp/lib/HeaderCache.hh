@@ -0,0 +1,60 @@
+//
+// One parsed header for every GVCF whose header only differs from the others' by its sample name.
+//
+
+#ifndef GVCFGENOTYPER_HEADERCACHE_HH
+#define GVCFGENOTYPER_HEADERCACHE_HH
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+extern "C" {
+#include <htslib/vcf.h>
+}
+
+//how the contigs of a (shared) GVCF header are numbered in the output header
+struct contig_map_t
+{
+    //the GVCF's header with the output's contigs in the output's order, its other ids are the GVCF header's
+    std::shared_ptr<bcf_hdr_t> header;
+    //output rid of each of the GVCF header's contigs (-1 if the output has no such contig), empty if they are the same
+    std::vector<int> rids;
+    //the GVCF's contigs are in the same order in the output, so the GVCF can be read in its own order
+    bool in_order;
+};
+
+//The header VcfReader and GVCFReader work with is the GVCF's header plus FORMAT/FT, which the readers write. A cohort's
+//GVCFs usually come from one pipeline, so rather than each reader keeping a copy, readers whose headers define the same
+//contigs, FILTER, INFO and FORMAT tags (in the same order) share one, along with its dictionaries. The shared header's
+//sample names and generic lines (##source=...) are those of the first GVCF that asked for it, so callers have to take
+//sample names from somewhere else.
+//Shared headers are only read (looking up tags and contigs, formatting records), which is safe across threads. VCF text
+//is parsed with a copy of the header for each thread (see GetParseHeader), as vcf_parse uses the header's buffers.
+class HeaderCache
+{
+public:
+    //the header for a GVCF with this header, shared with any GVCF that is already open with the same header (modulo
+    //sample names). It is freed with the last reader that holds it.
+    static std::shared_ptr<bcf_hdr_t> Share(const bcf_hdr_t *header);
+    //the translation of a header from Share to the contigs of output, built once for each distinct header
+    static std::shared_ptr<const contig_map_t> MapContigs(const std::shared_ptr<bcf_hdr_t> &header,
+                                                          const bcf_hdr_t *output);
+    //the calling thread's copy of a header from Share (or MapContigs), to parse VCF text with
+    static bcf_hdr_t *GetParseHeader(const std::shared_ptr<bcf_hdr_t> &header);
+    //distinct headers in use
+    static size_t GetNumHeaders();
+
+    //the header lines that make up the dictionaries, and the number of samples
+    static std::string GetKey(const bcf_hdr_t *header);
+
+private:
+    static std::mutex _mutex;
+    static std::unordered_map<std::string, std::weak_ptr<bcf_hdr_t>> _headers;
+    static std::map<std::pair<const bcf_hdr_t *, const bcf_hdr_t *>, std::weak_ptr<const contig_map_t>> _contig_maps;
+};
+
+#endif //GVCFGENOTYPER_HEADERCACHE_HH
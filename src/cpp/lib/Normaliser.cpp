@@ -115,19 +115,20 @@ int mnp_decompose(bcf1_t *record_to_split, bcf_hdr_t *header, vector<bcf1_t *> &
 }
 
 //Performs left-alignment and trimming using code from bcftools' vcfnorm.c
-bool Normaliser::Realign(bcf1_t *record, bcf_hdr_t *header) {
+bool Normaliser::Realign(bcf1_t *record, bcf_hdr_t *header, const char *sample) {
     if (realign(_norm_args, record, header) != ERR_OK) {
         if (_ignore_non_matching_ref) {
-            _lg->warn("WARNING: VCF record did not match the reference at sample {} {}:{}", header->samples[0], bcf_hdr_int2id(header, BCF_DT_CTG, record->rid),record->pos+1);
+            _lg->warn("WARNING: VCF record did not match the reference at sample {} {}:{}", ggutils::sample_name(header, sample), bcf_hdr_int2id(header, BCF_DT_CTG, record->rid),record->pos+1);
             return (false);
         } else {
-            ggutils::die("VCF record did not match the reference at sample " + (string) header->samples[0] + " "+ (string)bcf_hdr_int2id(header, BCF_DT_CTG, record->rid)+":"+std::to_string(record->pos+1));
+            ggutils::die("VCF record did not match the reference at sample " + (string) ggutils::sample_name(header, sample) + " "+ (string)bcf_hdr_int2id(header, BCF_DT_CTG, record->rid)+":"+std::to_string(record->pos+1));
         }
     }
     return (true);
 }
 
-void Normaliser::MultiSplit(bcf1_t *bcf_record_to_split, vector<bcf1_t *> &split_variants, bcf_hdr_t *hdr) {
+void Normaliser::MultiSplit(bcf1_t *bcf_record_to_split, vector<bcf1_t *> &split_variants, bcf_hdr_t *hdr,
+                            const char *sample) {
     assert(bcf_record_to_split->n_allele > 2);
     bcf_unpack(bcf_record_to_split, BCF_UN_ALL);
     Genotype src(hdr, bcf_record_to_split);
@@ -141,7 +142,7 @@ void Normaliser::MultiSplit(bcf1_t *bcf_record_to_split, vector<bcf1_t *> &split
         new_alleles[0] = bcf_record_to_split->d.allele[0];
         new_alleles[1] = bcf_record_to_split->d.allele[i];
         bcf_update_alleles(hdr, tmp_record, (const char **) new_alleles, 2);
-        if (Realign(tmp_record, hdr))
+        if (Realign(tmp_record, hdr, sample))
             new_positions.push_back(pair<int, int>(tmp_record->pos, ggutils::get_variant_rank(tmp_record)));
         bcf_destroy(tmp_record);
     }
@@ -173,15 +174,16 @@ void Normaliser::MultiSplit(bcf1_t *bcf_record_to_split, vector<bcf1_t *> &split
         for (int i = 1; i < tmp_record->n_allele; i++) {
             bcf1_t *out_record = bcf_dup(tmp_record);
             bcf_unpack(out_record, BCF_UN_ALL);
-            ggutils::bcf1_allele_swap(hdr, out_record, i, 1);
-            if (Realign(out_record, hdr))split_variants.push_back(out_record);
+            ggutils::bcf1_allele_swap(hdr, out_record, i, 1, sample);
+            if (Realign(out_record, hdr, sample))split_variants.push_back(out_record);
         }
         bcf_destroy1(tmp_record);
     }
     free(new_alleles);
 }
 
-void Normaliser::Unarise(bcf1_t *bcf_record_to_marginalise, vector<bcf1_t *> &atomised_variants, bcf_hdr_t *hdr) {
+void Normaliser::Unarise(bcf1_t *bcf_record_to_marginalise, vector<bcf1_t *> &atomised_variants, bcf_hdr_t *hdr,
+                         const char *sample) {
 #ifdef DEBUG
     ggutils::print_variant(hdr,bcf_record_to_marginalise);
 #endif
@@ -200,17 +202,18 @@ void Normaliser::Unarise(bcf1_t *bcf_record_to_marginalise, vector<bcf1_t *> &at
         bcf1_t *decomposed_record = *it;
         if (decomposed_record->n_allele == 2)//bi-allelic. no further decomposition needed.
         {
-            if (Realign(decomposed_record, hdr))
+            if (Realign(decomposed_record, hdr, sample))
                 atomised_variants.push_back(decomposed_record);
         } else {
-            MultiSplit(*it, atomised_variants, hdr);
+            MultiSplit(*it, atomised_variants, hdr, sample);
             bcf_destroy(*it);
         }
     }
 }
 
 bcf1_t *CollapseRecords(bcf_hdr_t *sample_header,
-                        pair<std::deque<bcf1_t *>::iterator, std::deque<bcf1_t *>::iterator> &sample_variants) {
+                        pair<std::deque<bcf1_t *>::iterator, std::deque<bcf1_t *>::iterator> &sample_variants,
+                        const char *sample) {
 
     if ((sample_variants.second - sample_variants.first) == 0)
         return nullptr;
@@ -253,7 +256,7 @@ bcf1_t *CollapseRecords(bcf_hdr_t *sample_header,
             {
                 auto logger = spdlog::get("gg_logger");
                 logger->warn("conflicting ploidy for sample {} {}:{}",
-                          sample_header->samples[0],
+                          ggutils::sample_name(sample_header, sample),
                           bcf_hdr_id2name(sample_header, (*it)->rid),
                           ((*it)->pos + 1)
                 );
@@ -37,12 +37,14 @@ public:
     Normaliser(const std::string &ref_fname, bool ignore_non_matching_ref=false);
     ~Normaliser();
     //breaks multi-allelics into pseudo-unary representation (primitive alleles and one-variant-per-row)
-    void Unarise(bcf1_t *rec, std::vector<bcf1_t *> &atomised_variants, bcf_hdr_t *hdr);
+    //sample names the GVCF in messages, see ggutils::sample_name
+    void Unarise(bcf1_t *rec, std::vector<bcf1_t *> &atomised_variants, bcf_hdr_t *hdr, const char *sample=nullptr);
     //splits N multi-allelics into N separate records
-    void MultiSplit(bcf1_t *bcf_record_to_split, vector<bcf1_t *> &split_variants, bcf_hdr_t *hdr);
+    void MultiSplit(bcf1_t *bcf_record_to_split, vector<bcf1_t *> &split_variants, bcf_hdr_t *hdr,
+                    const char *sample=nullptr);
 
 //Performs left-alignment and trimming using code from bcftools' vcfnorm.c
-    bool Realign(bcf1_t *record, bcf_hdr_t *header);
+    bool Realign(bcf1_t *record, bcf_hdr_t *header, const char *sample=nullptr);
 
 private:
     char _symbolic_allele[2];
@@ -52,6 +54,7 @@ private:
 };
 
 bcf1_t *CollapseRecords(bcf_hdr_t *sample_header,
-                        pair<std::deque<bcf1_t *>::iterator,std::deque<bcf1_t *>::iterator> & sample_variants);
+                        pair<std::deque<bcf1_t *>::iterator,std::deque<bcf1_t *>::iterator> & sample_variants,
+                        const char *sample=nullptr);
 
 #endif //GVCFGENOTYPER_NORMALISER_HH
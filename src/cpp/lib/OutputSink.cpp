@@ -0,0 +1,259 @@
+#include "OutputSink.hh"
+#include "ggutils.hh"
+#include "Trace.hh"
+
+bool is_output_mode(const std::string &mode)
+{
+    if (mode.empty() || mode.size() > 2 || string("buzv").find(mode[0]) == string::npos)
+    {
+        return (false);
+    }
+    //a compression level only makes sense for bgzf
+    return (mode.size() == 1 || ((mode[0] == 'b' || mode[0] == 'z') && isdigit(mode[1])));
+}
+
+OutputSink::OutputSink(const std::string &file_name, const std::string &mode, const bcf_hdr_t *full_header,
+                       bool sites_only, const std::vector<std::string> &samples)
+{
+    _file_name = file_name;
+    _sites_only = sites_only;
+    _closing = false;
+    _idx = nullptr;
+    _num_written = 0;
+    if (!is_output_mode(mode))
+    {
+        ggutils::die("invalid output type: " + mode);
+    }
+
+    if (sites_only)
+    {
+        _header = bcf_hdr_subset(full_header, 0, nullptr, nullptr);
+    }
+    else if (!samples.empty())
+    {
+        _imap.resize(samples.size());
+        vector<char *> names;
+        for (auto it = samples.begin(); it != samples.end(); it++)
+        {
+            if (bcf_hdr_id2int(full_header, BCF_DT_SAMPLE, it->c_str()) < 0)
+            {
+                ggutils::die("sample " + *it + " of " + file_name + " is not in the input");
+            }
+            names.push_back((char *) it->c_str());
+        }
+        _header = bcf_hdr_subset(full_header, (int) names.size(), names.data(), _imap.data());
+    }
+    else
+    {
+        _header = bcf_hdr_dup(full_header);
+    }
+    if (_header == nullptr)
+    {
+        ggutils::die("problem creating the header of " + file_name);
+    }
+    bcf_hdr_sync(_header);
+
+    _fp = hts_open(!file_name.empty() ? file_name.c_str() : "-", ("w" + mode).c_str());
+    if (_fp == nullptr)
+    {
+        ggutils::die("problem opening output file: " + file_name);
+    }
+    if (bcf_hdr_write(_fp, _header) != 0)
+    {
+        ggutils::die("problem writing the header of " + file_name);
+    }
+    _thread = std::thread(&OutputSink::Run, this);
+}
+
+OutputSink::~OutputSink()
+{
+    Close();
+    for (auto it = _free.begin(); it != _free.end(); it++)
+    {
+        bcf_destroy(*it);
+    }
+    bcf_hdr_destroy(_header);
+}
+
+//Same index as bcf_index/tbx_index would build from the finished file, records are pushed with the virtual
+//offset of their end as they are written. Text VCF also gets the tabix meta data with the contig names in
+//header order, so that tids are the header's rids.
+hts_idx_t *init_csi_index(htsFile *fp, bcf_hdr_t *header)
+{
+    int64_t max_len = 0;
+    int num_contigs = header->n[BCF_DT_CTG];
+    for (int i = 0; i < num_contigs; i++)
+    {
+        max_len = max(max_len, (int64_t) header->id[BCF_DT_CTG][i].val->info[0]);
+    }
+    if (max_len == 0)
+    {
+        max_len = ((int64_t) 1 << 31) - 1;
+    }
+    max_len += 256;
+    int n_lvls = 0;
+    for (int64_t s = 1 << INDEX_MIN_SHIFT; max_len > s; s <<= 3)
+    {
+        n_lvls++;
+    }
+    hts_idx_t *idx = hts_idx_init(num_contigs, HTS_FMT_CSI, bgzf_tell(fp->fp.bgzf), INDEX_MIN_SHIFT, n_lvls);
+    if (idx == nullptr)
+    {
+        return (nullptr);
+    }
+
+    if (fp->format.format != binary_format)
+    {
+        //tbx_conf_vcf followed by the length of the names and the names
+        kstring_t meta = {0, 0, nullptr};
+        int32_t conf[7] = {TBX_VCF, 1, 2, 0, '#', 0, 0};
+        for (int i = 0; i < num_contigs; i++)
+        {
+            conf[6] += strlen(bcf_hdr_id2name(header, i)) + 1;
+        }
+        kputsn((char *) conf, sizeof(conf), &meta);
+        for (int i = 0; i < num_contigs; i++)
+        {
+            kputsn(bcf_hdr_id2name(header, i), strlen(bcf_hdr_id2name(header, i)) + 1, &meta);
+        }
+        hts_idx_set_meta(idx, meta.l, (uint8_t *) meta.s, 0);
+    }
+    return (idx);
+}
+
+void OutputSink::BuildIndex()
+{
+    if (_file_name.empty() || _file_name == "-" || _fp->format.compression != bgzf || !_fp->fp.bgzf->is_compressed)
+    {
+        ggutils::die("cannot index " + (_file_name.empty() ? "stdout" : _file_name) +
+                     ", indexing needs a compressed BCF or VCF file (-O b or z)");
+    }
+    if (_num_written > 0)
+    {
+        ggutils::die("OutputSink::BuildIndex has to be called before any record is written");
+    }
+    _idx = init_csi_index(_fp, _header);
+    if (_idx == nullptr)
+    {
+        ggutils::die("problem creating the index of " + _file_name);
+    }
+}
+
+void OutputSink::SaveIndex()
+{
+    if (bgzf_flush(_fp->fp.bgzf) != 0)
+    {
+        ggutils::die("problem writing to " + _file_name);
+    }
+    hts_idx_finish(_idx, bgzf_tell(_fp->fp.bgzf));
+    if (hts_idx_save(_idx, _file_name.c_str(), HTS_FMT_CSI) != 0)
+    {
+        ggutils::die("problem writing the index of " + _file_name);
+    }
+    hts_idx_destroy(_idx);
+    _idx = nullptr;
+}
+
+void OutputSink::Write(bcf1_t *record)
+{
+    bcf1_t *copy;
+    {
+        std::unique_lock<std::mutex> lock(_lock);
+        if (_queue.size() >= SINK_QUEUE_SIZE)
+        {
+            _stats.producer_stalls++;
+            _queue_changed.wait(lock, [this] { return _queue.size() < SINK_QUEUE_SIZE; });
+        }
+        if (_free.empty())
+        {
+            copy = bcf_init1();
+        }
+        else
+        {
+            copy = _free.front();
+            _free.pop_front();
+        }
+    }
+
+    //records are subset here, only the text formatting and compression are left to the sink's thread
+    bcf_copy(copy, record);
+    if (_sites_only)
+    {
+        bcf_subset(_header, copy, 0, nullptr);
+    }
+    else if (!_imap.empty() && copy->n_sample > 0)
+    {
+        bcf_subset(_header, copy, (int) _imap.size(), _imap.data());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _queue.push_back(copy);
+    }
+    _queue_changed.notify_all();
+}
+
+void OutputSink::Run()
+{
+    GG_TRACE_THREAD("output " + (_file_name.empty() ? std::string("stdout") : _file_name));
+    while (true)
+    {
+        bcf1_t *record;
+        {
+            std::unique_lock<std::mutex> lock(_lock);
+            if (_queue.empty() && !_closing)
+            {
+                _stats.consumer_stalls++;
+                _queue_changed.wait(lock, [this] { return !_queue.empty() || _closing; });
+            }
+            if (_queue.empty())
+            {
+                return;
+            }
+            _stats.num_popped++;
+            _stats.queued += _queue.size();
+            record = _queue.front();
+            _queue.pop_front();
+        }
+        _clock.Switch(STAGE_WRITE);
+        if (bcf_write1(_fp, _header, record) != 0)
+        {
+            ggutils::die("problem writing to " + _file_name);
+        }
+        if (_idx != nullptr &&
+            hts_idx_push(_idx, record->rid, record->pos, record->pos + record->rlen, bgzf_tell(_fp->fp.bgzf), 1) < 0)
+        {
+            ggutils::die("problem indexing " + _file_name + ", records are not sorted");
+        }
+        _num_written++;
+        _clock.Switch(STAGE_NONE);
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            _free.push_back(record);
+        }
+        _queue_changed.notify_all();
+    }
+}
+
+void OutputSink::Close()
+{
+    if (_fp == nullptr)
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _closing = true;
+    }
+    _queue_changed.notify_all();
+    _thread.join();
+    if (_idx != nullptr)
+    {
+        SaveIndex();
+    }
+    if (hts_close(_fp) != 0)
+    {
+        ggutils::die("problem closing " + _file_name);
+    }
+    _fp = nullptr;
+}
@@ -0,0 +1,84 @@
+//
+// One output file of GVCFMerger.
+//
+
+#ifndef GVCFGENOTYPER_OUTPUTSINK_HH
+#define GVCFGENOTYPER_OUTPUTSINK_HH
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <htslib/hts.h>
+#include <htslib/vcf.h>
+#include <htslib/bgzf.h>
+#include <htslib/tbx.h>
+}
+
+#include "ggutils.hh"
+#include "RunStats.hh"
+
+//records a sink can have queued before Write blocks
+#define SINK_QUEUE_SIZE 256
+//min_shift of the CSI index written by BuildIndex, the default of bcftools index
+#define INDEX_MIN_SHIFT 14
+
+//Writes the merged records to one file, either with every sample, a subset of the samples or none (sites-only).
+//Formatting and compression happen on the sink's own thread so that several outputs cost little more wall time
+//than one. INFO is written as computed for the whole cohort, also for sample subsets.
+class OutputSink
+{
+public:
+    //full_header has every sample. mode is as for -O (b|u|z|v), b and z may be followed by a compression level 0-9.
+    //samples are the names of the samples to keep, all of them if empty (and not sites_only).
+    OutputSink(const std::string &file_name, const std::string &mode, const bcf_hdr_t *full_header,
+               bool sites_only, const std::vector<std::string> &samples = {});
+    ~OutputSink();
+
+    //builds a CSI index of the file as records are written, saved to file_name.csi by Close.
+    //Needs a bgzf compressed (b or z) file and must be called before the first Write.
+    void BuildIndex();
+    //queues a copy of record, which must have either no samples or every sample of full_header
+    void Write(bcf1_t *record);
+    //writes whatever is queued and closes the file
+    void Close();
+
+    bool IsSitesOnly() const { return _sites_only; }
+    const std::string &GetFileName() const { return _file_name; }
+    size_t GetNumWritten() const { return _num_written; }
+    //the queue between the merge and the sink's thread, producer stalls mean formatting and compression is slower
+    //than the merge. Only complete after Close.
+    const ggutils::stage_stats_t &GetStats() const { return _stats; }
+    //the sink thread's time in bcf_write1 (and indexing) is STAGE_WRITE, waiting for records is not counted
+    const StageClock &GetClock() const { return _clock; }
+
+private:
+    void Run();
+    void SaveIndex();
+
+    std::string _file_name;
+    htsFile *_fp;
+    hts_idx_t *_idx;//nullptr unless BuildIndex was called
+    bcf_hdr_t *_header;
+    bool _sites_only;
+    std::vector<int> _imap;//index of each kept sample in full_header, empty when all are kept
+    std::deque<bcf1_t *> _queue, _free;
+    std::mutex _lock;
+    std::condition_variable _queue_changed;
+    bool _closing;
+    size_t _num_written;
+    ggutils::stage_stats_t _stats;
+    StageClock _clock;
+    std::thread _thread;
+};
+
+//true if mode is a valid -O output type
+bool is_output_mode(const std::string &mode);
+//starts a CSI index of a bgzf compressed BCF/VCF whose header has just been written
+hts_idx_t *init_csi_index(htsFile *fp, bcf_hdr_t *header);
+
+#endif //GVCFGENOTYPER_OUTPUTSINK_HH
@@ -0,0 +1,115 @@
+#include "ProgressMeter.hh"
+
+#include <algorithm>
+#include <climits>
+#include <iostream>
+
+ProgressMeter::ProgressMeter(const bcf_hdr_t *header, const std::vector<ggutils::region_t> &bounds, int interval,
+                             bool to_stderr)
+{
+    if (interval < 0)
+    {
+        ggutils::die("ProgressMeter needs a non-negative interval");
+    }
+    _header = header;
+    _interval = interval;
+    _to_stderr = to_stderr;
+    _num_updates = 0;
+    _cursor = 0;
+    _total_bp = 0;
+    bool open_ended = false;
+    for (auto it = bounds.begin(); it != bounds.end(); it++)
+    {
+        int rid = bcf_hdr_name2id(header, it->chrom.c_str());
+        if (rid < 0)
+        {
+            continue;
+        }
+        ggutils::region_t bound = *it;
+        //an open end (chr or chr:start- regions, contigs indexed without a length) ends the contig
+        if (bound.end >= INT_MAX - 1)
+        {
+            int length = (int) header->id[BCF_DT_CTG][rid].val->info[0];
+            open_ended |= length <= 0;
+            bound.end = length > 0 ? std::max(bound.start, length - 1) : bound.start;
+        }
+        _rids.push_back(rid);
+        _bounds.push_back(bound);
+        _bp_before.push_back(_total_bp);
+        _total_bp += (double) bound.end - bound.start + 1;
+    }
+    if (open_ended)
+    {
+        _total_bp = 0;
+    }
+    _start = _last_report = std::chrono::steady_clock::now();
+    _lg = spdlog::get("gg_logger");
+}
+
+double ProgressMeter::GetFraction(int rid, int pos)
+{
+    if (_total_bp <= 0)
+    {
+        return (-1);
+    }
+    //the last bound starting at or before rid:pos
+    while (_cursor + 1 < _bounds.size() &&
+           (_rids[_cursor + 1] < rid || (_rids[_cursor + 1] == rid && _bounds[_cursor + 1].start <= pos)))
+    {
+        _cursor++;
+    }
+    if (_rids[_cursor] > rid || (_rids[_cursor] == rid && pos < _bounds[_cursor].start))
+    {
+        return (0);
+    }
+    double length = (double) _bounds[_cursor].end - _bounds[_cursor].start + 1;
+    double done = _rids[_cursor] < rid ? length : std::min(length, (double) pos - _bounds[_cursor].start + 1);
+    return ((_bp_before[_cursor] + done) / _total_bp);
+}
+
+double ProgressMeter::GetSecondsLeft(double fraction, double elapsed)
+{
+    if (fraction <= 0 || fraction > 1 || elapsed <= 0)
+    {
+        return (-1);
+    }
+    return (elapsed * (1 - fraction) / fraction);
+}
+
+static std::string format_seconds(double seconds)
+{
+    long long s = (long long) (seconds + 0.5);
+    return (fmt::format("{}:{:02d}:{:02d}", s / 3600, (int) (s / 60 % 60), (int) (s % 60)));
+}
+
+void ProgressMeter::MaybeReport(int rid, int pos, size_t num_sites)
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now - _last_report < std::chrono::seconds(_interval))
+    {
+        return;
+    }
+    _last_report = now;
+    double elapsed = std::chrono::duration<double>(now - _start).count();
+    double fraction = GetFraction(rid, pos);
+    std::string message = fmt::format("Progress: {}:{}, {} sites, {:.1f} sites/s", bcf_hdr_id2name(_header, rid),
+                                      pos + 1, num_sites, elapsed > 0 ? num_sites / elapsed : 0.);
+    if (fraction >= 0)
+    {
+        double left = GetSecondsLeft(fraction, elapsed);
+        message += fmt::format(", {:.1f}% of {:.0f} bp done, {} elapsed, {} left", 100 * fraction, _total_bp,
+                               format_seconds(elapsed), left >= 0 ? format_seconds(left) : "?");
+    }
+    else
+    {
+        message += fmt::format(", {} elapsed", format_seconds(elapsed));
+    }
+    if (_lg != nullptr)
+    {
+        _lg->info(message);
+    }
+    if (_to_stderr)
+    {
+        std::cerr << message << std::endl;
+    }
+}
@@ -0,0 +1,65 @@
+//
+// Progress of write_vcf through the genome, with an estimate of the time left.
+//
+
+#ifndef GVCFGENOTYPER_PROGRESSMETER_HH
+#define GVCFGENOTYPER_PROGRESSMETER_HH
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <htslib/vcf.h>
+}
+
+#include "ggutils.hh"
+#include "spdlog.h"
+
+//default --progress-interval, seconds between two progress reports
+#define PROGRESS_INTERVAL 60
+//sites written between two looks at the clock
+#define PROGRESS_CHECK_SITES 16
+
+//Turns the position of the last site written into the fraction of the genome (the -r/-R regions, or the header
+//lengths of the contigs) that is done, and logs it with sites/sec and the time left every interval seconds.
+//Positions must not go backwards. When a contig has no length in the header, only the position and sites/sec are
+//reported.
+class ProgressMeter
+{
+public:
+    //bounds are the sorted, non-overlapping regions being genotyped (ChunkGenotyper::GetBounds)
+    ProgressMeter(const bcf_hdr_t *header, const std::vector<ggutils::region_t> &bounds, int interval,
+                  bool to_stderr = false);
+
+    //called with each site written, num_sites is the number of sites written so far
+    void Update(int rid, int pos, size_t num_sites)
+    {
+        if (_interval > 0 && ++_num_updates % PROGRESS_CHECK_SITES == 0)
+        {
+            MaybeReport(rid, pos, num_sites);
+        }
+    }
+    //fraction of the bp up to and including rid:pos, -1 if the total is not known
+    double GetFraction(int rid, int pos);
+    //the expected seconds left when fraction of the work took elapsed seconds, -1 if there is no estimate yet
+    static double GetSecondsLeft(double fraction, double elapsed);
+
+private:
+    void MaybeReport(int rid, int pos, size_t num_sites);
+
+    const bcf_hdr_t *_header;
+    std::vector<int> _rids;
+    std::vector<ggutils::region_t> _bounds;
+    std::vector<double> _bp_before;//bp of the bounds before each bound
+    double _total_bp;//0 when a bound has no end
+    size_t _cursor;//bound of the last position seen
+    int _interval;
+    bool _to_stderr;
+    size_t _num_updates;
+    std::chrono::steady_clock::time_point _start, _last_report;
+    std::shared_ptr<spdlog::logger> _lg;
+};
+
+#endif //GVCFGENOTYPER_PROGRESSMETER_HH
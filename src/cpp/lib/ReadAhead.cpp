@@ -0,0 +1,191 @@
+#include "ReadAhead.hh"
+#include "Trace.hh"
+
+#include <string>
+
+ReadAhead::ReadAhead(int num_threads)
+{
+    if (num_threads < 1)
+    {
+        ggutils::die("ReadAhead needs at least one thread");
+    }
+    _num_threads = num_threads;
+    _stop = false;
+}
+
+ReadAhead::~ReadAhead()
+{
+    for (size_t t = 0; t < _thread_state.size(); t++)
+    {
+        std::lock_guard<std::mutex> lock(_thread_state[t]->mutex);
+        _stop = true;
+        _thread_state[t]->wake.notify_one();
+    }
+    for (auto it = _threads.begin(); it != _threads.end(); it++)
+    {
+        it->join();
+    }
+    for (auto it = _batches.begin(); it != _batches.end(); it++)
+    {
+        for (int k = 0; k < READ_AHEAD_BATCH; k++)
+        {
+            bcf_destroy((*it)->records[k]);
+        }
+        delete *it;
+    }
+    for (auto it = _streams.begin(); it != _streams.end(); it++)
+    {
+        delete *it;
+    }
+    for (auto it = _thread_state.begin(); it != _thread_state.end(); it++)
+    {
+        delete *it;
+    }
+}
+
+size_t ReadAhead::Add(VcfReader *reader)
+{
+    if (!_threads.empty())
+    {
+        ggutils::die("ReadAhead::Add called after Start");
+    }
+    stream_t *stream = new stream_t(reader);
+    for (int b = 0; b < READ_AHEAD_QUEUE; b++)
+    {
+        read_batch_t *batch = new read_batch_t;
+        for (int k = 0; k < READ_AHEAD_BATCH; k++)
+        {
+            batch->records[k] = bcf_init1();
+        }
+        batch->size = batch->next = 0;
+        batch->last = false;
+        _batches.push_back(batch);
+        stream->free.TryPush(batch);
+    }
+    _streams.push_back(stream);
+    return (_streams.size() - 1);
+}
+
+void ReadAhead::Start()
+{
+    size_t num_threads = std::min((size_t) _num_threads, _streams.size());
+    for (size_t t = 0; t < num_threads; t++)
+    {
+        _thread_state.push_back(new read_thread_t);
+        _thread_state.back()->pending = false;
+        _thread_state.back()->stalls = 0;
+    }
+    for (size_t t = 0; t < num_threads; t++)
+    {
+        _threads.emplace_back(&ReadAhead::Run, this, t);
+    }
+}
+
+//reads free batches of stream until there are none left, returns false if there was nothing to do
+bool ReadAhead::Fill(stream_t &stream)
+{
+    bool progress = false;
+    read_batch_t *batch;
+    while (!stream.done && stream.free.TryPop(batch))
+    {
+        GG_TRACE_SCOPE("fill");
+        while (batch->size < READ_AHEAD_BATCH && stream.reader->Next(batch->records[batch->size]))
+        {
+            batch->region_index[batch->size++] = stream.reader->GetRegionIndex();
+        }
+        batch->last = batch->size < READ_AHEAD_BATCH;
+        stream.done = batch->last;
+        stream.full.TryPush(batch);
+        {
+            std::lock_guard<std::mutex> lock(stream.mutex);
+        }
+        stream.filled.notify_one();
+        progress = true;
+    }
+    return (progress);
+}
+
+void ReadAhead::Run(size_t thread_index)
+{
+    read_thread_t &state = *_thread_state[thread_index];
+    GG_TRACE_THREAD("read ahead " + std::to_string(thread_index));
+    while (true)
+    {
+        bool progress = false, done = true;
+        for (size_t s = thread_index; s < _streams.size(); s += _thread_state.size())
+        {
+            progress |= Fill(*_streams[s]);
+            done &= _streams[s]->done;
+        }
+        std::unique_lock<std::mutex> lock(state.mutex);
+        if (_stop || done)
+        {
+            return;
+        }
+        if (!progress && !state.pending)
+        {
+            //every stream of this thread is as far ahead as it may be, the merge is the slower stage
+            state.stalls++;
+            state.wake.wait(lock, [&state, this] { return state.pending || _stop; });
+        }
+        state.pending = false;
+    }
+}
+
+int ReadAhead::Next(size_t stream_index, bcf1_t *&record, int &region_index)
+{
+    stream_t &stream = *_streams[stream_index];
+    while (true)
+    {
+        read_batch_t *batch = stream.current;
+        if (batch != nullptr && batch->next < batch->size)
+        {
+            std::swap(record, batch->records[batch->next]);
+            region_index = batch->region_index[batch->next++];
+            return (1);
+        }
+        if (batch != nullptr)
+        {
+            if (batch->last)
+            {
+                return (0);
+            }
+            //hand the batch back to its read thread
+            batch->size = batch->next = 0;
+            stream.free.TryPush(batch);
+            read_thread_t &state = *_thread_state[stream_index % _thread_state.size()];
+            {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                state.pending = true;
+            }
+            state.wake.notify_one();
+            stream.current = nullptr;
+        }
+
+        stream.queued += stream.full.Size();
+        if (!stream.full.TryPop(stream.current))
+        {
+            //the merge caught up with the reading of this GVCF
+            stream.stalls++;
+            std::unique_lock<std::mutex> lock(stream.mutex);
+            stream.filled.wait(lock, [&stream] { return stream.full.TryPop(stream.current); });
+        }
+        stream.num_batches++;
+    }
+}
+
+ggutils::stage_stats_t ReadAhead::GetStats() const
+{
+    ggutils::stage_stats_t stats;
+    for (auto it = _streams.begin(); it != _streams.end(); it++)
+    {
+        stats.num_popped += (*it)->num_batches;
+        stats.queued += (*it)->queued;
+        stats.consumer_stalls += (*it)->stalls;
+    }
+    for (auto it = _thread_state.begin(); it != _thread_state.end(); it++)
+    {
+        stats.producer_stalls += (*it)->stalls;
+    }
+    return (stats);
+}
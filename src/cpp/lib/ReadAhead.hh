@@ -0,0 +1,92 @@
+//
+// The read stage of the streaming merge: GVCF records are read and decompressed on their own threads.
+//
+
+#ifndef GVCFGENOTYPER_READAHEAD_HH
+#define GVCFGENOTYPER_READAHEAD_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <htslib/vcf.h>
+}
+
+#include "SpscQueue.hh"
+#include "VcfReader.hh"
+#include "ggutils.hh"
+
+//records a read thread hands to a GVCFReader at a time
+#define READ_AHEAD_BATCH 32
+//batches of each GVCF that can be read ahead of the merge
+#define READ_AHEAD_QUEUE 4
+
+//Each GVCF (stream) has two single-producer/single-consumer queues of READ_AHEAD_BATCH record batches: read threads
+//fill batches from the free queue and push them onto the full queue, GVCFReader takes records out of full batches
+//and hands the emptied batches back. Records are swapped rather than copied, the consumer's spare record goes into
+//the batch in place of the one it takes, so nothing is allocated once the batches are set up.
+//The streams are spread round robin over the threads. A thread sleeps when all of its streams are full or done.
+class ReadAhead
+{
+public:
+    explicit ReadAhead(int num_threads);
+    //stops the threads, which must be done before the readers are deleted
+    ~ReadAhead();
+
+    //hands reader to the read threads, it must not be used by anything else from now on. Returns its stream.
+    size_t Add(VcfReader *reader);
+    //starts the threads, no more streams can be added
+    void Start();
+    //swaps record for the next record of stream, returns 0 when the stream has no more.
+    //region_index is VcfReader::GetRegionIndex() for the record.
+    int Next(size_t stream, bcf1_t *&record, int &region_index);
+
+    //summed over the streams, producer stalls are a read thread finding all of its streams full
+    ggutils::stage_stats_t GetStats() const;
+    int GetNumThreads() const { return (int) _threads.size(); }
+
+private:
+    struct read_batch_t
+    {
+        bcf1_t *records[READ_AHEAD_BATCH];
+        int region_index[READ_AHEAD_BATCH];
+        int size, next;
+        bool last;//the reader has nothing after these records
+    };
+
+    struct stream_t
+    {
+        VcfReader *reader;
+        SpscQueue<read_batch_t *> full, free;
+        read_batch_t *current;//batch the consumer is taking records from
+        bool done;//the producer has pushed the last batch
+        size_t queued, num_batches, stalls;//consumer side counters
+        std::mutex mutex;
+        std::condition_variable filled;
+        stream_t(VcfReader *r) : reader(r), full(READ_AHEAD_QUEUE), free(READ_AHEAD_QUEUE), current(nullptr),
+                                 done(false), queued(0), num_batches(0), stalls(0) {}
+    };
+
+    struct read_thread_t
+    {
+        std::mutex mutex;
+        std::condition_variable wake;
+        bool pending;//a batch was handed back since the thread last looked
+        size_t stalls;
+    };
+
+    void Run(size_t thread_index);
+    bool Fill(stream_t &stream);
+
+    std::vector<stream_t *> _streams;
+    std::vector<read_batch_t *> _batches;
+    std::vector<read_thread_t *> _thread_state;
+    std::vector<std::thread> _threads;
+    int _num_threads;
+    std::atomic<bool> _stop;
+};
+
+#endif //GVCFGENOTYPER_READAHEAD_HH
@@ -0,0 +1,80 @@
+#include "ReferenceBander.hh"
+
+ReferenceBander::ReferenceBander(size_t num_sample, int dp_band, int gq_band)
+    : _num_sample(num_sample), _dp_band(dp_band), _gq_band(gq_band), _open(false)
+{
+    _current.dp.resize(num_sample);
+    _current.gq.resize(num_sample);
+    _current.ploidy.resize(num_sample);
+    _anchor_dp.resize(num_sample);
+    _anchor_gq.resize(num_sample);
+}
+
+//true if a value is within band of anchor, missing values only match missing values
+static bool within_band(int32_t value, int32_t anchor, int band)
+{
+    if (value == bcf_int32_missing || anchor == bcf_int32_missing)
+    {
+        return (value == anchor);
+    }
+    return (abs(value - anchor) <= band);
+}
+
+bool ReferenceBander::Extends(int rid, int start, std::vector<DepthBlock *> &blocks)
+{
+    if (!_open || rid != _current.rid || start != _current.end + 1)
+    {
+        return (false);
+    }
+    for (size_t i = 0; i < _num_sample; i++)
+    {
+        int32_t ploidy = blocks[i] == nullptr ? bcf_int32_missing : blocks[i]->ploidy();
+        int32_t dp = blocks[i] == nullptr ? bcf_int32_missing : blocks[i]->dp();
+        int32_t gq = blocks[i] == nullptr ? bcf_int32_missing : blocks[i]->gq();
+        if (ploidy != _current.ploidy[i] || !within_band(dp, _anchor_dp[i], _dp_band) ||
+            !within_band(gq, _anchor_gq[i], _gq_band))
+        {
+            return (false);
+        }
+    }
+    return (true);
+}
+
+void ReferenceBander::Add(int rid, int start, int end, std::vector<DepthBlock *> &blocks)
+{
+    assert(blocks.size() == _num_sample);
+    if (Extends(rid, start, blocks))
+    {
+        _current.end = end;
+        for (size_t i = 0; i < _num_sample; i++)
+        {
+            if (blocks[i] != nullptr)
+            {
+                _current.dp[i] = min(_current.dp[i], blocks[i]->dp());
+                _current.gq[i] = min(_current.gq[i], blocks[i]->gq());
+            }
+        }
+        return;
+    }
+
+    Close();
+    _open = true;
+    _current.rid = rid;
+    _current.start = start;
+    _current.end = end;
+    for (size_t i = 0; i < _num_sample; i++)
+    {
+        _current.ploidy[i] = blocks[i] == nullptr ? bcf_int32_missing : blocks[i]->ploidy();
+        _current.dp[i] = _anchor_dp[i] = blocks[i] == nullptr ? bcf_int32_missing : blocks[i]->dp();
+        _current.gq[i] = _anchor_gq[i] = blocks[i] == nullptr ? bcf_int32_missing : blocks[i]->gq();
+    }
+}
+
+void ReferenceBander::Close()
+{
+    if (_open)
+    {
+        _finished.push_back(_current);
+        _open = false;
+    }
+}
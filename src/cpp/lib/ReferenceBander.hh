@@ -0,0 +1,51 @@
+//
+// Cohort reference blocks for --output-mode gvcf.
+//
+
+#ifndef GVCFGENOTYPER_REFERENCEBANDER_HH
+#define GVCFGENOTYPER_REFERENCEBANDER_HH
+
+#include <deque>
+#include <vector>
+
+#include "DepthBlock.hh"
+
+//A reference block of the merged output. rid:start-end is 0-based and inclusive, dp/gq/ploidy have one value
+//per sample: the smallest DP and GQ over the block, missing where the sample has no data.
+struct cohort_block_t
+{
+    int rid, start, end;
+    std::vector<int32_t> dp, gq, ploidy;
+};
+
+//Merges every sample's homozygous reference blocks into cohort blocks. A block is extended until any sample's
+//DP or GQ moves more than dp_band/gq_band away from its value at the start of the block (or its ploidy or
+//whether it has data changes), so the output stays compact where coverage is flat.
+class ReferenceBander
+{
+public:
+    ReferenceBander(size_t num_sample, int dp_band, int gq_band);
+
+    //adds rid:start-end, over which no sample's values change. blocks[i] is the block of sample i
+    //covering the interval or nullptr if that sample has no data there.
+    void Add(int rid, int start, int end, std::vector<DepthBlock *> &blocks);
+    //ends the current block, the next Add starts a new one
+    void Close();
+
+    //finished blocks, oldest first
+    bool HasBlock() const { return !_finished.empty(); }
+    cohort_block_t &Front() { return _finished.front(); }
+    void Pop() { _finished.pop_front(); }
+
+private:
+    bool Extends(int rid, int start, std::vector<DepthBlock *> &blocks);
+
+    size_t _num_sample;
+    int _dp_band, _gq_band;
+    bool _open;
+    cohort_block_t _current;
+    std::vector<int32_t> _anchor_dp, _anchor_gq;//values at the start of _current
+    std::deque<cohort_block_t> _finished;
+};
+
+#endif //GVCFGENOTYPER_REFERENCEBANDER_HH
@@ -0,0 +1,210 @@
+#include "ReferenceBlockWriter.hh"
+
+ReferenceBlockWriter::ReferenceBlockWriter(const std::string &reference_genome, bcf_hdr_t *output_header,
+                                           size_t num_samples, const std::string &region, int is_file,
+                                           int dp_band, int gq_band)
+{
+    _output_header = output_header;
+    _num_samples = num_samples;
+    _bander = nullptr;
+    SetBands(dp_band, gq_band);
+    _fai = fai_load(reference_genome.c_str());
+    if (_fai == nullptr)
+    {
+        ggutils::die("problem loading the index for " + reference_genome);
+    }
+    _record = bcf_init1();
+    if (!region.empty())
+    {
+        vector<ggutils::region_t> regions;
+        is_file ? ggutils::read_regions_file(region, regions) : ggutils::parse_regions(region, regions);
+        for (auto it = regions.begin(); it != regions.end(); it++)
+        {
+            int rid = bcf_hdr_name2id(_output_header, it->chrom.c_str());
+            if (rid >= 0)
+            {
+                _band_regions.emplace_back(rid, *it);
+            }
+        }
+        std::sort(_band_regions.begin(), _band_regions.end(),
+                  [](const std::pair<int, ggutils::region_t> &a, const std::pair<int, ggutils::region_t> &b)
+                  {
+                      return (a.first < b.first || (a.first == b.first && a.second.start < b.second.start));
+                  });
+    }
+    Reset();
+}
+
+ReferenceBlockWriter::~ReferenceBlockWriter()
+{
+    delete _bander;
+    fai_destroy(_fai);
+    bcf_destroy(_record);
+}
+
+void ReferenceBlockWriter::SetBands(int dp_band, int gq_band)
+{
+    if (dp_band < 0 || gq_band < 0)
+    {
+        ggutils::die("reference bands can not be negative");
+    }
+    delete _bander;
+    _bander = new ReferenceBander(_num_samples, dp_band, gq_band);
+}
+
+void ReferenceBlockWriter::Reset()
+{
+    _band_rid = -1;
+    _band_pos = 0;
+    _num_written = 0;
+}
+
+//true if block ends before rid:pos
+static bool ends_before(int block_rid, int block_end, int rid, int pos)
+{
+    return (block_rid < rid || (block_rid == rid && block_end < pos));
+}
+
+//The interval is cut wherever any sample's block starts or ends, so each piece has constant values for every sample.
+void ReferenceBlockWriter::Band(std::vector<GVCFReader> &readers, int rid, int pos)
+{
+    vector<size_t> index(_num_samples, 0);
+    vector<DepthBlock> current(_num_samples);//copies of the blocks at _band_pos, which blocks points to
+    vector<DepthBlock *> blocks(_num_samples);
+    while (_band_rid < rid || (_band_rid == rid && _band_pos < pos))
+    {
+        bool covered = false;
+        int next_rid = INT_MAX, next_pos = INT_MAX;
+        for (size_t i = 0; i < _num_samples; i++)
+        {
+            GVCFReader &reader = readers[i];
+            while (index[i] < reader.GetNumDepthBlocks() &&
+                   ends_before(reader.GetDepthBlockRid(index[i]), reader.GetDepthBlockEnd(index[i]), _band_rid, _band_pos))
+            {
+                index[i]++;
+            }
+            blocks[i] = nullptr;
+            if (index[i] < reader.GetNumDepthBlocks())
+            {
+                int block_rid = reader.GetDepthBlockRid(index[i]), block_start = reader.GetDepthBlockStart(index[i]);
+                if (block_rid == _band_rid && block_start <= _band_pos)
+                {
+                    current[i] = reader.GetDepthBlock(index[i]);
+                    blocks[i] = &current[i];
+                    covered = true;
+                }
+                else if (block_rid < next_rid || (block_rid == next_rid && block_start < next_pos))
+                {
+                    next_rid = block_rid;
+                    next_pos = block_start;
+                }
+            }
+        }
+
+        //no sample has data here, jump to where the next block starts
+        if (!covered)
+        {
+            if (next_rid == INT_MAX)
+            {
+                break;
+            }
+            _band_rid = next_rid;
+            _band_pos = next_pos;
+            continue;
+        }
+
+        int end = _band_rid == rid ? pos - 1 : INT_MAX;
+        for (size_t i = 0; i < _num_samples; i++)
+        {
+            if (blocks[i] != nullptr)
+            {
+                end = min(end, blocks[i]->end());
+            }
+            else if (index[i] < readers[i].GetNumDepthBlocks() && readers[i].GetDepthBlockRid(index[i]) == _band_rid)
+            {
+                end = min(end, readers[i].GetDepthBlockStart(index[i]) - 1);
+            }
+        }
+        AddSegment(_band_rid, _band_pos, end, blocks);
+        _band_pos = end + 1;
+    }
+}
+
+void ReferenceBlockWriter::AddSite(std::vector<GVCFReader> &readers, bcf1_t *site)
+{
+    //reference blocks stop at the site and pick up again after it
+    Band(readers, site->rid, site->pos);
+    _bander->Close();
+    int end = site->pos + site->rlen;
+    if (site->rid > _band_rid || end > _band_pos)
+    {
+        _band_rid = site->rid;
+        _band_pos = end;
+    }
+}
+
+void ReferenceBlockWriter::Close()
+{
+    _bander->Close();
+}
+
+//adds the parts of rid:start-end that are inside -r/-R (if given) to the current reference block
+void ReferenceBlockWriter::AddSegment(int rid, int start, int end, vector<DepthBlock *> &blocks)
+{
+    if (_band_regions.empty())
+    {
+        _bander->Add(rid, start, end, blocks);
+        return;
+    }
+    for (auto it = _band_regions.begin(); it != _band_regions.end(); it++)
+    {
+        if (it->first == rid && it->second.start <= end && start <= it->second.end)
+        {
+            _bander->Add(rid, max(start, it->second.start), min(end, it->second.end), blocks);
+        }
+    }
+}
+
+bcf1_t *ReferenceBlockWriter::NextRecord()
+{
+    if (!_bander->HasBlock())
+    {
+        return (nullptr);
+    }
+    const cohort_block_t &block = _bander->Front();
+    bcf_clear(_record);
+    _record->rid = block.rid;
+    _record->pos = block.start;
+    bcf_update_id(_output_header, _record, ".");
+    int len = 0;
+    char *ref = faidx_fetch_seq(_fai, bcf_hdr_id2name(_output_header, block.rid), block.start, block.start, &len);
+    if (ref == nullptr || len < 1)
+    {
+        ggutils::die("could not fetch the reference base at " + (string) bcf_hdr_id2name(_output_header, block.rid) + ":" +
+                     to_string(block.start + 1));
+    }
+    ref[0] = toupper(ref[0]);
+    bcf_update_alleles_str(_output_header, _record, ref);
+    free(ref);
+    _record->rlen = block.end - block.start + 1;
+    bcf_float_set_missing(_record->qual);
+    int end = block.end + 1;
+    bcf_update_info_int32(_output_header, _record, "END", &end, 1);
+
+    //GT as for a sample genotyped from its homref block at a site
+    vector<int32_t> gt(2 * _num_samples, bcf_gt_missing);
+    for (size_t i = 0; i < _num_samples; i++)
+    {
+        if (block.dp[i] != bcf_int32_missing && block.dp[i] > 0)
+        {
+            gt[2 * i] = bcf_gt_unphased(0);
+            gt[2 * i + 1] = block.ploidy[i] == 2 ? bcf_gt_unphased(0) : bcf_int32_vector_end;
+        }
+    }
+    bcf_update_genotypes(_output_header, _record, gt.data(), gt.size());
+    bcf_update_format_int32(_output_header, _record, "DP", block.dp.data(), _num_samples);
+    bcf_update_format_int32(_output_header, _record, "GQ", block.gq.data(), _num_samples);
+    _bander->Pop();
+    _num_written++;
+    return (_record);
+}
@@ -0,0 +1,65 @@
+//
+// The reference blocks of --output-mode gvcf, from the readers' buffered homref blocks to output records.
+//
+
+#ifndef GVCFGENOTYPER_REFERENCEBLOCKWRITER_HH
+#define GVCFGENOTYPER_REFERENCEBLOCKWRITER_HH
+
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <htslib/vcf.h>
+#include <htslib/faidx.h>
+}
+
+#include "ggutils.hh"
+#include "GVCFReader.hh"
+#include "ReferenceBander.hh"
+
+//default --band-dp/--band-gq of --output-mode gvcf
+#define DEFAULT_DP_BAND 5
+#define DEFAULT_GQ_BAND 10
+
+//Bands the homref blocks of every sample between the merged sites (see ReferenceBander) and formats the cohort
+//blocks as records with INFO/END, GT, DP and GQ. Blocks are clipped to the -r/-R regions, if any.
+class ReferenceBlockWriter
+{
+public:
+    //reference_genome needs a .fai, its first base of each block is the block's REF
+    ReferenceBlockWriter(const std::string &reference_genome, bcf_hdr_t *output_header, size_t num_samples,
+                         const std::string &region = "", int is_file = 0,
+                         int dp_band = DEFAULT_DP_BAND, int gq_band = DEFAULT_GQ_BAND);
+    ~ReferenceBlockWriter();
+
+    //a new block starts when any sample's DP/GQ moves more than this from the block's start
+    void SetBands(int dp_band, int gq_band);
+    //starts again from the beginning of the genome
+    void Reset();
+
+    //bands the buffered homref blocks of every reader from where the last call (or site) left off up to (not
+    //including) rid:pos. The readers' blocks are not flushed.
+    void Band(std::vector<GVCFReader> &readers, int rid, int pos);
+    //bands up to site and ends the current block, banding picks up again after site
+    void AddSite(std::vector<GVCFReader> &readers, bcf1_t *site);
+    //ends the current block, after the last site
+    void Close();
+
+    //the next finished block as a record, nullptr if there is none. The record is valid until the next call.
+    bcf1_t *NextRecord();
+    size_t GetNumWritten() const { return _num_written; }
+
+private:
+    void AddSegment(int rid, int start, int end, std::vector<DepthBlock *> &blocks);
+
+    bcf_hdr_t *_output_header;
+    size_t _num_samples;
+    ReferenceBander *_bander;
+    int _band_rid, _band_pos;//first position not yet covered by a reference block or site
+    std::vector<std::pair<int, ggutils::region_t> > _band_regions;//-r/-R, reference blocks are clipped to these
+    faidx_t *_fai;
+    bcf1_t *_record;
+    size_t _num_written;
+};
+
+#endif //GVCFGENOTYPER_REFERENCEBLOCKWRITER_HH
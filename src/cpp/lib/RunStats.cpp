@@ -0,0 +1,386 @@
+#include "RunStats.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+
+#include <sys/resource.h>
+
+#include "ggutils.hh"
+#include "Trace.hh"
+
+thread_local StageClock *StageClock::_current = nullptr;
+
+StageClock::StageClock()
+{
+    for (int s = 0; s <= STAGE_NONE; s++)
+    {
+        _ticks[s] = 0;
+    }
+    _last = stats_ticks();
+    _stage = STAGE_NONE;
+}
+
+run_stage_t StageClock::Switch(run_stage_t stage)
+{
+    uint64_t now = stats_ticks();
+#ifdef GG_TRACE
+    if (_stage != STAGE_NONE && Tracer::IsOpen())
+    {
+        Tracer::Span(RunStats::StageName(_stage), "stage", _last, now);
+    }
+#endif
+    //only this clock's thread writes its counters, so they need no atomic read-modify-write
+    _ticks[_stage].store(_ticks[_stage].load(std::memory_order_relaxed) + (now - _last), std::memory_order_relaxed);
+    _last = now;
+    run_stage_t previous = _stage;
+    _stage = stage;
+    return (previous);
+}
+
+void StageClock::Attach(StageClock *clock)
+{
+    if (_current != nullptr)
+    {
+        _current->Switch(STAGE_NONE);
+    }
+    _current = clock;
+    if (_current != nullptr)
+    {
+        _current->Switch(STAGE_NONE);
+    }
+}
+
+void reader_stats_t::Add(uint64_t records, uint64_t variants, uint64_t read, uint64_t normalise)
+{
+    //the readers of several chunk workers can read the same GVCF at once
+    num_records.fetch_add(records, std::memory_order_relaxed);
+    num_variants.fetch_add(variants, std::memory_order_relaxed);
+    read_ticks.fetch_add(read, std::memory_order_relaxed);
+    normalise_ticks.fetch_add(normalise, std::memory_order_relaxed);
+}
+
+void reader_stats_t::AddSkipped(uint64_t invalid, uint64_t duplicates)
+{
+    num_invalid.fetch_add(invalid, std::memory_order_relaxed);
+    num_duplicates.fetch_add(duplicates, std::memory_order_relaxed);
+}
+
+template<typename T>
+static void update_max(std::atomic<T> &peak, T value)
+{
+    T current = peak.load(std::memory_order_relaxed);
+    while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+void reader_stats_t::UpdatePeaks(uint64_t buffered_variants, uint64_t buffered_blocks)
+{
+    update_max(peak_variants, buffered_variants);
+    update_max(peak_blocks, buffered_blocks);
+}
+
+MemoryStats::MemoryStats()
+{
+    for (int c = 0; c <= MEM_TOTAL; c++)
+    {
+        _bytes[c] = 0;
+        _peak[c] = 0;
+    }
+    _budget = 0;
+    _warned = false;
+    _lg = spdlog::get("gg_logger");
+}
+
+void MemoryStats::Add(memory_component_t component, int64_t bytes)
+{
+    update_max(_peak[component], _bytes[component].fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    int64_t total = _bytes[MEM_TOTAL].fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    update_max(_peak[MEM_TOTAL], total);
+    if (_budget == 0)
+    {
+        return;
+    }
+    //warns once each time the total comes close to the budget
+    bool close = total >= MEMORY_WARN_FRACTION * _budget;
+    if (close != _warned.load(std::memory_order_relaxed) && close != _warned.exchange(close) && close &&
+        _lg != nullptr)
+    {
+        _lg->warn("WARNING: {:.1f}MB of memory is accounted for, {:.0f}% of the {:.1f}MB budget: {}",
+                  total / 1048576., 100. * total / _budget, _budget / 1048576., Summary());
+    }
+}
+
+std::string MemoryStats::Summary() const
+{
+    std::string ret;
+    for (int c = 0; c <= MEM_TOTAL; c++)
+    {
+        ret += fmt::format("{}{} {:.1f}MB (peak {:.1f}MB)", c > 0 ? ", " : "", ComponentName((memory_component_t) c),
+                           GetBytes((memory_component_t) c) / 1048576., GetPeak((memory_component_t) c) / 1048576.);
+    }
+    return (ret);
+}
+
+const char *MemoryStats::ComponentName(memory_component_t component)
+{
+    static const char *names[] = {"variants", "blocks", "headers", "indexes", "columns", "records", "total"};
+    return (names[component]);
+}
+
+RunStats::RunStats(const std::vector<std::string> &files, int interval)
+{
+    if (interval < 0)
+    {
+        ggutils::die("RunStats needs a non-negative interval");
+    }
+    _files = files;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        _readers.push_back(new reader_stats_t);
+    }
+    _interval = interval;
+    _start = _last_report = std::chrono::steady_clock::now();
+    _start_ticks = stats_ticks();
+    _last_sites = 0;
+    _num_dropped = 0;
+    _lg = spdlog::get("gg_logger");
+}
+
+RunStats::~RunStats()
+{
+    for (auto it = _readers.begin(); it != _readers.end(); it++)
+    {
+        delete *it;
+    }
+    for (auto it = _own_clocks.begin(); it != _own_clocks.end(); it++)
+    {
+        delete *it;
+    }
+}
+
+StageClock *RunStats::NewClock()
+{
+    _own_clocks.push_back(new StageClock);
+    _clocks.push_back(_own_clocks.back());
+    return (_own_clocks.back());
+}
+
+void RunStats::AddClock(const StageClock *clock)
+{
+    _clocks.push_back(clock);
+}
+
+const char *RunStats::StageName(run_stage_t stage)
+{
+    static const char *names[] = {"read", "normalise", "sites", "hom-ref", "alt", "info", "encode", "write", "none"};
+    return (names[stage]);
+}
+
+double RunStats::GetElapsed() const
+{
+    return (std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count());
+}
+
+//ticks are calibrated against the steady clock over the run so far
+double RunStats::GetSecondsPerTick() const
+{
+    uint64_t ticks = stats_ticks() - _start_ticks;
+    return (ticks > 0 ? GetElapsed() / ticks : 0.);
+}
+
+double RunStats::GetStageSeconds(run_stage_t stage) const
+{
+    uint64_t ticks = 0;
+    for (auto it = _clocks.begin(); it != _clocks.end(); it++)
+    {
+        ticks += (*it)->GetTicks(stage);
+    }
+    return (ticks * GetSecondsPerTick());
+}
+
+void RunStats::MaybeReport(size_t num_sites)
+{
+    if (_interval > 0 &&
+        std::chrono::steady_clock::now() - _last_report >= std::chrono::seconds(_interval))
+    {
+        Report(num_sites);
+    }
+}
+
+void RunStats::Report(size_t num_sites, bool final)
+{
+    if (!_json_file.empty())
+    {
+        WriteJson(num_sites, final);
+    }
+    if (_lg == nullptr)
+    {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = GetElapsed();
+    double since_last = std::chrono::duration<double>(now - _last_report).count();
+    double seconds_per_tick = GetSecondsPerTick();
+    uint64_t num_records = 0, num_variants = 0;
+    for (auto it = _readers.begin(); it != _readers.end(); it++)
+    {
+        num_records += (*it)->num_records.load(std::memory_order_relaxed);
+        num_variants += (*it)->num_variants.load(std::memory_order_relaxed);
+    }
+    _lg->info("{} after {:.0f}s: {} sites ({:.1f} sites/s, {:.1f} sites/s since the last report), "
+              "{} GVCF records ({:.0f} records/s) with {} variants",
+              final ? "Run" : "Progress", elapsed, num_sites, elapsed > 0 ? num_sites / elapsed : 0.,
+              since_last > 0 ? (num_sites - _last_sites) / since_last : 0., num_records,
+              elapsed > 0 ? num_records / elapsed : 0., num_variants);
+
+    //thread time, which adds up to more than the elapsed time when several threads are busy
+    double stage_seconds[STAGE_NONE], total = 0;
+    for (int s = 0; s < STAGE_NONE; s++)
+    {
+        stage_seconds[s] = GetStageSeconds((run_stage_t) s);
+        total += stage_seconds[s];
+    }
+    std::string stages;
+    for (int s = 0; s < STAGE_NONE; s++)
+    {
+        stages += fmt::format("{}{} {:.2f}s ({:.1f}%)", s > 0 ? ", " : "", StageName((run_stage_t) s),
+                              stage_seconds[s], total > 0 ? 100. * stage_seconds[s] / total : 0.);
+    }
+    _lg->info("Thread time by stage: {}", stages);
+
+    //a snapshot, as the readers may still be counting
+    std::vector<uint64_t> busy(_readers.size());
+    for (size_t i = 0; i < _readers.size(); i++)
+    {
+        busy[i] = _readers[i]->read_ticks.load(std::memory_order_relaxed) +
+                  _readers[i]->normalise_ticks.load(std::memory_order_relaxed);
+    }
+    std::vector<size_t> order(_readers.size());
+    std::iota(order.begin(), order.end(), 0);
+    size_t num_slowest = std::min(order.size(), (size_t) STATS_SLOWEST_READERS);
+    std::partial_sort(order.begin(), order.begin() + num_slowest, order.end(),
+                      [&busy](size_t a, size_t b) { return (busy[a] > busy[b]); });
+    std::string slowest;
+    for (size_t k = 0; k < num_slowest; k++)
+    {
+        reader_stats_t *reader = _readers[order[k]];
+        double read = reader->read_ticks.load(std::memory_order_relaxed) * seconds_per_tick;
+        double normalise = reader->normalise_ticks.load(std::memory_order_relaxed) * seconds_per_tick;
+        uint64_t records = reader->num_records.load(std::memory_order_relaxed);
+        slowest += fmt::format("{}{} (read {:.2f}s, normalise {:.2f}s, {} records, {:.0f} records/s)",
+                               k > 0 ? ", " : "", _files[order[k]], read, normalise, records,
+                               read + normalise > 0 ? records / (read + normalise) : 0.);
+    }
+    if (!slowest.empty())
+    {
+        _lg->info("Slowest GVCFs: {}", slowest);
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    _lg->info("Memory by component: {}; peak RSS {:.1f}MB", _memory.Summary(), usage.ru_maxrss / 1024.);
+    _last_report = now;
+    _last_sites = num_sites;
+}
+
+//rchar and wchar of /proc/self/io, the bytes the process read and wrote (through the page cache or not).
+//false where there is no /proc/self/io.
+static bool get_io_bytes(uint64_t &read, uint64_t &written)
+{
+    std::ifstream io("/proc/self/io");
+    std::string key;
+    uint64_t value;
+    int found = 0;
+    while (io >> key >> value)
+    {
+        if (key == "rchar:")
+        {
+            read = value;
+            found++;
+        }
+        else if (key == "wchar:")
+        {
+            written = value;
+            found++;
+        }
+    }
+    return (found == 2);
+}
+
+//written to a temporary file that is renamed over fname, so a reader never sees half a report
+void RunStats::WriteJson(size_t num_sites, bool final)
+{
+    double seconds_per_tick = GetSecondsPerTick();
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    uint64_t io_read = 0, io_written = 0;
+    bool has_io = get_io_bytes(io_read, io_written);
+
+    std::string json = "{\n";
+    json += fmt::format("  \"final\": {},\n", final ? "true" : "false");
+    json += fmt::format("  \"elapsed_seconds\": {:.3f},\n", GetElapsed());
+    json += fmt::format("  \"cpu_user_seconds\": {:.3f},\n", usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6);
+    json += fmt::format("  \"cpu_system_seconds\": {:.3f},\n", usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6);
+    json += fmt::format("  \"peak_rss_kb\": {},\n", usage.ru_maxrss);
+    json += fmt::format("  \"io_read_bytes\": {},\n", has_io ? std::to_string(io_read) : "null");
+    json += fmt::format("  \"io_written_bytes\": {},\n", has_io ? std::to_string(io_written) : "null");
+    json += fmt::format("  \"sites_written\": {},\n", num_sites);
+    json += fmt::format("  \"sites_dropped_max_alleles\": {},\n", _num_dropped.load(std::memory_order_relaxed));
+
+    uint64_t totals[4] = {0, 0, 0, 0};
+    std::string readers;
+    for (size_t i = 0; i < _readers.size(); i++)
+    {
+        reader_stats_t *reader = _readers[i];
+        uint64_t values[4] = {reader->num_records.load(std::memory_order_relaxed),
+                              reader->num_variants.load(std::memory_order_relaxed),
+                              reader->num_duplicates.load(std::memory_order_relaxed),
+                              reader->num_invalid.load(std::memory_order_relaxed)};
+        for (int k = 0; k < 4; k++)
+        {
+            totals[k] += values[k];
+        }
+        readers += fmt::format("    {{\"file\": {}, \"records\": {}, \"variants\": {}, \"duplicate_records\": {}, "
+                               "\"invalid_records\": {}, \"read_seconds\": {:.3f}, \"normalise_seconds\": {:.3f}, "
+                               "\"peak_buffered_variants\": {}, \"peak_buffered_blocks\": {}}}{}\n",
+                               ggutils::json_string(_files[i]), values[0], values[1], values[2], values[3],
+                               reader->read_ticks.load(std::memory_order_relaxed) * seconds_per_tick,
+                               reader->normalise_ticks.load(std::memory_order_relaxed) * seconds_per_tick,
+                               reader->peak_variants.load(std::memory_order_relaxed),
+                               reader->peak_blocks.load(std::memory_order_relaxed),
+                               i + 1 < _readers.size() ? "," : "");
+    }
+    json += fmt::format("  \"records_read\": {},\n", totals[0]);
+    json += fmt::format("  \"variants_read\": {},\n", totals[1]);
+    json += fmt::format("  \"duplicate_records\": {},\n", totals[2]);
+    json += fmt::format("  \"invalid_records\": {},\n", totals[3]);
+    json += "  \"stage_thread_seconds\": {";
+    for (int s = 0; s < STAGE_NONE; s++)
+    {
+        json += fmt::format("{}\"{}\": {:.3f}", s > 0 ? ", " : "", StageName((run_stage_t) s),
+                            GetStageSeconds((run_stage_t) s));
+    }
+    json += "},\n";
+    for (int peak = 0; peak < 2; peak++)
+    {
+        json += peak ? "  \"memory_peak_bytes\": {" : "  \"memory_bytes\": {";
+        for (int c = 0; c <= MEM_TOTAL; c++)
+        {
+            json += fmt::format("{}\"{}\": {}", c > 0 ? ", " : "", MemoryStats::ComponentName((memory_component_t) c),
+                                peak ? _memory.GetPeak((memory_component_t) c) : _memory.GetBytes((memory_component_t) c));
+        }
+        json += "},\n";
+    }
+    json += fmt::format("  \"memory_budget_bytes\": {},\n", _memory.GetBudget());
+    json += "  \"readers\": [\n" + readers + "  ]\n}\n";
+
+    std::string tmp = _json_file + ".tmp";
+    FILE *fp = fopen(tmp.c_str(), "w");
+    if (fp == nullptr || fwrite(json.data(), 1, json.size(), fp) != json.size() || fclose(fp) != 0 ||
+        rename(tmp.c_str(), _json_file.c_str()) != 0)
+    {
+        ggutils::die("problem writing " + _json_file);
+    }
+}
@@ -0,0 +1,192 @@
+//
+// Timing and throughput counters of a merge, logged (and with --stats-json written as JSON) every --stats-interval
+// seconds and at the end of the run.
+//
+
+#ifndef GVCFGENOTYPER_RUNSTATS_HH
+#define GVCFGENOTYPER_RUNSTATS_HH
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "spdlog.h"
+
+//default --stats-interval, seconds between two reports of the counters
+#define STATS_INTERVAL 600
+//GVCFs listed as the slowest in each report
+#define STATS_SLOWEST_READERS 5
+//a warning is logged when the accounted memory reaches this fraction of --memory-budget
+#define MEMORY_WARN_FRACTION 0.9
+
+//the stages a thread's time is charged to. STAGE_NONE is time that is not counted (waiting on a queue or thread).
+enum run_stage_t
+{
+    STAGE_READ,//reading and decoding GVCF records (GVCFReader::ReadLines less normalisation)
+    STAGE_NORMALISE,//Normaliser::Unarise
+    STAGE_SITES,//finding the next site and its alleles
+    STAGE_HOMREF,//genotyping samples without a variant at a site from their reference blocks
+    STAGE_ALT,//genotyping samples with a variant at a site
+    STAGE_INFO,//site level INFO from the genotypes
+    STAGE_ENCODE,//FORMAT into the output record, transposing sample columns and handing records to the outputs
+    STAGE_WRITE,//bcf_write1 (formatting and compression) on the outputs' threads
+    STAGE_NONE
+};
+
+//a timestamp that costs a few ns: TSC cycles on x86, nanoseconds elsewhere. RunStats converts ticks to seconds.
+inline uint64_t stats_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return (__rdtsc());
+#else
+    return (std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+//Charges the time between two switches to the stage that was current, so every tick of a thread goes to exactly
+//one stage and nested stages (a reader filling its buffer while a sample is genotyped) are not counted twice.
+//Only its thread switches a clock, any thread may read its counters.
+class StageClock
+{
+public:
+    StageClock();
+    //charges the ticks since the last switch to the current stage, makes stage current and returns the previous one
+    run_stage_t Switch(run_stage_t stage);
+    uint64_t GetTicks(run_stage_t stage) const { return _ticks[stage].load(std::memory_order_relaxed); }
+    //ticks of the last switch
+    uint64_t GetLast() const { return _last; }
+
+    //the calling thread's clock from now on, nullptr for none. Its current stage is STAGE_NONE.
+    static void Attach(StageClock *clock);
+    static StageClock *Current() { return _current; }
+    //switches the calling thread's clock, if it has one, returns the previous stage
+    static run_stage_t Enter(run_stage_t stage)
+    {
+        return (_current != nullptr ? _current->Switch(stage) : STAGE_NONE);
+    }
+
+private:
+    std::atomic<uint64_t> _ticks[STAGE_NONE + 1];
+    uint64_t _last;
+    run_stage_t _stage;
+    static thread_local StageClock *_current;
+};
+
+//what the memory of a merge is accounted to
+enum memory_component_t
+{
+    MEM_VARIANTS,//variants buffered by the readers (VariantBuffer)
+    MEM_BLOCKS,//reference blocks buffered by the readers (DepthBuffer)
+    MEM_HEADERS,//the readers' GVCF headers
+    MEM_INDEXES,//GVCF indexes loaded for regions, -@ or --two-pass, as their uncompressed size
+    MEM_COLUMNS,//genotyped sample columns of chunks and batches that are not written yet
+    MEM_RECORDS,//the output record and the FORMAT arrays it is encoded from, which grow with the number of alleles
+    MEM_TOTAL
+};
+
+//Bytes held by each memory_component_t and the most each (and the total) has held. The bytes are worked out from
+//the sizes of the structures rather than by hooking the allocator, and are updated by whichever thread changes
+//them. With a budget a warning is logged when the total reaches MEMORY_WARN_FRACTION of it.
+class MemoryStats
+{
+public:
+    MemoryStats();
+    void Add(memory_component_t component, int64_t bytes);
+    //moves component from the published bytes to bytes, for owners that keep what they have published
+    void Update(memory_component_t component, int64_t &published, int64_t bytes)
+    {
+        if (bytes != published)
+        {
+            Add(component, bytes - published);
+            published = bytes;
+        }
+    }
+    //0 for no budget
+    void SetBudget(uint64_t bytes) { _budget = bytes; }
+    uint64_t GetBudget() const { return _budget; }
+    int64_t GetBytes(memory_component_t component) const { return _bytes[component].load(std::memory_order_relaxed); }
+    int64_t GetPeak(memory_component_t component) const { return _peak[component].load(std::memory_order_relaxed); }
+    //"variant buffers 1.2MB (peak 3.4MB), ...", MB are 2^20 bytes
+    std::string Summary() const;
+    static const char *ComponentName(memory_component_t component);
+
+private:
+    std::atomic<int64_t> _bytes[MEM_TOTAL + 1], _peak[MEM_TOTAL + 1];
+    uint64_t _budget;
+    std::atomic<bool> _warned;
+    std::shared_ptr<spdlog::logger> _lg;
+};
+
+//records read from one GVCF and the time it took, added to by whichever thread reads the GVCF
+struct reader_stats_t
+{
+    std::atomic<uint64_t> num_records, num_variants, read_ticks, normalise_ticks;
+    std::atomic<uint64_t> num_invalid;//variant lines that are not valid Strelka records
+    std::atomic<uint64_t> num_duplicates;//see VariantBuffer::GetNumDuplicatedRecords
+    std::atomic<uint64_t> peak_variants, peak_blocks;//most variants and reference blocks buffered by one reader
+    reader_stats_t() : num_records(0), num_variants(0), read_ticks(0), normalise_ticks(0), num_invalid(0),
+                       num_duplicates(0), peak_variants(0), peak_blocks(0) {}
+    void Add(uint64_t records, uint64_t variants, uint64_t read, uint64_t normalise);
+    void AddSkipped(uint64_t invalid, uint64_t duplicates);
+    void UpdatePeaks(uint64_t buffered_variants, uint64_t buffered_blocks);
+};
+
+//The counters of a run: a StageClock for each thread of the merge, and a reader_stats_t for each GVCF.
+//Reports give sites/sec (over the run and since the last report), records/sec, the thread time of every stage
+//and the GVCFs that took the longest to read, so a stalled stage or input shows up in the log of a long run.
+//Reports also give the bytes and peak of each memory component (see MemoryStats).
+//With SetJsonFile every report also (over)writes a JSON file with all of the counters, the process' CPU time,
+//peak RSS and bytes read and written, for scripts rather than people.
+class RunStats
+{
+public:
+    //interval is seconds between reports, 0 only reports when Report is called
+    RunStats(const std::vector<std::string> &files, int interval);
+    ~RunStats();
+
+    //a clock for a thread of the merge, owned by RunStats
+    StageClock *NewClock();
+    //counts a clock owned by someone else (an OutputSink), which has to live as long as RunStats
+    void AddClock(const StageClock *clock);
+    reader_stats_t *GetReader(size_t index) { return _readers[index]; }
+    //a site that was not written because it has more than --max-alleles alleles, any thread may call this
+    void AddDroppedSite() { _num_dropped.fetch_add(1, std::memory_order_relaxed); }
+    //reports are also written to fname as JSON, replacing the previous report
+    void SetJsonFile(const std::string &fname) { _json_file = fname; }
+    MemoryStats *GetMemory() { return &_memory; }
+
+    //reports if interval seconds have passed since the last report, num_sites is the number of sites written so far
+    void MaybeReport(size_t num_sites);
+    void Report(size_t num_sites, bool final = false);
+
+    //seconds counted in stage over every clock
+    double GetStageSeconds(run_stage_t stage) const;
+    double GetSecondsPerTick() const;
+    static const char *StageName(run_stage_t stage);
+
+private:
+    double GetElapsed() const;
+    void WriteJson(size_t num_sites, bool final);
+
+    std::vector<std::string> _files;
+    std::vector<reader_stats_t *> _readers;
+    std::vector<StageClock *> _own_clocks;
+    std::vector<const StageClock *> _clocks;
+    int _interval;
+    std::chrono::steady_clock::time_point _start, _last_report;
+    uint64_t _start_ticks;
+    size_t _last_sites;
+    std::atomic<uint64_t> _num_dropped;
+    std::string _json_file;
+    MemoryStats _memory;
+    std::shared_ptr<spdlog::logger> _lg;
+};
+
+#endif //GVCFGENOTYPER_RUNSTATS_HH
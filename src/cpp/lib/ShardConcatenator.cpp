@@ -0,0 +1,293 @@
+#include "ShardConcatenator.hh"
+#include "OutputSink.hh"
+#include "ggutils.hh"
+
+#include <sys/stat.h>
+
+extern "C" {
+#include <htslib/hfile.h>
+#include <htslib/kstring.h>
+}
+
+//bytes moved per read/write when copying compressed blocks
+#define CONCAT_COPY_BUFFER (1 << 20)
+//size of the empty BGZF block marking the end of a file
+#define BGZF_EOF_BLOCK_SIZE 28
+
+ShardConcatenator::ShardConcatenator(const std::vector<std::string> &shards, const std::string &output_filename)
+{
+    _shards = shards;
+    _output_filename = output_filename;
+    _out = nullptr;
+    _header = nullptr;
+    _header_text = {0, 0, nullptr};
+    _line = {0, 0, nullptr};
+    _record = bcf_init1();
+    _idx = nullptr;
+    _last_rid = -1;
+    _last_pos = -1;
+    _num_records = 0;
+    _num_duplicates = 0;
+    _num_bytes_copied = 0;
+    _lg = spdlog::get("gg_logger");
+    if (_shards.empty())
+    {
+        ggutils::die("no shards to concatenate");
+    }
+    if (_output_filename.empty() || _output_filename == "-")
+    {
+        ggutils::die("concat needs an output file name, the output is indexed");
+    }
+}
+
+ShardConcatenator::~ShardConcatenator()
+{
+    if (_header != nullptr) bcf_hdr_destroy(_header);
+    if (_idx != nullptr) hts_idx_destroy(_idx);
+    bcf_destroy(_record);
+    free(_header_text.s);
+    free(_line.s);
+}
+
+//the first shard's header is written to the output, every other shard has to have the same header
+void ShardConcatenator::CheckHeader(htsFile *fp, const std::string &fname)
+{
+    if (fp->format.category != variant_data || fp->format.compression != bgzf)
+    {
+        ggutils::die(fname + " is not a bgzf compressed BCF/VCF");
+    }
+    bcf_hdr_t *header = bcf_hdr_read(fp);
+    if (header == nullptr)
+    {
+        ggutils::die("problem reading the header of " + fname);
+    }
+    kstring_t text = {0, 0, nullptr};
+    bcf_hdr_format(header, 0, &text);
+    if (_header == nullptr)
+    {
+        if (strstr(text.s, "\n##gvcfgenotyper_version=") == nullptr)
+        {
+            ggutils::die(fname + " was not written by gvcfgenotyper");
+        }
+        _header = header;
+        _header_text = text;
+        return;
+    }
+    bcf_hdr_destroy(header);
+    bool matches = text.l == _header_text.l && memcmp(text.s, _header_text.s, text.l) == 0;
+    free(text.s);
+    if (!matches)
+    {
+        ggutils::die("the header of " + fname + " is different from the header of " + _shards[0] +
+                     ". Shards have to come from the same version, GVCFs and options.");
+    }
+}
+
+//reads the next record's position, end is that of the last base. Returns false at the end of the file.
+bool ShardConcatenator::ReadPosition(htsFile *fp, int &rid, int &pos, int &end)
+{
+    if (fp->format.format == bcf)
+    {
+        int ret = bcf_read1(fp, _header, _record);
+        if (ret < -1)
+        {
+            ggutils::die("problem reading " + (string) fp->fn);
+        }
+        rid = _record->rid;
+        pos = _record->pos;
+        end = _record->pos + _record->rlen - 1;
+        return (ret >= 0);
+    }
+
+    //VCF, only CHROM, POS, REF and INFO/END are looked at
+    int ret = bgzf_getline(fp->fp.bgzf, '\n', &_line);
+    if (ret < -1)
+    {
+        ggutils::die("problem reading " + (string) fp->fn);
+    }
+    if (ret < 0)
+    {
+        return (false);
+    }
+    char *columns[8] = {_line.s};
+    int num_columns = 1;
+    for (char *p = _line.s; *p && num_columns < 8; p++)
+    {
+        if (*p == '\t')
+        {
+            *p = '\0';
+            columns[num_columns++] = p + 1;
+        }
+    }
+    if (num_columns < 8)
+    {
+        ggutils::die("problem parsing a record in " + (string) fp->fn);
+    }
+    rid = bcf_hdr_name2id(_header, columns[0]);
+    pos = atoi(columns[1]) - 1;
+    end = pos + (int) strlen(columns[3]) - 1;
+    if (rid < 0)
+    {
+        ggutils::die("contig " + (string) columns[0] + " of " + (string) fp->fn + " is not in the header");
+    }
+    char *info_end = strstr(columns[7], "END=");
+    if (info_end != nullptr && (info_end == columns[7] || info_end[-1] == ';'))
+    {
+        end = atoi(info_end + 4) - 1;
+    }
+    return (true);
+}
+
+int64_t ShardConcatenator::OutputAddress()
+{
+    return (htell(_out->fp.bgzf->fp));
+}
+
+//copies length compressed bytes from the current position of in to the output
+void ShardConcatenator::CopyRawBlocks(BGZF *in, int64_t length)
+{
+    vector<char> buffer(CONCAT_COPY_BUFFER);
+    while (length > 0)
+    {
+        ssize_t n = bgzf_raw_read(in, buffer.data(), (size_t) min(length, (int64_t) buffer.size()));
+        if (n <= 0 || bgzf_raw_write(_out->fp.bgzf, buffer.data(), n) != n)
+        {
+            ggutils::die("problem copying blocks to " + _output_filename);
+        }
+        length -= n;
+        _num_bytes_copied += n;
+    }
+}
+
+void ShardConcatenator::CopyShard(const std::string &fname)
+{
+    htsFile *fp = hts_open(fname.c_str(), "r");
+    if (fp == nullptr)
+    {
+        ggutils::die("problem opening " + fname);
+    }
+    bool first_shard = _header == nullptr;
+    CheckHeader(fp, fname);
+    if (first_shard)
+    {
+        _out = hts_open(_output_filename.c_str(), fp->format.format == bcf ? "wb" : "wz");
+        if (_out == nullptr || bcf_hdr_write(_out, _header) != 0 || bgzf_flush(_out->fp.bgzf) != 0)
+        {
+            ggutils::die("problem opening output file: " + _output_filename);
+        }
+        _idx = init_csi_index(_out, _header);
+    }
+    else if ((fp->format.format == bcf) != (_out->format.format == binary_format))
+    {
+        ggutils::die(fname + " is not in the same format as " + _shards[0]);
+    }
+
+    //skip the records that the previous shard already had
+    int rid, pos, end;
+    int64_t start = bgzf_tell(fp->fp.bgzf);
+    bool has_record;
+    while ((has_record = ReadPosition(fp, rid, pos, end)) &&
+           (rid < _last_rid || (rid == _last_rid && pos <= _last_pos)))
+    {
+        if (rid < _last_rid)
+        {
+            ggutils::die(fname + " starts before the end of the previous shard, shards have to be given in order");
+        }
+        _num_duplicates++;
+        start = bgzf_tell(fp->fp.bgzf);
+    }
+    if (!has_record)
+    {
+        hts_close(fp);
+        return;
+    }
+
+    //recompress the rest of the block the first record starts in, the following blocks are copied as they are
+    struct stat st;
+    BGZF *raw = bgzf_open(fname.c_str(), "r");
+    if (raw == nullptr || stat(fname.c_str(), &st) != 0)
+    {
+        ggutils::die("problem opening " + fname);
+    }
+    int64_t file_end = st.st_size - (bgzf_check_EOF(raw) == 1 ? BGZF_EOF_BLOCK_SIZE : 0);
+    int64_t head_address = start >> 16;
+    int head_offset = (int) (start & 0xFFFF);
+    vector<rewritten_block_t> head_blocks;
+    if (bgzf_seek(raw, head_address << 16, SEEK_SET) < 0)
+    {
+        ggutils::die("problem reading " + fname);
+    }
+    if (head_offset > 0)
+    {
+        if (bgzf_read_block(raw) != 0)
+        {
+            ggutils::die("problem reading " + fname);
+        }
+        for (int offset = head_offset; offset < raw->block_length; offset += BGZF_BLOCK_SIZE)
+        {
+            int length = min(raw->block_length - offset, BGZF_BLOCK_SIZE);
+            head_blocks.push_back({offset, OutputAddress()});
+            if (bgzf_write(_out->fp.bgzf, (char *) raw->uncompressed_block + offset, length) != length ||
+                bgzf_flush(_out->fp.bgzf) != 0)
+            {
+                ggutils::die("problem writing " + _output_filename);
+            }
+        }
+    }
+    int64_t raw_address = htell(raw->fp);//first input block that is copied as it is
+    int64_t raw_output_address = OutputAddress();
+    CopyRawBlocks(raw, file_end - raw_address);
+    bgzf_close(raw);
+
+    //index the records at their new offsets
+    do
+    {
+        int64_t record_end = bgzf_tell(fp->fp.bgzf);
+        int64_t address = record_end >> 16, offset = record_end & 0xFFFF;
+        int64_t output_offset;
+        if (address >= raw_address)
+        {
+            output_offset = ((address - raw_address + raw_output_address) << 16) | offset;
+        }
+        else
+        {
+            size_t i = head_blocks.size() - 1;
+            while (i > 0 && head_blocks[i].input_offset > offset)
+            {
+                i--;
+            }
+            output_offset = (head_blocks[i].output_address << 16) | (offset - head_blocks[i].input_offset);
+        }
+        if (hts_idx_push(_idx, rid, pos, end + 1, output_offset, 1) < 0)
+        {
+            ggutils::die("problem indexing " + _output_filename + ", " + fname + " is not sorted");
+        }
+        _last_pos = rid == _last_rid ? max(_last_pos, pos) : pos;
+        _last_rid = rid;
+        _num_records++;
+    } while (ReadPosition(fp, rid, pos, end));
+    hts_close(fp);
+}
+
+void ShardConcatenator::Concat()
+{
+    for (size_t i = 0; i < _shards.size(); i++)
+    {
+        CopyShard(_shards[i]);
+        if (_lg != nullptr)
+        {
+            _lg->info("Concatenated {} {}/{}", _shards[i], i + 1, _shards.size());
+        }
+    }
+
+    hts_idx_finish(_idx, OutputAddress() << 16);
+    if (hts_close(_out) != 0)
+    {
+        ggutils::die("problem closing " + _output_filename);
+    }
+    _out = nullptr;
+    if (hts_idx_save(_idx, _output_filename.c_str(), HTS_FMT_CSI) != 0)
+    {
+        ggutils::die("problem writing the index of " + _output_filename);
+    }
+}
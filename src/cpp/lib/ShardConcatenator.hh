@@ -0,0 +1,63 @@
+//
+// gvcfgenotyper concat: joins region-sharded outputs without recompressing them.
+//
+
+#ifndef GVCFGENOTYPER_SHARDCONCATENATOR_HH
+#define GVCFGENOTYPER_SHARDCONCATENATOR_HH
+
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <htslib/hts.h>
+#include <htslib/vcf.h>
+#include <htslib/bgzf.h>
+}
+
+#include "spdlog.h"
+
+//Concatenates bgzf compressed BCF/VCF shards written by gvcfgenotyper for consecutive regions (in order).
+//The headers have to be identical. Most BGZF blocks are copied as they are, only the block where a shard's
+//first record starts is recompressed, without the header and without records that the previous shard already
+//had (a deletion overlapping the boundary of two -r regions is written by both). The records are still
+//decompressed to build a CSI index of the output, but not parsed beyond their position.
+class ShardConcatenator
+{
+public:
+    ShardConcatenator(const std::vector<std::string> &shards, const std::string &output_filename);
+    ~ShardConcatenator();
+    //writes output_filename and output_filename.csi
+    void Concat();
+
+    size_t GetNumRecords() const { return _num_records; }
+    size_t GetNumDuplicates() const { return _num_duplicates; }
+    //compressed bytes copied without recompressing them
+    size_t GetNumBytesCopied() const { return _num_bytes_copied; }
+
+private:
+    //a BGZF block of the output that was recompressed from part of an input block
+    struct rewritten_block_t
+    {
+        int input_offset;//of the first byte in the input block
+        int64_t output_address;
+    };
+
+    void CheckHeader(htsFile *fp, const std::string &fname);
+    bool ReadPosition(htsFile *fp, int &rid, int &pos, int &end);
+    void CopyShard(const std::string &fname);
+    void CopyRawBlocks(BGZF *in, int64_t length);
+    int64_t OutputAddress();
+
+    std::vector<std::string> _shards;
+    std::string _output_filename;
+    htsFile *_out;
+    bcf_hdr_t *_header;
+    kstring_t _header_text, _line;
+    bcf1_t *_record;
+    hts_idx_t *_idx;
+    int _last_rid, _last_pos;
+    size_t _num_records, _num_duplicates, _num_bytes_copied;
+    std::shared_ptr<spdlog::logger> _lg;
+};
+
+#endif //GVCFGENOTYPER_SHARDCONCATENATOR_HH
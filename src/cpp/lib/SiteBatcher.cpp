@@ -0,0 +1,87 @@
+#include "SiteBatcher.hh"
+
+#include "Trace.hh"
+
+SiteBatcher::SiteBatcher(std::vector<GVCFReader> &readers, const SiteColumns &columns, size_t batch_sites,
+                         MemoryStats *memory)
+    : _readers(readers), _site_columns(columns)
+{
+    if (batch_sites < 1)
+    {
+        ggutils::die("SiteBatcher needs at least one site per batch");
+    }
+    _batch_sites = batch_sites;
+    _memory = memory;
+    _columns_published = 0;
+    _scratch = _site_columns.NewScratch();
+    _columns.resize(_readers.size());
+}
+
+SiteBatcher::~SiteBatcher()
+{
+    Clear();
+    _memory->Update(MEM_COLUMNS, _columns_published, 0);
+    delete _scratch;
+}
+
+void SiteBatcher::Clear()
+{
+    for (auto it = _sites.begin(); it != _sites.end(); it++)
+    {
+        bcf_destroy(it->record);
+    }
+    _sites.clear();
+}
+
+int SiteBatcher::GetLookAhead(int buffer_size)
+{
+    int look_ahead = buffer_size;
+    for (size_t i = 0; i < _readers.size(); i++)
+    {
+        look_ahead = std::max(look_ahead, _readers[i].GetLookAhead());
+    }
+    return (look_ahead);
+}
+
+bool SiteBatcher::Next(int buffer_size)
+{
+    Clear();
+    bcf1_t *first = nullptr;
+    for (size_t i = 0; i < _readers.size(); i++)
+    {
+        bcf1_t *rec = _readers[i].Front();
+        if (rec != nullptr && (first == nullptr || ggutils::bcf1_less_than(rec, first)))
+        {
+            first = rec;
+        }
+    }
+    if (first == nullptr)
+    {
+        return (false);
+    }
+    GG_TRACE_SCOPE("batch");
+    int rid = first->rid;
+    int end = (int) std::min((long long) first->pos + buffer_size, (long long) INT_MAX - 1);
+    //a deletion read near the margin can make it longer, every variant overlapping it has to be read too
+    int look_ahead = 0;
+    while (look_ahead < GetLookAhead(buffer_size))
+    {
+        look_ahead = GetLookAhead(buffer_size);
+        for (size_t i = 0; i < _readers.size(); i++)
+        {
+            _readers[i].ReadVariantsUntil(rid, (int) std::min((long long) end + look_ahead, (long long) INT_MAX - 1));
+        }
+    }
+
+    _site_columns.Plan(_readers, 0, end, _sites, _batch_sites);
+    for (size_t i = 0; i < _readers.size(); i++)
+    {
+        _columns[i].values.clear();
+        _columns[i].offsets.clear();
+        _columns[i].ft.clear();
+        _columns[i].stats.clear();
+        SiteColumns::GenotypeColumn(_readers[i], _sites, _columns[i], _scratch);
+    }
+    _memory->Update(MEM_COLUMNS, _columns_published, SiteColumns::GetBytes(_sites, _columns));
+    return (true);
+}
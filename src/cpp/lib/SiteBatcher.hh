@@ -0,0 +1,52 @@
+//
+// The batched streaming merge (--batch-sites).
+//
+
+#ifndef GVCFGENOTYPER_SITEBATCHER_HH
+#define GVCFGENOTYPER_SITEBATCHER_HH
+
+#include <deque>
+#include <vector>
+
+#include "GVCFReader.hh"
+#include "RunStats.hh"
+#include "SiteColumns.hh"
+
+//Plans and genotypes up to batch_sites sites at a time from the streaming readers, in the same three steps as the
+//sample-parallel engine (see SiteColumns):
+//1. every reader reads all its variants up to GetLookAhead() bp past the batch (the margin GVCFReader::FillBuffer
+//   keeps for normalisation and deletions), starting from the first buffered variant, and the sites are planned
+//   from those
+//2. each sample is genotyped at every site of the batch in turn, flushing its reader as GVCFMerger::next() would
+//3. the caller transposes the sample columns into site rows and writes them (SiteColumns::Transpose)
+//The output is the same as from GVCFMerger::next().
+class SiteBatcher
+{
+public:
+    //the columns of a batch are accounted to memory's MEM_COLUMNS until the batcher goes
+    SiteBatcher(std::vector<GVCFReader> &readers, const SiteColumns &columns, size_t batch_sites, MemoryStats *memory);
+    ~SiteBatcher();
+
+    //plans and genotypes the next batch of sites, which start within buffer_size bp of the first buffered variant.
+    //Returns false once every reader is empty.
+    bool Next(int buffer_size);
+
+    std::deque<planned_site_t> &GetSites() { return _sites; }
+    std::vector<sample_column_t> &GetColumns() { return _columns; }
+
+private:
+    void Clear();
+    //the longest look-ahead of any reader, at least buffer_size
+    int GetLookAhead(int buffer_size);
+
+    std::vector<GVCFReader> &_readers;
+    const SiteColumns &_site_columns;
+    size_t _batch_sites;
+    MemoryStats *_memory;
+    int64_t _columns_published;//the columns are reused, so they stay accounted until the last batch is written
+    ggutils::vcf_data_t *_scratch;
+    std::deque<planned_site_t> _sites;
+    std::vector<sample_column_t> _columns;
+};
+
+#endif //GVCFGENOTYPER_SITEBATCHER_HH
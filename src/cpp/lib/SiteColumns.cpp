@@ -0,0 +1,299 @@
+#include "SiteColumns.hh"
+
+#include <cstring>
+
+#include "Genotype.hh"
+#include "Normaliser.hh"
+
+static void genotype_homref_variant(ggutils::vcf_data_t *format, int sample_index, int num_allele, DepthBlock &homref_block)
+{
+    int num_pl_per_sample = ggutils::get_number_of_likelihoods(2,num_allele);
+    int num_pl_in_this_sample = ggutils::get_number_of_likelihoods(homref_block.ploidy(),num_allele);
+
+    format->dp[sample_index] = homref_block.dp();
+    format->dpf[sample_index] = homref_block.dpf();
+    format->gq[sample_index] = homref_block.gq();
+    if(format->ft[sample_index]) format->ft[sample_index]=(char *)realloc(format->ft[sample_index],2);
+    else format->ft[sample_index]=(char *)malloc(2);
+    format->ft[sample_index][0] = '.';
+    format->ft[sample_index][1] = '\0';
+
+    if (homref_block.dp() > 0)
+    {
+        if(homref_block.ploidy()==2)
+        {
+            format->gt[2 * sample_index] = format->gt[2 * sample_index + 1] = bcf_gt_unphased(0);
+        }
+        else
+        {
+            format->gt[2 * sample_index] = bcf_gt_unphased(0);
+            format->gt[2 * sample_index + 1] = bcf_int32_vector_end;
+        }
+    }
+    if(format->local)
+    {
+        //only REF is local, its PL is the 0 of the dummy PL below
+        int32_t dp = homref_block.dp(), pl = 0;
+        format->set_local_fields(sample_index, vector<int>(1, 0), &dp, &pl, 1);
+        return;
+    }
+    format->ad[sample_index * num_allele] = homref_block.dp();
+    for(int i=1;i<num_allele;i++)
+        format->ad[sample_index * num_allele+i] = 0;
+
+    //FIXME: dummy PL value for homref sites
+    int *pl_ptr = format->pl + sample_index*num_pl_per_sample;
+    std::fill(pl_ptr,pl_ptr+num_pl_per_sample,bcf_int32_vector_end);
+    std::fill(pl_ptr,pl_ptr+num_pl_in_this_sample,255);
+    pl_ptr[0] = 0;
+}
+
+static void set_sample_stats(Genotype &g, sample_stats_t &stats)
+{
+    if(g.mq() != bcf_int32_missing)
+    {
+        stats.mq_weighted = g.dp() * g.mq();
+        stats.mq_weight = g.dp();
+    }
+    stats.qual = g.qual();
+}
+
+static void genotype_alt_variant(bcf_hdr_t *sample_header, multiAllele &alleles, bcf1_t *sample_variants,
+                                 ggutils::vcf_data_t *format, int sample_index, sample_stats_t &stats)
+{
+    int default_ploidy=2;
+    if(format->local)
+    {
+        vector<int> local_alleles;
+        Genotype g(sample_header, sample_variants, alleles, local_alleles);
+        g.PropagateLocalFormatFields(sample_index, default_ploidy, local_alleles, format);
+        set_sample_stats(g, stats);
+    }
+    else
+    {
+        Genotype g(sample_header, sample_variants, alleles);
+        g.PropagateFormatFields(sample_index, default_ploidy, format);
+        set_sample_stats(g, stats);
+    }
+}
+
+void genotype_sample(GVCFReader &reader, multiAllele &alleles, bcf1_t *site, ggutils::vcf_data_t *format,
+                     int sample_index, sample_stats_t &stats)
+{
+    StageClock::Enter(STAGE_ALT);
+    stats.mq_weighted = stats.mq_weight = 0;
+    bcf_float_set_missing(stats.qual);
+    DepthBlock homref_block;//working structure to store homref info.
+    auto hdr = reader.GetHeader();
+    auto records = reader.GetAllVariantsUpTo(alleles.GetMax());
+
+    bcf1_t *sample_record = CollapseRecords(hdr,records,reader.GetSampleName().c_str());
+    //this sample has variants at this position, we need to populate its FORMAT field
+    if (sample_record!=nullptr)
+    {
+        genotype_alt_variant(hdr, alleles, sample_record, format, sample_index, stats);
+        bcf_destroy(sample_record);
+    }
+    else    //this sample does not have the variant, reconstruct the format fields from homref blocks
+    {
+        StageClock::Enter(STAGE_HOMREF);
+        reader.GetDepth(site->rid, site->pos, ggutils::get_end_of_variant(site), homref_block);
+        genotype_homref_variant(format, sample_index, site->n_allele, homref_block);
+    }
+}
+
+SiteColumns::SiteColumns(bcf_hdr_t *output_header, size_t num_samples, bool local_alleles)
+{
+    _output_header = output_header;
+    _num_samples = num_samples;
+    _local_alleles = local_alleles;
+    _max_alleles = std::numeric_limits<size_t>::max();
+    _stats = nullptr;
+    _lg = spdlog::get("gg_logger");
+}
+
+SiteColumns::~SiteColumns()
+{
+    for (auto it = _rows.begin(); it != _rows.end(); it++)
+    {
+        delete *it;
+    }
+}
+
+void SiteColumns::Plan(std::vector<GVCFReader> &readers, int start, int end, std::deque<planned_site_t> &sites,
+                       size_t max_sites) const
+{
+    StageClock::Enter(STAGE_SITES);
+    vector<size_t> cursor(_num_samples, 0);
+    while (sites.size() < max_sites)
+    {
+        bcf1_t *min_rec = nullptr;
+        for (size_t i = 0; i < _num_samples; i++)
+        {
+            if (cursor[i] < readers[i].GetNumVariants())
+            {
+                bcf1_t *rec = readers[i].GetVariant(cursor[i]);
+                if (min_rec == nullptr || ggutils::bcf1_less_than(rec, min_rec))
+                {
+                    min_rec = rec;
+                }
+            }
+        }
+        if (min_rec == nullptr ||
+            (!sites.empty() && (min_rec->rid != sites.front().record->rid || min_rec->pos > end)))
+        {
+            break;
+        }
+
+        sites.emplace_back();
+        planned_site_t &site = sites.back();
+        site.alleles.Init(_output_header, false);
+        site.alleles.SetPosition(min_rec->rid, min_rec->pos);
+        for (size_t i = 0; i < _num_samples; i++)
+        {
+            for (size_t j = cursor[i]; j < readers[i].GetNumVariants(); j++)
+            {
+                bcf1_t *rec = readers[i].GetVariant(j);
+                if (rec->rid != min_rec->rid || rec->pos > min_rec->pos)
+                {
+                    break;
+                }
+                if (ggutils::get_variant_rank(rec) == ggutils::get_variant_rank(min_rec))
+                {
+                    site.alleles.Allele(rec);
+                }
+            }
+        }
+        site.record = bcf_init1();
+        site.alleles.Collapse(site.record);
+        site.emit = site.record->pos >= start && site.record->pos <= end;
+        if (site.emit && (size_t) site.record->n_allele > _max_alleles)
+        {
+            _lg->warn("Too many alleles at {}:{} dropping this position.",
+                      bcf_hdr_id2name(_output_header, site.record->rid), site.record->pos + 1);
+            if (_stats != nullptr) _stats->AddDroppedSite();
+            site.emit = false;
+        }
+
+        bcf1_t *max_rec = site.alleles.GetMax();
+        for (size_t i = 0; i < _num_samples; i++)
+        {
+            while (cursor[i] < readers[i].GetNumVariants() && ggutils::bcf1_leq(readers[i].GetVariant(cursor[i]), max_rec))
+            {
+                cursor[i]++;
+            }
+        }
+    }
+}
+
+void SiteColumns::GenotypeColumn(GVCFReader &reader, std::deque<planned_site_t> &sites, sample_column_t &column,
+                                 ggutils::vcf_data_t *scratch)
+{
+    for (auto site = sites.begin(); site != sites.end(); site++)
+    {
+        if (site->emit)
+        {
+            scratch->resize(site->record->n_allele);
+            scratch->set_missing();
+            sample_stats_t stats;
+            genotype_sample(reader, site->alleles, site->record, scratch, 0, stats);
+            column.offsets.push_back(column.values.size());
+            column.values.resize(column.values.size() + scratch->packed_size());
+            scratch->pack(0, column.values.data() + column.offsets.back());
+            column.ft.push_back(scratch->ft[0]);
+            column.stats.push_back(stats);
+        }
+        reader.FlushBuffer(site->alleles.GetMax());
+    }
+}
+
+void SiteColumns::Transpose(std::deque<planned_site_t> &sites, std::vector<sample_column_t> &columns,
+                            const row_writer_t &write)
+{
+    StageClock::Enter(STAGE_ENCODE);
+    if (_rows.empty())
+    {
+        for (int k = 0; k < TRANSPOSE_SITE_BLOCK; k++)
+        {
+            _rows.push_back(new ggutils::vcf_data_t(2, 2, _num_samples, _local_alleles));
+        }
+    }
+    vector<planned_site_t *> emitted;
+    for (auto it = sites.begin(); it != sites.end(); it++)
+    {
+        if (it->emit)
+        {
+            emitted.push_back(&(*it));
+        }
+    }
+
+    for (size_t first = 0; first < emitted.size(); first += TRANSPOSE_SITE_BLOCK)
+    {
+        size_t num_sites = min((size_t) TRANSPOSE_SITE_BLOCK, emitted.size() - first);
+        for (size_t k = 0; k < num_sites; k++)
+        {
+            ggutils::vcf_data_t *row = _rows[k];
+            row->resize(emitted[first + k]->record->n_allele);
+            if (row->local)
+            {
+                //the packed values of each sample start with its number of local alleles
+                row->set_missing();
+                for (size_t i = 0; i < _num_samples; i++)
+                {
+                    row->reserve_local(columns[i].values[columns[i].offsets[first + k]]);
+                }
+            }
+        }
+        for (size_t first_sample = 0; first_sample < _num_samples; first_sample += TRANSPOSE_SAMPLE_BLOCK)
+        {
+            size_t last_sample = min(_num_samples, first_sample + TRANSPOSE_SAMPLE_BLOCK);
+            for (size_t k = 0; k < num_sites; k++)
+            {
+                ggutils::vcf_data_t *row = _rows[k];
+                for (size_t i = first_sample; i < last_sample; i++)
+                {
+                    row->unpack(columns[i].values.data() + columns[i].offsets[first + k], i);
+                    const string &ft = columns[i].ft[first + k];
+                    row->ft[i] = (char *) realloc(row->ft[i], ft.size() + 1);
+                    strcpy(row->ft[i], ft.c_str());
+                }
+            }
+        }
+
+        for (size_t k = 0; k < num_sites; k++)
+        {
+            write(*emitted[first + k], _rows[k], first + k);
+        }
+    }
+}
+
+ggutils::vcf_data_t *SiteColumns::NewScratch() const
+{
+    return (new ggutils::vcf_data_t(2, 2, 1, _local_alleles));
+}
+
+size_t SiteColumns::GetRowBytes() const
+{
+    size_t bytes = 0;
+    for (auto it = _rows.begin(); it != _rows.end(); it++)
+    {
+        bytes += (*it)->bytes();
+    }
+    return (bytes);
+}
+
+size_t SiteColumns::GetBytes(const std::deque<planned_site_t> &sites, const std::vector<sample_column_t> &columns)
+{
+    size_t bytes = 0;
+    for (auto it = sites.begin(); it != sites.end(); it++)
+    {
+        bytes += sizeof(planned_site_t) + ggutils::bcf1_bytes(it->record);
+    }
+    for (auto it = columns.begin(); it != columns.end(); it++)
+    {
+        bytes += sizeof(sample_column_t) + it->values.capacity() * sizeof(int32_t) +
+                 it->offsets.capacity() * sizeof(size_t) + it->ft.capacity() * sizeof(string) +
+                 it->stats.capacity() * sizeof(sample_stats_t);
+    }
+    return (bytes);
+}
@@ -0,0 +1,107 @@
+//
+// Sample-major genotyping of a run of sites, shared by the batched streaming merge and the sample-parallel engine.
+//
+
+#ifndef GVCFGENOTYPER_SITECOLUMNS_HH
+#define GVCFGENOTYPER_SITECOLUMNS_HH
+
+#include <deque>
+#include <functional>
+#include <limits>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <htslib/vcf.h>
+}
+
+#include "ggutils.hh"
+#include "GVCFReader.hh"
+#include "multiAllele.hh"
+#include "RunStats.hh"
+
+//the transpose from sample columns to site rows is done in tiles of this many sites by samples
+#define TRANSPOSE_SITE_BLOCK 16
+#define TRANSPOSE_SAMPLE_BLOCK 64
+
+//a sample's contribution to the site level QUAL and INFO/MQ
+struct sample_stats_t
+{
+    float qual;
+    int mq_weighted, mq_weight;
+};
+
+//a site planned by SiteColumns::Plan
+struct planned_site_t
+{
+    multiAllele alleles;
+    bcf1_t *record = nullptr;//alleles collapsed into a record
+    bool emit = false;//false for sites in a chunk's padding or with too many alleles
+};
+
+//one sample's genotypes for the emitted sites of a run, laid out sample-major so that
+//a thread can fill it without touching the other samples
+struct sample_column_t
+{
+    std::vector<int32_t> values;//vcf_data_t::pack() of each site
+    std::vector<size_t> offsets;//of each site in values
+    std::vector<std::string> ft;
+    std::vector<sample_stats_t> stats;
+};
+
+//genotypes one sample at site (whose alleles are in alleles), writing the result to format at sample_index.
+//only touches reader and format so samples can be genotyped independently of each other.
+void genotype_sample(GVCFReader &reader, multiAllele &alleles, bcf1_t *site, ggutils::vcf_data_t *format,
+                     int sample_index, sample_stats_t &stats);
+
+//Genotypes a run of sites one sample at a time rather than every sample at each site in turn:
+//1. the sites and their alleles are fixed by replaying GVCFMerger::GetNextVariant over the readers' buffered variants
+//2. each sample is genotyped at every site, into a sample-major column
+//3. the columns are transposed into site-major rows a tile at a time
+//The rows are the same as GVCFMerger::next() fills in, the per site work is done in tight loops over one sample or
+//one site.
+class SiteColumns
+{
+public:
+    //called with each emitted site, its row and its index in the columns
+    typedef std::function<void(planned_site_t &site, const ggutils::vcf_data_t *row, size_t index)> row_writer_t;
+
+    SiteColumns(bcf_hdr_t *output_header, size_t num_samples, bool local_alleles);
+    ~SiteColumns();
+
+    //sites with more alleles are not emitted
+    void SetMaxAlleles(size_t max_alleles) { _max_alleles = max_alleles; }
+    //dropped sites are counted in stats, nullptr counts nothing
+    void SetStats(RunStats *stats) { _stats = stats; }
+
+    //replays GetNextVariant/FlushBuffer over the buffered variants of every reader, without flushing them.
+    //Stops before the first site that starts after end or on another contig than the first site, or at max_sites
+    //sites. Sites starting before start are planned but not emitted.
+    void Plan(std::vector<GVCFReader> &readers, int start, int end, std::deque<planned_site_t> &sites,
+              size_t max_sites = std::numeric_limits<size_t>::max()) const;
+    //genotypes one sample at every planned site, flushing its reader exactly as GVCFMerger::next() would
+    static void GenotypeColumn(GVCFReader &reader, std::deque<planned_site_t> &sites, sample_column_t &column,
+                               ggutils::vcf_data_t *scratch);
+    //transposes the columns of the emitted sites into rows and calls write(site, row, index) for each emitted site
+    //in order, index is the site's place in the columns. row is only valid during the call.
+    void Transpose(std::deque<planned_site_t> &sites, std::vector<sample_column_t> &columns, const row_writer_t &write);
+
+    //a one sample row for GenotypeColumn, the caller deletes it
+    ggutils::vcf_data_t *NewScratch() const;
+
+    //bytes of the site rows
+    size_t GetRowBytes() const;
+    //bytes of sites and columns, for MEM_COLUMNS
+    static size_t GetBytes(const std::deque<planned_site_t> &sites, const std::vector<sample_column_t> &columns);
+
+private:
+    bcf_hdr_t *_output_header;
+    size_t _num_samples;
+    bool _local_alleles;
+    size_t _max_alleles;
+    RunStats *_stats;
+    std::vector<ggutils::vcf_data_t *> _rows;//site-major rows that sample columns are transposed into
+    std::shared_ptr<spdlog::logger> _lg;
+};
+
+#endif //GVCFGENOTYPER_SITECOLUMNS_HH
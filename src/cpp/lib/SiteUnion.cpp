@@ -0,0 +1,150 @@
+#include "SiteUnion.hh"
+
+//a seek decompresses at least one BGZF block, which holds roughly this many GVCF lines
+#define SEEK_COST_IN_LINES 256
+
+SiteUnion::SiteUnion(Normaliser *normaliser, const std::string &region /*=""*/, const int is_file /*=0*/)
+{
+    _normaliser = normaliser;
+    _region = region;
+    _is_file = is_file;
+    _num_lines = 0;
+    _num_gvcfs = 0;
+    _all_indexed = true;
+    _lg = spdlog::get("gg_logger");
+    assert(_lg != nullptr);
+    if (!region.empty())
+    {
+        if (is_file)
+        {
+            ggutils::read_regions_file(region, _scan_regions);
+        }
+        else
+        {
+            ggutils::parse_regions(region, _scan_regions);
+        }
+    }
+}
+
+//merges sorted (possibly overlapping) intervals into the sorted, non-overlapping output
+void SiteUnion::MergeInto(intervals_t &sorted, intervals_t &output)
+{
+    intervals_t merged;
+    merged.reserve(sorted.size() + output.size());
+    std::merge(sorted.begin(), sorted.end(), output.begin(), output.end(), std::back_inserter(merged));
+    output.clear();
+    for (auto it = merged.begin(); it != merged.end(); it++)
+    {
+        if (!output.empty() && it->first <= output.back().second + 1)
+        {
+            output.back().second = max(output.back().second, it->second);
+        }
+        else
+        {
+            output.push_back(*it);
+        }
+    }
+}
+
+size_t SiteUnion::Add(const std::string &gvcf)
+{
+    VcfReader reader(gvcf);
+    if (!_region.empty())
+    {
+        _is_file ? reader.SetRegionsFile(_region) : reader.SetRegions(_region);
+    }
+    //the reader's header is shared with GVCFs with the same header (see HeaderCache), so it may carry another sample name
+    bcf_hdr_t *header = reader.GetHeader();
+    const char *sample = reader.GetSampleNames()[0].c_str();
+    std::map<std::string, intervals_t> sites;
+    bcf1_t *record = bcf_init1();
+    size_t num_variants = 0;
+    while (reader.NextVariant(record))
+    {
+        if (!ggutils::is_valid_strelka_record(header, record))
+        {
+            continue;
+        }
+        intervals_t &intervals = sites[bcf_hdr_id2name(header, record->rid)];
+        intervals.emplace_back(record->pos, record->pos + record->rlen - 1);
+        vector<bcf1_t *> atomised_variants;
+        _normaliser->Unarise(record, atomised_variants, header, sample);
+        for (auto v = atomised_variants.begin(); v != atomised_variants.end(); v++)
+        {
+            bcf_unpack(*v, BCF_UN_STR);
+            intervals.emplace_back((*v)->pos, ggutils::get_end_of_variant(*v));
+            bcf_destroy(*v);
+        }
+        num_variants++;
+    }
+    bcf_destroy(record);
+
+    for (auto it = sites.begin(); it != sites.end(); it++)
+    {
+        //normalisation can move an indel a little way left so the lines are only nearly sorted
+        std::sort(it->second.begin(), it->second.end());
+        MergeInto(it->second, _sites[it->first]);
+    }
+    _num_lines += reader.GetNumRecordsRead() + reader.GetNumRecordsSkipped();
+    _num_gvcfs++;
+    _all_indexed &= reader.HasIndex();
+    _lg->info("Scanned {} variant lines from {}", num_variants, gvcf);
+    return (num_variants);
+}
+
+std::vector<ggutils::region_t> SiteUnion::GetRegions(int merge_distance) const
+{
+    std::vector<ggutils::region_t> ret;
+    for (auto it = _sites.begin(); it != _sites.end(); it++)
+    {
+        size_t first = ret.size();
+        for (auto site = it->second.begin(); site != it->second.end(); site++)
+        {
+            if (ret.size() > first && site->first - ret.back().end <= merge_distance)
+            {
+                ret.back().end = max(ret.back().end, site->second);
+            }
+            else
+            {
+                ret.push_back({it->first, site->first, site->second});
+            }
+        }
+    }
+    if (_scan_regions.empty())
+    {
+        return (ret);
+    }
+
+    //sites can hang over the edge of the scanned region, which the second pass must not read past
+    std::vector<ggutils::region_t> clipped;
+    for (auto site = ret.begin(); site != ret.end(); site++)
+    {
+        for (auto r = _scan_regions.begin(); r != _scan_regions.end(); r++)
+        {
+            if (r->chrom == site->chrom && r->start <= site->end && site->start <= r->end)
+            {
+                clipped.push_back({site->chrom, max(site->start, r->start), min(site->end, r->end)});
+            }
+        }
+    }
+    return (clipped);
+}
+
+bool SiteUnion::ShouldSeek(size_t num_regions) const
+{
+    if (_num_gvcfs == 0 || !_all_indexed)
+    {
+        return (false);
+    }
+    return (num_regions * SEEK_COST_IN_LINES < _num_lines / _num_gvcfs);
+}
+
+size_t SiteUnion::GetNumSites() const
+{
+    size_t ret = 0;
+    for (auto it = _sites.begin(); it != _sites.end(); it++)
+    {
+        ret += it->second.size();
+    }
+    return (ret);
+}
@@ -0,0 +1,61 @@
+//
+// First pass of --two-pass: the union of cohort site positions.
+//
+
+#ifndef GVCFGENOTYPER_SITEUNION_HH
+#define GVCFGENOTYPER_SITEUNION_HH
+
+#include <map>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <htslib/vcf.h>
+}
+
+#include "ggutils.hh"
+#include "Normaliser.hh"
+#include "VcfReader.hh"
+
+#include "spdlog.h"
+
+//Scans only the variant lines of each GVCF and accumulates the footprint of every site, both as written
+//in the GVCF and after normalisation (left-alignment can move an indel). The merged intervals let the
+//second pass seek each GVCF straight to the blocks that overlap a site instead of streaming the whole file.
+class SiteUnion
+{
+public:
+    //region/is_file restrict the scan in the same way as GVCFReader
+    SiteUnion(Normaliser *normaliser, const std::string &region = "", const int is_file = 0);
+
+    //scans the variant lines of gvcf, returns the number of variant lines read
+    size_t Add(const std::string &gvcf);
+
+    //sorted site intervals, intervals less than merge_distance apart are joined
+    //and the result is clipped to the scanned region (if any)
+    std::vector<ggutils::region_t> GetRegions(int merge_distance) const;
+
+    //true if seeking num_regions intervals is expected to read fewer lines than streaming the GVCFs
+    //(always false if any GVCF is not indexed)
+    bool ShouldSeek(size_t num_regions) const;
+
+    //number of disjoint site intervals
+    size_t GetNumSites() const;
+    size_t GetNumLinesScanned() const { return _num_lines; }
+    size_t GetNumGvcfs() const { return _num_gvcfs; }
+
+private:
+    typedef std::vector<std::pair<int, int> > intervals_t;
+    static void MergeInto(intervals_t &sorted, intervals_t &output);
+
+    Normaliser *_normaliser;
+    std::string _region;
+    int _is_file;
+    std::vector<ggutils::region_t> _scan_regions;
+    std::map<std::string, intervals_t> _sites;//per contig, sorted and non-overlapping
+    size_t _num_lines, _num_gvcfs;
+    bool _all_indexed;
+    std::shared_ptr<spdlog::logger> _lg;
+};
+
+#endif //GVCFGENOTYPER_SITEUNION_HH
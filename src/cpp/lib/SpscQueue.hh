@@ -0,0 +1,58 @@
+//
+// Bounded lock-free queue between one producer thread and one consumer thread.
+//
+
+#ifndef GVCFGENOTYPER_SPSCQUEUE_HH
+#define GVCFGENOTYPER_SPSCQUEUE_HH
+
+#include <atomic>
+#include <vector>
+
+//A ring of capacity items. TryPush may only be called by one thread and TryPop by one other thread.
+//Neither blocks, waiting for the other side is left to the caller.
+template<typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(size_t capacity) : _items(capacity + 1), _head(0), _tail(0) {}
+
+    bool TryPush(const T &item)
+    {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        size_t next = tail + 1 == _items.size() ? 0 : tail + 1;
+        if (next == _head.load(std::memory_order_acquire))
+        {
+            return (false);
+        }
+        _items[tail] = item;
+        _tail.store(next, std::memory_order_release);
+        return (true);
+    }
+
+    bool TryPop(T &item)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire))
+        {
+            return (false);
+        }
+        item = _items[head];
+        _head.store(head + 1 == _items.size() ? 0 : head + 1, std::memory_order_release);
+        return (true);
+    }
+
+    //only exact when neither side is running
+    size_t Size() const
+    {
+        size_t head = _head.load(std::memory_order_acquire), tail = _tail.load(std::memory_order_acquire);
+        return (tail >= head ? tail - head : tail + _items.size() - head);
+    }
+
+    size_t Capacity() const { return _items.size() - 1; }
+
+private:
+    std::vector<T> _items;
+    std::atomic<size_t> _head, _tail;
+};
+
+#endif //GVCFGENOTYPER_SPSCQUEUE_HH
@@ -0,0 +1,195 @@
+#include "Trace.hh"
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "RunStats.hh"
+#include "ggutils.hh"
+
+//a span waiting in a thread's buffer
+struct trace_event_t
+{
+    const char *name, *category;
+    uint64_t start, end;
+    std::string detail;
+};
+
+//the trace file and the thread names, under mutex
+struct trace_file_t
+{
+    std::mutex mutex;
+    FILE *fp = nullptr;
+    bool first = true;
+    uint64_t start_ticks = 0, min_ticks = 0;
+    double us_per_tick = 0;
+    std::map<std::string, int> thread_ids;
+    int next_tid = 1;
+};
+
+static trace_file_t g_trace;
+
+static void write_events(std::vector<trace_event_t> &events, int tid);
+
+//the calling thread's track and buffered spans, written when the thread exits
+struct trace_thread_t
+{
+    int tid = 0;
+    std::vector<trace_event_t> events;
+    ~trace_thread_t() { write_events(events, tid); }
+};
+
+static thread_local trace_thread_t t_thread;
+
+std::atomic<bool> Tracer::_open(false);
+
+//an unnamed thread gets a track of its own
+static int new_tid()
+{
+    std::lock_guard<std::mutex> lock(g_trace.mutex);
+    return (g_trace.next_tid++);
+}
+
+//needs g_trace.mutex
+static void write_json(const std::string &json)
+{
+    fputs(g_trace.first ? "\n" : ",\n", g_trace.fp);
+    fputs(json.c_str(), g_trace.fp);
+    g_trace.first = false;
+}
+
+static void write_events(std::vector<trace_event_t> &events, int tid)
+{
+    if (events.empty())
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(g_trace.mutex);
+    //spans of threads that outlive the trace are dropped
+    for (auto it = events.begin(); g_trace.fp != nullptr && it != events.end(); it++)
+    {
+        //spans started before Open (a clock that was already in a stage) are cut at the start of the trace
+        uint64_t start = std::max(it->start, g_trace.start_ticks);
+        std::string json = fmt::format("{{\"name\": \"{}\", \"cat\": \"{}\", \"ph\": \"X\", \"pid\": 1, \"tid\": {}, "
+                                       "\"ts\": {:.3f}, \"dur\": {:.3f}", it->name, it->category, tid,
+                                       (start - g_trace.start_ticks) * g_trace.us_per_tick,
+                                       (it->end - start) * g_trace.us_per_tick);
+        if (!it->detail.empty())
+        {
+            json += ", \"args\": {\"detail\": " + ggutils::json_string(it->detail) + "}";
+        }
+        write_json(json + "}");
+    }
+    events.clear();
+}
+
+void Tracer::Open(const std::string &fname)
+{
+    std::lock_guard<std::mutex> lock(g_trace.mutex);
+    if (g_trace.fp != nullptr)
+    {
+        ggutils::die("Tracer::Open: a trace is already open");
+    }
+    g_trace.fp = fopen(fname.c_str(), "w");
+    if (g_trace.fp == nullptr)
+    {
+        ggutils::die("could not write the trace to " + fname);
+    }
+    //ticks per us are measured over a few ms, which is enough to place spans on a timeline
+    auto start = std::chrono::steady_clock::now();
+    uint64_t start_ticks = stats_ticks();
+    while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(10))
+    {
+    }
+    double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    g_trace.us_per_tick = elapsed / (stats_ticks() - start_ticks);
+    g_trace.min_ticks = (uint64_t) (TRACE_MIN_NS / 1000. / g_trace.us_per_tick);
+    g_trace.start_ticks = start_ticks;
+    g_trace.first = true;
+    g_trace.thread_ids.clear();
+    fputs("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [", g_trace.fp);
+    _open.store(true, std::memory_order_relaxed);
+}
+
+void Tracer::Close()
+{
+    Flush();
+    std::lock_guard<std::mutex> lock(g_trace.mutex);
+    if (g_trace.fp == nullptr)
+    {
+        return;
+    }
+    _open.store(false, std::memory_order_relaxed);
+    fputs("\n]}\n", g_trace.fp);
+    if (fclose(g_trace.fp) != 0)
+    {
+        ggutils::die("problem writing the trace");
+    }
+    g_trace.fp = nullptr;
+}
+
+void Tracer::Span(const char *name, const char *category, uint64_t start, uint64_t end, const std::string &detail)
+{
+    if (end - start < g_trace.min_ticks || !IsOpen())
+    {
+        return;
+    }
+    if (t_thread.tid == 0)
+    {
+        t_thread.tid = new_tid();
+    }
+    t_thread.events.push_back({name, category, start, end, detail});
+    if (t_thread.events.size() >= TRACE_BUFFER_EVENTS)
+    {
+        Flush();
+    }
+}
+
+void Tracer::NameThread(const std::string &name)
+{
+    if (!IsOpen())
+    {
+        return;
+    }
+    //the spans so far belong to the thread's previous track
+    Flush();
+    std::lock_guard<std::mutex> lock(g_trace.mutex);
+    if (g_trace.fp == nullptr)
+    {
+        return;
+    }
+    auto found = g_trace.thread_ids.find(name);
+    if (found != g_trace.thread_ids.end())
+    {
+        t_thread.tid = found->second;
+        return;
+    }
+    t_thread.tid = g_trace.next_tid++;
+    g_trace.thread_ids[name] = t_thread.tid;
+    write_json(fmt::format("{{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": {}, "
+                           "\"args\": {{\"name\": {}}}}}", t_thread.tid, ggutils::json_string(name)));
+}
+
+void Tracer::Flush()
+{
+    write_events(t_thread.events, t_thread.tid);
+}
+
+TraceScope::TraceScope(const char *name, const std::string &detail)
+{
+    _name = Tracer::IsOpen() ? name : nullptr;
+    if (_name != nullptr)
+    {
+        _detail = detail;
+        _start = stats_ticks();
+    }
+}
+
+TraceScope::~TraceScope()
+{
+    if (_name != nullptr)
+    {
+        Tracer::Span(_name, "scope", _start, stats_ticks(), _detail);
+    }
+}
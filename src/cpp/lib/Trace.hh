@@ -0,0 +1,67 @@
+//
+// A timeline of the run in the Chrome trace event format, which chrome://tracing and ui.perfetto.dev open.
+// Only builds with -DGG_TRACE (make trace) emit events, elsewhere the GG_TRACE_ macros compile to nothing.
+//
+
+#ifndef GVCFGENOTYPER_TRACE_HH
+#define GVCFGENOTYPER_TRACE_HH
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+//events a thread buffers before they are written to the trace file
+#define TRACE_BUFFER_EVENTS 4096
+//spans shorter than this many ns are not written, they would be too small to see and would swamp the file
+#define TRACE_MIN_NS 1000
+
+//Writes the spans of every thread to one JSON file. Each thread buffers its spans and writes them (under a lock)
+//when its buffer is full, when it exits and, for the thread that calls it, on Close. Threads have to exit before
+//Close for their last spans to be written. Times are stats_ticks (see RunStats.hh), converted to us with a rate
+//measured by Open.
+class Tracer
+{
+public:
+    //starts a trace in fname, dies if it cannot be written
+    static void Open(const std::string &fname);
+    static void Close();
+    static bool IsOpen() { return _open.load(std::memory_order_relaxed); }
+
+    //a span from start to end ticks on the calling thread. name and category have to be string literals.
+    static void Span(const char *name, const char *category, uint64_t start, uint64_t end,
+                     const std::string &detail = "");
+    //the calling thread's track in the viewer. Threads with the same name (the sample threads of successive
+    //chunks) share a track, so they must not run at the same time.
+    static void NameThread(const std::string &name);
+    //writes the calling thread's buffered spans
+    static void Flush();
+
+private:
+    static std::atomic<bool> _open;
+};
+
+//a span from its construction to its destruction on the calling thread
+class TraceScope
+{
+public:
+    TraceScope(const char *name, const std::string &detail = "");
+    ~TraceScope();
+
+private:
+    const char *_name;
+    std::string _detail;
+    uint64_t _start;
+};
+
+#ifdef GG_TRACE
+#define GG_TRACE_CONCAT2(a, b) a##b
+#define GG_TRACE_CONCAT(a, b) GG_TRACE_CONCAT2(a, b)
+#define GG_TRACE_SCOPE(...) TraceScope GG_TRACE_CONCAT(gg_trace_scope_, __LINE__)(__VA_ARGS__)
+#define GG_TRACE_THREAD(name) Tracer::NameThread(name)
+#else
+#define GG_TRACE_SCOPE(...)
+#define GG_TRACE_THREAD(name)
+#endif
+
+#endif //GVCFGENOTYPER_TRACE_HH
@@ -3,6 +3,7 @@
 VariantBuffer::VariantBuffer()
 {
     _num_duplicated_records = 0;
+    _bytes = 0;
 }
 
 VariantBuffer::~VariantBuffer()
@@ -36,14 +37,18 @@ bool VariantBuffer::HasVariant(const bcf_hdr_t *hdr, bcf1_t *v)
 int VariantBuffer::PushBack(const bcf_hdr_t *hdr, bcf1_t *rec)
 {
     bcf_unpack(rec, BCF_UN_ALL);
+    size_t bytes = ggutils::bcf1_bytes(rec);
     if (HasVariant(hdr, rec))
     {
+        //rec may have been swapped with the buffered record
+        _bytes += bytes - ggutils::bcf1_bytes(rec);
         _num_duplicated_records++;
         bcf_destroy(rec);
         return (0);
     }
 
     _buffer.push_back(rec);
+    _bytes += bytes;
     //moves the new record back through the buffer until buffer is sorted ie. one iteration of insert-sort
     int i = _buffer.size() - 1;
     while (i > 0 && ggutils::bcf1_less_than(_buffer[i], _buffer[i - 1]))
@@ -60,6 +65,7 @@ int VariantBuffer::FlushBuffer(bcf1_t *record)
     int num_flushed = 0;
     while (!_buffer.empty() &&  ggutils::bcf1_leq(_buffer.front(), record))
     {
+        _bytes -= ggutils::bcf1_bytes(_buffer.front());
         bcf_destroy(_buffer.front());
         _buffer.pop_front();
         num_flushed++;
@@ -72,12 +78,14 @@ int VariantBuffer::FlushBuffer(int chrom, int pos)
     int num_flushed = 0;
     while (!_buffer.empty() && _buffer.front()->rid < chrom)
     {
+        _bytes -= ggutils::bcf1_bytes(_buffer.front());
         bcf_destroy(_buffer.front());
         _buffer.pop_front();
         num_flushed++;
     }
     while (!_buffer.empty() && _buffer.front()->pos < pos && _buffer.front()->rid == chrom)
     {
+        _bytes -= ggutils::bcf1_bytes(_buffer.front());
         bcf_destroy(_buffer.front());
         _buffer.pop_front();
         num_flushed++;
@@ -90,6 +98,7 @@ int VariantBuffer::FlushBuffer()
     int num_flushed = 0;
     while (!_buffer.empty())
     {
+        _bytes -= ggutils::bcf1_bytes(_buffer.front());
         bcf_destroy(_buffer.front());
         _buffer.pop_front();
         num_flushed++;
@@ -123,6 +132,14 @@ bcf1_t *VariantBuffer::Back()
     }
 }
 
+bcf1_t *VariantBuffer::At(size_t index)
+{
+    assert(index < _buffer.size());
+    bcf1_t *ret = _buffer[index];
+    bcf_unpack(ret, BCF_UN_ALL);
+    return (ret);
+}
+
 bcf1_t *VariantBuffer::Front()
 {
     if (_buffer.empty())
@@ -148,6 +165,7 @@ bcf1_t *VariantBuffer::Pop()
     else
     {
         bcf1_t *ret = _buffer.front();
+        _bytes -= ggutils::bcf1_bytes(ret);
         _buffer.pop_front();
         return (ret);
     }
@@ -32,14 +32,18 @@ public:
     bool HasVariant(const bcf_hdr_t *hdr, bcf1_t *v);//does the buffer already have v? Swap info fields if duplicate is hom-ref
     bcf1_t *Front(); //return pointer to current vcf record
     bcf1_t *Back(); //return pointer to last vcf record
+    bcf1_t *At(size_t index); //return pointer to the index'th vcf record
     bcf1_t *Pop(); //return pointer to current vcf record and remove it from buffer
     bool IsEmpty();
 
     size_t Size();
     size_t GetNumDuplicatedRecords() const { return _num_duplicated_records;};
+    //bytes of the buffered records (see ggutils::bcf1_bytes)
+    size_t GetBytes() const { return _bytes; }
 
 private:
     size_t  _num_duplicated_records;
+    size_t _bytes;
     deque<bcf1_t *> _buffer;
     set<std::string> _seen; //list of seen variants at this position.
 };
@@ -0,0 +1,462 @@
+#include "VcfReader.hh"
+
+extern "C" {
+#include <htslib/kseq.h>
+}
+
+VcfReader::VcfReader(const std::string &fname)
+{
+    _fname = fname;
+    _bcf_idx = nullptr;
+    _tbx_idx = nullptr;
+    _itr = nullptr;
+    _line = {0, 0, nullptr};
+    _region_index = -1;
+    _eof = false;
+    _num_records = 0;
+    _num_skipped = 0;
+    _num_seeks_saved = 0;
+    _resume_offset = 0;
+    _index_bytes = 0;
+    _fp = hts_open(fname.c_str(), "r");
+    if (_fp == nullptr)
+    {
+        ggutils::die("problem opening " + fname);
+    }
+    if (_fp->format.category != variant_data)
+    {
+        ggutils::die("problem opening " + fname + "\nnot a VCF/BCF file");
+    }
+    bcf_hdr_t *header = bcf_hdr_read(_fp);
+    if (header == nullptr)
+    {
+        ggutils::die("problem opening " + fname + "\ncould not read the header");
+    }
+    _sample_names.assign(header->samples, header->samples + bcf_hdr_nsamples(header));
+    _shared_header = HeaderCache::Share(header);
+    _header = _shared_header.get();
+    bcf_hdr_destroy(header);
+}
+
+VcfReader::~VcfReader()
+{
+    if (_itr != nullptr) hts_itr_destroy(_itr);
+    if (_bcf_idx != nullptr) hts_idx_destroy(_bcf_idx);
+    if (_tbx_idx != nullptr) tbx_destroy(_tbx_idx);
+    free(_line.s);
+    hts_close(_fp);
+}
+
+//the decompressed size of fname's .csi or .tbi (whichever is there), 0 if neither can be read
+static size_t get_index_bytes(const std::string &fname)
+{
+    for (const char *suffix : {".csi", ".tbi"})
+    {
+        BGZF *fp = bgzf_open((fname + suffix).c_str(), "r");
+        if (fp == nullptr)
+        {
+            continue;
+        }
+        char buffer[65536];
+        size_t bytes = 0;
+        ssize_t num_read;
+        while ((num_read = bgzf_read(fp, buffer, sizeof(buffer))) > 0)
+        {
+            bytes += num_read;
+        }
+        bgzf_close(fp);
+        return (bytes);
+    }
+    return (0);
+}
+
+bool VcfReader::TryLoadIndex()
+{
+    if (_bcf_idx != nullptr || _tbx_idx != nullptr)
+    {
+        return (true);
+    }
+    if (_fp->format.format == bcf)
+    {
+        _bcf_idx = bcf_index_load(_fname.c_str());
+    }
+    else if (_fp->format.compression == bgzf)
+    {
+        _tbx_idx = tbx_index_load(_fname.c_str());
+    }
+    if (_bcf_idx != nullptr || _tbx_idx != nullptr)
+    {
+        _index_bytes = get_index_bytes(_fname);
+    }
+    return (_bcf_idx != nullptr || _tbx_idx != nullptr);
+}
+
+bool VcfReader::HasIndex()
+{
+    return (TryLoadIndex());
+}
+
+void VcfReader::LoadIndex()
+{
+    if (!TryLoadIndex())
+    {
+        ggutils::die("could not load the index for " + _fname + ". Regions require a bgzipped and indexed file.");
+    }
+}
+
+std::vector<std::string> VcfReader::GetIndexedContigs()
+{
+    LoadIndex();
+    int n = 0;
+    const char **names = _tbx_idx != nullptr ? tbx_seqnames(_tbx_idx, &n) : bcf_index_seqnames(_bcf_idx, _header, &n);
+    std::vector<std::string> ret(names, names + n);
+    free(names);
+    return (ret);
+}
+
+hts_idx_t *VcfReader::GetIndex()
+{
+    LoadIndex();
+    return (_tbx_idx != nullptr ? _tbx_idx->idx : _bcf_idx);
+}
+
+int VcfReader::GetIndexTid(const std::string &chrom)
+{
+    LoadIndex();
+    return (_tbx_idx != nullptr ? tbx_name2id(_tbx_idx, chrom.c_str()) : bcf_hdr_name2id(_header, chrom.c_str()));
+}
+
+int VcfReader::SetRegions(const std::string &regions)
+{
+    std::vector<ggutils::region_t> parsed;
+    ggutils::parse_regions(regions, parsed);
+    return (SetRegions(parsed));
+}
+
+int VcfReader::SetRegionsFile(const std::string &fname)
+{
+    std::vector<ggutils::region_t> parsed;
+    ggutils::read_regions_file(fname, parsed);
+    return (SetRegions(parsed));
+}
+
+void VcfReader::SortRegions(const bcf_hdr_t *header, const std::vector<ggutils::region_t> &regions,
+                            std::vector<ggutils::region_t> &sorted_regions, std::vector<int> &rids,
+                            const std::vector<int> *order)
+{
+    //(position of the contig, rid), region
+    std::vector<std::pair<std::pair<int, int>, ggutils::region_t> > sorted;
+    for (auto it = regions.begin(); it != regions.end(); it++)
+    {
+        int rid = bcf_hdr_name2id(header, it->chrom.c_str());
+        if (rid >= 0)
+        {
+            sorted.emplace_back(std::make_pair(order != nullptr ? order->at(rid) : rid, rid), *it);
+        }
+    }
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const std::pair<std::pair<int, int>, ggutils::region_t> &a,
+                        const std::pair<std::pair<int, int>, ggutils::region_t> &b)
+                     {
+                         return (a.first < b.first || (a.first == b.first && a.second.start < b.second.start));
+                     });
+
+    //overlapping regions are merged so each record is visited once
+    sorted_regions.clear();
+    rids.clear();
+    for (auto it = sorted.begin(); it != sorted.end(); it++)
+    {
+        if (!sorted_regions.empty() && rids.back() == it->first.second && it->second.start <= sorted_regions.back().end)
+        {
+            sorted_regions.back().end = max(sorted_regions.back().end, it->second.end);
+        }
+        else
+        {
+            sorted_regions.push_back(it->second);
+            rids.push_back(it->first.second);
+        }
+    }
+}
+
+int VcfReader::SetRegions(const std::vector<ggutils::region_t> &regions)
+{
+    LoadIndex();
+    SortRegions(_header, regions, _regions, _region_rids, _contigs != nullptr ? &_contigs->rids : nullptr);
+    _region_index = -1;
+    _eof = _regions.empty();
+    if (_itr != nullptr)
+    {
+        hts_itr_destroy(_itr);
+        _itr = nullptr;
+    }
+    return ((int) _regions.size());
+}
+
+void VcfReader::SetContigMap(const std::shared_ptr<const contig_map_t> &contigs)
+{
+    _contigs = contigs->rids.empty() ? nullptr : contigs;
+    //streaming would return the contigs in the file's order, so every contig becomes a region (sorted in the output's order)
+    if (_contigs != nullptr && !_contigs->in_order && _regions.empty())
+    {
+        std::vector<ggutils::region_t> contig_regions;
+        for (int rid = 0; rid < _header->n[BCF_DT_CTG]; rid++)
+        {
+            ggutils::region_t region;
+            region.chrom = bcf_hdr_id2name(_header, rid);
+            region.start = 0;
+            region.end = std::numeric_limits<int>::max() - 1;
+            contig_regions.push_back(region);
+        }
+        SetRegions(contig_regions);
+    }
+}
+
+bool VcfReader::Seek(int rid, int start, int end)
+{
+    const char *chrom = bcf_hdr_id2name(_header, rid);
+    std::vector<ggutils::region_t> region(1);
+    region[0].chrom = chrom;
+    region[0].start = start;
+    region[0].end = end;
+    return (SetRegions(region) == 1);
+}
+
+//moves the iterator to the next region that is present in the index.
+bool VcfReader::NextRegion()
+{
+    if (_itr != nullptr)
+    {
+        hts_itr_destroy(_itr);
+        _itr = nullptr;
+    }
+    while (_itr == nullptr && (size_t) (_region_index + 1) < _regions.size())
+    {
+        _region_index++;
+        const ggutils::region_t &r = _regions[_region_index];
+        if (_tbx_idx != nullptr)
+        {
+            int tid = tbx_name2id(_tbx_idx, r.chrom.c_str());
+            if (tid >= 0)
+            {
+                _itr = tbx_itr_queryi(_tbx_idx, tid, r.start, r.end + 1);
+            }
+        }
+        else
+        {
+            _itr = bcf_itr_queryi(_bcf_idx, _region_rids[_region_index], r.start, r.end + 1);
+        }
+    }
+    if (_itr != nullptr)
+    {
+        ResumeIterator();
+    }
+    return (_itr != nullptr);
+}
+
+//Regions are sorted, so on the same contig the next region's records never come before the record that ended the
+//previous region: anything earlier overlaps the previous region and is skipped anyway. The iterator is started
+//there instead of at its first chunk, which with many small regions (-R) is often a block or more further back.
+//If that position is in the block already in memory it is not read and inflated again (bgzf_seek always drops it).
+void VcfReader::ResumeIterator()
+{
+    BGZF *fp = _fp->fp.bgzf;
+    if (_itr->n_off == 0 || _itr->finished || fp->mt != nullptr)
+    {
+        return;
+    }
+    int i = 0;
+    uint64_t start = _itr->off[0].u;
+    if (_resume_offset > start && _region_index > 0 && _region_rids[_region_index - 1] == _region_rids[_region_index])
+    {
+        while (i < _itr->n_off && _itr->off[i].v <= _resume_offset)
+        {
+            i++;
+        }
+        if (i == _itr->n_off)
+        {
+            _itr->finished = 1;
+            return;
+        }
+        start = max(_itr->off[i].u, _resume_offset);
+    }
+    if ((int64_t) (start >> 16) == fp->block_address && fp->block_length > 0 && (int) (start & 0xFFFF) <= fp->block_length)
+    {
+        fp->block_offset = (int) (start & 0xFFFF);
+    }
+    else if (start != _itr->off[0].u)
+    {
+        if (bgzf_seek(fp, (int64_t) start, SEEK_SET) < 0)
+        {
+            ggutils::die("problem reading " + _fname);
+        }
+    }
+    else
+    {
+        return;//hts_itr_next seeks as usual
+    }
+    _itr->i = i;
+    _itr->curr_off = start;
+    _num_seeks_saved++;
+}
+
+//true unless the ALT column of a VCF text line is "." (ie. a GVCF reference block)
+static bool has_alt_allele(const kstring_t &line)
+{
+    int column = 0;
+    for (size_t i = 0; i < line.l; i++)
+    {
+        if (line.s[i] == '\t' && ++column == 4)
+        {
+            return (!(i + 2 <= line.l && line.s[i + 1] == '.' && (i + 2 == line.l || line.s[i + 2] == '\t')));
+        }
+    }
+    return (true);
+}
+
+//reads the next line of a streamed file, returns -1 at the end of the file and 0 if the line was skipped
+int VcfReader::ReadLine(bcf1_t *record, bool variants_only)
+{
+    int ret;
+    if (_fp->format.format == bcf)
+    {
+        ret = bcf_read(_fp, _header, record);
+        if (ret >= 0 && variants_only && record->n_allele < 2)
+        {
+            return (0);
+        }
+    }
+    else
+    {
+        ret = hts_getline(_fp, KS_SEP_LINE, &_line);
+        if (ret >= 0)
+        {
+            if (variants_only && !has_alt_allele(_line))
+            {
+                return (0);
+            }
+            if (vcf_parse1(&_line, HeaderCache::GetParseHeader(_shared_header), record) < 0)
+            {
+                ggutils::die("problem parsing a record in " + _fname);
+            }
+        }
+    }
+    if (ret < -1)
+    {
+        ggutils::die("problem reading " + _fname);
+    }
+    return (ret < 0 ? -1 : 1);
+}
+
+//as ReadLine but for the current region's iterator
+int VcfReader::ReadFromIterator(bcf1_t *record, bool variants_only)
+{
+    int ret;
+    //start of the record about to be read, the one ending the region is where the next region resumes
+    _resume_offset = _itr->curr_off;
+    if (_tbx_idx != nullptr)
+    {
+        ret = tbx_itr_next(_fp, _tbx_idx, _itr, &_line);
+        if (ret >= 0)
+        {
+            if (variants_only && !has_alt_allele(_line))
+            {
+                return (0);
+            }
+            if (vcf_parse1(&_line, HeaderCache::GetParseHeader(_shared_header), record) < 0)
+            {
+                ggutils::die("problem parsing a record in " + _fname);
+            }
+        }
+    }
+    else
+    {
+        ret = bcf_itr_next(_fp, _itr, record);
+        if (ret >= 0 && variants_only && record->n_allele < 2)
+        {
+            return (0);
+        }
+    }
+    if (ret < -1)
+    {
+        ggutils::die("problem reading " + _fname);
+    }
+    return (ret < 0 ? -1 : 1);
+}
+
+//regions are sorted and non-overlapping, so a record spanning several regions also overlaps the one before it.
+bool VcfReader::OverlapsPreviousRegion(bcf1_t *record)
+{
+    if (_region_index <= 0 || _region_rids[_region_index - 1] != record->rid)
+    {
+        return (false);
+    }
+    const ggutils::region_t &prev = _regions[_region_index - 1];
+    return (record->pos <= prev.end && (record->pos + record->rlen - 1) >= prev.start);
+}
+
+int VcfReader::Next(bcf1_t *record)
+{
+    return (Read(record, false));
+}
+
+int VcfReader::NextVariant(bcf1_t *record)
+{
+    return (Read(record, true));
+}
+
+int VcfReader::Read(bcf1_t *record, bool variants_only)
+{
+    if (_eof)
+    {
+        return (0);
+    }
+
+    while (true)
+    {
+        int ret;
+        if (_regions.empty())
+        {
+            ret = ReadLine(record, variants_only);
+            if (ret < 0)
+            {
+                _eof = true;
+                return (0);
+            }
+        }
+        else
+        {
+            if (_itr == nullptr && !NextRegion())
+            {
+                _eof = true;
+                return (0);
+            }
+            ret = ReadFromIterator(record, variants_only);
+            if (ret < 0)
+            {
+                hts_itr_destroy(_itr);
+                _itr = nullptr;
+                continue;
+            }
+            if (ret > 0 && OverlapsPreviousRegion(record))
+            {
+                continue;
+            }
+        }
+        if (ret > 0)
+        {
+            break;
+        }
+        _num_skipped++;
+    }
+    bcf_unpack(record, BCF_UN_STR);
+    if (_contigs != nullptr)
+    {
+        record->rid = record->rid < (int) _contigs->rids.size() ? _contigs->rids[record->rid] : -1;
+        if (record->rid < 0)
+        {
+            ggutils::die("a record in " + _fname + " is on a contig that is not in the output header");
+        }
+    }
+    _num_records++;
+    return (1);
+}
@@ -0,0 +1,118 @@
+//
+// Lean single-file BCF/VCF reader. Replaces the bcf_srs_t synced reader in GVCFReader.
+//
+
+#ifndef GVCFGENOTYPER_VCFREADER_HH
+#define GVCFGENOTYPER_VCFREADER_HH
+
+#include <memory>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <htslib/hts.h>
+#include <htslib/vcf.h>
+#include <htslib/tbx.h>
+#include <htslib/bgzf.h>
+}
+
+#include "ggutils.hh"
+#include "HeaderCache.hh"
+
+//Reads records from a single BCF/VCF file, either streaming the whole file or
+//iterating over a sorted list of regions using the file's CSI/TBI index.
+//The synced reader does per-record synchronisation across files which we do not need
+//for one GVCF, and it keeps a fair amount of per-reader state around.
+//The header is shared with other readers of GVCFs with the same header (see HeaderCache), only the sample names are kept.
+class VcfReader
+{
+public:
+    explicit VcfReader(const std::string &fname);
+    ~VcfReader();
+
+    //Restricts iteration to regions (comma separated chr, chr:start or chr:start-end). Needs an index.
+    //Returns the number of regions present in this file's header.
+    int SetRegions(const std::string &regions);
+    //As above but reads regions from a file (see ggutils::read_regions_file).
+    int SetRegionsFile(const std::string &fname);
+    int SetRegions(const std::vector<ggutils::region_t> &regions);
+    //the regions on contigs of header, sorted by contig and start with overlapping regions merged, and their ids.
+    //Contigs are sorted by order[rid] when order is given.
+    static void SortRegions(const bcf_hdr_t *header, const std::vector<ggutils::region_t> &regions,
+                            std::vector<ggutils::region_t> &sorted_regions, std::vector<int> &rids,
+                            const std::vector<int> *order = nullptr);
+    //Returns records with the contig ids of the output header the map was made for (see HeaderCache::MapContigs). A file
+    //whose contigs are in another order than the output's is read contig by contig in the output's order, which needs
+    //an index. Call before SetRegions.
+    void SetContigMap(const std::shared_ptr<const contig_map_t> &contigs);
+
+    //Jumps to rid:start-end (0-based inclusive) discarding any remaining regions. Returns false if the contig is not indexed.
+    bool Seek(int rid, int start, int end);
+
+    //Reads the next record into record. Returns 1 on success and 0 when there are no more records.
+    //Records that overlap several adjacent regions are only returned once.
+    int Next(bcf1_t *record);
+    //As Next but skips lines without an ALT allele (reference blocks). For VCF text these lines are skipped
+    //without being parsed, which makes a variant-only scan of a GVCF much cheaper than reading every record.
+    int NextVariant(bcf1_t *record);
+
+    //true if the file has a CSI/TBI index, ie. SetRegions can be used
+    bool HasIndex();
+    //names of the contigs the index has records for. Needs an index.
+    std::vector<std::string> GetIndexedContigs();
+    //the CSI/TBI index and the index's id for chrom (-1 if the index has no such contig). Needs an index.
+    hts_idx_t *GetIndex();
+    int GetIndexTid(const std::string &chrom);
+
+    bcf_hdr_t *GetHeader() { return _header; }
+    const std::shared_ptr<bcf_hdr_t> &GetSharedHeader() const { return _shared_header; }
+    const std::vector<std::string> &GetSampleNames() const { return _sample_names; }
+    bool HasRegions() const { return !_regions.empty(); }
+    bool IsEof() const { return _eof; }
+    //index of the region the last record came from (-1 when streaming)
+    int GetRegionIndex() const { return _region_index; }
+    size_t GetNumRegions() const { return _regions.size(); }
+    const ggutils::region_t &GetRegion(size_t index) const { return _regions[index]; }
+    const std::vector<ggutils::region_t> &GetRegions() const { return _regions; }
+    const std::vector<int> &GetRegionRids() const { return _region_rids; }
+    size_t GetNumRecordsRead() const { return _num_records; }
+    //lines passed over by NextVariant
+    size_t GetNumRecordsSkipped() const { return _num_skipped; }
+    //regions that were started where the previous one ended rather than at their first index chunk
+    size_t GetNumSeeksSaved() const { return _num_seeks_saved; }
+    const std::string &GetFileName() const { return _fname; }
+    //uncompressed size of the index, roughly what it takes in memory. 0 until the index is loaded.
+    size_t GetIndexBytes() const { return _index_bytes; }
+
+private:
+    bool TryLoadIndex();
+    void LoadIndex();
+    bool NextRegion();
+    void ResumeIterator();
+    int Read(bcf1_t *record, bool variants_only);
+    int ReadLine(bcf1_t *record, bool variants_only);
+    int ReadFromIterator(bcf1_t *record, bool variants_only);
+    bool OverlapsPreviousRegion(bcf1_t *record);
+
+    std::string _fname;
+    htsFile *_fp;
+    std::shared_ptr<bcf_hdr_t> _shared_header;
+    bcf_hdr_t *_header;
+    std::vector<std::string> _sample_names;
+    std::shared_ptr<const contig_map_t> _contigs;
+    hts_idx_t *_bcf_idx;
+    tbx_t *_tbx_idx;
+    hts_itr_t *_itr;
+    kstring_t _line;
+    std::vector<ggutils::region_t> _regions;
+    std::vector<int> _region_rids;
+    int _region_index;
+    bool _eof;
+    size_t _num_records;
+    size_t _num_skipped;
+    size_t _num_seeks_saved;
+    uint64_t _resume_offset;
+    size_t _index_bytes;
+};
+
+#endif //GVCFGENOTYPER_VCFREADER_HH
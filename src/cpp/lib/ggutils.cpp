@@ -1,5 +1,7 @@
 #include <htslib/vcf.h>
+#include <htslib/kseq.h>
 #include "ggutils.hh"
+#include "StringUtil.hh"
 
 #include<algorithm>
 #include<sstream>
@@ -141,6 +143,117 @@ namespace ggutils
         return (0);
     }
 
+    region_t parse_region(const string &region)
+    {
+        region_t ret;
+        ret.start = 0;
+        ret.end = std::numeric_limits<int>::max() - 1;
+        size_t colon = region.rfind(':');
+        ret.chrom = region.substr(0, colon);
+        if (colon != string::npos)
+        {
+            string interval = region.substr(colon + 1);
+            size_t dash = interval.find('-');
+            try
+            {
+                ret.start = stoi(interval.substr(0, dash)) - 1;
+                if (dash == string::npos)
+                {
+                    ret.end = ret.start;
+                }
+                else if (dash + 1 < interval.size())
+                {
+                    ret.end = stoi(interval.substr(dash + 1)) - 1;
+                }
+            }
+            catch (const std::exception &e)
+            {
+                die("invalid region: " + region);
+            }
+        }
+        if (ret.chrom.empty() || ret.start < 0 || ret.end < ret.start)
+        {
+            die("invalid region: " + region);
+        }
+        return (ret);
+    }
+
+    string region2string(const region_t &region)
+    {
+        if (region.end == std::numeric_limits<int>::max() - 1)
+        {
+            return (region.start == 0 ? region.chrom : region.chrom + ":" + to_string(region.start + 1) + "-");
+        }
+        return (region.chrom + ":" + to_string(region.start + 1) + "-" + to_string(region.end + 1));
+    }
+
+    int parse_regions(const string &regions, vector<region_t> &output)
+    {
+        vector<string> tokens;
+        strsplit(regions, ',', tokens);
+        output.clear();
+        for (size_t i = 0; i < tokens.size(); i++)
+        {
+            if (!tokens[i].empty())
+            {
+                output.push_back(parse_region(tokens[i]));
+            }
+        }
+        return (output.size());
+    }
+
+    int read_regions_file(const string &fname, vector<region_t> &output)
+    {
+        //hts_open reads bgzipped and gzipped files as well as plain text
+        htsFile *fp = hts_open(fname.c_str(), "r");
+        if (fp == nullptr)
+        {
+            die("problem opening " + fname);
+        }
+        bool is_bed = stringutil::endsWith(fname, ".bed") || stringutil::endsWith(fname, ".bed.gz");
+        output.clear();
+        kstring_t line = {0, 0, nullptr};
+        int line_number = 0;
+        while (hts_getline(fp, KS_SEP_LINE, &line) >= 0)
+        {
+            line_number++;
+            string text(line.s, line.l);
+            if (text.empty() || text[0] == '#' || text.compare(0, 5, "track") == 0)
+            {
+                continue;
+            }
+            vector<string> fields;
+            strsplit(text, '\t', fields);
+            if (fields.size() == 1)
+            {
+                output.push_back(parse_region(fields[0]));
+                continue;
+            }
+            region_t r;
+            r.chrom = fields[0];
+            try
+            {
+                r.start = stoi(fields[1]) - (is_bed ? 0 : 1);
+                r.end = fields.size() > 2 ? stoi(fields[2]) - 1 : r.start;
+            }
+            catch (const std::exception &e)
+            {
+                die("invalid region on line " + to_string(line_number) + " of " + fname);
+            }
+            if (r.start < 0 || r.end < r.start)
+            {
+                die("invalid region on line " + to_string(line_number) + " of " + fname);
+            }
+            output.push_back(r);
+        }
+        free(line.s);
+        if (hts_close(fp) != 0)
+        {
+            die("problem reading " + fname);
+        }
+        return (output.size());
+    }
+
     int read_text_file(const string &fname, vector<string> &output)
     {
         ifstream ifile(fname.c_str());
@@ -182,13 +295,19 @@ namespace ggutils
     }
 
     int get_end_of_gvcf_block(bcf_hdr_t *header, bcf1_t *record)
+    {
+        int end_id = bcf_hdr_id2int(header, BCF_DT_ID, "END");
+        return (get_end_of_gvcf_block(record, bcf_hdr_idinfo_exists(header, BCF_HL_INFO, end_id) ? end_id : -1));
+    }
+
+    int get_end_of_gvcf_block(bcf1_t *record, int end_id)
     {
         int ret;
-        int *ptr = NULL, nval = 0;
-        if (bcf_get_info_int32(header, record, "END", &ptr, &nval) == 1)
+        //reads INFO/END in place rather than via bcf_get_info_int32, this is called on every GVCF line
+        bcf_info_t *info = end_id >= 0 ? bcf_get_info_id(record, end_id) : nullptr;
+        if (info != nullptr && info->len == 1 && info->type != BCF_BT_FLOAT && info->type != BCF_BT_CHAR)
         {
-            ret = *ptr - 1;
-            free(ptr);
+            ret = info->v1.i - 1;
         }
         else
         {
@@ -303,6 +422,45 @@ namespace ggutils
     }
 
 
+    //d.var is left out, bcf_get_variant_types fills it in lazily and a buffered record would change size
+    size_t bcf1_bytes(const bcf1_t *record)
+    {
+        const bcf_dec_t &d = record->d;
+        return (sizeof(bcf1_t) + record->shared.m + record->indiv.m + d.m_fmt * sizeof(bcf_fmt_t) +
+                d.m_info * sizeof(bcf_info_t) + d.m_id + d.m_als + d.m_allele * sizeof(char *) +
+                d.m_flt * sizeof(int));
+    }
+
+    //the dictionaries are khashes, which are counted as a key pointer, a value and a flag for each entry
+    size_t bcf_hdr_bytes(const bcf_hdr_t *header)
+    {
+        size_t bytes = sizeof(bcf_hdr_t) + header->mem.m;
+        for (int type = 0; type < 3; type++)
+        {
+            bytes += header->m[type] * sizeof(bcf_idpair_t);
+            for (int i = 0; i < header->n[type]; i++)
+            {
+                if (header->id[type][i].key != nullptr)
+                {
+                    bytes += strlen(header->id[type][i].key) + 1 + sizeof(char *) + sizeof(bcf_idinfo_t) + 1;
+                }
+            }
+        }
+        bytes += header->n[BCF_DT_SAMPLE] * sizeof(char *);
+        for (int i = 0; i < header->nhrec; i++)
+        {
+            const bcf_hrec_t *hrec = header->hrec[i];
+            bytes += sizeof(bcf_hrec_t *) + sizeof(bcf_hrec_t) + strlen(hrec->key) + 1;
+            bytes += hrec->value != nullptr ? strlen(hrec->value) + 1 : 0;
+            for (int k = 0; k < hrec->nkeys; k++)
+            {
+                bytes += 2 * sizeof(char *) + strlen(hrec->keys[k]) + 1;
+                bytes += hrec->vals[k] != nullptr ? strlen(hrec->vals[k]) + 1 : 0;
+            }
+        }
+        return (bytes);
+    }
+
     bool bcf1_less_than(bcf1_t *a, bcf1_t *b)
     {
         assert(a->n_allele>1 && b->n_allele>1);
@@ -531,7 +689,12 @@ namespace ggutils
         return(ret);
     }
 
-    int bcf1_allele_swap(bcf_hdr_t *header, bcf1_t *record, int a,int b)
+    const char *sample_name(const bcf_hdr_t *header, const char *sample)
+    {
+        return (sample != nullptr ? sample : header->samples[0]);
+    }
+
+    int bcf1_allele_swap(bcf_hdr_t *header, bcf1_t *record, int a,int b, const char *sample)
     {
         assert(a>0 && b>0);
         assert(a<record->n_allele && b<record->n_allele);
@@ -591,7 +754,7 @@ namespace ggutils
             if(status!=(int)ggutils::get_number_of_likelihoods(ploidy,record->n_allele))
 	    {
 		ggutils::print_variant(header,record);
-		ggutils::die("problem with sample "+(string)header->samples[0]);
+		ggutils::die("problem with sample "+(string)sample_name(header, sample));
 	    }
             vector<int> tmp_pl(format_pl,format_pl+num_pl);
             for(int i=0;i<record->n_allele;i++)
@@ -618,11 +781,12 @@ namespace ggutils
         return(1);
     }
 
-    vcf_data_t::vcf_data_t(size_t ploidy, size_t num_allele, size_t num_sample)
+    vcf_data_t::vcf_data_t(size_t ploidy, size_t num_allele, size_t num_sample, bool local)
     {
         this->ploidy=ploidy;
         this->num_allele=num_allele;
         this->num_sample=num_sample;
+        this->local=local;
 
 	ft=(char **)malloc(num_sample*sizeof(char *));
         std::fill(ft,ft+num_sample,nullptr);
@@ -637,9 +801,14 @@ namespace ggutils
         adf = (int32_t *)malloc(num_ad*sizeof(int32_t));
         adr = (int32_t *)malloc(num_ad*sizeof(int32_t));
 
-        num_pl = get_number_of_likelihoods(ploidy,num_allele)*num_sample;
+        num_pl = local ? 0 : get_number_of_likelihoods(ploidy,num_allele)*num_sample;
         pl = (int32_t *)malloc(num_pl*sizeof(int32_t));
         gt = (int32_t *)malloc(num_sample*ploidy*sizeof(int32_t));
+
+        num_local = 1;
+        laa = (int32_t *)malloc(local ? num_sample*sizeof(int32_t) : 0);
+        lad = (int32_t *)malloc(local ? num_sample*sizeof(int32_t) : 0);
+        lpl = (int32_t *)malloc(local ? num_sample*sizeof(int32_t) : 0);
     }
 
     void vcf_data_t::resize(size_t num_alleles)
@@ -647,8 +816,11 @@ namespace ggutils
         if(num_alleles!=this->num_allele)
         {
             this->num_allele=num_alleles;
-            num_pl = ggutils::get_number_of_likelihoods(ploidy,num_allele)* num_sample;
-            pl = (int32_t *) realloc(pl, num_pl * sizeof(int32_t));
+            if(!local)
+            {
+                num_pl = ggutils::get_number_of_likelihoods(ploidy,num_allele)* num_sample;
+                pl = (int32_t *) realloc(pl, num_pl * sizeof(int32_t));
+            }
             num_ad=num_allele*num_sample;
             ad = (int32_t *)realloc(ad,num_ad*sizeof(int32_t));
             adr = (int32_t *)realloc(adr,num_ad*sizeof(int32_t));
@@ -668,6 +840,136 @@ namespace ggutils
         std::fill(ad,ad+num_ad,bcf_int32_missing);
         std::fill(adf,adf+num_ad,bcf_int32_missing);
         std::fill(adr,adr+num_ad,bcf_int32_missing);
+        if(local)
+        {
+            //a single missing value per sample, fields are widened by reserve_local as samples are added
+            num_local=1;
+            std::fill(laa,laa+num_sample,bcf_int32_missing);
+            std::fill(lad,lad+num_sample,bcf_int32_missing);
+            std::fill(lpl,lpl+num_sample*lpl_per_sample(),bcf_int32_missing);
+        }
+    }
+
+    size_t vcf_data_t::lpl_per_sample() const
+    {
+        return(get_number_of_likelihoods(ploidy,num_local));
+    }
+
+    //moves num_sample blocks of old_stride values apart to new_stride, padding with vector_end
+    static int32_t *restride(int32_t *buf,size_t num_sample,size_t old_stride,size_t new_stride)
+    {
+        if(new_stride==old_stride) return(buf);
+        buf = (int32_t *)realloc(buf,num_sample*new_stride*sizeof(int32_t));
+        for(size_t i=num_sample;i-->0;)
+        {
+            memmove(buf+i*new_stride,buf+i*old_stride,old_stride*sizeof(int32_t));
+            std::fill(buf+i*new_stride+old_stride,buf+(i+1)*new_stride,bcf_int32_vector_end);
+        }
+        return(buf);
+    }
+
+    void vcf_data_t::reserve_local(size_t num_local)
+    {
+        assert(local);
+        if(num_local<=this->num_local) return;
+        size_t old_laa=laa_per_sample(),old_lad=this->num_local,old_lpl=lpl_per_sample();
+        this->num_local=num_local;
+        laa = restride(laa,num_sample,old_laa,laa_per_sample());
+        lad = restride(lad,num_sample,old_lad,num_local);
+        lpl = restride(lpl,num_sample,old_lpl,lpl_per_sample());
+    }
+
+    void vcf_data_t::set_local_fields(size_t sample,const vector<int> &local_alleles,const int32_t *lad,const int32_t *lpl,size_t num_lpl)
+    {
+        reserve_local(local_alleles.size());
+        int32_t *dst = laa + sample*laa_per_sample();
+        std::fill(dst,dst+laa_per_sample(),bcf_int32_vector_end);
+        if(local_alleles.size()>1) std::copy(local_alleles.begin()+1,local_alleles.end(),dst);
+        else dst[0] = bcf_int32_missing;
+
+        dst = this->lad + sample*num_local;
+        std::fill(std::copy(lad,lad+local_alleles.size(),dst),dst+num_local,bcf_int32_vector_end);
+        dst = this->lpl + sample*lpl_per_sample();
+        std::fill(std::copy(lpl,lpl+num_lpl,dst),dst+lpl_per_sample(),bcf_int32_vector_end);
+    }
+
+    size_t vcf_data_t::bytes() const
+    {
+        size_t ints = num_sample * (5 + ploidy) + 3 * num_ad + num_pl;
+        if(local) ints += num_sample * (laa_per_sample() + num_local + lpl_per_sample());
+        return (sizeof(vcf_data_t) + num_sample * sizeof(char *) + ints * sizeof(int32_t));
+    }
+
+    size_t vcf_data_t::packed_size() const
+    {
+        if(local) return (ploidy + 6 + 2 * num_allele + laa_per_sample() + num_local + lpl_per_sample());
+        return (ploidy + 5 + 3 * num_allele + num_pl / num_sample);
+    }
+
+    void vcf_data_t::pack(size_t sample, int32_t *dst) const
+    {
+        if(local) *dst++ = num_local;
+        dst = std::copy(gt + sample * ploidy, gt + (sample + 1) * ploidy, dst);
+        *dst++ = gq[sample];
+        *dst++ = gqx[sample];
+        *dst++ = dp[sample];
+        *dst++ = dpf[sample];
+        *dst++ = ps[sample];
+        if(!local) dst = std::copy(ad + sample * num_allele, ad + (sample + 1) * num_allele, dst);
+        dst = std::copy(adf + sample * num_allele, adf + (sample + 1) * num_allele, dst);
+        dst = std::copy(adr + sample * num_allele, adr + (sample + 1) * num_allele, dst);
+        if(local)
+        {
+            dst = std::copy(laa + sample * laa_per_sample(), laa + (sample + 1) * laa_per_sample(), dst);
+            dst = std::copy(lad + sample * num_local, lad + (sample + 1) * num_local, dst);
+            std::copy(lpl + sample * lpl_per_sample(), lpl + (sample + 1) * lpl_per_sample(), dst);
+        }
+        else
+        {
+            size_t num_pl_per_sample = num_pl / num_sample;
+            std::copy(pl + sample * num_pl_per_sample, pl + (sample + 1) * num_pl_per_sample, dst);
+        }
+    }
+
+    //copies n values to dst and pads it to stride with vector_end
+    static const int32_t *unpack_padded(const int32_t *src,size_t n,int32_t *dst,size_t stride)
+    {
+        std::fill(std::copy(src,src+n,dst),dst+stride,bcf_int32_vector_end);
+        return(src+n);
+    }
+
+    void vcf_data_t::unpack(const int32_t *src, size_t sample)
+    {
+        //the caller has to reserve_local() the widest sample first
+        size_t sample_num_local = local ? *src++ : 0;
+        assert(sample_num_local <= num_local);
+        std::copy(src, src + ploidy, gt + sample * ploidy);
+        src += ploidy;
+        gq[sample] = *src++;
+        gqx[sample] = *src++;
+        dp[sample] = *src++;
+        dpf[sample] = *src++;
+        ps[sample] = *src++;
+        if(!local)
+        {
+            std::copy(src, src + num_allele, ad + sample * num_allele);
+            src += num_allele;
+        }
+        std::copy(src, src + num_allele, adf + sample * num_allele);
+        src += num_allele;
+        std::copy(src, src + num_allele, adr + sample * num_allele);
+        src += num_allele;
+        if(local)
+        {
+            src = unpack_padded(src, sample_num_local > 1 ? sample_num_local - 1 : 1, laa + sample * laa_per_sample(), laa_per_sample());
+            src = unpack_padded(src, sample_num_local, lad + sample * num_local, num_local);
+            unpack_padded(src, get_number_of_likelihoods(ploidy, sample_num_local), lpl + sample * lpl_per_sample(), lpl_per_sample());
+        }
+        else
+        {
+            size_t num_pl_per_sample = num_pl / num_sample;
+            std::copy(src, src + num_pl_per_sample, pl + sample * num_pl_per_sample);
+        }
     }
 
     vcf_data_t::~vcf_data_t()
@@ -682,6 +984,9 @@ namespace ggutils
         free(dp);
         free(dpf);
         free(ps);
+        free(laa);
+        free(lad);
+        free(lpl);
 	for(size_t i=0;i<num_sample;i++) free(ft[i]);
 	free(ft);
     }
@@ -855,6 +1160,30 @@ namespace ggutils
         return((std::string)buffer);
     }
 
+    std::string json_string(const std::string &s)
+    {
+        std::string ret = "\"";
+        for (auto c = s.begin(); c != s.end(); c++)
+        {
+            if (*c == '"' || *c == '\\')
+            {
+                ret += '\\';
+                ret += *c;
+            }
+            else if ((unsigned char) *c < 0x20)
+            {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", (int) *c);
+                ret += escaped;
+            }
+            else
+            {
+                ret += *c;
+            }
+        }
+        return (ret + "\"");
+    }
+
 
     float median(int *x, int n)
     {
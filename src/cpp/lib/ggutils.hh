@@ -34,17 +34,62 @@ extern "C" {
 namespace ggutils
 {
     //Simple struct to hold our default FORMAT fields.
+    //In local allele mode AD/PL are replaced by LAA/LAD/LPL, which only cover REF plus the alleles a sample
+    //actually has (LAA, 1-based ALT indices), so their size grows with the sample's alleles rather than the site's.
     struct vcf_data_t
     {
 	char **ft;
         int32_t *pl,*ad,*adf,*adr,*gt,*gq,*gqx,*dp,*dpf,*ps;
+        int32_t *laa,*lad,*lpl;
         size_t ploidy,num_allele,num_sample,num_ad,num_pl;
-        vcf_data_t(size_t ploidy,size_t num_allele,size_t num_sample);
+        bool local;
+        size_t num_local;//most local alleles (including REF) of any sample, the stride of lad
+        vcf_data_t(size_t ploidy,size_t num_allele,size_t num_sample,bool local=false);
         void resize(size_t num_alleles);
         void set_missing();
+        //widens LAA/LAD/LPL to num_local alleles per sample, keeping the values already set
+        void reserve_local(size_t num_local);
+        //sets a sample's LAA/LAD/LPL. local_alleles are indices into the site's alleles, starting with REF
+        void set_local_fields(size_t sample,const vector<int> &local_alleles,const int32_t *lad,const int32_t *lpl,size_t num_lpl);
+        size_t laa_per_sample() const {return num_local>1 ? num_local-1 : 1;}
+        size_t lpl_per_sample() const;
+        //number of int32s one sample's values take up in pack()
+        size_t packed_size() const;
+        //bytes allocated for the arrays
+        size_t bytes() const;
+        //copies one sample's GT/GQ/GQX/DP/DPF/PS/AD/ADF/ADR/PL into dst (FT is not included), unpack() is the inverse.
+        //in local mode AD/PL are replaced by the sample's number of local alleles (first) and LAA/LAD/LPL.
+        void pack(size_t sample, int32_t *dst) const;
+        void unpack(const int32_t *src, size_t sample);
         ~vcf_data_t();
     };
 
+    //occupancy and stalls of the queue between two stages of the merge (see ReadAhead and OutputSink)
+    struct stage_stats_t
+    {
+        size_t num_popped = 0;//items (batches or records) taken off the queue by the consumer
+        size_t queued = 0;//sum over pops of the items that were queued, for the mean occupancy
+        size_t producer_stalls = 0;//the queue was full, so the producer waited for the consumer
+        size_t consumer_stalls = 0;//the queue was empty, so the consumer waited for the producer
+    };
+
+    //A genomic interval on a named contig, 0-based with an inclusive end.
+    struct region_t
+    {
+        std::string chrom;
+        int start, end;
+    };
+
+    //parses chr, chr:start or chr:start-end (1-based, inclusive) into a region_t
+    region_t parse_region(const string &region);
+    //the inverse of parse_region, an open end (as parsed from chr or chr:start-) is written as such
+    string region2string(const region_t &region);
+    //parses a comma separated list of regions, returns the number of regions
+    int parse_regions(const string &regions, vector<region_t> &output);
+    //reads a tab-delimited CHROM[,BEG[,END]] regions file (1-based, inclusive) or a BED file if fname ends with .bed
+    //(or .bed.gz), plain or compressed
+    int read_regions_file(const string &fname, vector<region_t> &output);
+
     void init_vcf_data(size_t ploidy,size_t num_allele,size_t num_sample,vcf_data_t & record);
     void destroy_vcf_data(vcf_data_t & record);
 
@@ -99,6 +144,8 @@ namespace ggutils
     int get_variant_rank(bcf1_t *record);
 
     int get_end_of_gvcf_block(bcf_hdr_t *header, bcf1_t *record);
+    //as above with the INFO/END id looked up beforehand, -1 if the header has no INFO/END
+    int get_end_of_gvcf_block(bcf1_t *record, int end_id);
 
 
     int get_ploidy(bcf_hdr_t *header, bcf1_t *record);
@@ -121,6 +168,10 @@ namespace ggutils
 
     bool bcf1_geq(bcf1_t *a, bcf1_t *b);
 
+    //bytes allocated for a record (including what bcf_unpack decoded) and for a header, for memory accounting
+    size_t bcf1_bytes(const bcf1_t *record);
+    size_t bcf_hdr_bytes(const bcf_hdr_t *header);
+
     bool bcf1_not_equal(bcf1_t *a, bcf1_t *b);
 
     size_t get_number_of_likelihoods(int ploidy, int num_allele);
@@ -141,7 +192,11 @@ namespace ggutils
     int get_gl_index(int g0, int g1);
 
     //swaps the ath alle with the bth allele, rearranges PL/AD accordingly
-    int bcf1_allele_swap(bcf_hdr_t *header, bcf1_t *record, int a,int b);
+    int bcf1_allele_swap(bcf_hdr_t *header, bcf1_t *record, int a,int b, const char *sample=nullptr);
+
+    //sample for messages about a single sample GVCF's records, the header's own sample if nullptr. Headers can be
+    //shared between GVCFs (see HeaderCache) so readers pass their sample name in.
+    const char *sample_name(const bcf_hdr_t *header, const char *sample);
 
     //returns the string length of the right trimmed ref/alt (see https://academic.oup.com/bioinformatics/article/31/13/2202/196142)
     void right_trim(const char *ref,const char *alt,size_t &reflen,size_t &altlen);
@@ -166,6 +221,8 @@ namespace ggutils
     void fisher_sb_test(int *adf,int *adr,int num_allele,std::vector<float> & output,float maxret=1000.);
 
     std::string string_time();
+    //s as a quoted JSON string
+    std::string json_string(const std::string &s);
     std::string generateUUID();
     int bcf1_get_one_format_string(const bcf_hdr_t *header, bcf1_t *record, const char *tag,std::string & output);
 }
@@ -32,6 +32,7 @@ multiAllele::multiAllele()
     _rid = -1;
     _pos = -1;
     _hdr = nullptr;
+    _owns_hdr = false;
 }
 
 void multiAllele::SetPosition(int rid, int pos)
@@ -42,9 +43,10 @@ void multiAllele::SetPosition(int rid, int pos)
     _pos = pos;
 }
 
-void multiAllele::Init(bcf_hdr_t *hdr)
+void multiAllele::Init(bcf_hdr_t *hdr, bool copy_header)
 {
-    _hdr = bcf_hdr_dup(hdr);
+    _hdr = copy_header ? bcf_hdr_dup(hdr) : hdr;
+    _owns_hdr = copy_header;
 }
 
 int multiAllele::Clear()
@@ -63,7 +65,7 @@ int multiAllele::Clear()
 multiAllele::~multiAllele()
 {
     Clear();
-    bcf_hdr_destroy(_hdr);
+    if (_owns_hdr) bcf_hdr_destroy(_hdr);
 }
 
 int multiAllele::Allele(bcf1_t *record,int index)
@@ -22,7 +22,9 @@ public:
     multiAllele();
     ~multiAllele();
 
-    void Init(bcf_hdr_t *hdr);
+    //copy_header=false shares hdr with the caller, which must outlive this object. Used when many
+    //multiAlleles are alive at once (planning the sites of a chunk) so each does not dup the header.
+    void Init(bcf_hdr_t *hdr, bool copy_header=true);
     void SetPosition(int rid, int pos);
     int Allele(bcf1_t *record,int index=1);
     int AlleleIndex(bcf1_t *record,int index);
@@ -39,6 +41,7 @@ public:
 private:
     int _rid,_pos;
     bcf_hdr_t *_hdr;
+    bool _owns_hdr;
     list<bcf1_t*> _records;//FIXME. we should probably use some sorted data structure + binary search here. in practice in might not matter.
 };
 
@@ -0,0 +1,17 @@
+#include "test_helpers.hh"
+
+#include "ChunkGenotyper.hh"
+
+//-r regions come back in header order with overlapping ones merged, contigs not in the header are dropped
+TEST(ChunkGenotyper, boundsFollowHeaderOrder)
+{
+    bcf_hdr_t *header = get_header();
+    std::vector<GVCFReader> readers;
+    auto bounds = ChunkGenotyper::GetBounds("chr2:100-200,chr1:500-600,chrNotThere:1-10,chr1:100-550,chr1:700-800",
+                                            0, readers, header);
+    ASSERT_EQ(bounds.size(), (size_t) 3);
+    ASSERT_EQ(ggutils::region2string(bounds[0]), "chr1:100-600");
+    ASSERT_EQ(ggutils::region2string(bounds[1]), "chr1:700-800");
+    ASSERT_EQ(ggutils::region2string(bounds[2]), "chr2:100-200");
+    bcf_hdr_destroy(header);
+}
@@ -0,0 +1,130 @@
+#include "test_helpers.hh"
+
+#include <unistd.h>
+
+#include "ChunkPlanner.hh"
+#include "GVCFMerger.hh"
+#include "GVCFSimulator.hh"
+
+TEST(ChunkPlanner, cutsAvoidVariants)
+{
+    std::string test_file = g_testenv->getBasePath() + "/../test/test2/NA12877_S1.vcf.gz";
+    //the TTCTAA deletion at chr1:72696 spans the bin boundary at 72700
+    ChunkPlanner planner({test_file}, 100);
+    auto chunks = planner.Plan(2000);
+    ASSERT_GT(chunks.size(), (size_t) 1000);
+    ASSERT_LT(chunks.size(), (size_t) 2000);
+
+    std::vector<int> starts;
+    double total = 0;
+    for (size_t k = 0; k < chunks.size(); k++)
+    {
+        ASSERT_EQ(chunks[k].size(), (size_t) 1);
+        ASSERT_EQ(chunks[k][0].chrom, "chr1");
+        //chunks follow each other without gaps, the last one is open ended
+        ASSERT_EQ(chunks[k][0].start, k == 0 ? 0 : chunks[k - 1][0].end + 1);
+        starts.push_back(chunks[k][0].start);
+        total += planner.GetChunkBytes()[k];
+    }
+    ASSERT_EQ(chunks.back()[0].end, std::numeric_limits<int>::max() - 1);
+    ASSERT_NEAR(total, planner.GetTotalBytes(), 1e-6 * total);
+    ASSERT_TRUE(std::find(starts.begin(), starts.end(), 72701) != starts.end());
+
+    VcfReader reader(test_file);
+    bcf1_t *record = bcf_init1();
+    while (reader.NextVariant(record))
+    {
+        auto first_after = std::upper_bound(starts.begin(), starts.end(), record->pos);
+        ASSERT_TRUE(first_after == starts.end() || *first_after > record->pos + record->rlen - 1);
+    }
+    bcf_destroy(record);
+}
+
+TEST(ChunkPlanner, fewerChunksThanBins)
+{
+    std::string test_base = g_testenv->getBasePath() + "/../test/test2/";
+    ChunkPlanner planner({test_base + "NA12877_S1.vcf.gz", test_base + "NA12878_S1.vcf.gz"});
+    //all the data is in the first bin
+    auto chunks = planner.Plan(4);
+    ASSERT_EQ(chunks.size(), (size_t) 1);
+    ASSERT_EQ(ggutils::region2string(chunks[0][0]), "chr1");
+    ASSERT_GT(planner.GetTotalBytes(), 0);
+}
+
+//the records of a merged VCF
+static std::vector<std::string> read_records(const std::string &fname)
+{
+    htsFile *fp = hts_open(fname.c_str(), "r");
+    kstring_t line = {0, 0, nullptr};
+    std::vector<std::string> records;
+    while (hts_getline(fp, '\n', &line) >= 0)
+    {
+        if (line.s[0] != '#')
+        {
+            records.push_back(line.s);
+        }
+    }
+    free(line.s);
+    hts_close(fp);
+    return (records);
+}
+
+TEST(ChunkPlanner, chunksAcrossContigsMerge)
+{
+    char dir[] = "/tmp/tmpsim-XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != nullptr);
+    simulation_t params;
+    params.num_samples = 3;
+    params.num_contigs = 2;
+    params.contig_length = 60000;
+    params.snp_rate = 5e-3;
+    params.indel_rate = 2e-3;
+    GVCFSimulator simulator(params);
+    simulator.Write(dir);
+    std::string ref = (std::string) dir + "/ref.fa";
+    char tn[] = "/tmp/tmpvcf-XXXXXX";
+    close(mkstemp(tn));
+    {
+        GVCFMerger g(simulator.GetFiles(), tn, "v", ref, 1000);
+        g.write_vcf();
+    }
+    auto expected = read_records(tn);
+    ASSERT_GT(expected.size(), (size_t) 0);
+
+    //the middle chunk runs from inside the first contig (open ended) into the second
+    ChunkPlanner planner(simulator.GetFiles(), 1000);
+    auto chunks = planner.Plan(3);
+    ASSERT_EQ(chunks.size(), (size_t) 3);
+    ASSERT_EQ(chunks[1].size(), (size_t) 2);
+    ASSERT_GT(chunks[1][0].start, 0);
+    ASSERT_EQ(chunks[1][0].end, std::numeric_limits<int>::max() - 1);
+    ASSERT_EQ(ggutils::region2string(chunks[1][0]).back(), '-');
+
+    //merging each chunk with the -r plan writes gives the same records as one merge
+    std::vector<std::string> observed;
+    for (auto &chunk : chunks)
+    {
+        std::string region;
+        for (auto &r : chunk)
+        {
+            region += (region.empty() ? "" : ",") + ggutils::region2string(r);
+        }
+        {
+            GVCFMerger g(simulator.GetFiles(), tn, "v", ref, 1000, region);
+            g.write_vcf();
+        }
+        auto records = read_records(tn);
+        observed.insert(observed.end(), records.begin(), records.end());
+    }
+    ASSERT_EQ(observed, expected);
+    remove(tn);
+    for (auto &fname : simulator.GetFiles())
+    {
+        remove(fname.c_str());
+        remove((fname + ".tbi").c_str());
+    }
+    remove(ref.c_str());
+    remove((ref + ".fai").c_str());
+    remove(((std::string) dir + "/gvcfs.txt").c_str());
+    rmdir(dir);
+}
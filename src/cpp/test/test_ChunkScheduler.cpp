@@ -0,0 +1,101 @@
+#include "test_helpers.hh"
+
+#include <thread>
+
+#include "ChunkScheduler.hh"
+
+struct test_output_t : public chunk_output_t
+{
+    int worker;
+};
+
+TEST(ChunkScheduler, unevenChunksComeOutInOrder)
+{
+    std::vector<ggutils::region_t> bounds = {{"chr1", 0, 599999}, {"chr2", 5000, 5999}, {"chrUn", 0, std::numeric_limits<int>::max() - 1}};
+    int num_workers = 4;
+    ChunkScheduler scheduler(bounds, 100000, num_workers, 1000);
+    ASSERT_EQ(scheduler.GetNumChunks(), (size_t) 8);
+
+    std::vector<std::thread> threads;
+    for (int w = 0; w < num_workers; w++)
+    {
+        threads.emplace_back([&, w]()
+                             {
+                                 chunk_task_t task;
+                                 while (scheduler.Take(w, task))
+                                 {
+                                     //the first 100kb of chr1 are dense, the rest is quick
+                                     if (task.bound == 0 && task.start < 100000)
+                                     {
+                                         std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                                     }
+                                     test_output_t *output = new test_output_t;
+                                     output->worker = w;
+                                     scheduler.Finish(task, output);
+                                 }
+                             });
+    }
+
+    //the chunks tile the bounds and come out in genome order
+    chunk_task_t task;
+    chunk_output_t *output;
+    size_t bound = 0;
+    int start = bounds[0].start;
+    size_t num_chunks = 0;
+    while ((output = scheduler.NextOutput(task)) != nullptr)
+    {
+        if (start > bounds[bound].end)
+        {
+            bound++;
+            start = bounds[bound].start;
+        }
+        ASSERT_EQ(task.bound, bound);
+        ASSERT_EQ(task.start, start);
+        ASSERT_LE(task.end, bounds[bound].end);
+        start = task.end + 1;
+        num_chunks++;
+        delete output;
+    }
+    ASSERT_EQ(bound, bounds.size() - 1);
+    ASSERT_EQ(start, std::numeric_limits<int>::max());
+    for (auto it = threads.begin(); it != threads.end(); it++)
+    {
+        it->join();
+    }
+
+    //the workers that were not stuck on the dense chunk took (and split) the chunk queued behind it
+    ASSERT_EQ(num_chunks, scheduler.GetNumChunks());
+    ASSERT_GT(scheduler.GetNumSteals(), (size_t) 0);
+    ASSERT_GT(scheduler.GetNumSplits(), (size_t) 0);
+    ASSERT_LE(scheduler.GetMaxPending(), (size_t) CHUNK_REORDER_BUFFER * num_workers);
+}
+
+TEST(ChunkScheduler, idleWorkersSplitTheLastChunk)
+{
+    std::vector<ggutils::region_t> bounds = {{"chr1", 0, 99999}};
+    ChunkScheduler scheduler(bounds, 100000, 2, 1000);
+    ASSERT_EQ(scheduler.GetNumChunks(), (size_t) 1);
+
+    //worker 1 has nothing queued, it takes the first half of worker 0's only chunk
+    chunk_task_t task;
+    ASSERT_TRUE(scheduler.Take(1, task));
+    ASSERT_EQ(task.start, 0);
+    ASSERT_EQ(task.end, 49999);
+    scheduler.Finish(task, new test_output_t);
+    ASSERT_TRUE(scheduler.Take(0, task));
+    ASSERT_EQ(task.start, 50000);
+    ASSERT_EQ(task.end, 99999);
+    scheduler.Finish(task, new test_output_t);
+    ASSERT_FALSE(scheduler.Take(0, task));
+    ASSERT_EQ(scheduler.GetNumSplits(), (size_t) 1);
+    ASSERT_EQ(scheduler.GetNumChunks(), (size_t) 2);
+
+    for (int end : {49999, 99999})
+    {
+        chunk_output_t *output = scheduler.NextOutput(task);
+        ASSERT_NE(output, nullptr);
+        ASSERT_EQ(task.end, end);
+        delete output;
+    }
+    ASSERT_EQ(scheduler.NextOutput(task), nullptr);
+}
@@ -1,5 +1,7 @@
 #include "test_helpers.hh"
 
+#include <functional>
+
 #include "GVCFMerger.hh"
 #include "StringUtil.hh"
 
@@ -78,6 +80,481 @@ TEST(GVCFMerger, platinumGenomeTinyTest)
     g.write_vcf();
 }
 
+static std::vector<std::string> read_vcf_body(const std::string &fname)
+{
+    std::vector<std::string> ret;
+    std::ifstream in(fname);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line[0] != '#')
+        {
+            ret.push_back(line);
+        }
+    }
+    return (ret);
+}
+
+//the GVCFMerger constructor arguments the GVCFMergerTrio tests vary
+struct merge_options_t
+{
+    merge_options_t()
+    : output_mode("v"), is_file(0), buffer_size(1000), two_pass(TWO_PASS_OFF), local_alleles(false), gvcf_output(false),
+      sites_only(false)
+    {}
+
+    std::string output;//a new temporary file if empty
+    std::string output_mode;
+    std::string region;
+    int is_file;
+    int buffer_size;
+    int two_pass;
+    bool local_alleles, gvcf_output, sites_only;
+};
+
+//merges of NA12877, NA12878 and NA12882 from test2, written to temporary files that are removed after the test
+class GVCFMergerTrio : public ::testing::Test
+{
+protected:
+    typedef std::function<void(GVCFMerger &)> configure_t;
+
+    GVCFMergerTrio()
+    {
+        std::string test_base = g_testenv->getBasePath() + "/../test/test2/";
+        _files = {test_base + "NA12877_S1.vcf.gz", test_base + "NA12878_S1.vcf.gz", test_base + "NA12882_S1.vcf.gz"};
+        _ref = test_base + "test2.ref.fa";
+    }
+
+    ~GVCFMergerTrio()
+    {
+        for (auto &fname : _temp_files)
+        {
+            remove(fname.c_str());
+            remove((fname + ".csi").c_str());
+        }
+    }
+
+    //a new temporary file, which is removed (with any index) after the test
+    std::string TempFile(const std::string &suffix = "")
+    {
+        char tn[] = "/tmp/tmpvcf-XXXXXX";
+        close(mkstemp(tn));
+        _temp_files.push_back(tn);
+        if (!suffix.empty())
+        {
+            _temp_files.push_back(tn + suffix);
+        }
+        return (_temp_files.back());
+    }
+
+    //merges the trio and returns the output file, configure calls any setters before the merge is written
+    std::string Merge(const merge_options_t &options = merge_options_t(), const configure_t &configure = nullptr)
+    {
+        std::string output = options.output.empty() ? TempFile() : options.output;
+        GVCFMerger g(_files, output, options.output_mode, _ref, options.buffer_size, options.region, options.is_file, false, false,
+                     options.two_pass, options.local_alleles, options.gvcf_output, options.sites_only);
+        if (configure != nullptr)
+        {
+            configure(g);
+        }
+        g.write_vcf();
+        return (output);
+    }
+
+    //the records of Merge, as lines of text
+    std::vector<std::string> MergeToLines(const merge_options_t &options = merge_options_t(),
+                                          const configure_t &configure = nullptr)
+    {
+        return (read_vcf_body(Merge(options, configure)));
+    }
+
+    std::vector<std::string> _files;
+    std::string _ref;
+    std::vector<std::string> _temp_files;
+};
+
+TEST_F(GVCFMergerTrio, twoPassMatchesStreaming)
+{
+    auto expected = MergeToLines();
+    ASSERT_GT(expected.size(), (size_t) 0);
+    merge_options_t seeked;
+    seeked.two_pass = TWO_PASS_ALWAYS;
+    ASSERT_EQ(MergeToLines(seeked), expected);
+}
+
+TEST_F(GVCFMergerTrio, regionsFileMatchesRegions)
+{
+    //the TTCTAA deletion at chr1:72696 of NA12877 starts before the second region and overlaps it
+    merge_options_t first, second, both, file;
+    first.region = "chr1:50001-60000";
+    second.region = "chr1:72698-80000";
+    both.region = first.region + "," + second.region;
+    file.region = TempFile(".bed");
+    file.is_file = 1;
+    std::ofstream(file.region) << "chr1\t50000\t60000\nchr1\t72697\t80000\n";
+
+    //every region drops the variants that start before it, whether it comes first or not and from -r or -R
+    auto expected = MergeToLines(first), after = MergeToLines(second);
+    expected.insert(expected.end(), after.begin(), after.end());
+    ASSERT_GT(after.size(), (size_t) 0);
+    ASSERT_GE(std::stoi(after[0].substr(5)), 72698);
+    ASSERT_EQ(MergeToLines(both), expected);
+    ASSERT_EQ(MergeToLines(file), expected);
+    file.two_pass = TWO_PASS_ALWAYS;
+    ASSERT_EQ(MergeToLines(file), expected);
+}
+
+TEST_F(GVCFMergerTrio, sampleParallelMatchesStreaming)
+{
+    merge_options_t options;
+    options.region = "chr1:50000-150000";
+    auto expected = MergeToLines(options);
+    ASSERT_GT(expected.size(), (size_t) 0);
+    //one worker with two threads, then three workers genotyping chunks at once
+    for (int chunk_workers : {1, 3})
+    {
+        //small chunks so that plenty of sites and reference blocks straddle chunk boundaries
+        auto chunked = MergeToLines(options, [&](GVCFMerger &g) { g.SetThreads(2, 997, chunk_workers); });
+        ASSERT_EQ(chunked, expected);
+    }
+}
+
+TEST_F(GVCFMergerTrio, readAheadMatchesStreaming)
+{
+    //whole files and a region, the second with reference blocks so that depth blocks are read ahead too
+    for (bool gvcf_output : {false, true})
+    {
+        merge_options_t options;
+        options.region = gvcf_output ? "chr1:50000-150000" : "";
+        options.gvcf_output = gvcf_output;
+        auto expected = MergeToLines(options);
+        ASSERT_GT(expected.size(), (size_t) 0);
+        //fewer threads than GVCFs, so a thread reads ahead for several of them
+        auto read_ahead = MergeToLines(options, [](GVCFMerger &g) { g.SetReadThreads(2); });
+        ASSERT_EQ(read_ahead, expected);
+    }
+}
+
+TEST_F(GVCFMergerTrio, batchedMatchesStreaming)
+{
+    for (std::string region : {"", "chr1:50000-150000"})
+    {
+        merge_options_t options;
+        options.region = region;
+        auto expected = MergeToLines(options);
+        ASSERT_GT(expected.size(), (size_t) 0);
+        //batches of one site, batches cut short by max_sites and batches cut short by the buffered window
+        for (int batch_sites : {1, 5, 256})
+        {
+            for (int read_threads : {0, 2})
+            {
+                auto batched = MergeToLines(options, [&](GVCFMerger &g)
+                {
+                    g.SetBatchSites(batch_sites);
+                    if (read_threads > 0)
+                    {
+                        g.SetReadThreads(read_threads);
+                    }
+                });
+                ASSERT_EQ(batched, expected);
+            }
+        }
+    }
+}
+
+TEST(GVCFMerger, adaptiveBufferSize)
+{
+    //1MB over 10 readers holding 100 bytes/record at 0.01 records/bp
+    ASSERT_EQ(GVCFMerger::GetAdaptiveBufferSize(1e6, 10, 100, 0.01), 100000);
+    ASSERT_EQ(GVCFMerger::GetAdaptiveBufferSize(1e6, 10000, 100, 0.01), MIN_ADAPTIVE_BUFFER_SIZE);
+    ASSERT_EQ(GVCFMerger::GetAdaptiveBufferSize(1e9, 10, 100, 0.01), MAX_ADAPTIVE_BUFFER_SIZE);
+    //nothing buffered yet, or no memory left after the headers
+    ASSERT_EQ(GVCFMerger::GetAdaptiveBufferSize(1e6, 10, 100, 0), MAX_ADAPTIVE_BUFFER_SIZE);
+    ASSERT_EQ(GVCFMerger::GetAdaptiveBufferSize(-1e6, 10, 100, 0.01), MIN_ADAPTIVE_BUFFER_SIZE);
+}
+
+TEST_F(GVCFMergerTrio, maxMemoryMatchesFixedWindow)
+{
+    merge_options_t options;
+    options.buffer_size = 5000;
+    auto expected = MergeToLines(options);
+    ASSERT_GT(expected.size(), (size_t) 0);
+    for (int batch_sites : {0, 256})
+    {
+        auto adaptive = MergeToLines(options, [&](GVCFMerger &g)
+        {
+            g.SetBatchSites(batch_sites);
+            g.SetMaxMemory(1 << 20);
+        });
+        ASSERT_EQ(adaptive, expected);
+    }
+}
+
+TEST_F(GVCFMergerTrio, sitesOnlyMatchesFullInfo)
+{
+    //the first eight columns are unchanged and there are no sample columns
+    std::vector<std::string> expected;
+    for (auto &line : MergeToLines())
+    {
+        size_t tab = 0;
+        for (int column = 0; column < 8; column++)
+        {
+            tab = line.find('\t', tab + 1);
+        }
+        expected.push_back(line.substr(0, tab));
+    }
+    ASSERT_GT(expected.size(), (size_t) 0);
+    merge_options_t options;
+    options.sites_only = true;
+    std::string sites = Merge(options);
+    ASSERT_EQ(read_vcf_body(sites), expected);
+    VcfReader reader(sites);
+    ASSERT_EQ(bcf_hdr_nsamples(reader.GetHeader()), 0);
+}
+
+//a GVCF with chr1 moved after its other contigs and a contig no other GVCF has put first, merged with GVCFs
+//whose headers have the usual order. Records get the output header's contig ids, so nothing changes.
+TEST_F(GVCFMergerTrio, reorderedContigsMatchSameOrder)
+{
+    merge_options_t region;
+    region.region = "chr1:50000-150000";
+    auto expected = MergeToLines(), expected_region = MergeToLines(region);
+    ASSERT_GT(expected.size(), (size_t) 0);
+
+    std::string reordered = TempFile(".vcf.gz");
+    _temp_files.push_back(reordered + ".tbi");
+    htsFile *in = hts_open(_files[1].c_str(), "r");
+    BGZF *out = bgzf_open(reordered.c_str(), "w");
+    kstring_t line = {0, 0, nullptr};
+    std::string chr1;
+    bool first_contig = true;
+    while (hts_getline(in, '\n', &line) >= 0)
+    {
+        std::string text = (std::string) line.s + "\n";
+        if (text.compare(0, 17, "##contig=<ID=chr1") == 0 && text[17] == ',')
+        {
+            chr1 = text;
+            continue;
+        }
+        if (text.compare(0, 9, "##contig=") == 0 && first_contig)
+        {
+            text = "##contig=<ID=chrUn_extra,length=1000>\n" + text;
+            first_contig = false;
+        }
+        if (text.compare(0, 6, "#CHROM") == 0)
+        {
+            text = chr1 + text;
+        }
+        ASSERT_EQ(bgzf_write(out, text.c_str(), text.size()), (ssize_t) text.size());
+    }
+    free(line.s);
+    hts_close(in);
+    bgzf_close(out);
+    ASSERT_FALSE(chr1.empty());
+    ASSERT_EQ(tbx_index_build(reordered.c_str(), 0, &tbx_conf_vcf), 0);
+    _files[1] = reordered;
+
+    std::string output = Merge();
+    ASSERT_EQ(read_vcf_body(output), expected);
+    VcfReader reader(output);
+    ASSERT_EQ(bcf_hdr_name2id(reader.GetHeader(), "chr1"), 1);
+    ASSERT_EQ(bcf_hdr_name2id(reader.GetHeader(), "chrUn_extra"), reader.GetHeader()->n[BCF_DT_CTG] - 1);
+    ASSERT_EQ(MergeToLines(region), expected_region);
+    region.two_pass = TWO_PASS_ALWAYS;
+    ASSERT_EQ(MergeToLines(region), expected_region);
+    auto chunked = MergeToLines(region, [](GVCFMerger &g) { g.SetThreads(2, 997, 3); });
+    ASSERT_EQ(chunked, expected_region);
+}
+
+TEST_F(GVCFMergerTrio, extraOutputsMatchFullOutput)
+{
+    std::string sites = TempFile(), subset = TempFile();
+    auto full = MergeToLines(merge_options_t(), [&](GVCFMerger &g)
+    {
+        g.AddOutput(sites, "v", true);
+        g.AddOutput(subset, "v", false, {"NA12882_S1", "NA12877_S1"});
+    });
+
+    std::vector<std::string> expected_sites, expected_subset;
+    for (auto &line : full)
+    {
+        std::vector<std::string> columns;
+        stringutil::split(line, columns, "\t", true);
+        ASSERT_EQ(columns.size(), (size_t) 12);
+        std::string site = columns[0];
+        for (size_t i = 1; i < 8; i++)
+        {
+            site += "\t" + columns[i];
+        }
+        expected_sites.push_back(site);
+        expected_subset.push_back(site + "\t" + columns[8] + "\t" + columns[11] + "\t" + columns[9]);
+    }
+    ASSERT_GT(expected_sites.size(), (size_t) 0);
+    ASSERT_EQ(read_vcf_body(sites), expected_sites);
+    ASSERT_EQ(read_vcf_body(subset), expected_subset);
+}
+
+TEST_F(GVCFMergerTrio, writeIndexWhileMerging)
+{
+    merge_options_t options;
+    options.output = TempFile(".bcf");
+    options.output_mode = "b";
+    std::string bcf = options.output, vcf = TempFile(".vcf.gz");
+    Merge(options, [&](GVCFMerger &g)
+    {
+        g.AddOutput(vcf, "z", false);
+        g.SetWriteIndex();
+    });
+
+    //a region read through each index matches the same region of the streamed file
+    std::vector<std::pair<int, int> > expected;
+    {
+        VcfReader reader(bcf);
+        bcf1_t *record = bcf_init1();
+        while (reader.Next(record))
+        {
+            if (record->pos + record->rlen > 90000 && record->pos < 95000)
+            {
+                expected.emplace_back(record->rid, record->pos);
+            }
+        }
+        bcf_destroy(record);
+    }
+    ASSERT_GT(expected.size(), (size_t) 0);
+    for (auto &fname : {bcf, vcf})
+    {
+        VcfReader reader(fname);
+        ASSERT_TRUE(reader.HasIndex());
+        ASSERT_EQ(reader.SetRegions("chr1:90001-95000"), 1);
+        std::vector<std::pair<int, int> > observed;
+        bcf1_t *record = bcf_init1();
+        while (reader.Next(record))
+        {
+            observed.emplace_back(record->rid, record->pos);
+        }
+        bcf_destroy(record);
+        ASSERT_EQ(observed, expected);
+    }
+}
+
+TEST_F(GVCFMergerTrio, gvcfOutputFillsGapsBetweenSites)
+{
+    std::vector<std::string> expected = MergeToLines(), observed;
+    merge_options_t options;
+    options.gvcf_output = true;
+    std::string blocks = Merge(options);
+
+    //the sites are unchanged and reference blocks neither overlap each other nor the sites
+    VcfReader reader(blocks);
+    bcf1_t *record = bcf_init1();
+    int last_rid = -1, last_end = -1;
+    size_t num_blocks = 0;
+    std::ifstream in(blocks);
+    std::string line;
+    while (reader.Next(record))
+    {
+        do
+        {
+            std::getline(in, line);
+        } while (line[0] == '#');
+        if (record->n_allele == 1)
+        {
+            ASSERT_TRUE(record->rid > last_rid || record->pos > last_end);
+            last_end = record->pos + record->rlen - 1;
+            num_blocks++;
+        }
+        else
+        {
+            observed.push_back(line);
+            last_end = record->pos + record->rlen - 1;
+        }
+        last_rid = record->rid;
+    }
+    bcf_destroy(record);
+    ASSERT_GT(num_blocks, (size_t) 0);
+    ASSERT_EQ(observed, expected);
+}
+
+TEST_F(GVCFMergerTrio, localAllelesMatchGlobal)
+{
+    std::string global = Merge();
+    merge_options_t options;
+    options.local_alleles = true;
+    std::string local = Merge(options);
+
+    VcfReader global_reader(global), local_reader(local);
+    bcf_hdr_t *gh = global_reader.GetHeader(), *lh = local_reader.GetHeader();
+    ASSERT_EQ(bcf_hdr_id2int(lh, BCF_DT_ID, "PL"), -1);
+    bcf1_t *grec = bcf_init1(), *lrec = bcf_init1();
+    int32_t *gt = nullptr, *lgt = nullptr, *ad = nullptr, *pl = nullptr, *laa = nullptr, *lad = nullptr, *lpl = nullptr;
+    int ngt = 0, nlgt = 0, nad = 0, npl = 0, nlaa = 0, nlad = 0, nlpl = 0;
+    size_t num_records = 0, num_multi_allelic_samples = 0;
+    while (global_reader.Next(grec))
+    {
+        ASSERT_TRUE(local_reader.Next(lrec));
+        ASSERT_EQ(grec->pos, lrec->pos);
+        ASSERT_EQ(grec->n_allele, lrec->n_allele);
+        int num_sample = bcf_hdr_nsamples(gh);
+        ASSERT_EQ(bcf_get_genotypes(gh, grec, &gt, &ngt), bcf_get_genotypes(lh, lrec, &lgt, &nlgt));
+        ASSERT_TRUE(std::equal(gt, gt + ngt, lgt));
+        ASSERT_EQ(bcf_get_format_int32(gh, grec, "AD", &ad, &nad), num_sample * grec->n_allele);
+        int pl_stride = ggutils::get_number_of_likelihoods(2, grec->n_allele);
+        ASSERT_EQ(bcf_get_format_int32(gh, grec, "PL", &pl, &npl), num_sample * pl_stride);
+        //bcf_get_format_int32 returns the number of values, which is a multiple of the number of samples
+        int laa_stride = bcf_get_format_int32(lh, lrec, "LAA", &laa, &nlaa) / num_sample;
+        int lad_stride = bcf_get_format_int32(lh, lrec, "LAD", &lad, &nlad) / num_sample;
+        int lpl_stride = bcf_get_format_int32(lh, lrec, "LPL", &lpl, &nlpl) / num_sample;
+        ASSERT_GT(laa_stride, 0);
+        ASSERT_GT(lad_stride, 0);
+        ASSERT_GT(lpl_stride, 0);
+        for (int i = 0; i < num_sample; i++)
+        {
+            if (lad[i * lad_stride] == bcf_int32_missing)
+            {
+                continue;
+            }
+            //LAD/LPL must be the AD/PL of REF and the LAA alleles, every other allele has no reads
+            std::vector<int> local_alleles(1, 0);
+            for (int j = 0; j < laa_stride && laa[i * laa_stride + j] != bcf_int32_vector_end; j++)
+            {
+                if (laa[i * laa_stride + j] != bcf_int32_missing)
+                {
+                    local_alleles.push_back(laa[i * laa_stride + j]);
+                }
+            }
+            num_multi_allelic_samples += local_alleles.size() < (size_t) grec->n_allele;
+            std::vector<int> expanded_ad(grec->n_allele, 0);
+            for (size_t j = 0; j < local_alleles.size(); j++)
+            {
+                expanded_ad[local_alleles[j]] = lad[i * lad_stride + j];
+            }
+            ASSERT_TRUE(std::equal(expanded_ad.begin(), expanded_ad.end(), ad + i * grec->n_allele));
+            bool diploid = gt[2 * i + 1] != bcf_int32_vector_end;
+            for (size_t j = 0; diploid && j < local_alleles.size(); j++)
+            {
+                for (size_t k = 0; k <= j; k++)
+                {
+                    ASSERT_EQ(lpl[i * lpl_stride + ggutils::get_gl_index(k, j)],
+                              pl[i * pl_stride + ggutils::get_gl_index(local_alleles[k], local_alleles[j])]);
+                }
+            }
+        }
+        num_records++;
+    }
+    ASSERT_FALSE(local_reader.Next(lrec));
+    ASSERT_GT(num_records, (size_t) 0);
+    ASSERT_GT(num_multi_allelic_samples, (size_t) 0);
+    free(gt);
+    free(lgt);
+    free(ad);
+    free(pl);
+    free(laa);
+    free(lad);
+    free(lpl);
+    bcf_destroy(grec);
+    bcf_destroy(lrec);
+}
+
 TEST(GVCFMerger, likelihood)
 {
     auto hdr = get_header();
@@ -55,6 +55,53 @@ TEST(DepthBuffer, interpolate)
     ASSERT_EQ(db.dp(), 37);
 }
 
+TEST(DepthBuffer, packedValues)
+{
+    DepthBuffer buf;
+    buf.push_back(DepthBlock(0, 0, 99, 70000, bcf_int32_missing, 3070, 2));
+    buf.push_back(DepthBlock(0, 100, 100, 0, 12, 0, -3));
+    DepthBlock db = buf.At(0);
+    ASSERT_EQ(db.end(), 99);
+    ASSERT_EQ(db.dp(), DEPTH_MAX_VALUE);
+    ASSERT_EQ(db.dpf(), bcf_int32_missing);
+    ASSERT_EQ(db.gq(), 3070);
+    ASSERT_EQ(db.ploidy(), 2);
+    db = buf.At(1);
+    ASSERT_EQ(db.dp(), 0);
+    ASSERT_EQ(db.dpf(), 12);
+    ASSERT_EQ(db.ploidy(), -3);
+}
+
+TEST(DepthBuffer, ringAcrossContigs)
+{
+    //10bp blocks with DP of their number on three contigs, flushed behind the last one read as a reader would
+    DepthBuffer buf;
+    DepthBlock db;
+    int n = 0;
+    for (int rid = 0; rid < 3; rid++)
+    {
+        for (int block = 0; block < 100; block++, n++)
+        {
+            buf.push_back(DepthBlock(rid, block * 10, block * 10 + 9, n, 1, 30, 2));
+            if (block >= 20)
+            {
+                ASSERT_EQ(buf.Interpolate(rid, block * 10 - 195, block * 10 - 195, db), 0);
+                ASSERT_EQ(db.dp(), n - 20);
+                ASSERT_EQ(db.rid(), rid);
+                buf.FlushBuffer(rid, block * 10 - 195);
+            }
+        }
+        ASSERT_LE(buf.size(), (size_t) 21);
+    }
+    //the blocks left are the last ones on contig 2 and an interval across two blocks averages them
+    ASSERT_EQ(buf.GetRid(0), 2);
+    ASSERT_EQ(buf.Interpolate(2, 985, 994, db), 0);
+    ASSERT_EQ(db.dp(), 299);
+    ASSERT_EQ(buf.Interpolate(3, 0, 0, db), -1);
+    ASSERT_EQ(buf.FlushBuffer(), 21);
+    ASSERT_TRUE(buf.empty());
+}
+
 TEST(VariantBuffer, test1)
 {
     int rid=1;
@@ -192,3 +239,46 @@ TEST(GVCFReader, readAGVCF)
 }
 
 
+
+TEST(GVCFReader, lookAheadCoversDeletions)
+{
+    std::string test_base = g_testenv->getBasePath() + "/../test/test2/";
+    Normaliser normaliser(test_base + "test2.ref.fa");
+    GVCFReader reader(test_base + "NA12877_S1.vcf.gz", &normaliser, 2);
+    ASSERT_EQ(reader.GetBufferSize(), 2);
+    reader.ReadAll();
+    //the GVCF has deletions longer than 2bp
+    ASSERT_GT(reader.GetLookAhead(), 2);
+    ASSERT_GT(reader.GetNumBufferedRecords(), reader.GetNumVariants());
+    ASSERT_GT(reader.GetBufferedBytes(), (size_t) 0);
+    reader.SetBufferSize(100000);
+    ASSERT_EQ(reader.GetLookAhead(), 100000);
+}
+
+TEST(DepthBuffer, pushBackMatchesDepthBlock)
+{
+    //diploid blocks with FORMAT/GQ, and haploid blocks with only FORMAT/GQX
+    for (std::string fname : {"/../test/test2/NA12877_S1.vcf.gz", "/../test/regression/GG-30.vcf.gz"})
+    {
+        VcfReader reader(g_testenv->getBasePath() + fname);
+        bcf_hdr_t *hdr = reader.GetHeader();
+        DepthBuffer by_name, by_id;
+        bcf1_t *record = bcf_init1();
+        while (reader.Next(record))
+        {
+            if (bcf_get_fmt(hdr, record, "DP") != nullptr)
+            {
+                by_name.push_back(DepthBlock(hdr, record));
+            }
+            by_id.push_back(hdr, record);
+        }
+        bcf_destroy(record);
+        ASSERT_GT(by_id.size(), (size_t) 2);
+        ASSERT_EQ(by_id.size(), by_name.size());
+        for (size_t i = 0; i < by_id.size(); i++)
+        {
+            ASSERT_EQ(by_id.At(i), by_name.At(i));
+            ASSERT_EQ(by_id.At(i).ploidy(), by_name.At(i).ploidy());
+        }
+    }
+}
@@ -0,0 +1,130 @@
+#include "test_helpers.hh"
+
+#include <fstream>
+#include <unistd.h>
+
+#include "GVCFSimulator.hh"
+#include "GVCFMerger.hh"
+#include "GVCFReader.hh"
+
+static void remove_cohort(const std::string &dir, const GVCFSimulator &simulator)
+{
+    for (auto &fname : simulator.GetFiles())
+    {
+        remove(fname.c_str());
+        remove((fname + ".tbi").c_str());
+    }
+    remove((dir + "/ref.fa").c_str());
+    remove((dir + "/ref.fa.fai").c_str());
+    remove((dir + "/gvcfs.txt").c_str());
+    rmdir(dir.c_str());
+}
+
+static std::string read_gz(const std::string &fname)
+{
+    htsFile *fp = hts_open(fname.c_str(), "r");
+    kstring_t line = {0, 0, nullptr};
+    std::string text;
+    while (hts_getline(fp, '\n', &line) >= 0)
+    {
+        text += std::string(line.s) + "\n";
+    }
+    free(line.s);
+    hts_close(fp);
+    return (text);
+}
+
+static simulation_t small_cohort()
+{
+    simulation_t params;
+    params.num_samples = 6;
+    params.num_contigs = 2;
+    params.contig_length = 20000;
+    params.snp_rate = 5e-3;
+    params.indel_rate = 2e-3;
+    params.mnp_rate = 5e-4;
+    params.multiallelic_rate = 0.3;
+    params.mean_block_length = 20;
+    params.missing_rate = 0.1;
+    return (params);
+}
+
+TEST(GVCFSimulator, simulatedCohortMerges)
+{
+    char dir[] = "/tmp/tmpsim-XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != nullptr);
+    GVCFSimulator simulator(small_cohort());
+    simulator.Write(dir);
+    ASSERT_EQ(simulator.GetFiles().size(), (size_t) 6);
+    ASSERT_GT(simulator.GetNumSites(), (size_t) 100);
+
+    //every base of every contig is covered, so GVCFReader takes the blocks as they are
+    Normaliser normaliser((std::string) dir + "/ref.fa");
+    size_t num_variants = 0;
+    for (auto &fname : simulator.GetFiles())
+    {
+        GVCFReader reader(fname, &normaliser, 1000);
+        reader.ReadAll();
+        num_variants += reader.GetNumVariants();
+        ASSERT_GT(reader.GetNumDepthBlocks(), (size_t) 0);
+    }
+    ASSERT_GT(num_variants, (size_t) 0);
+
+    char streamed[] = "/tmp/tmpvcf-XXXXXX";
+    char parallel[] = "/tmp/tmpvcf-XXXXXX";
+    close(mkstemp(streamed));
+    close(mkstemp(parallel));
+    {
+        GVCFMerger g(simulator.GetFiles(), streamed, "v", (std::string) dir + "/ref.fa", 1000);
+        g.write_vcf();
+    }
+    {
+        GVCFMerger g(simulator.GetFiles(), parallel, "v", (std::string) dir + "/ref.fa", 1000);
+        g.SetThreads(3, 7000);
+        g.write_vcf();
+    }
+    std::string text = read_gz(streamed);
+    ASSERT_EQ(read_gz(parallel), text);
+    size_t num_sites = 0, num_multiallelic = 0;
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        if (line[0] != '#')
+        {
+            std::istringstream fields(line);
+            std::string chrom, pos, id, ref, alt;
+            fields >> chrom >> pos >> id >> ref >> alt;
+            num_sites++;
+            num_multiallelic += alt.find(',') != std::string::npos;
+        }
+    }
+    ASSERT_GT(num_sites, (size_t) 100);
+    ASSERT_GT(num_multiallelic, (size_t) 0);
+    remove(streamed);
+    remove(parallel);
+    remove_cohort(dir, simulator);
+}
+
+TEST(GVCFSimulator, sameGvcfsWhateverThreads)
+{
+    char dir1[] = "/tmp/tmpsim-XXXXXX";
+    char dir2[] = "/tmp/tmpsim-XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir1) != nullptr);
+    ASSERT_TRUE(mkdtemp(dir2) != nullptr);
+    GVCFSimulator simulator1(small_cohort()), simulator2(small_cohort());
+    simulator1.Write(dir1, 1);
+    simulator2.Write(dir2, 3);
+    ASSERT_EQ(read_gz((std::string) dir1 + "/ref.fa"), read_gz((std::string) dir2 + "/ref.fa"));
+    for (size_t i = 0; i < simulator1.GetFiles().size(); i++)
+    {
+        ASSERT_EQ(read_gz(simulator1.GetFiles()[i]), read_gz(simulator2.GetFiles()[i]));
+    }
+    //another seed is another cohort
+    simulation_t params = small_cohort();
+    params.seed = 2;
+    GVCFSimulator simulator3(params);
+    ASSERT_NE(simulator3.GetNumSites(), simulator1.GetNumSites());
+    remove_cohort(dir1, simulator1);
+    remove_cohort(dir2, simulator2);
+}
@@ -0,0 +1,116 @@
+#include "test_helpers.hh"
+
+#include <thread>
+
+#include "HeaderCache.hh"
+#include "GVCFReader.hh"
+
+//a single sample GVCF header, source is a generic line that does not go into the dictionaries
+static bcf_hdr_t *make_header(const std::string &sample, const std::string &source, bool with_chr2,
+                              bool chr2_first = false)
+{
+    bcf_hdr_t *header = bcf_hdr_init("w");
+    bcf_hdr_append(header, ("##source=" + source).c_str());
+    bcf_hdr_append(header, "##INFO=<ID=END,Number=1,Type=Integer,Description=\"End position\">");
+    bcf_hdr_append(header, "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">");
+    bcf_hdr_append(header, "##FORMAT=<ID=DP,Number=1,Type=Integer,Description=\"Depth\">");
+    if (with_chr2 && chr2_first)
+    {
+        bcf_hdr_append(header, "##contig=<ID=chr2,length=500>");
+    }
+    bcf_hdr_append(header, "##contig=<ID=chr1,length=1000>");
+    if (with_chr2 && !chr2_first)
+    {
+        bcf_hdr_append(header, "##contig=<ID=chr2,length=500>");
+    }
+    bcf_hdr_add_sample(header, sample.c_str());
+    bcf_hdr_sync(header);
+    return (header);
+}
+
+TEST(HeaderCache, sameHeaderDifferentSamples)
+{
+    size_t num_headers = HeaderCache::GetNumHeaders();
+    bcf_hdr_t *a = make_header("A", "run1", true), *b = make_header("B", "run2", true);
+    {
+        auto shared_a = HeaderCache::Share(a);
+        auto shared_b = HeaderCache::Share(b);
+        ASSERT_EQ(shared_a.get(), shared_b.get());
+        ASSERT_EQ(HeaderCache::GetNumHeaders(), num_headers + 1);
+        //the shared header has FORMAT/FT for the readers to write
+        ASSERT_NE(bcf_hdr_id2int(shared_a.get(), BCF_DT_ID, "FT"), -1);
+        ASSERT_EQ(bcf_hdr_id2int(a, BCF_DT_ID, "FT"), -1);
+        ASSERT_EQ(bcf_hdr_name2id(shared_b.get(), "chr2"), 1);
+    }
+    //freed with the last holder
+    ASSERT_EQ(HeaderCache::GetNumHeaders(), num_headers);
+    bcf_hdr_destroy(a);
+    bcf_hdr_destroy(b);
+}
+
+TEST(HeaderCache, differentHeadersNotShared)
+{
+    bcf_hdr_t *a = make_header("A", "run1", true), *b = make_header("B", "run1", false);
+    ASSERT_NE(HeaderCache::GetKey(a), HeaderCache::GetKey(b));
+    auto shared_a = HeaderCache::Share(a);
+    auto shared_b = HeaderCache::Share(b);
+    ASSERT_NE(shared_a.get(), shared_b.get());
+    ASSERT_EQ(bcf_hdr_name2id(shared_b.get(), "chr2"), -1);
+    bcf_hdr_destroy(a);
+    bcf_hdr_destroy(b);
+}
+
+TEST(HeaderCache, readersKeepTheirSampleNames)
+{
+    std::string gvcf = g_testenv->getBasePath() + "/../test/NA12877.tiny.vcf.gz";
+    std::string ref = g_testenv->getBasePath() + "/../test/tiny.ref.fa";
+    Normaliser norm(ref, true);
+    GVCFReader first(gvcf, &norm, 1000), second(gvcf, &norm, 1000);
+    ASSERT_EQ(first.GetHeader(), second.GetHeader());
+    ASSERT_EQ(first.GetNumSamples(), 1);
+    ASSERT_EQ(first.GetSampleName(), "NA12877");
+}
+
+TEST(HeaderCache, contigMapFollowsOutput)
+{
+    bcf_hdr_t *a = make_header("A", "run1", true), *output = make_header("B", "run1", true, true);
+    auto shared = HeaderCache::Share(a);
+    //numbered as the output, the header is used as it is
+    auto same = HeaderCache::MapContigs(shared, a);
+    ASSERT_TRUE(same->rids.empty());
+    ASSERT_EQ(same->header, shared);
+
+    auto map = HeaderCache::MapContigs(shared, output);
+    ASSERT_EQ(map, HeaderCache::MapContigs(shared, output));
+    ASSERT_EQ(map->rids, std::vector<int>({1, 0}));
+    ASSERT_FALSE(map->in_order);
+    ASSERT_EQ(bcf_hdr_name2id(map->header.get(), "chr2"), 0);
+    ASSERT_EQ(bcf_hdr_name2id(map->header.get(), "chr1"), 1);
+    for (const char *tag : {"END", "GT", "DP", "FT"})
+    {
+        ASSERT_EQ(bcf_hdr_id2int(map->header.get(), BCF_DT_ID, tag), bcf_hdr_id2int(shared.get(), BCF_DT_ID, tag));
+    }
+
+    //an output with a contig the GVCF does not have keeps the GVCF's order
+    bcf_hdr_t *fewer = make_header("C", "run1", false);
+    auto in_order = HeaderCache::MapContigs(HeaderCache::Share(fewer), output);
+    ASSERT_EQ(in_order->rids, std::vector<int>({1}));
+    ASSERT_TRUE(in_order->in_order);
+    bcf_hdr_destroy(a);
+    bcf_hdr_destroy(output);
+    bcf_hdr_destroy(fewer);
+}
+
+TEST(HeaderCache, parseHeaderPerThread)
+{
+    bcf_hdr_t *a = make_header("A", "run1", true);
+    auto shared = HeaderCache::Share(a);
+    bcf_hdr_t *copy = HeaderCache::GetParseHeader(shared), *other_copy = nullptr;
+    ASSERT_NE(copy, shared.get());
+    ASSERT_EQ(HeaderCache::GetParseHeader(shared), copy);
+    std::thread thread([&]() { other_copy = HeaderCache::GetParseHeader(shared); });
+    thread.join();
+    ASSERT_NE(other_copy, copy);
+    ASSERT_EQ(bcf_hdr_name2id(copy, "chr2"), 1);
+    bcf_hdr_destroy(a);
+}
@@ -0,0 +1,61 @@
+#include "test_helpers.hh"
+
+#include <climits>
+
+#include "ProgressMeter.hh"
+
+//a header with chr1 (1000bp), chr2 (500bp) and chr3 (no length)
+static bcf_hdr_t *make_header()
+{
+    bcf_hdr_t *header = bcf_hdr_init("w");
+    bcf_hdr_append(header, "##contig=<ID=chr1,length=1000>");
+    bcf_hdr_append(header, "##contig=<ID=chr2,length=500>");
+    bcf_hdr_append(header, "##contig=<ID=chr3>");
+    bcf_hdr_sync(header);
+    return (header);
+}
+
+TEST(ProgressMeter, fractionOfContigLengths)
+{
+    bcf_hdr_t *header = make_header();
+    ProgressMeter meter(header, {{"chr1", 0, INT_MAX - 1}, {"chr2", 0, INT_MAX - 1}}, 0);
+    ASSERT_DOUBLE_EQ(meter.GetFraction(0, 0), 1. / 1500);
+    ASSERT_DOUBLE_EQ(meter.GetFraction(0, 499), 500. / 1500);
+    ASSERT_DOUBLE_EQ(meter.GetFraction(1, 249), 1250. / 1500);
+    ASSERT_DOUBLE_EQ(meter.GetFraction(1, 499), 1.);
+    bcf_hdr_destroy(header);
+}
+
+TEST(ProgressMeter, fractionOfRegions)
+{
+    bcf_hdr_t *header = make_header();
+    //100bp, 100bp and 200bp
+    ProgressMeter meter(header, {{"chr1", 100, 199}, {"chr1", 300, 399}, {"chr2", 0, 199}}, 0);
+    ASSERT_DOUBLE_EQ(meter.GetFraction(0, 50), 0.);
+    ASSERT_DOUBLE_EQ(meter.GetFraction(0, 149), 50. / 400);
+    //between two regions the first is done
+    ASSERT_DOUBLE_EQ(meter.GetFraction(0, 250), 100. / 400);
+    ASSERT_DOUBLE_EQ(meter.GetFraction(0, 399), 200. / 400);
+    ASSERT_DOUBLE_EQ(meter.GetFraction(0, 900), 200. / 400);
+    ASSERT_DOUBLE_EQ(meter.GetFraction(1, 99), 300. / 400);
+    bcf_hdr_destroy(header);
+}
+
+TEST(ProgressMeter, noFractionWithoutLengths)
+{
+    bcf_hdr_t *header = make_header();
+    ProgressMeter meter(header, {{"chr1", 0, INT_MAX - 1}, {"chr3", 0, INT_MAX - 1}}, 0);
+    ASSERT_EQ(meter.GetFraction(0, 10), -1);
+    //a region with an end does not need a length
+    ProgressMeter bounded(header, {{"chr3", 0, 99}}, 0);
+    ASSERT_DOUBLE_EQ(bounded.GetFraction(2, 49), 0.5);
+    bcf_hdr_destroy(header);
+}
+
+TEST(ProgressMeter, secondsLeft)
+{
+    ASSERT_DOUBLE_EQ(ProgressMeter::GetSecondsLeft(0.25, 60), 180);
+    ASSERT_DOUBLE_EQ(ProgressMeter::GetSecondsLeft(1, 60), 0);
+    ASSERT_EQ(ProgressMeter::GetSecondsLeft(0, 60), -1);
+    ASSERT_EQ(ProgressMeter::GetSecondsLeft(-1, 60), -1);
+}
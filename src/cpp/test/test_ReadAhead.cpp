@@ -0,0 +1,69 @@
+#include "test_helpers.hh"
+
+#include "ReadAhead.hh"
+
+TEST(ReadAhead, sameRecordsAsReadingDirectly)
+{
+    std::string test_base = g_testenv->getBasePath() + "/../test/test2/";
+    std::vector<std::string> files = {test_base + "NA12877_S1.vcf.gz", test_base + "NA12878_S1.vcf.gz",
+                                      test_base + "NA12882_S1.vcf.gz"};
+    std::vector<std::vector<std::pair<int, int> > > expected(files.size());
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        VcfReader reader(files[i]);
+        bcf1_t *record = bcf_init1();
+        while (reader.Next(record))
+        {
+            expected[i].emplace_back(record->pos, record->rlen);
+        }
+        bcf_destroy(record);
+        //enough records for several rounds of batches
+        ASSERT_GT(expected[i].size(), (size_t) (READ_AHEAD_BATCH * READ_AHEAD_QUEUE * 2));
+    }
+
+    std::vector<VcfReader *> readers;
+    std::vector<bcf1_t *> records;
+    ReadAhead *read_ahead_ptr = new ReadAhead(2);
+    ReadAhead &read_ahead = *read_ahead_ptr;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        readers.push_back(new VcfReader(files[i]));
+        records.push_back(bcf_init1());
+        ASSERT_EQ(read_ahead.Add(readers.back()), i);
+    }
+    read_ahead.Start();
+    ASSERT_EQ(read_ahead.GetNumThreads(), 2);
+
+    //the streams are taken in turns, as the merge does
+    std::vector<std::vector<std::pair<int, int> > > observed(files.size());
+    bool more = true;
+    while (more)
+    {
+        more = false;
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            int region_index;
+            if (read_ahead.Next(i, records[i], region_index))
+            {
+                ASSERT_EQ(region_index, -1);
+                observed[i].emplace_back(records[i]->pos, records[i]->rlen);
+                more = true;
+            }
+        }
+    }
+    ASSERT_EQ(observed, expected);
+    auto stats = read_ahead.GetStats();
+    ASSERT_GT(stats.num_popped, (size_t) 0);
+    ASSERT_LE(stats.queued, stats.num_popped * READ_AHEAD_QUEUE);
+    //the read threads stop before the readers go
+    delete read_ahead_ptr;
+
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        bcf_destroy(records[i]);
+    }
+    for (auto it = readers.begin(); it != readers.end(); it++)
+    {
+        delete *it;
+    }
+}
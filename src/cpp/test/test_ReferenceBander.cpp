@@ -0,0 +1,57 @@
+#include "test_helpers.hh"
+#include "ReferenceBander.hh"
+
+TEST(ReferenceBander, bandsOnLargeChanges)
+{
+    ReferenceBander bander(2, 5, 10);
+    DepthBlock a1(0, 0, 9, 30, 0, 60, 2), b1(0, 0, 19, 20, 0, 40, 2);
+    DepthBlock a2(0, 10, 29, 33, 0, 55, 2);//within the bands of a1
+    DepthBlock a3(0, 30, 39, 40, 0, 55, 2);//DP moves 10 from the start of the block
+    std::vector<DepthBlock *> blocks = {&a1, &b1};
+    bander.Add(0, 0, 9, blocks);
+    blocks[0] = &a2;
+    bander.Add(0, 10, 19, blocks);
+    blocks[1] = nullptr;//sample 2 has no data from here on
+    bander.Add(0, 20, 29, blocks);
+    blocks[0] = &a3;
+    bander.Add(0, 30, 39, blocks);
+    bander.Close();
+
+    ASSERT_TRUE(bander.HasBlock());
+    cohort_block_t block = bander.Front();
+    ASSERT_EQ(block.start, 0);
+    ASSERT_EQ(block.end, 19);
+    ASSERT_EQ(block.dp, std::vector<int32_t>({30, 20}));
+    ASSERT_EQ(block.gq, std::vector<int32_t>({55, 40}));
+    bander.Pop();
+
+    block = bander.Front();
+    ASSERT_EQ(block.start, 20);
+    ASSERT_EQ(block.end, 29);
+    ASSERT_EQ(block.dp, std::vector<int32_t>({33, bcf_int32_missing}));
+    bander.Pop();
+
+    block = bander.Front();
+    ASSERT_EQ(block.start, 30);
+    ASSERT_EQ(block.end, 39);
+    bander.Pop();
+    ASSERT_FALSE(bander.HasBlock());
+}
+
+TEST(ReferenceBander, gapsEndBlocks)
+{
+    ReferenceBander bander(1, 100, 100);
+    DepthBlock a(0, 0, 100, 30, 0, 60, 2);
+    std::vector<DepthBlock *> blocks = {&a};
+    bander.Add(0, 0, 9, blocks);
+    bander.Add(0, 20, 29, blocks);
+    bander.Add(1, 30, 39, blocks);
+    bander.Close();
+    int num_blocks = 0;
+    while (bander.HasBlock())
+    {
+        bander.Pop();
+        num_blocks++;
+    }
+    ASSERT_EQ(num_blocks, 3);
+}
@@ -0,0 +1,53 @@
+#include "test_helpers.hh"
+
+#include "ReferenceBlockWriter.hh"
+#include "Normaliser.hh"
+
+//with bands of 0 every change of DP/GQ starts a new block, so the blocks cover exactly the homref blocks in the region
+TEST(ReferenceBlockWriter, blocksCoverHomrefBlocksInRegion)
+{
+    std::string test_base = g_testenv->getBasePath() + "/../test/test2/";
+    std::string ref = test_base + "test2.ref.fa", region = "chr1:50001-52000";
+    Normaliser normaliser(ref, false);
+    std::vector<GVCFReader> readers;
+    readers.emplace_back(test_base + "NA12878_S1.vcf.gz", &normaliser, 1000, region);
+    readers[0].ReadAll();
+    ASSERT_GT(readers[0].GetNumDepthBlocks(), (size_t) 0);
+    int expected = 0;
+    for (size_t i = 0; i < readers[0].GetNumDepthBlocks(); i++)
+    {
+        int start = std::max(readers[0].GetDepthBlockStart(i), 50000);
+        int end = std::min(readers[0].GetDepthBlockEnd(i), 51999);
+        expected += std::max(0, end - start + 1);
+    }
+
+    bcf_hdr_t *header = bcf_hdr_dup(readers[0].GetHeader());
+    ReferenceBlockWriter writer(ref, header, 1, region, 0, 0, 0);
+    writer.Band(readers, INT_MAX, INT_MAX);
+    writer.Close();
+
+    faidx_t *fai = fai_load(ref.c_str());
+    int observed = 0, last_end = -1;
+    bcf1_t *block;
+    while ((block = writer.NextRecord()) != nullptr)
+    {
+        bcf_unpack(block, BCF_UN_ALL);
+        ASSERT_GE(block->pos, 50000);
+        ASSERT_GT(block->pos, last_end);
+        last_end = block->pos + block->rlen - 1;
+        ASSERT_LE(last_end, 51999);
+        int32_t *end = nullptr, num_end = 0;
+        ASSERT_EQ(bcf_get_info_int32(header, block, "END", &end, &num_end), 1);
+        ASSERT_EQ(end[0], last_end + 1);
+        free(end);
+        int len = 0;
+        char *base = faidx_fetch_seq(fai, "chr1", block->pos, block->pos, &len);
+        ASSERT_EQ(toupper(base[0]), block->d.allele[0][0]);
+        free(base);
+        observed += block->rlen;
+    }
+    ASSERT_EQ(observed, expected);
+    ASSERT_GT(writer.GetNumWritten(), (size_t) 0);
+    fai_destroy(fai);
+    bcf_hdr_destroy(header);
+}
@@ -0,0 +1,194 @@
+#include "test_helpers.hh"
+
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+
+#include "RunStats.hh"
+#include "GVCFMerger.hh"
+
+//spins rather than sleeps, so that the time is the same on the steady clock and in ticks
+static void busy_wait(int ms)
+{
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+    while (std::chrono::steady_clock::now() < end)
+    {
+    }
+}
+
+TEST(RunStats, chargesTimeToTheCurrentStage)
+{
+    RunStats stats({}, 0);
+    StageClock::Attach(stats.NewClock());
+    ASSERT_EQ(StageClock::Enter(STAGE_READ), STAGE_NONE);
+    busy_wait(40);
+    ASSERT_EQ(StageClock::Enter(STAGE_ALT), STAGE_READ);
+    busy_wait(20);
+    StageClock::Enter(STAGE_NONE);
+    busy_wait(20);
+    StageClock::Attach(nullptr);
+    //threads without a clock count nothing
+    ASSERT_EQ(StageClock::Enter(STAGE_INFO), STAGE_NONE);
+
+    double read = stats.GetStageSeconds(STAGE_READ), alt = stats.GetStageSeconds(STAGE_ALT);
+    ASSERT_GT(read, 0.03);
+    ASSERT_LT(read, 0.2);
+    ASSERT_GT(alt, 0.015);
+    ASSERT_LT(alt, read);
+    ASSERT_EQ(stats.GetStageSeconds(STAGE_INFO), 0.);
+}
+
+TEST(RunStats, clocksOfOtherThreadsAreSummed)
+{
+    RunStats stats({}, 0);
+    StageClock *clocks[2] = {stats.NewClock(), stats.NewClock()};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 2; t++)
+    {
+        threads.emplace_back([&clocks, t]()
+                             {
+                                 StageClock::Attach(clocks[t]);
+                                 StageClock::Enter(STAGE_HOMREF);
+                                 busy_wait(20);
+                                 StageClock::Attach(nullptr);
+                             });
+    }
+    for (auto it = threads.begin(); it != threads.end(); it++)
+    {
+        it->join();
+    }
+    ASSERT_GT(stats.GetStageSeconds(STAGE_HOMREF), 0.035);
+    ASSERT_GT(clocks[0]->GetTicks(STAGE_HOMREF), (uint64_t) 0);
+    ASSERT_GT(clocks[1]->GetTicks(STAGE_HOMREF), (uint64_t) 0);
+}
+
+TEST(RunStats, readerCountsRecordsAndVariants)
+{
+    std::string test_base = g_testenv->getBasePath() + "/../test/test2/";
+    std::string fname = test_base + "NA12877_S1.vcf.gz";
+    Normaliser normaliser(test_base + "test2.ref.fa");
+    GVCFReader reader(fname, &normaliser, 1000);
+    size_t buffered = reader.GetNumVariants();
+
+    RunStats stats({fname}, 0);
+    StageClock::Attach(stats.NewClock());
+    StageClock::Enter(STAGE_SITES);
+    reader.SetStats(stats.GetReader(0));
+    reader.ReadAll();
+    //reading puts the clock back to the stage it was in
+    ASSERT_EQ(StageClock::Enter(STAGE_NONE), STAGE_SITES);
+    StageClock::Attach(nullptr);
+
+    reader_stats_t *counted = stats.GetReader(0);
+    ASSERT_GT(counted->num_records.load(), counted->num_variants.load());
+    //variants are counted as lines, which normalisation may split into several buffered variants
+    ASSERT_GT(counted->num_variants.load(), (uint64_t) 0);
+    ASSERT_LE(counted->num_variants.load(), reader.GetNumVariants() - buffered);
+    ASSERT_GT(counted->read_ticks.load(), (uint64_t) 0);
+    ASSERT_GT(counted->normalise_ticks.load(), (uint64_t) 0);
+    ASSERT_GT(stats.GetStageSeconds(STAGE_READ), 0.);
+    ASSERT_GT(stats.GetStageSeconds(STAGE_NORMALISE), 0.);
+}
+
+TEST(RunStats, memoryPeaks)
+{
+    MemoryStats memory;
+    int64_t published = 0;
+    memory.Add(MEM_HEADERS, 1000);
+    memory.Update(MEM_VARIANTS, published, 5000);
+    memory.Update(MEM_VARIANTS, published, 2000);
+    ASSERT_EQ(published, 2000);
+    ASSERT_EQ(memory.GetBytes(MEM_VARIANTS), 2000);
+    ASSERT_EQ(memory.GetPeak(MEM_VARIANTS), 5000);
+    ASSERT_EQ(memory.GetBytes(MEM_TOTAL), 3000);
+    ASSERT_EQ(memory.GetPeak(MEM_TOTAL), 6000);
+    memory.Add(MEM_HEADERS, -1000);
+    ASSERT_EQ(memory.GetBytes(MEM_HEADERS), 0);
+    ASSERT_EQ(memory.GetPeak(MEM_HEADERS), 1000);
+    ASSERT_NE(memory.Summary().find("variants 0.0MB (peak 0.0MB)"), std::string::npos);
+}
+
+TEST(RunStats, readerAccountsItsMemory)
+{
+    std::string test_base = g_testenv->getBasePath() + "/../test/test2/";
+    Normaliser normaliser(test_base + "test2.ref.fa");
+    GVCFReader reader(test_base + "NA12877_S1.vcf.gz", &normaliser, 1000);
+    MemoryStats memory;
+    reader.SetMemoryStats(&memory);
+    ASSERT_GT(memory.GetBytes(MEM_HEADERS), 0);
+    ASSERT_GT(memory.GetBytes(MEM_VARIANTS), 0);
+    int64_t headers = memory.GetBytes(MEM_HEADERS);
+
+    reader.ReadAll();
+    reader.FlushBuffer();
+    ASSERT_GT(memory.GetPeak(MEM_VARIANTS), memory.GetBytes(MEM_VARIANTS));
+    ASSERT_GT(memory.GetPeak(MEM_BLOCKS), 0);
+    ASSERT_EQ(memory.GetBytes(MEM_VARIANTS), 0);
+    ASSERT_EQ(memory.GetBytes(MEM_HEADERS), headers);
+    //the index is counted once regions need it
+    reader.SetRegions({{"chr1", 0, 100000}});
+    ASSERT_GT(memory.GetBytes(MEM_INDEXES), 0);
+
+    //and everything is taken out again
+    reader.SetMemoryStats(nullptr);
+    ASSERT_EQ(memory.GetBytes(MEM_TOTAL), 0);
+}
+
+//the integer after "key": in json, -1 if there is none
+static long long json_value(const std::string &json, const std::string &key)
+{
+    size_t pos = json.find("\"" + key + "\": ");
+    return (pos == std::string::npos ? -1 : std::stoll(json.substr(pos + key.size() + 4)));
+}
+
+TEST(RunStats, jsonReport)
+{
+    std::string test_base = g_testenv->getBasePath() + "/../test/test2/";
+    std::vector<std::string> files = {test_base + "NA12877_S1.vcf.gz", test_base + "NA12878_S1.vcf.gz",
+                                      test_base + "NA12882_S1.vcf.gz"};
+    char output[] = "/tmp/tmpvcf-XXXXXX";
+    char json_file[] = "/tmp/tmpjson-XXXXXX";
+    close(mkstemp(output));
+    close(mkstemp(json_file));
+    size_t num_all_sites = 0;
+    for (int max_alleles : {50, 2})
+    {
+        GVCFMerger g(files, output, "v", test_base + "test2.ref.fa", 1000);
+        g.SetMaxAlleles(max_alleles);
+        g.SetStatsJson(json_file);
+        g.write_vcf();
+
+        std::ifstream in(json_file);
+        std::string json((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::ifstream vcf(output);
+        long long num_sites = 0;
+        std::string line;
+        while (std::getline(vcf, line))
+        {
+            num_sites += line[0] != '#';
+        }
+        ASSERT_EQ(json_value(json, "sites_written"), num_sites);
+        ASSERT_GT(json_value(json, "records_read"), json_value(json, "variants_read"));
+        ASSERT_GT(json_value(json, "peak_rss_kb"), 0);
+        ASSERT_GE(json_value(json, "duplicate_records"), 0);
+        ASSERT_EQ(json_value(json, "invalid_records"), 0);
+        ASSERT_GT(json_value(json, "peak_buffered_variants"), 0);
+        ASSERT_NE(json.find("\"memory_peak_bytes\": {\"variants\": "), std::string::npos);
+        ASSERT_GT(json_value(json, "headers"), 0);
+        ASSERT_NE(json.find("\"final\": true"), std::string::npos);
+        ASSERT_NE(json.find("\"file\": \"" + files[2] + "\""), std::string::npos);
+        if (max_alleles == 50)
+        {
+            ASSERT_EQ(json_value(json, "sites_dropped_max_alleles"), 0);
+            num_all_sites = num_sites;
+        }
+        else
+        {
+            //every site that is not written was dropped
+            ASSERT_GT(json_value(json, "sites_dropped_max_alleles"), 0);
+            ASSERT_EQ(num_sites + json_value(json, "sites_dropped_max_alleles"), (long long) num_all_sites);
+        }
+    }
+    remove(output);
+    remove(json_file);
+}
@@ -0,0 +1,87 @@
+#include "test_helpers.hh"
+
+#include "GVCFMerger.hh"
+#include "ShardConcatenator.hh"
+#include "VcfReader.hh"
+
+static std::vector<std::pair<int, int> > read_positions(const std::string &fname, const std::string &region = "")
+{
+    VcfReader reader(fname);
+    if (!region.empty())
+    {
+        reader.SetRegions(region);
+    }
+    std::vector<std::pair<int, int> > ret;
+    bcf1_t *record = bcf_init1();
+    while (reader.Next(record))
+    {
+        ret.emplace_back(record->rid, record->pos);
+    }
+    bcf_destroy(record);
+    return (ret);
+}
+
+TEST(ShardConcatenator, overlappingShards)
+{
+    std::string test_base = g_testenv->getBasePath() + "/../test/test2/";
+    std::vector<std::string> files = {test_base + "NA12877_S1.vcf.gz", test_base + "NA12878_S1.vcf.gz",
+                                      test_base + "NA12882_S1.vcf.gz"};
+    std::string ref_file_name = test_base + "test2.ref.fa";
+    char tn[] = "/tmp/tmpvcf-XXXXXX";
+    close(mkstemp(tn));
+
+    for (auto &mode : {"b", "z"})
+    {
+        std::string suffix = (std::string) mode == "b" ? ".bcf" : ".vcf.gz";
+        std::vector<std::string> shards = {(std::string) tn + ".1" + suffix, (std::string) tn + ".2" + suffix};
+        std::string output = (std::string) tn + suffix;
+        //the regions overlap, so the records in chr1:59000-60000 are in both shards
+        {
+            GVCFMerger g(files, shards[0], mode, ref_file_name, 1000, "chr1:1-60000");
+            g.write_vcf();
+        }
+        {
+            GVCFMerger g(files, shards[1], mode, ref_file_name, 1000, "chr1:59000-200000");
+            g.write_vcf();
+        }
+        auto expected = read_positions(shards[0]);
+        int last_pos = expected.back().second;
+        size_t num_duplicates = 0;
+        for (auto &p : read_positions(shards[1]))
+        {
+            if (p.second > last_pos || expected.back().second > last_pos)
+            {
+                expected.push_back(p);
+            }
+            else
+            {
+                num_duplicates++;
+            }
+        }
+        ASSERT_GT(num_duplicates, (size_t) 0);
+
+        ShardConcatenator concat(shards, output);
+        concat.Concat();
+        ASSERT_EQ(concat.GetNumRecords(), expected.size());
+        ASSERT_EQ(concat.GetNumDuplicates(), num_duplicates);
+        ASSERT_EQ(read_positions(output), expected);
+
+        //the index written alongside the output covers records from both shards
+        std::vector<std::pair<int, int> > in_region;
+        for (auto &p : expected)
+        {
+            if (p.second >= 55000 && p.second < 65000)
+            {
+                in_region.push_back(p);
+            }
+        }
+        ASSERT_EQ(read_positions(output, "chr1:55001-65000"), in_region);
+
+        for (auto &fname : {shards[0], shards[1], output})
+        {
+            remove(fname.c_str());
+        }
+        remove((output + ".csi").c_str());
+    }
+    remove(tn);
+}
@@ -0,0 +1,105 @@
+#include "test_helpers.hh"
+
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+
+#include "Trace.hh"
+#include "RunStats.hh"
+
+static std::string read_file(const std::string &fname)
+{
+    std::ifstream in(fname);
+    return (std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>()));
+}
+
+static size_t count(const std::string &s, const std::string &what)
+{
+    size_t n = 0;
+    for (size_t pos = s.find(what); pos != std::string::npos; pos = s.find(what, pos + 1))
+    {
+        n++;
+    }
+    return (n);
+}
+
+//spins rather than sleeps, so that the time is the same on the steady clock and in ticks
+static void busy_wait(int ms)
+{
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+    while (std::chrono::steady_clock::now() < end)
+    {
+    }
+}
+
+TEST(Tracer, writesSpansOfEveryThread)
+{
+    char trace_file[] = "/tmp/tmptrace-XXXXXX";
+    close(mkstemp(trace_file));
+    //nothing is buffered without an open trace
+    {
+        TraceScope before("before");
+    }
+    Tracer::Open(trace_file);
+    ASSERT_TRUE(Tracer::IsOpen());
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 3; t++)
+    {
+        threads.emplace_back([t]()
+                             {
+                                 //two threads share a track by name
+                                 Tracer::NameThread(t < 2 ? "worker" : "\"other\"");
+                                 TraceScope scope("work", "chr1:1-100");
+                                 busy_wait(2);
+                                 //too short to be written
+                                 uint64_t now = stats_ticks();
+                                 Tracer::Span("tiny", "stage", now, now);
+                             });
+        threads.back().join();
+    }
+    {
+        TraceScope scope("main");
+        busy_wait(2);
+    }
+    Tracer::Close();
+    ASSERT_FALSE(Tracer::IsOpen());
+
+    std::string trace = read_file(trace_file);
+    ASSERT_EQ(trace.find("{\"displayTimeUnit\": \"ms\", \"traceEvents\": ["), (size_t) 0);
+    ASSERT_EQ(trace.substr(trace.size() - 4), "\n]}\n");
+    ASSERT_EQ(count(trace, "\"ph\": \"X\""), (size_t) 4);
+    ASSERT_EQ(count(trace, "\"name\": \"work\", "), (size_t) 3);
+    ASSERT_EQ(count(trace, "\"detail\": \"chr1:1-100\""), (size_t) 3);
+    ASSERT_EQ(count(trace, "\"name\": \"main\""), (size_t) 1);
+    ASSERT_EQ(count(trace, "\"name\": \"before\""), (size_t) 0);
+    ASSERT_EQ(count(trace, "\"name\": \"tiny\""), (size_t) 0);
+    ASSERT_EQ(count(trace, "\"name\": \"thread_name\""), (size_t) 2);
+    ASSERT_EQ(count(trace, "\"args\": {\"name\": \"\\\"other\\\"\"}"), (size_t) 1);
+    //events are separated by commas, with none after the last
+    ASSERT_EQ(count(trace, "},\n"), (size_t) 5);
+    remove(trace_file);
+}
+
+#ifdef GG_TRACE
+TEST(Tracer, stageClockSwitchesAreSpans)
+{
+    char trace_file[] = "/tmp/tmptrace-XXXXXX";
+    close(mkstemp(trace_file));
+    Tracer::Open(trace_file);
+    StageClock clock;
+    clock.Switch(STAGE_ALT);
+    busy_wait(2);
+    clock.Switch(STAGE_INFO);
+    busy_wait(2);
+    clock.Switch(STAGE_NONE);
+    busy_wait(2);
+    clock.Switch(STAGE_NONE);
+    Tracer::Close();
+
+    std::string trace = read_file(trace_file);
+    ASSERT_EQ(count(trace, "\"cat\": \"stage\""), (size_t) 2);
+    ASSERT_EQ(count(trace, "\"name\": \"alt\""), (size_t) 1);
+    ASSERT_EQ(count(trace, "\"name\": \"info\""), (size_t) 1);
+    remove(trace_file);
+}
+#endif
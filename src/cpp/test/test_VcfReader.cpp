@@ -0,0 +1,144 @@
+#include "test_helpers.hh"
+
+#include "VcfReader.hh"
+
+static std::string vcf_test_file()
+{
+    return (g_testenv->getBasePath() + "/../test/test2/NA12877_S1.vcf.gz");
+}
+
+static std::vector<std::pair<int, int> > read_positions(VcfReader &reader)
+{
+    std::vector<std::pair<int, int> > ret;
+    bcf1_t *record = bcf_init1();
+    while (reader.Next(record))
+    {
+        ret.emplace_back(record->rid, record->pos);
+    }
+    bcf_destroy(record);
+    return (ret);
+}
+
+TEST(VcfReader, streamMatchesSyncedReader)
+{
+    VcfReader reader(vcf_test_file());
+    auto observed = read_positions(reader);
+
+    bcf_srs_t *sr = bcf_sr_init();
+    ASSERT_EQ(bcf_sr_add_reader(sr, vcf_test_file().c_str()), 1);
+    std::vector<std::pair<int, int> > expected;
+    while (bcf_sr_next_line(sr))
+    {
+        bcf1_t *record = bcf_sr_get_line(sr, 0);
+        expected.emplace_back(record->rid, record->pos);
+    }
+    bcf_sr_destroy(sr);
+
+    ASSERT_EQ(observed.size(), (size_t) 753);
+    ASSERT_EQ(observed, expected);
+    ASSERT_TRUE(reader.IsEof());
+}
+
+TEST(VcfReader, adjacentRegionsAreDeduplicated)
+{
+    VcfReader single(vcf_test_file());
+    ASSERT_EQ(single.SetRegions("chr1:90000-95000"), 1);
+    auto expected = read_positions(single);
+    ASSERT_GT(expected.size(), (size_t) 0);
+
+    //the second and third regions are out of order and overlap, reference blocks span all three
+    VcfReader multi(vcf_test_file());
+    ASSERT_EQ(multi.SetRegions("chr1:92001-95000,chr1:90000-91000,chr1:90500-92000,chrNotThere:1-10"), 2);
+    auto observed = read_positions(multi);
+    ASSERT_EQ(observed, expected);
+}
+
+TEST(VcfReader, bcfRegions)
+{
+    //write a BCF copy of the test file and index it
+    char tn[] = "/tmp/tmpbcf-XXXXXX";
+    int fd = mkstemp(tn);
+    ASSERT_GT(fd, 0);
+    close(fd);
+    {
+        VcfReader reader(vcf_test_file());
+        htsFile *out = hts_open(tn, "wb");
+        ASSERT_EQ(bcf_hdr_write(out, reader.GetHeader()), 0);
+        bcf1_t *record = bcf_init1();
+        while (reader.Next(record))
+        {
+            ASSERT_EQ(bcf_write1(out, reader.GetHeader(), record), 0);
+        }
+        bcf_destroy(record);
+        hts_close(out);
+    }
+    ASSERT_EQ(bcf_index_build(tn, 14), 0);
+
+    VcfReader vcf(vcf_test_file());
+    int rid = bcf_hdr_name2id(vcf.GetHeader(), "chr1");
+    ASSERT_TRUE(vcf.Seek(rid, 50000, 60000));
+    VcfReader bcf(tn);
+    ASSERT_TRUE(bcf.Seek(rid, 50000, 60000));
+    auto expected = read_positions(vcf);
+    ASSERT_GT(expected.size(), (size_t) 0);
+    ASSERT_EQ(read_positions(bcf), expected);
+
+    remove(tn);
+    remove((std::string(tn) + ".csi").c_str());
+}
+
+TEST(VcfReader, nextVariantSkipsReferenceBlocks)
+{
+    VcfReader all(vcf_test_file());
+    std::vector<std::pair<int, int> > expected;
+    bcf1_t *record = bcf_init1();
+    while (all.Next(record))
+    {
+        if (record->n_allele > 1)
+        {
+            expected.emplace_back(record->rid, record->pos);
+        }
+    }
+
+    VcfReader variants(vcf_test_file());
+    std::vector<std::pair<int, int> > observed;
+    while (variants.NextVariant(record))
+    {
+        ASSERT_GT(record->n_allele, 1);
+        observed.emplace_back(record->rid, record->pos);
+    }
+    bcf_destroy(record);
+    ASSERT_GT(observed.size(), (size_t) 0);
+    ASSERT_EQ(observed, expected);
+    ASSERT_EQ(variants.GetNumRecordsRead() + variants.GetNumRecordsSkipped(), all.GetNumRecordsRead());
+}
+
+TEST(VcfReader, manySmallRegions)
+{
+    std::vector<ggutils::region_t> regions;
+    for (int start = 0; start < 130000; start += 700)
+    {
+        regions.push_back({"chr1", start, start + 349});
+    }
+    VcfReader all(vcf_test_file());
+    std::vector<std::pair<int, int> > expected;
+    bcf1_t *record = bcf_init1();
+    while (all.Next(record))
+    {
+        for (auto it = regions.begin(); it != regions.end(); it++)
+        {
+            if (record->pos <= it->end && record->pos + record->rlen - 1 >= it->start)
+            {
+                expected.emplace_back(record->rid, record->pos);
+                break;
+            }
+        }
+    }
+    bcf_destroy(record);
+
+    VcfReader reader(vcf_test_file());
+    ASSERT_EQ(reader.SetRegions(regions), (int) regions.size());
+    ASSERT_EQ(read_positions(reader), expected);
+    //most regions carry on from the previous one instead of seeking back to their first index chunk
+    ASSERT_GT(reader.GetNumSeeksSaved(), regions.size() / 2);
+}
@@ -441,3 +441,28 @@ TEST(UtilTest,filter2string)
     ASSERT_STREQ(ft2.s,"SiteConflict;LowGQX;HighDPFRatio");
     free(ft.s);
 }
+
+TEST(UtilTest,readRegionsFileBgzipped)
+{
+    char fname[] = "/tmp/gg_regionsXXXXXX";
+    close(mkstemp(fname));
+    string bed = string(fname) + ".bed.gz";
+    BGZF *fp = bgzf_open(bed.c_str(), "w");
+    string text = "track name=test\nchr1\t99\t200\nchr2\t0\t20\n";
+    ASSERT_EQ(bgzf_write(fp, text.c_str(), text.size()), (ssize_t) text.size());
+    ASSERT_EQ(bgzf_close(fp), 0);
+    vector<ggutils::region_t> regions;
+    ASSERT_EQ(ggutils::read_regions_file(bed, regions), 2);
+    ASSERT_EQ(ggutils::region2string(regions[0]), "chr1:100-200");
+    ASSERT_EQ(ggutils::region2string(regions[1]), "chr2:1-20");
+    remove(bed.c_str());
+    remove(fname);
+}
+
+TEST(UtilTest,parseRegionsOpenEnded)
+{
+    vector<ggutils::region_t> regions;
+    ASSERT_EQ(ggutils::parse_regions("chr1:100-,chr2:1-20", regions), 2);
+    ASSERT_EQ(ggutils::region2string(regions[0]), "chr1:100-");
+    ASSERT_EQ(regions[1].end, 19);
+}